@@ -31,51 +31,38 @@ B_Map* B_Map_createFromFile(char* grid_path) {
   assert(grid_path);
   MAP_DEBUG{printf("starting to create B_Map from file\n"); fflush(stdout);}
 
-  FILE* gridFile = fopen(grid_path, "r+");
+  //the shared loader maps the file and parses it on all the cores at once
+  GridFile* gridFile = gio_open(grid_path);
   assert(gridFile);
 
-  float header[6];
-  B_Map_readHeader(gridFile, header);
-
-  MAP_DEBUG{printf("header is %f, %f, %f, %f, %f, %f\n", header[0], header[1], header[2], header[3], header[4], header[5]); fflush(stdout);}
+  MAP_DEBUG{printf("header is %llu, %llu, %f\n", (unsigned long long) gridFile->hd.ncol, (unsigned long long) gridFile->hd.nrow, gridFile->hd.nodata); fflush(stdout);}
 
   //we have all we need to make a map, so lets make it
-  B_Map* newB_Map = B_Map_new(header[0], header[1], header[5]);
+  B_Map* newB_Map = B_Map_new(gridFile->hd.ncol, gridFile->hd.nrow, (elev_type) gridFile->hd.nodata);
+
+  //read all the values straight into elev_data - they are cast to elev_type the same way a float would be
+  int result = gio_read(gridFile, GIO_SHRT, newB_Map->elev_data, 0);
+  assert(result == 0);
+  gio_close(gridFile);
 
-  //start reading in values.  
-  unsigned short c, r;
-  //We'll use the float temp, and cast it to elev_type for storage
-  float temp;
+  //now find the max and min elev over the valid points
+  unsigned int i, n = B_Map_getNCols(*newB_Map) * B_Map_getNRows(*newB_Map);
   elev_type value;
   //we need to set the max and min elev values the first time through, so this will make sure that is done
-  int firstTime;
-  firstTime = 1;
-
-  //start reading
-  for(r = 0; r < B_Map_getNRows(*newB_Map); r++) {
-    for(c = 0; c < B_Map_getNCols(*newB_Map); c++) {
-      //read in the value
-      fscanf(gridFile, "%f", &temp);
-      value = (elev_type) temp;
-      //store the value
-      B_Map_setValue(newB_Map, c, r, value);
-      //check if min or max elev need no be updated, and do so accordingly if its a valid point
-      if(value != B_Map_getNoDataValue(*newB_Map)) {
-	if(value < B_Map_getMinElev(*newB_Map) || firstTime) {
-	  B_Map_setMinElev(newB_Map, value);
-	}
-	if(value > B_Map_getMaxElev(*newB_Map) || firstTime) {
-	  B_Map_setMaxElev(newB_Map, value);
-	}
-	if(firstTime) {
-	  firstTime = 0;
-	}
+  int firstTime = 1;
+  for(i = 0; i < n; i++) {
+    value = newB_Map->elev_data[i];
+    if(value != B_Map_getNoDataValue(*newB_Map)) {
+      if(value < B_Map_getMinElev(*newB_Map) || firstTime) {
+	B_Map_setMinElev(newB_Map, value);
       }
+      if(value > B_Map_getMaxElev(*newB_Map) || firstTime) {
+	B_Map_setMaxElev(newB_Map, value);
+      }
+      firstTime = 0;
     }
   }
 
-  fclose(gridFile);
-
   return(newB_Map);
 }
 
@@ -8,6 +8,7 @@
 #include <math.h>
 
 #include "Elev_type.h"
+#include "gridio.h"
 
 //short for basic map - just has your basic map structure
 typedef struct b_map_t {
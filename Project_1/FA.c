@@ -1,29 +1,51 @@
 #include "FA.h"
+#include "FA_Grid.h"
+
+#include <string.h>
 
 //Main function
+//args are elev, flowdir, output, and optionally "sort" to use the old sort based engine
 int main(int argc, char** argv, char** envp) {
 
-  if(argc != 3) {
+  if(argc != 3 && argc != 4) {
     exit(0);
   }
 
+  //the flat grid engine is the default; the sort engine is kept around to compare against
+  int use_sort = (argc == 4 && strcmp(argv[3], "sort") == 0);
+
   //rtimer stuff
   Rtimer timer;
 
   //start the timer
   rt_start(timer);
 
-  //make the FA map
-  FA_Map* map = FA_Map_createFromFile(argv[0], argv[1]);
+  if(use_sort) {
+    //make the FA map
+    FA_Map* map = FA_Map_createFromFile(argv[0], argv[1]);
+
+    //fill up the FA map
+    FA_fill(map);
+
+    //output the FA Map
+    FA_Map_writeMap(*map, argv[0], argv[2]);
 
-  //fill up the FA map
-  FA_fill(map);
+    //free up the map
+    FA_Map_kill(map);
+  }
+  else {
+    //make the FA grid
+    FA_Grid* grid = FA_Grid_createFromFile(argv[0], argv[1]);
 
-  //output the FA Map
-  FA_Map_writeMap(*map, argv[0], argv[2]);
+    //fill it in topological order
+    FA_Grid_fill(grid);
 
-  //free up the map
-  FA_Map_kill(map);
+    //output the FA grid
+    FA_Grid_writeMap(*grid, argv[0], argv[2]);
+
+    //free up the grid
+    FA_Grid_kill(grid);
+  }
 
   //stop the timer
   rt_stop(timer);
@@ -31,7 +53,7 @@ int main(int argc, char** argv, char** envp) {
   //print the read timer
   char buf[1000];
   rt_sprint(buf, timer);
-  printf("time for flow accumulation algorithm: %s\n", buf);
+  printf("time for flow accumulation algorithm (%s): %s\n", use_sort ? "sort" : "topological", buf);
 
   //exit
   exit(0);
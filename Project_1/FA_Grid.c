@@ -0,0 +1,256 @@
+#include "FA_Grid.h"
+
+#define FA_GRID_DEBUG if(0)
+
+//column and row offsets for each direction, using the standard set in the FD files
+//1  2  3
+//8  0  4
+//7  6  5
+static const int dir_dc[9] = {0, -1, 0, 1, 1, 1, 0, -1, -1};
+static const int dir_dr[9] = {0, -1, -1, -1, 0, 1, 1, 1, 0};
+
+//Construct and Distroy ------------------------------------------------
+//create and return a new FA_Grid, with its arrays allocated but not filled
+FA_Grid* FA_Grid_new(unsigned short num_c, unsigned short num_r, elev_type no_data_value) {
+
+  //create the new FA_Grid
+  FA_Grid* new_FA_Grid = (FA_Grid*) malloc(sizeof(FA_Grid));
+  assert(new_FA_Grid);
+
+  //store the passed values
+  new_FA_Grid->ncols = num_c;
+  new_FA_Grid->nrows = num_r;
+  new_FA_Grid->NODATA = no_data_value;
+
+  //allocate the two flat arrays
+  new_FA_Grid->fd_data = (unsigned char*) malloc(sizeof(unsigned char) * num_c * num_r);
+  assert(new_FA_Grid->fd_data);
+  new_FA_Grid->fa_data = (unsigned int*) malloc(sizeof(unsigned int) * num_c * num_r);
+  assert(new_FA_Grid->fa_data);
+
+  return new_FA_Grid;
+}
+
+//create an FA_Grid from the elevation and flow direction files
+FA_Grid* FA_Grid_createFromFile(char* grid_path, char* fd_path) {
+  assert(grid_path);
+  assert(fd_path);
+
+  //the elevation is only needed to find the NODATA points, so it is not kept
+  B_Map* b_map = B_Map_createFromFile(grid_path);
+
+  //we have the data to make the grid, so make it
+  FA_Grid* newFA_Grid = FA_Grid_new(B_Map_getNCols(*b_map), B_Map_getNRows(*b_map), B_Map_getNoDataValue(*b_map));
+  unsigned int i, n = newFA_Grid->ncols * newFA_Grid->nrows;
+
+  //a packed FD file has its directions read all at once, and already marks the NODATA points
+  if(FD_Pack_isPacked(fd_path)) {
+    unsigned short fd_ncols, fd_nrows;
+    unsigned char* dirs = FD_Pack_read(fd_path, &fd_ncols, &fd_nrows);
+    assert(fd_ncols == newFA_Grid->ncols && fd_nrows == newFA_Grid->nrows);
+
+    for(i = 0; i < n; i++) {
+      FA_Grid_setDir(newFA_Grid, i % newFA_Grid->ncols, i / newFA_Grid->ncols, b_map->elev_data[i], dirs[i]);
+    }
+
+    free(dirs);
+    B_Map_kill(b_map);
+    return newFA_Grid;
+  }
+
+  //otherwise parse the ascii directions with the shared loader too
+  GridFile* fdFile = gio_open(fd_path);
+  assert(fdFile);
+  assert(fdFile->hd.ncol == newFA_Grid->ncols && fdFile->hd.nrow == newFA_Grid->nrows);
+  short* fd_data = (short*) malloc(sizeof(short) * n);
+  assert(fd_data);
+  int result = gio_read(fdFile, GIO_SHRT, fd_data, 0);
+  assert(result == 0);
+  gio_close(fdFile);
+
+  for(i = 0; i < n; i++) {
+    FA_Grid_setDir(newFA_Grid, i % newFA_Grid->ncols, i / newFA_Grid->ncols, b_map->elev_data[i], fd_data[i]);
+  }
+
+  free(fd_data);
+  B_Map_kill(b_map);
+  return newFA_Grid;
+}
+
+//create an FA_Grid straight from a map and its flow directions
+FA_Grid* FA_Grid_createFromData(B_Map* b_map, short* fd_data) {
+  assert(b_map);
+  assert(fd_data);
+
+  FA_Grid* newFA_Grid = FA_Grid_new(B_Map_getNCols(*b_map), B_Map_getNRows(*b_map), B_Map_getNoDataValue(*b_map));
+
+  unsigned short c, r;
+  for(r = 0; r < newFA_Grid->nrows; r++) {
+    for(c = 0; c < newFA_Grid->ncols; c++) {
+      FA_Grid_setDir(newFA_Grid, c, r, B_Map_getValue(*b_map, c, r), fd_data[c + r*newFA_Grid->ncols]);
+    }
+  }
+
+  return newFA_Grid;
+}
+
+//points FA_Grid_writeMap formats at a time
+#define FA_GRID_WRITE_BATCH (1 << 22)
+
+//write the FA grid to file.  in_path is passed so we can copy the header from it
+void FA_Grid_writeMap(FA_Grid grid, char* in_path, char* out_path) {
+
+  //first open the files
+  FILE* inFile = fopen(in_path, "r");
+  assert(inFile);
+
+  FILE* outFile = fopen(out_path, "w");
+  assert(outFile);
+
+  //write the header (the first 6 lines) from inFile to outFile
+  int i;
+  char headerLine[40];
+  for(i = 0; i < 6; i++) {
+    fputs(fgets(headerLine, 40, inFile), outFile);
+  }
+
+  //all done with the input file, so close it
+  fclose(inFile);
+
+  //now, go through and write all the recorded values, NODATA where there is no direction.
+  //a batch of rows at a time is copied into an int buffer (the counts fit an int on any
+  //grid under 2^31 points) and formatted in parallel by gio_write_rows
+  unsigned int batch = FA_GRID_WRITE_BATCH / grid.ncols;
+  if(batch < 1) batch = 1;
+  int* buf = (int*) malloc(sizeof(int) * batch * grid.ncols);
+  assert(buf);
+  unsigned int index = 0;
+  unsigned int r, k, n;
+  for(r = 0; r < grid.nrows; r += k) {
+    for(k = 0, n = 0; k < batch && r + k < grid.nrows; k++) {
+      for(i = 0; i < grid.ncols; i++, index++, n++) {
+	buf[n] = grid.fd_data[index] == FA_GRID_NODIR ? grid.NODATA : (int) grid.fa_data[index];
+      }
+    }
+    int result = gio_write_rows(outFile, GIO_INT, buf, k, grid.ncols, 0, 0);
+    assert(result == 0);
+  }
+  free(buf);
+
+  fclose(outFile);
+}
+
+//free the FA_Grid
+void FA_Grid_kill(FA_Grid* grid) {
+  assert(grid);
+
+  free(grid->fd_data);
+  free(grid->fa_data);
+  free(grid);
+}
+
+//GETTERS --------------------------------------------------
+unsigned short FA_Grid_getNRows(FA_Grid grid) {
+  return grid.nrows;
+}
+unsigned short FA_Grid_getNCols(FA_Grid grid) {
+  return grid.ncols;
+}
+elev_type FA_Grid_getNoDataValue(FA_Grid grid) {
+  return grid.NODATA;
+}
+//get the fa value stored at c,r
+unsigned int FA_Grid_getFAValue(FA_Grid grid, unsigned short c, unsigned short r) {
+  return grid.fa_data[c + r*grid.ncols];
+}
+
+//SETTERS ----------------------------------------------------------
+//store the flow direction at c,r; NODATA points get FA_GRID_NODIR
+void FA_Grid_setDir(FA_Grid* grid, unsigned short c, unsigned short r, elev_type elev, int fd) {
+  assert(grid);
+
+  if(elev == grid->NODATA || fd < 0 || fd > 8) {
+    grid->fd_data[c + r*grid->ncols] = FA_GRID_NODIR;
+  }
+  else {
+    grid->fd_data[c + r*grid->ncols] = (unsigned char) fd;
+  }
+}
+
+//HELPERS ----------------------------------------------------------
+//return the index of the point that index i flows to, or -1 if it flows off the grid, into NODATA, or nowhere
+long FA_Grid_downstream(FA_Grid grid, unsigned int i) {
+  unsigned char dir = grid.fd_data[i];
+  if(dir == 0 || dir == FA_GRID_NODIR) {
+    return -1;
+  }
+
+  int c = i % grid.ncols + dir_dc[dir];
+  int r = i / grid.ncols + dir_dr[dir];
+  if(c < 0 || r < 0 || c >= grid.ncols || r >= grid.nrows) {
+    return -1;
+  }
+
+  long d = c + (long) r * grid.ncols;
+  if(grid.fd_data[d] == FA_GRID_NODIR) {
+    return -1;
+  }
+  return d;
+}
+
+//WORKHORSE ----------------------------------------------------------
+/*passes flow downstream in topological order.  Every point gets a count of
+  the neighbors that flow into it; points with a count of 0 are the tops of
+  the flow paths and go on the queue first.  When a point is taken off the
+  queue it already holds all the flow it will ever get, so it passes it on
+  and, if it was the last one its downstream neighbor was waiting for,
+  queues that neighbor.  Every point is queued exactly once, so this is O(n)
+  with no sorting.*/
+void FA_Grid_fill(FA_Grid* grid) {
+  assert(grid);
+
+  unsigned int n = grid->ncols * grid->nrows;
+  unsigned int i;
+  long d;
+
+  //number of upstream neighbors each point is still waiting for (at most 8)
+  unsigned char* indeg = (unsigned char*) calloc(n, sizeof(unsigned char));
+  assert(indeg);
+  //the queue holds every point once, so it never needs to wrap
+  unsigned int* queue = (unsigned int*) malloc(sizeof(unsigned int) * n);
+  assert(queue);
+  unsigned int head = 0, tail = 0;
+
+  //every point starts with 1 unit of flow, and counts its upstream neighbors
+  for(i = 0; i < n; i++) {
+    grid->fa_data[i] = 1;
+    d = FA_Grid_downstream(*grid, i);
+    if(d >= 0) {
+      indeg[d]++;
+    }
+  }
+
+  //queue up all the points that have nothing flowing into them
+  for(i = 0; i < n; i++) {
+    if(indeg[i] == 0 && grid->fd_data[i] != FA_GRID_NODIR) {
+      queue[tail++] = i;
+    }
+  }
+  FA_GRID_DEBUG{printf("%u of %u points start on the queue\n", tail, n); fflush(stdout);}
+
+  //pass the flow down
+  while(head < tail) {
+    i = queue[head++];
+    d = FA_Grid_downstream(*grid, i);
+    if(d < 0) {
+      continue;
+    }
+    grid->fa_data[d] += grid->fa_data[i];
+    if(--indeg[d] == 0) {
+      queue[tail++] = (unsigned int) d;
+    }
+  }
+
+  free(indeg);
+  free(queue);
+}
@@ -0,0 +1,65 @@
+#ifndef __FA_GRID_H
+#define __FA_GRID_H
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "Elev_type.h"
+#include "B_Map.h" //use the read_header method from B_Map
+#include "FD_Pack.h" //FD files may be packed
+
+//fd value stored for NODATA points, never a valid direction
+#define FA_GRID_NODIR 255
+
+/*flat flow accumulation grid - instead of one malloc'd FA_Point per cell,
+  the flow direction and accumulation are kept in two contiguous arrays
+  indexed by c + r*ncols.  fa values are 32 bit, since unsigned short
+  overflows on any real basin.*/
+typedef struct fa_grid_t {
+  unsigned short ncols;
+  unsigned short nrows;
+  elev_type NODATA;
+  unsigned char* fd_data; //direction codes 0-8 as written by flowdir, or FA_GRID_NODIR
+  unsigned int* fa_data;
+} FA_Grid;
+
+//Construct and Distroy ------------------------------------------------
+//create and return a new FA_Grid, with its arrays allocated but not filled
+FA_Grid* FA_Grid_new(unsigned short num_c, unsigned short num_r, elev_type no_data_value);
+
+//create an FA_Grid from the elevation and flow direction files
+FA_Grid* FA_Grid_createFromFile(char* grid_path, char* fd_path);
+
+//create an FA_Grid straight from a map and its flow directions, as FD_fill leaves them, without going through a file
+FA_Grid* FA_Grid_createFromData(B_Map* b_map, short* fd_data);
+
+//write the FA grid to file.  in_path is passed so we can copy the header from it
+void FA_Grid_writeMap(FA_Grid grid, char* in_path, char* out_path);
+
+//free the FA_Grid
+void FA_Grid_kill(FA_Grid* grid);
+
+//GETTERS --------------------------------------------------
+unsigned short FA_Grid_getNRows(FA_Grid grid);
+unsigned short FA_Grid_getNCols(FA_Grid grid);
+elev_type FA_Grid_getNoDataValue(FA_Grid grid);
+//get the fa value stored at c,r
+unsigned int FA_Grid_getFAValue(FA_Grid grid, unsigned short c, unsigned short r);
+
+//SETTERS ----------------------------------------------------------
+//store the flow direction at c,r; NODATA points get FA_GRID_NODIR
+void FA_Grid_setDir(FA_Grid* grid, unsigned short c, unsigned short r, elev_type elev, int fd);
+
+//HELPERS ----------------------------------------------------------
+//return the index of the point that index i flows to, or -1 if it flows off the grid, into NODATA, or nowhere
+long FA_Grid_downstream(FA_Grid grid, unsigned int i);
+
+//WORKHORSE ----------------------------------------------------------
+/*fills fa_data in O(n): counts, for every point, how many neighbors flow
+  into it, then pushes the points nobody flows into on a queue and passes
+  flow downstream, queueing a point once all of its upstream neighbors
+  have been processed.*/
+void FA_Grid_fill(FA_Grid* grid);
+
+#endif
@@ -1,48 +1,11 @@
 #include "FD.h"
 
-#define FD_DEBUG if(0)
-
-//Main function
-int main(int argc, char** argv, char** envp) {
-
-  if(argc != 2) {
-    exit(0);
-  }
-
-  //rtimer stuff
-  Rtimer timer;
-
-  //start the timer
-  rt_start(timer);
-
-  //make the FD map
-  FD_Map* map = FD_Map_createFromFile(argv[0]);
-  FD_DEBUG{printf("done making map\n"); fflush(stdout);}
-
-  //fill up the FD map
-  FD_fill(map);
-  FD_DEBUG{printf("done filling the map\n"); fflush(stdout);}
-
-  //output the map
-  FD_Map_writeMap(*map, argv[0], argv[1]);
-  FD_DEBUG{printf("done writing the map"); fflush(stdout);}
-
-  //free up the map
-  FD_Map_kill(map);
-
-  //stop the timer
-  rt_stop(timer);
-  //print the timer
-  //print the read timer
-  char buf[1000];
-  rt_sprint(buf, timer);
-  printf("time for flow direction algorithm: %s\n", buf);
-
-  //exit
-  FD_DEBUG{printf("freed everything - exiting\n"); fflush(stdout);}
-  exit(0);
-}
+#include <limits.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
+#define FD_DEBUG if(0)
 
 //Construct, Output and Distroy
 //create FD_Map from file
@@ -59,6 +22,9 @@ FD_Map* FD_Map_createFromFile(char* grid_path) {
   new_FD_Map->fd_data = (short*) malloc(sizeof(short) * B_Map_getNRows(*new_FD_Map->b_map) * B_Map_getNCols(*new_FD_Map->b_map));
   assert(new_FD_Map->fd_data);
 
+  //not filled until FD_Map_fillDepressions is called
+  new_FD_Map->pf_dir = NULL;
+
   return new_FD_Map;
 }
 
@@ -66,6 +32,14 @@ FD_Map* FD_Map_createFromFile(char* grid_path) {
 //write the FD map to file.  in_path is passed so that we can copy the header from it
 void FD_Map_writeMap(FD_Map map, char* in_path, char* out_path) {
 
+  //a .fdp out_path gets the packed format instead
+  if(FD_Pack_wantsPacked(out_path)) {
+    FD_DEBUG{printf("writing the FD map packed\n"); fflush(stdout);}
+    B_Map* b_map = FD_Map_getBMap(map);
+    FD_Pack_write(map.fd_data, B_Map_getNCols(*b_map), B_Map_getNRows(*b_map), B_Map_getNoDataValue(*b_map), in_path, out_path);
+    return;
+  }
+
   FD_DEBUG{printf("starting to write the FD map\n"); fflush(stdout);}
   //first open the files
   FILE* inFile = fopen(in_path, "r+");
@@ -87,16 +61,14 @@ void FD_Map_writeMap(FD_Map map, char* in_path, char* out_path) {
 
   FD_DEBUG{printf("wrote the header\n"); fflush(stdout);}
 
-  //now, go through and write all the recorded values
-  int c, r;
-  for(r = 0; r < B_Map_getNRows(*FD_Map_getBMap(map)); r++) {
-    for(c = 0; c < B_Map_getNCols(*FD_Map_getBMap(map)); c++) {
-      fprintf(outFile, "%hi ", FD_get_value(map, c, r));
-    }
-    fprintf(outFile, "\n");
-  }
+  //now write all the recorded values, formatted in parallel - fd_data is already in row order
+  int result = gio_write_rows(outFile, GIO_SHRT, map.fd_data, B_Map_getNRows(*FD_Map_getBMap(map)), B_Map_getNCols(*FD_Map_getBMap(map)), 0, 0);
+  assert(result == 0);
   FD_DEBUG{printf("done writing all the data\n"); fflush(stdout);}
 
+  fclose(inFile);
+  fclose(outFile);
+
 }
 
 //free up the FD_Map
@@ -108,6 +80,21 @@ void FD_Map_kill(FD_Map* map) {
 
   //free up the fd_data
   free(map->fd_data);
+
+  //free up the flood directions, if we filled
+  if(map->pf_dir) {
+    free(map->pf_dir);
+  }
+}
+
+//fill the depressions in the map's elevations, and keep the flood directions for FD_fill
+void FD_Map_fillDepressions(FD_Map* map) {
+  assert(map);
+
+  if(map->pf_dir) {
+    free(map->pf_dir);
+  }
+  map->pf_dir = PF_fill(FD_Map_getBMap(*map));
 }
 
 //GETTERS --------------------------------------------------
@@ -136,79 +123,158 @@ void FD_Map_setValue(FD_Map* map, unsigned short i, unsigned short j, unsigned s
 //WORKHORSE ----------------------------------------------------------
 //actually does the work for the FD algorithm - passed a FD grid, fills the FD grid
 
+//padding for NODATA and off-map neighbors.  It is higher than any real elevation, so it is never the lowest neighbor
+#define FD_PAD SHRT_MAX
+
+//mixes the bits of a point's index, so ties are broken the same way every run without any shared random state
+static inline unsigned int FD_hash(unsigned int i) {
+  i ^= i >> 16;
+  i *= 0x7feb352d;
+  i ^= i >> 15;
+  i *= 0x846ca68b;
+  i ^= i >> 16;
+  return i;
+}
+
+//given a mask with bit dir-1 set for each lowest direction, pick one - if there's a tie, the hash of index decides
+static inline short FD_pickDir(unsigned int mask, unsigned int index) {
+  int numPossibles = __builtin_popcount(mask);
+  int k = (numPossibles == 1) ? 0 : FD_hash(index) % numPossibles;
+
+  //skip the first k set bits
+  while(k-- > 0) {
+    mask &= mask - 1;
+  }
+  return __builtin_ctz(mask) + 1;
+}
+
+//copy row r of the map into padded, with one FD_PAD on either side and NODATA replaced by FD_PAD.  Rows off the map are all FD_PAD.
+static void FD_padRow(B_Map* b_map, int r, elev_type* padded) {
+  int c;
+  int ncols = B_Map_getNCols(*b_map);
+
+  if(r < 0 || r >= B_Map_getNRows(*b_map)) {
+    for(c = 0; c < ncols + 2; c++) {
+      padded[c] = FD_PAD;
+    }
+    return;
+  }
+
+  elev_type* row = b_map->elev_data + r*ncols;
+  elev_type NODATA = B_Map_getNoDataValue(*b_map);
+  padded[0] = FD_PAD;
+  for(c = 0; c < ncols; c++) {
+    padded[c+1] = (row[c] == NODATA) ? FD_PAD : row[c];
+  }
+  padded[ncols+1] = FD_PAD;
+}
+
 /*fills the fd array with the following values depending on which direction is the one of steepest decent.
 1  2  3
 8  0  4
 7  6  5
-It looks at all neighbors, and compares them to the previously found steepest past of decent.  If no steepest decent is found, 0 is assigned.  If multiple points have the same elevation, each possible direction is stored in the "possibles" array.  If more than one value is found, the stored value is chosen at random.*/
+Works one row at a time, on padded copies of the row and its neighbors, so that every point sees 8 neighbors and needs no edge checks.  For each point, a mask is built with a bit set for every neighbor that is the lowest and lower than the point.  With SSE2 this is done 8 points at a time: the 8 neighbors are the padded rows shifted by one either way, so a min over the 8 shifted vectors gives the lowest neighbors and a compare against that min gives the mask.
+If the mask is empty, 0 is assigned, unless the map was filled, in which case the point is on a flat and the flood direction from PF_fill is used.  If more than one direction is in the mask, one is chosen by a hash of the point's index, so the same map always gives the same directions.*/
 void FD_fill(FD_Map* map) {
   assert(map);
 
-  unsigned short possibles[8]; //stores all the possible steepest value;
-  unsigned short numPossibles = 0; //keeps track of how many possible values there are.
-  elev_type steepest; //the steepest evelation found so far.
-
-  //set up the random stuff
-  srand((unsigned int) time(NULL));
-
-  int indexToStore; //if we need to store one of several directions, this is going to store which direction to store
-
-  unsigned short c, r, i;
-  for(c = 0; c < B_Map_getNCols(*FD_Map_getBMap(*map)); c++) {
-    for(r = 0; r < B_Map_getNRows(*FD_Map_getBMap(*map)); r++) {
-      //write the NODATA value if it's nodata in the map
-      if(B_Map_getValue(*FD_Map_getBMap(*map), c, r) == B_Map_getNoDataValue(*FD_Map_getBMap(*map))) {
-	FD_Map_setValue(map, c, r, B_Map_getNoDataValue(*FD_Map_getBMap(*map)));
-	continue;
+  B_Map* b_map = FD_Map_getBMap(*map);
+  int ncols = B_Map_getNCols(*b_map);
+  int nrows = B_Map_getNRows(*b_map);
+  elev_type NODATA = B_Map_getNoDataValue(*b_map);
+
+  //three padded rows, rotated as we go down the map
+  elev_type* up = (elev_type*) malloc(sizeof(elev_type) * (ncols + 2));
+  elev_type* mid = (elev_type*) malloc(sizeof(elev_type) * (ncols + 2));
+  elev_type* dn = (elev_type*) malloc(sizeof(elev_type) * (ncols + 2));
+  assert(up && mid && dn);
+  elev_type* temp;
+
+  //lowest-neighbor mask of each point in the row
+  unsigned short* masks = (unsigned short*) malloc(sizeof(unsigned short) * ncols);
+  assert(masks);
+
+  FD_padRow(b_map, -1, mid);
+  FD_padRow(b_map, 0, dn);
+
+  int c, r, dir;
+  elev_type lowest, value;
+  for(r = 0; r < nrows; r++) {
+    //slide down a row
+    temp = up; up = mid; mid = dn; dn = temp;
+    FD_padRow(b_map, r+1, dn);
+
+    c = 0;
+#ifdef __SSE2__
+    for(; c + 8 <= ncols; c += 8) {
+      __m128i center = _mm_loadu_si128((__m128i*) (mid + c + 1));
+      __m128i n[8];
+      n[0] = _mm_loadu_si128((__m128i*) (up + c));     //1 - NW
+      n[1] = _mm_loadu_si128((__m128i*) (up + c + 1)); //2 - N
+      n[2] = _mm_loadu_si128((__m128i*) (up + c + 2)); //3 - NE
+      n[3] = _mm_loadu_si128((__m128i*) (mid + c + 2));//4 - E
+      n[4] = _mm_loadu_si128((__m128i*) (dn + c + 2)); //5 - SE
+      n[5] = _mm_loadu_si128((__m128i*) (dn + c + 1)); //6 - S
+      n[6] = _mm_loadu_si128((__m128i*) (dn + c));     //7 - SW
+      n[7] = _mm_loadu_si128((__m128i*) (mid + c));    //8 - W
+
+      __m128i low = n[0];
+      for(dir = 1; dir < 8; dir++) {
+	low = _mm_min_epi16(low, n[dir]);
       }
+      //only neighbors lower than the point count
+      __m128i isLower = _mm_cmplt_epi16(low, center);
 
-      //make sure we reset the number of possibilites and steepest elevation
-      numPossibles = 0;
-      steepest = B_Map_getMaxElev(*FD_Map_getBMap(*map));
-
-      //go through all the possible directions, and find the steepest decent
-      for(i = 1; i < 8; i++) {
-	//skip point if its a valid point
-	if(FD_elevInDir(*FD_Map_getBMap(*map), c, r, i) == 
-	   B_Map_getNoDataValue(*FD_Map_getBMap(*map))) {
-	  continue;
-	}
-
-	//consider the value if it is lower than 
-	if(FD_elevInDir(*FD_Map_getBMap(*map), c, r, i) < 
-	   B_Map_getValue(*FD_Map_getBMap(*map), c, r)) {
-	  //if it is lower than our current point, store it if it's lower than the lowest point so far
-	  
-	  if(FD_elevInDir(*FD_Map_getBMap(*map), c, r, i) < steepest) {
-	    steepest = FD_elevInDir(*FD_Map_getBMap(*map), c, r, i);
-	    possibles[0] = i;
-	    numPossibles = 1;
-	  }
-	  
-	  //if the value we're looking at equals the steepest value found so far, store it, and increment the number of possible steepest values
-	  else if(FD_elevInDir(*FD_Map_getBMap(*map), c, r, i) == steepest) {
-	    possibles[numPossibles] = i;
-	    numPossibles++;
-	  }
+      __m128i mask = _mm_setzero_si128();
+      for(dir = 0; dir < 8; dir++) {
+	mask = _mm_or_si128(mask, _mm_and_si128(_mm_cmpeq_epi16(n[dir], low), _mm_set1_epi16(1 << dir)));
+      }
+      mask = _mm_and_si128(mask, isLower);
+      _mm_storeu_si128((__m128i*) (masks + c), mask);
+    }
+#endif
+    //whatever is left of the row (all of it without SSE2)
+    for(; c < ncols; c++) {
+      elev_type n[8] = {up[c], up[c+1], up[c+2], mid[c+2], dn[c+2], dn[c+1], dn[c], mid[c]};
+      lowest = n[0];
+      for(dir = 1; dir < 8; dir++) {
+	lowest = (n[dir] < lowest) ? n[dir] : lowest;
+      }
+      masks[c] = 0;
+      if(lowest < mid[c+1]) {
+	for(dir = 0; dir < 8; dir++) {
+	  masks[c] |= (n[dir] == lowest) << dir;
 	}
       }
+    }
 
-      //now that all possible directions have been considered, store values depending on how many possible answers there are
-      if(numPossibles == 0) {
-	//there are now points lower than this point, so we should store a 0 in fd to say stay in this point
-	FD_Map_setValue(map, c, r, 0);
+    //turn the masks into directions
+    short* fdRow = map->fd_data + r*ncols;
+    unsigned char* pfRow = map->pf_dir ? map->pf_dir + r*ncols : NULL;
+    for(c = 0; c < ncols; c++) {
+      value = b_map->elev_data[c + r*ncols];
+      if(value == NODATA) {
+	//write the NODATA value if it's nodata in the map
+	fdRow[c] = NODATA;
+      }
+      else if(masks[c]) {
+	fdRow[c] = FD_pickDir(masks[c], c + r*ncols);
       }
-      else if(numPossibles == 1) {
-	//there is only one possible steepest direction, so store it
-	FD_Map_setValue(map, c, r, possibles[0]);
+      else if(pfRow) {
+	//the map was filled, so this point is on a flat - follow the flood back out to the edge
+	fdRow[c] = pfRow[c];
       }
-      else{
-	//there is more than one possible steepest direction, so choose one randomly
-	indexToStore = rand() % numPossibles;
-	FD_Map_setValue(map, c, r, possibles[indexToStore]);
+      else {
+	//there are no points lower than this point, so we should store a 0 in fd to say stay in this point
+	fdRow[c] = 0;
       }
     }
   }
+
+  free(up);
+  free(mid);
+  free(dn);
+  free(masks);
 }
 
 
@@ -12,22 +12,28 @@
 #include "Elev_type.h"
 #include "B_Map.h"
 #include "rtimer.h"
+#include "PF.h"
+#include "FD_Pack.h"
 
 typedef struct fd_map_t {
   B_Map* b_map;
   short* fd_data;
+  unsigned char* pf_dir; //flood directions from PF_fill, or NULL if the map was not filled
 } FD_Map;
 
 //Construct, Output and Distroy
 //create FD_Map from file
 FD_Map* FD_Map_createFromFile(char* grid_path);
 
-//write the FD map to file
+//write the FD map to file, packed if out_path ends with FD_PACK_EXT
 void FD_Map_writeMap(FD_Map map, char* in_path, char* out_path);
 
 //free up the FD_Map
 void FD_Map_kill(FD_Map* map);
 
+//fill the depressions in the map's elevations, and keep the flood directions for FD_fill
+void FD_Map_fillDepressions(FD_Map* map);
+
 //GETTERS --------------------------------------------------
 B_Map* FD_Map_getBMap(FD_Map map);
 
@@ -0,0 +1,132 @@
+#include "FD_Pack.h"
+
+#define FD_PACK_DEBUG if(0)
+
+//the on-disk header, 48 bytes
+typedef struct fd_pack_header_t {
+  char magic[8];
+  uint8_t scheme;
+  uint8_t reserved[7];
+  uint64_t nrows;
+  uint64_t ncols;
+  float xllcorner;
+  float yllcorner;
+  float cellsize;
+  uint32_t reserved2;
+} FD_Pack_Header;
+
+/*our direction for each fishgis direction.  fishgis numbers them
+  0 none, 1 down, 2 down-right, 3 down-left, 4 right, 5 left, 6 up-right,
+  7 up-left, 8 up and 9 NODATA*/
+static const unsigned char fishgis_to_d8[16] = {0, 6, 5, 7, 4, 8, 3, 1, 2, 9, 9, 9, 9, 9, 9, 9};
+
+//HELPERS --------------------------------------------------
+int FD_Pack_isPacked(char* path) {
+  assert(path);
+
+  FILE* file = fopen(path, "rb");
+  if(file == NULL) {
+    return 0;
+  }
+
+  char magic[8];
+  int packed = fread(magic, 1, 8, file) == 8 && memcmp(magic, FD_PACK_MAGIC, 8) == 0;
+  fclose(file);
+
+  return packed;
+}
+
+int FD_Pack_wantsPacked(char* path) {
+  assert(path);
+
+  size_t len = strlen(path);
+  size_t ext = strlen(FD_PACK_EXT);
+  return len >= ext && strcmp(path + len - ext, FD_PACK_EXT) == 0;
+}
+
+//Input and Output --------------------------------------------------
+void FD_Pack_write(short* fd_data, unsigned short ncols, unsigned short nrows, elev_type NODATA, char* in_path, char* out_path) {
+  assert(fd_data);
+  assert(sizeof(FD_Pack_Header) == 48);
+
+  //get the position out of the input header
+  FILE* inFile = fopen(in_path, "r");
+  assert(inFile);
+  float header[6];
+  B_Map_readHeader(inFile, header);
+  fclose(inFile);
+
+  FD_Pack_Header hd;
+  memset(&hd, 0, sizeof(hd));
+  memcpy(hd.magic, FD_PACK_MAGIC, 8);
+  hd.scheme = FD_PACK_D8;
+  hd.nrows = nrows;
+  hd.ncols = ncols;
+  hd.xllcorner = header[2];
+  hd.yllcorner = header[3];
+  hd.cellsize = header[4];
+
+  //pack the directions, two to a byte
+  unsigned int n = ncols * nrows;
+  unsigned int nbytes = (n + 1) / 2;
+  unsigned char* packed = (unsigned char*) calloc(nbytes, sizeof(unsigned char));
+  assert(packed);
+  unsigned int i;
+  unsigned char dir;
+  for(i = 0; i < n; i++) {
+    dir = (fd_data[i] == NODATA || fd_data[i] < 0 || fd_data[i] > 8) ? FD_PACK_NODIR : (unsigned char) fd_data[i];
+    packed[i >> 1] |= dir << ((i & 1) << 2);
+  }
+
+  FILE* outFile = fopen(out_path, "wb");
+  assert(outFile);
+  fwrite(&hd, sizeof(hd), 1, outFile);
+  fwrite(packed, 1, nbytes, outFile);
+  fclose(outFile);
+  FD_PACK_DEBUG{printf("wrote %u packed directions to %s\n", n, out_path); fflush(stdout);}
+
+  free(packed);
+}
+
+unsigned char* FD_Pack_read(char* path, unsigned short* ncols, unsigned short* nrows) {
+  assert(path);
+  assert(ncols);
+  assert(nrows);
+
+  FILE* file = fopen(path, "rb");
+  assert(file);
+
+  FD_Pack_Header hd;
+  if(fread(&hd, sizeof(hd), 1, file) != 1 || memcmp(hd.magic, FD_PACK_MAGIC, 8) != 0) {
+    printf("%s is not a packed flow direction file\n", path);
+    exit(1);
+  }
+  *ncols = (unsigned short) hd.ncols;
+  *nrows = (unsigned short) hd.nrows;
+
+  unsigned int n = *ncols * *nrows;
+  unsigned int nbytes = (n + 1) / 2;
+  unsigned char* packed = (unsigned char*) malloc(nbytes);
+  assert(packed);
+  if(fread(packed, 1, nbytes, file) != nbytes) {
+    printf("%s is too short\n", path);
+    exit(1);
+  }
+  fclose(file);
+
+  //unpack, changing the numbering over to ours if it was written by fishgis
+  unsigned char* dirs = (unsigned char*) malloc(n);
+  assert(dirs);
+  unsigned int i;
+  unsigned char dir;
+  for(i = 0; i < n; i++) {
+    dir = (packed[i >> 1] >> ((i & 1) << 2)) & 0x0f;
+    if(hd.scheme == FD_PACK_FISHGIS) {
+      dir = fishgis_to_d8[dir];
+    }
+    dirs[i] = (dir > 8) ? FD_PACK_NODIR : dir;
+  }
+
+  free(packed);
+  return dirs;
+}
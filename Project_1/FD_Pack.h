@@ -0,0 +1,51 @@
+#ifndef __FD_Pack_h
+#define __FD_Pack_h
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "Elev_type.h"
+#include "B_Map.h"
+
+/*packed flow direction files store every direction in 4 bits, two points per
+  byte (the even point in the low half), after a 48 byte header:
+    8 bytes  magic, FD_PACK_MAGIC
+    1 byte   numbering scheme, FD_PACK_D8 for ours
+    7 bytes  reserved
+    8 bytes  nrows, then 8 bytes ncols
+    4 bytes each xllcorner, yllcorner and cellsize (floats)
+    4 bytes  reserved
+  This is the same format the fishgis tools read and write, so the files can be
+  passed between the two.*/
+#define FD_PACK_MAGIC "FLOWDIR4"
+#define FD_PACK_EXT ".fdp"
+
+//numbering schemes - fishgis numbers its directions differently, see FD_Pack.c
+#define FD_PACK_FISHGIS 0
+#define FD_PACK_D8 1
+
+//direction stored for NODATA points
+#define FD_PACK_NODIR 9
+
+//HELPERS --------------------------------------------------
+//returns 1 if the file at path starts with FD_PACK_MAGIC
+int FD_Pack_isPacked(char* path);
+
+//returns 1 if path ends with FD_PACK_EXT, so it should be written packed
+int FD_Pack_wantsPacked(char* path);
+
+//Input and Output --------------------------------------------------
+/*write ncols*nrows directions to out_path.  The position is copied from the
+  header of in_path, and points whose direction is NODATA (or anything else
+  outside 0-8) are written as FD_PACK_NODIR*/
+void FD_Pack_write(short* fd_data, unsigned short ncols, unsigned short nrows, elev_type NODATA, char* in_path, char* out_path);
+
+/*read a packed file, returning a malloc'd array of ncols*nrows directions in
+  our numbering, with FD_PACK_NODIR for NODATA.  The size is returned in ncols
+  and nrows*/
+unsigned char* FD_Pack_read(char* path, unsigned short* ncols, unsigned short* nrows);
+
+#endif
@@ -0,0 +1,51 @@
+#include "FD.h"
+
+#define FD_DEBUG if(0)
+
+//Main function
+//args are elev, output, and optionally "fill" to fill depressions before computing directions
+int main(int argc, char** argv, char** envp) {
+
+  if(argc != 2 && argc != 3) {
+    exit(0);
+  }
+
+  //rtimer stuff
+  Rtimer timer;
+
+  //start the timer
+  rt_start(timer);
+
+  //make the FD map
+  FD_Map* map = FD_Map_createFromFile(argv[0]);
+  FD_DEBUG{printf("done making map\n"); fflush(stdout);}
+
+  //fill the depressions, if asked to
+  if(argc == 3 && strcmp(argv[2], "fill") == 0) {
+    FD_Map_fillDepressions(map);
+    FD_DEBUG{printf("done filling depressions\n"); fflush(stdout);}
+  }
+
+  //fill up the FD map
+  FD_fill(map);
+  FD_DEBUG{printf("done filling the map\n"); fflush(stdout);}
+
+  //output the map
+  FD_Map_writeMap(*map, argv[0], argv[1]);
+  FD_DEBUG{printf("done writing the map"); fflush(stdout);}
+
+  //free up the map
+  FD_Map_kill(map);
+
+  //stop the timer
+  rt_stop(timer);
+  //print the timer
+  //print the read timer
+  char buf[1000];
+  rt_sprint(buf, timer);
+  printf("time for flow direction algorithm: %s\n", buf);
+
+  //exit
+  FD_DEBUG{printf("freed everything - exiting\n"); fflush(stdout);}
+  exit(0);
+}
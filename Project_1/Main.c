@@ -58,6 +58,18 @@ int main(int argc, char** argv) {
 	sleep(1);
       }
     }
+    else if(strcmp(input[0], "flowdirfill") == 0 || strcmp(input[0], "fdf") == 0) {
+      //same as flowdir, but fill the depressions first
+      scanf("%s %s", input[1], input[2]);
+      if( (forkPid = fork()) == 0) {
+	//child process - execute flowdir with filling
+	execl("./flowdir", input[1], input[2], "fill", NULL);
+      }
+      else {
+	//parent - sleep
+	sleep(1);
+      }
+    }
     else if(strcmp(input[0], "flowaccu") == 0 || strcmp(input[0], "fa") == 0) {
       //read in the elev, input and output maps for flowaccu
       scanf("%s %s %s", input[1], input[2], input[3]);
@@ -71,6 +83,42 @@ int main(int argc, char** argv) {
 	sleep(1);
       }
     }
+    else if(strcmp(input[0], "flowaccusort") == 0 || strcmp(input[0], "fas") == 0) {
+      //same as flowaccu, but run with the old sort based engine
+      scanf("%s %s %s", input[1], input[2], input[3]);
+      if( (forkPid = fork()) == 0) {
+	// child process- execute flowaccu with the sort engine
+	execl("./flowaccu", input[1], input[2], input[3], "sort", NULL);
+      }
+      else {
+	//parent - sleep
+	sleep(1);
+      }
+    }
+    else if(strcmp(input[0], "pipeline") == 0 || strcmp(input[0], "pl") == 0) {
+      //flowdir and flowaccu in one go - read the elev and both outputs, either of which can be - to skip it
+      scanf("%s %s %s", input[1], input[2], input[3]);
+      if( (forkPid = fork()) == 0) {
+	//child process - execute pipeline
+	execl("./pipeline", input[1], input[2], input[3], NULL);
+      }
+      else {
+	//parent - sleep
+	sleep(1);
+      }
+    }
+    else if(strcmp(input[0], "pipelinefill") == 0 || strcmp(input[0], "plf") == 0) {
+      //same as pipeline, but fill the depressions first
+      scanf("%s %s %s", input[1], input[2], input[3]);
+      if( (forkPid = fork()) == 0) {
+	//child process - execute pipeline with filling
+	execl("./pipeline", input[1], input[2], input[3], "fill", NULL);
+      }
+      else {
+	//parent - sleep
+	sleep(1);
+      }
+    }
     else if(strcmp(input[0], "exit") == 0 || strcmp(input[0], "quit") == 0 || strcmp(input[0], "q") == 0) {
       //quit
       exit(0);
@@ -92,6 +140,6 @@ int main(int argc, char** argv) {
 
 //print out help information
 void print_help() {
-  printf("Invalid Command\nUsage:\nrender\t<input.asc>\nflowdir\t<elev.asc> <output.asc>\nflowaccu\t<elev.asc> <flowdir.asc> <output.asc>\nquit\n");
+  printf("Invalid Command\nUsage:\nrender\t<input.asc>\nflowdir\t<elev.asc> <output.asc>\nflowdirfill\t<elev.asc> <output.asc>\nflowaccu\t<elev.asc> <flowdir.asc> <output.asc>\nflowaccusort\t<elev.asc> <flowdir.asc> <output.asc>\npipeline\t<elev.asc> <flowdir.asc|-> <flowaccu.asc|->\npipelinefill\t<elev.asc> <flowdir.asc|-> <flowaccu.asc|->\nquit\n");
 
 }
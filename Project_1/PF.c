@@ -0,0 +1,127 @@
+#include "PF.h"
+
+#define PF_DEBUG if(0)
+
+//column and row offsets for each direction, using the standard set in the FD files
+//1  2  3
+//8  0  4
+//7  6  5
+static const int dir_dc[9] = {0, -1, 0, 1, 1, 1, 0, -1, -1};
+static const int dir_dr[9] = {0, -1, -1, -1, 0, 1, 1, 1, 0};
+
+//the direction pointing back the other way, so 1 <-> 5, 2 <-> 6 and so on
+#define PF_OPPOSITE(dir) (((dir) + 3) % 8 + 1)
+
+//HELPERS ----------------------------------------------------------
+//add point i to the end of the bucket for elevation level
+static void PF_push(int* head, int* tail, int* next, int level, int i) {
+  next[i] = -1;
+  if(tail[level] == -1) {
+    head[level] = i;
+  }
+  else {
+    next[tail[level]] = i;
+  }
+  tail[level] = i;
+}
+
+//WORKHORSE ----------------------------------------------------------
+unsigned char* PF_fill(B_Map* map) {
+  assert(map);
+
+  int ncols = B_Map_getNCols(*map);
+  int nrows = B_Map_getNRows(*map);
+  int n = ncols * nrows;
+  elev_type NODATA = B_Map_getNoDataValue(*map);
+  elev_type minElev = B_Map_getMinElev(*map);
+  int range = B_Map_getMaxElev(*map) - minElev + 1;
+  elev_type* elev = map->elev_data;
+
+  //flood directions, which double as the "already reached" marks
+  unsigned char* pf_dir = (unsigned char*) malloc(sizeof(unsigned char) * n);
+  assert(pf_dir);
+
+  //one FIFO list per elevation, linked through next
+  int* head = (int*) malloc(sizeof(int) * range);
+  assert(head);
+  int* tail = (int*) malloc(sizeof(int) * range);
+  assert(tail);
+  int* next = (int*) malloc(sizeof(int) * n);
+  assert(next);
+
+  int i, c, r, nc, nr, dir, level;
+  for(i = 0; i < range; i++) {
+    head[i] = -1;
+    tail[i] = -1;
+  }
+  for(i = 0; i < n; i++) {
+    pf_dir[i] = PF_UNSEEN;
+  }
+
+  //seed the queue with the edges - points on the border or next to NODATA
+  int numSeeds = 0;
+  for(r = 0; r < nrows; r++) {
+    for(c = 0; c < ncols; c++) {
+      i = c + r*ncols;
+      if(elev[i] == NODATA) {
+	continue;
+      }
+      for(dir = 1; dir <= 8; dir++) {
+	nc = c + dir_dc[dir];
+	nr = r + dir_dr[dir];
+	if(nc < 0 || nr < 0 || nc >= ncols || nr >= nrows || elev[nc + nr*ncols] == NODATA) {
+	  break;
+	}
+      }
+      if(dir <= 8) {
+	pf_dir[i] = 0;
+	PF_push(head, tail, next, elev[i] - minElev, i);
+	numSeeds++;
+      }
+    }
+  }
+  PF_DEBUG{printf("seeded the flood with %d of %d points\n", numSeeds, n); fflush(stdout);}
+
+  //flood inwards, lowest level first.  Anything pushed is at least as high
+  //as the point it was pushed from, so the level never has to go back down
+  int numRaised = 0;
+  for(level = 0; level < range; level++) {
+    while(head[level] != -1) {
+      i = head[level];
+      head[level] = next[i];
+      if(head[level] == -1) {
+	tail[level] = -1;
+      }
+
+      c = i % ncols;
+      r = i / ncols;
+      for(dir = 1; dir <= 8; dir++) {
+	nc = c + dir_dc[dir];
+	nr = r + dir_dr[dir];
+	if(nc < 0 || nr < 0 || nc >= ncols || nr >= nrows) {
+	  continue;
+	}
+	int ni = nc + nr*ncols;
+	if(pf_dir[ni] != PF_UNSEEN || elev[ni] == NODATA) {
+	  continue;
+	}
+
+	//the neighbor drains back through us
+	pf_dir[ni] = PF_OPPOSITE(dir);
+	//raise it out of the pit, if it is in one
+	if(elev[ni] < elev[i]) {
+	  elev[ni] = elev[i];
+	  numRaised++;
+	}
+	PF_push(head, tail, next, elev[ni] - minElev, ni);
+      }
+    }
+  }
+  PF_DEBUG{printf("raised %d points\n", numRaised); fflush(stdout);}
+
+  free(head);
+  free(tail);
+  free(next);
+
+  return pf_dir;
+}
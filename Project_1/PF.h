@@ -0,0 +1,31 @@
+#ifndef __PF_h
+#define __PF_h
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "Elev_type.h"
+#include "B_Map.h"
+
+//pf_dir value for points that have not been reached by the flood yet, and for NODATA points
+#define PF_UNSEEN 255
+
+//WORKHORSE ----------------------------------------------------------
+/*priority-flood depression filling.  Floods the map inwards from its edges
+  (the border and any point next to NODATA), always growing from the lowest
+  point reached so far, and raises every point it reaches to at least the
+  height of the point it was reached from.  Afterwards there are no pits: every
+  point has a non-increasing path to an edge.
+
+  Since elev_type is a short, the priority queue is a bucket queue with one
+  FIFO list per elevation, so the whole fill is O(n + maxElev - minElev).
+
+  The map is filled in place.  Returns a malloc'd array of ncols*nrows
+  directions (same codes as FD) giving, for each point, the neighbor the
+  flood reached it from; edge points get 0 and NODATA points PF_UNSEEN.
+  Following these always leads to an edge, so FD uses them to route flow
+  across the flats the fill creates.*/
+unsigned char* PF_fill(B_Map* map);
+
+#endif
@@ -0,0 +1,97 @@
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "Elev_type.h"
+#include "B_Map.h"
+#include "FD.h"
+#include "FA_Grid.h"
+#include "rtimer.h"
+
+#define PIPELINE_DEBUG if(0)
+
+//print how long a stage took, and add it to the running total
+void Pipeline_report(char* stage, Rtimer* timer, double* total) {
+  char buf[1000];
+  rt_sprint(buf, (*timer));
+  printf("%-12s %s\n", stage, buf);
+  *total += rt_w_useconds((*timer)) / 1000000;
+}
+
+//Main function
+/*runs flowdir and flowaccu one after the other without writing the flow
+  directions out and reading them back in.  The DEM is read once, and the
+  directions go from FD_fill straight into the FA grid.
+  args are elev, the flowdir output and the flowaccu output, and optionally
+  "fill" to fill depressions first.  An output given as "-" is not written.*/
+int main(int argc, char** argv, char** envp) {
+
+  if(argc != 3 && argc != 4) {
+    exit(0);
+  }
+
+  char* elev_path = argv[0];
+  char* fd_path = (strcmp(argv[1], "-") == 0) ? NULL : argv[1];
+  char* fa_path = (strcmp(argv[2], "-") == 0) ? NULL : argv[2];
+  int fill = (argc == 4 && strcmp(argv[3], "fill") == 0);
+
+  Rtimer timer;
+  double total = 0;
+
+  //load the DEM
+  rt_start(timer);
+  FD_Map* map = FD_Map_createFromFile(elev_path);
+  rt_stop(timer);
+  Pipeline_report("load", &timer, &total);
+
+  //fill the depressions, if asked to
+  if(fill) {
+    rt_start(timer);
+    FD_Map_fillDepressions(map);
+    rt_stop(timer);
+    Pipeline_report("fill", &timer, &total);
+  }
+
+  //flow direction
+  rt_start(timer);
+  FD_fill(map);
+  rt_stop(timer);
+  Pipeline_report("flowdir", &timer, &total);
+
+  if(fd_path) {
+    rt_start(timer);
+    FD_Map_writeMap(*map, elev_path, fd_path);
+    rt_stop(timer);
+    Pipeline_report("write fd", &timer, &total);
+  }
+
+  //flow accumulation, straight from the directions in memory
+  if(fa_path) {
+    rt_start(timer);
+    FA_Grid* grid = FA_Grid_createFromData(FD_Map_getBMap(*map), map->fd_data);
+    FA_Grid_fill(grid);
+    rt_stop(timer);
+    Pipeline_report("flowaccu", &timer, &total);
+
+    //done with the directions, so free them before writing
+    FD_Map_kill(map);
+    map = NULL;
+
+    rt_start(timer);
+    FA_Grid_writeMap(*grid, elev_path, fa_path);
+    rt_stop(timer);
+    Pipeline_report("write fa", &timer, &total);
+
+    FA_Grid_kill(grid);
+  }
+
+  if(map) {
+    FD_Map_kill(map);
+  }
+
+  printf("%-12s %.3f s wall\n", "total", total);
+
+  PIPELINE_DEBUG{printf("freed everything - exiting\n"); fflush(stdout);}
+  exit(0);
+}
@@ -0,0 +1,306 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "basin.h"
+#include "flow.h"
+#include "rtimer.h"
+#include "runthreads.h"
+#include "vector.h"
+
+// closure for the basin labelling threads; each thread owns cells
+// [begin, end) of the grid in every phase
+typedef struct basin_thread_data {
+  int id;
+  index_t begin;
+  index_t end;
+  Grid *flow;
+  index_t *cur;      // successor of each cell, after the jumps so far
+  index_t *nxt;      // successor after one more jump
+  int *changed;      // set when a jump moved any cell
+  Grid *label;
+  unsigned int *ncell;
+} basin_band;
+
+// helper threaded methods - forward references
+void* basin_successor(void *_closure);
+void* basin_jump(void *_closure);
+void* basin_label(void *_closure);
+
+/**
+ * Label every cell of a flow map with the basin it drains to.
+ *
+ * Each cell starts out pointing at its downstream neighbor; outlets (sinks,
+ * and cells that flow off the grid or into NODATA) point at themselves.
+ * Then, in rounds, every cell replaces its pointer with its successor's
+ * pointer, doubling the distance it has covered, until no pointer moves.  A
+ * flow path of length d is resolved in log2(d) rounds, and within a round
+ * every cell is independent, so the rounds are split evenly across threads.
+ *
+ * The result is an UINT grid with NODATA 0, and basins numbered from 1 in
+ * the order of their outlets.  If basins is not NULL, it is set to a new
+ * Vector of Basin, where basin k is element k-1.
+ */
+DataSet* flow_basins(DataSet *flow_set, int nthread, Vector **basins)
+{
+  static Rtimer rt;
+  Vector *bands;
+  DataSet *label_set;
+  Grid *flow, *label;
+  basin_band band, *b;
+  index_t *cur, *nxt, *tmp, n, i, nbasin;
+  unsigned int *ncell;
+  Basin basin;
+  int changed, round, t;
+
+  rt_start(rt);
+
+  // DataSet is unsigned char flow direction data
+  assert(flow_set);
+  flow = &flow_set->grid;
+  assert(flow->type == UCHAR);
+  n = flow->nrow * flow->ncol;
+
+  // Initialize output data grid
+  label_set = dInit(flow->nrow, flow->ncol, UINT);
+  if (!label_set)
+    return NULL;
+  label = &label_set->grid;
+  label->xllcorner = flow->xllcorner;
+  label->yllcorner = flow->yllcorner;
+  label->cellsize = flow->cellsize;
+  label->uiNODATA = 0;
+
+  cur = (index_t*) malloc(n * sizeof(index_t));
+  nxt = (index_t*) malloc(n * sizeof(index_t));
+  if (!cur || !nxt) {
+    perror("Unable to allocate basin successor arrays");
+    free(cur);
+    free(nxt);
+    dFree(label_set);
+    return NULL;
+  }
+
+  // allocate and initialize thread closures
+  bands = vinit2(sizeof(basin_band), nthread);
+  assert(bands);
+  t = -1;
+  while (++t < nthread) {
+    band.id = t;
+    band.begin = n * t / nthread;
+    band.end = n * (t + 1) / nthread;
+    band.flow = flow;
+    band.cur = cur;
+    band.nxt = nxt;
+    band.changed = &changed;
+    band.label = label;
+    band.ncell = NULL;
+
+    vappend(bands, &band);
+  }
+
+  run_threads(nthread, basin_successor, bands);
+
+  // jump until every pointer has reached an outlet; a path can be at most n
+  // long, so more rounds than bits in index_t means the flow map has a cycle
+  round = 0;
+  do {
+    changed = 0;
+    run_threads(nthread, basin_jump, bands);
+    tmp = cur; cur = nxt; nxt = tmp;
+    for (t = 0; t < nthread; t++) {
+      b = (basin_band*) vget(bands, t);
+      b->cur = cur;
+      b->nxt = nxt;
+    }
+    round++;
+  } while (changed && round <= 8 * (int) sizeof(index_t));
+
+  if (changed) {
+    fprintf(stderr, "flow_basins: flow directions contain a cycle\n");
+    vfree(bands);
+    free(cur);
+    free(nxt);
+    dFree(label_set);
+    return NULL;
+  }
+
+  // number the outlets in grid order, reusing nxt as the outlet -> label map
+  nbasin = 0;
+  for (i = 0; i < n; i++) {
+    if (cur[i] == i && flow->ucData[i] < NO_DIR)
+      nxt[i] = ++nbasin;
+  }
+
+  ncell = (unsigned int*) calloc(nbasin + 1, sizeof(unsigned int));
+  assert(ncell);
+  for (t = 0; t < nthread; t++)
+    ((basin_band*) vget(bands, t))->ncell = ncell;
+
+  run_threads(nthread, basin_label, bands);
+
+  if (basins) {
+    *basins = vinit(sizeof(Basin));
+    assert(*basins);
+    vensure_capacity(*basins, nbasin);
+    for (i = 0; i < n; i++) {
+      if (cur[i] == i && flow->ucData[i] < NO_DIR) {
+        basin.outlet = i;
+        basin.ncell = ncell[nxt[i]];
+        vappend(*basins, &basin);
+      }
+    }
+  }
+
+  // garbage collect
+  vfree(bands);
+  free(cur);
+  free(nxt);
+  free(ncell);
+
+  // print results
+  rt_stop(rt);
+  static char buf[1024];
+  rt_sprint(buf, rt);
+  printf("flow_basins(" DGI_FMT " basins, %d rounds)\t%s\n",
+         nbasin, round, buf);
+
+  return label_set;
+}
+
+/**
+ * Point each of a band's cells at its downstream neighbor, or at itself if
+ * it is an outlet or NODATA.
+ */
+void* basin_successor(void *_closure)
+{
+  basin_band band;
+  index_t i, r, c, ncol;
+  unsigned char dir;
+
+  assert(_closure);
+  band = *(basin_band*) _closure;
+  ncol = band.flow->ncol;
+
+  for (i = band.begin; i < band.end; i++) {
+    band.cur[i] = i;
+    dir = band.flow->ucData[i];
+    if (dir == MM || dir >= NO_DIR)
+      continue;
+
+    // index_t is unsigned, so -1 wraps to be out of range
+    r = i / ncol + flowdir_dr[dir];
+    c = i % ncol + flowdir_dc[dir];
+    if (r >= band.flow->nrow || c >= ncol ||
+        band.flow->ucData[r*ncol + c] >= NO_DIR)
+      continue;
+    band.cur[i] = r*ncol + c;
+  }
+
+  pthread_exit(NULL);
+}
+
+/**
+ * One round of pointer jumping over a band's cells.
+ */
+void* basin_jump(void *_closure)
+{
+  basin_band band;
+  index_t i, next;
+  int moved;
+
+  assert(_closure);
+  band = *(basin_band*) _closure;
+
+  moved = 0;
+  for (i = band.begin; i < band.end; i++) {
+    next = band.cur[band.cur[i]];
+    moved |= next != band.cur[i];
+    band.nxt[i] = next;
+  }
+  // only ever set, so a plain store is enough
+  if (moved)
+    *band.changed = 1;
+
+  pthread_exit(NULL);
+}
+
+/**
+ * Copy the label of each cell's outlet into the label grid, and count the
+ * cells of each basin.
+ */
+void* basin_label(void *_closure)
+{
+  basin_band band;
+  index_t i;
+  unsigned int k, last, run;
+
+  assert(_closure);
+  band = *(basin_band*) _closure;
+
+  // neighboring cells mostly share a basin, so counts are added per run of
+  // equal labels rather than per cell
+  last = 0;
+  run = 0;
+  for (i = band.begin; i < band.end; i++) {
+    k = band.flow->ucData[i] < NO_DIR ? band.nxt[band.cur[i]] : 0;
+    band.label->uiData[i] = k;
+    if (k != last) {
+      if (last)
+        __sync_fetch_and_add(band.ncell + last, run);
+      last = k;
+      run = 0;
+    }
+    run++;
+  }
+  if (last)
+    __sync_fetch_and_add(band.ncell + last, run);
+
+  pthread_exit(NULL);
+}
+
+/**
+ * Store a basin list as text, one basin per line: its label, the row and
+ * column of its outlet, and its cell count.
+ */
+int basins_store(Vector *basins, index_t ncol, const char *path)
+{
+  FILE *fp;
+  Basin *b;
+  vector_size_t k;
+
+  assert(basins);
+
+  fp = fopen(path, "w");
+  if (!fp) {
+    fprintf(stderr, "Could not open output file (%s).\n", path);
+    perror(NULL);
+    return -1;
+  }
+
+  fprintf(fp, "basin\trow\tcol\tcells\n");
+  for (k = 0; k < basins->length; k++) {
+    b = (Basin*) vget(basins, k);
+    fprintf(fp, "%u\t" DGI_FMT "\t" DGI_FMT "\t" DGI_FMT "\n", k + 1,
+            b->outlet / ncol, b->outlet % ncol, b->ncell);
+  }
+
+  fclose(fp);
+  return 0;
+}
@@ -0,0 +1,32 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _basin_h_DEFINED
+#define _basin_h_DEFINED
+
+#include "datagrid.h"
+#include "vector.h"
+
+// a drainage basin: every cell that drains to the same outlet
+typedef struct basin_t {
+  index_t outlet;  // cell index of the sink or edge cell the basin drains to
+  index_t ncell;   // number of cells in the basin, outlet included
+} Basin;
+
+DataSet* flow_basins(DataSet *flow_set, int nthread, Vector **basins);
+
+int basins_store(Vector *basins, index_t ncol, const char *path);
+
+#endif
@@ -0,0 +1,245 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "batch.h"
+#include "runthreads.h"
+#include "vector.h"
+
+static const char *BATCH_STAGE_NAME[BATCH_NSTAGE] = { "load", "compute",
+                                                     "store" };
+
+// a bounded queue of tiles between two stages
+typedef struct batch_queue_t {
+  pthread_mutex_t lock;
+  pthread_cond_t nonempty, nonfull;
+  size_t *index;
+  void **item;
+  int depth, head, count;
+  int closed;   // the stage before has passed on its last tile
+} BatchQueue;
+
+// closure of a stage thread
+typedef struct batch_thread_t {
+  int stage;
+  size_t ntile;
+  BatchStage func;
+  void *closure;
+  BatchQueue *in, *out;   // NULL before the first and after the last stage
+  double busy, starved, blocked;
+  size_t done, failed;
+} BatchThread;
+
+// wall clock seconds
+static double batch_now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void bq_init(BatchQueue *q, int depth)
+{
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->nonempty, NULL);
+  pthread_cond_init(&q->nonfull, NULL);
+  q->index = (size_t*) malloc(depth * sizeof(size_t));
+  q->item = (void**) malloc(depth * sizeof(void*));
+  assert(q->index && q->item);
+  q->depth = depth;
+  q->head = q->count = 0;
+  q->closed = 0;
+}
+
+static void bq_destroy(BatchQueue *q)
+{
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->nonempty);
+  pthread_cond_destroy(&q->nonfull);
+  free(q->index);
+  free(q->item);
+}
+
+// append tile k, waiting while the queue is full
+static void bq_push(BatchQueue *q, size_t k, void *item)
+{
+  int tail;
+
+  pthread_mutex_lock(&q->lock);
+  while (q->count == q->depth)
+    pthread_cond_wait(&q->nonfull, &q->lock);
+  tail = (q->head + q->count) % q->depth;
+  q->index[tail] = k;
+  q->item[tail] = item;
+  q->count++;
+  pthread_cond_signal(&q->nonempty);
+  pthread_mutex_unlock(&q->lock);
+}
+
+// mark that nothing more will be pushed
+static void bq_close(BatchQueue *q)
+{
+  pthread_mutex_lock(&q->lock);
+  q->closed = 1;
+  pthread_cond_broadcast(&q->nonempty);
+  pthread_mutex_unlock(&q->lock);
+}
+
+// take the next tile, waiting while the queue is empty; returns 0 once the
+//   queue is closed and empty
+static int bq_pop(BatchQueue *q, size_t *k, void **item)
+{
+  pthread_mutex_lock(&q->lock);
+  while (q->count == 0 && !q->closed)
+    pthread_cond_wait(&q->nonempty, &q->lock);
+  if (q->count == 0) {
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+  }
+  *k = q->index[q->head];
+  *item = q->item[q->head];
+  q->head = (q->head + 1) % q->depth;
+  q->count--;
+  pthread_cond_signal(&q->nonfull);
+  pthread_mutex_unlock(&q->lock);
+  return 1;
+}
+
+// thread routine running one stage over every tile, in order
+static void* batch_stage_sub(void *_closure)
+{
+  BatchThread *t;
+  size_t k;
+  void *item;
+  double t0, t1;
+  int more;
+
+  assert(_closure);
+  t = (BatchThread*) _closure;
+
+  k = 0;
+  for (;;) {
+    // the next tile: a number for the load stage, from the queue otherwise
+    t0 = batch_now();
+    if (t->in)
+      more = bq_pop(t->in, &k, &item);
+    else {
+      more = k < t->ntile;
+      item = NULL;
+    }
+    t1 = batch_now();
+    t->starved += t1 - t0;
+    if (!more)
+      break;
+
+    // a tile that failed in an earlier stage is just passed on
+    if (item || !t->in) {
+      item = t->func(t->closure, k, item);
+      if (!item)
+        t->failed++;
+    }
+    t0 = batch_now();
+    t->busy += t0 - t1;
+
+    if (t->out) {
+      bq_push(t->out, k, item);
+      t->blocked += batch_now() - t0;
+    }else if (item)
+      t->done++;
+
+    if (!t->in)
+      k++;
+  }
+
+  if (t->out)
+    bq_close(t->out);
+  pthread_exit(NULL);
+}
+
+size_t run_batch(size_t ntile, BatchStage stages[BATCH_NSTAGE], void *closure,
+                 int depth, BatchStats *stats)
+{
+  BatchQueue queues[BATCH_NSTAGE - 1];
+  BatchThread thread, *t;
+  Vector *threads;
+  double start;
+  size_t failed;
+  int s;
+
+  assert(depth > 0);
+
+  for (s = 0; s < BATCH_NSTAGE - 1; s++)
+    bq_init(&queues[s], depth);
+  threads = vinit2(sizeof(BatchThread), BATCH_NSTAGE);
+  assert(threads);
+  for (s = 0; s < BATCH_NSTAGE; s++) {
+    thread.stage = s;
+    thread.ntile = ntile;
+    thread.func = stages[s];
+    thread.closure = closure;
+    thread.in = s > 0 ? &queues[s-1] : NULL;
+    thread.out = s < BATCH_NSTAGE - 1 ? &queues[s] : NULL;
+    thread.busy = thread.starved = thread.blocked = 0;
+    thread.done = thread.failed = 0;
+    vappend(threads, &thread);
+  }
+
+  start = batch_now();
+  run_threads(BATCH_NSTAGE, batch_stage_sub, threads);
+
+  failed = 0;
+  if (stats)
+    stats->wall = batch_now() - start;
+  for (s = 0; s < BATCH_NSTAGE; s++) {
+    t = (BatchThread*) vget(threads, s);
+    failed += t->failed;
+    if (stats) {
+      stats->busy[s] = t->busy;
+      stats->starved[s] = t->starved;
+      stats->blocked[s] = t->blocked;
+      if (s == BATCH_STORE)
+        stats->done = t->done;
+    }
+  }
+  if (stats)
+    stats->failed = failed;
+
+  vfree(threads);
+  for (s = 0; s < BATCH_NSTAGE - 1; s++)
+    bq_destroy(&queues[s]);
+  return failed;
+}
+
+void print_batch_stats(FILE *out, const BatchStats *stats)
+{
+  double wall;
+  int s;
+
+  // utilisation is the share of the batch's wall time the stage was busy;
+  //   the busiest stage sets the pace, and the others mostly wait on it
+  wall = stats->wall > 0 ? stats->wall : 1;
+  fprintf(out, "batch: %lu tiles stored, %lu failed, %.2fs\n",
+          (unsigned long) stats->done, (unsigned long) stats->failed,
+          stats->wall);
+  fprintf(out, "  stage    \tbusy\tutil\tstarved\tblocked\n");
+  for (s = 0; s < BATCH_NSTAGE; s++)
+    fprintf(out, "  %-9s\t%.2fs\t%3.0f%%\t%.2fs\t%.2fs\n",
+            BATCH_STAGE_NAME[s], stats->busy[s],
+            100 * stats->busy[s] / wall, stats->starved[s],
+            stats->blocked[s]);
+}
@@ -0,0 +1,56 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _batch_h_DEFINED
+#define _batch_h_DEFINED
+
+#include <stddef.h>
+#include <stdio.h>
+
+// the stages of a batch pipeline, which run at once on different tiles
+enum {
+  BATCH_LOAD = 0,
+  BATCH_COMPUTE,
+  BATCH_STORE,
+  BATCH_NSTAGE
+};
+
+// a stage of a batch pipeline, run on tile k.  Takes over item, what the
+//   stage before returned for the tile (NULL for the load stage), and returns
+//   what to hand to the next stage, or NULL if the tile failed; the tile then
+//   skips the rest of the stages.  The store stage returns non-NULL on success
+typedef void* (*BatchStage)(void *closure, size_t k, void *item);
+
+// where each stage spent its time, in seconds
+typedef struct batch_stats_t {
+  double wall;                     // the whole batch
+  double busy[BATCH_NSTAGE];       // running the stage
+  double starved[BATCH_NSTAGE];    // waiting for a tile from the stage before
+  double blocked[BATCH_NSTAGE];    // waiting for room to pass a tile on
+  size_t done, failed;             // tiles stored, and tiles that failed
+} BatchStats;
+
+// run tiles 0..ntile-1 through the load, compute and store stages, a thread
+//   per stage, so tile k+1 loads and tile k-1 stores while tile k computes.
+//   At most depth tiles wait between two stages, so at most 2 * depth + 3
+//   tiles are in memory at once.  Fills stats if it isn't NULL; returns the
+//   number of tiles that failed
+size_t run_batch(size_t ntile, BatchStage stages[BATCH_NSTAGE], void *closure,
+                 int depth, BatchStats *stats);
+
+// print stats as a table of how busy each stage was
+void print_batch_stats(FILE *out, const BatchStats *stats);
+
+#endif
@@ -0,0 +1,368 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "catchment.h"
+#include "flow.h"
+#include "misc.h"
+#include "rtimer.h"
+
+// on-disk header, 40 bytes, followed by the tin and size arrays as uint64
+typedef struct catchment_header_t {
+  char magic[8];
+  uint64_t nrow;
+  uint64_t ncol;
+  float xllcorner;
+  float yllcorner;
+  float cellsize;
+  uint32_t reserved;
+} catchment_header;
+
+// cells converted at a time between index_t and the on-disk uint64
+#define CATCHMENT_IO_CHUNK 4096
+
+/**
+ * Write n index_t values as uint64, whatever the width of index_t.
+ */
+static int write_u64(const index_t *a, index_t n, FILE *fp)
+{
+  uint64_t buf[CATCHMENT_IO_CHUNK];
+  index_t i, k, m;
+
+  for (i = 0; i < n; i += m) {
+    m = MIN(n - i, CATCHMENT_IO_CHUNK);
+    for (k = 0; k < m; k++)
+      buf[k] = a[i + k] == CATCHMENT_NONE ? UINT64_MAX : a[i + k];
+    if (fwrite(buf, sizeof(uint64_t), m, fp) != m)
+      return -1;
+  }
+  return 0;
+}
+
+/**
+ * Read n uint64 values into index_t.
+ */
+static int read_u64(index_t *a, index_t n, FILE *fp)
+{
+  uint64_t buf[CATCHMENT_IO_CHUNK];
+  index_t i, k, m;
+
+  for (i = 0; i < n; i += m) {
+    m = MIN(n - i, CATCHMENT_IO_CHUNK);
+    if (fread(buf, sizeof(uint64_t), m, fp) != m)
+      return -1;
+    for (k = 0; k < m; k++)
+      a[i + k] = buf[k] == UINT64_MAX ? CATCHMENT_NONE : (index_t) buf[k];
+  }
+  return 0;
+}
+
+/**
+ * Allocate an index for an nrow by ncol grid.
+ */
+static Catchment* catchment_new(index_t nrow, index_t ncol)
+{
+  Catchment *cat;
+  index_t n;
+
+  cat = (Catchment*) malloc(sizeof(Catchment));
+  if (!cat) {
+    perror("Unable to allocate Catchment object");
+    return NULL;
+  }
+  n = nrow * ncol;
+  cat->nrow = nrow;
+  cat->ncol = ncol;
+  cat->tin = (index_t*) malloc(n * sizeof(index_t));
+  cat->size = (index_t*) malloc(n * sizeof(index_t));
+  cat->order = (index_t*) malloc(n * sizeof(index_t));
+  if (!cat->tin || !cat->size || !cat->order) {
+    perror("Unable to allocate catchment index arrays");
+    catchment_free(cat);
+    return NULL;
+  }
+  return cat;
+}
+
+/**
+ * Build the catchment index of a flow map.
+ *
+ * Every cell's downstream neighbor is its parent, and outlets (sinks, and
+ * cells that flow off the grid or into NODATA) are roots.  The children of
+ * each cell are gathered into one array, as in a CSR sparse matrix, and the
+ * trees are walked depth first with an explicit stack, so that every
+ * catchment is numbered contiguously.  Sizes are then summed from the
+ * leaves up by running back over the preorder.  Everything is O(n).
+ */
+Catchment* catchment_build(DataSet *flow_set)
+{
+  static Rtimer rt;
+  Catchment *cat;
+  Grid *flow;
+  index_t *parent, *first, *child, *stack;
+  index_t n, i, r, c, p, top, next;
+  unsigned char dir;
+
+  rt_start(rt);
+
+  assert(flow_set);
+  flow = &flow_set->grid;
+  assert(flow->type == UCHAR);
+  n = flow->nrow * flow->ncol;
+
+  cat = catchment_new(flow->nrow, flow->ncol);
+  if (!cat)
+    return NULL;
+  cat->xllcorner = flow->xllcorner;
+  cat->yllcorner = flow->yllcorner;
+  cat->cellsize = flow->cellsize;
+
+  parent = (index_t*) malloc(n * sizeof(index_t));
+  first = (index_t*) calloc(n + 1, sizeof(index_t));
+  child = (index_t*) malloc(n * sizeof(index_t));
+  // the stack never holds more than every cell once
+  stack = cat->size;
+  if (!parent || !first || !child) {
+    perror("Unable to allocate catchment build arrays");
+    free(parent);
+    free(first);
+    free(child);
+    catchment_free(cat);
+    return NULL;
+  }
+
+  // parent of each cell, and its number of children in first[p + 1]
+  for (i = 0; i < n; i++) {
+    parent[i] = CATCHMENT_NONE;
+    dir = flow->ucData[i];
+    if (dir == MM || dir >= NO_DIR)
+      continue;
+    // index_t is unsigned, so -1 wraps to be out of range
+    r = i / flow->ncol + flowdir_dr[dir];
+    c = i % flow->ncol + flowdir_dc[dir];
+    if (r >= flow->nrow || c >= flow->ncol ||
+        flow->ucData[r*flow->ncol + c] >= NO_DIR)
+      continue;
+    parent[i] = r*flow->ncol + c;
+    first[parent[i] + 1]++;
+  }
+
+  // children of p are child[first[p]] .. child[first[p+1] - 1]
+  for (i = 0; i < n; i++)
+    first[i + 1] += first[i];
+  // fill using tin as a cursor per parent
+  memcpy(cat->tin, first, n * sizeof(index_t));
+  for (i = 0; i < n; i++) {
+    if (parent[i] != CATCHMENT_NONE)
+      child[cat->tin[parent[i]]++] = i;
+  }
+
+  // depth-first preorder from each outlet, in grid order
+  next = 0;
+  for (i = 0; i < n; i++)
+    cat->tin[i] = CATCHMENT_NONE;
+  for (i = 0; i < n; i++) {
+    if (parent[i] != CATCHMENT_NONE || flow->ucData[i] >= NO_DIR)
+      continue;
+
+    top = 0;
+    stack[top++] = i;
+    while (top > 0) {
+      p = stack[--top];
+      cat->tin[p] = next;
+      cat->order[next++] = p;
+      for (c = first[p]; c < first[p + 1]; c++)
+        stack[top++] = child[c];
+    }
+  }
+
+  // sizes from the leaves up; children always come after their parent
+  for (i = 0; i < n; i++)
+    cat->size[i] = flow->ucData[i] < NO_DIR ? 1 : 0;
+  while (next-- > 0) {
+    p = cat->order[next];
+    if (parent[p] != CATCHMENT_NONE)
+      cat->size[parent[p]] += cat->size[p];
+  }
+
+  free(parent);
+  free(first);
+  free(child);
+
+  rt_stop(rt);
+  static char buf[1024];
+  rt_sprint(buf, rt);
+  printf("catchment_build\t\t%s\n", buf);
+
+  return cat;
+}
+
+index_t catchment_area(Catchment *cat, index_t i)
+{
+  assert(cat);
+  assert(i < cat->nrow * cat->ncol);
+  return cat->size[i];
+}
+
+const index_t* catchment_cells(Catchment *cat, index_t i, index_t *count)
+{
+  assert(cat);
+  assert(count);
+  assert(i < cat->nrow * cat->ncol);
+
+  *count = cat->size[i];
+  if (cat->tin[i] == CATCHMENT_NONE)
+    return NULL;
+  return cat->order + cat->tin[i];
+}
+
+DataSet* catchment_mask(Catchment *cat, index_t i)
+{
+  DataSet *mask_set;
+  Grid *mask;
+  const index_t *cells;
+  index_t count, k;
+
+  mask_set = dInit(cat->nrow, cat->ncol, UCHAR);
+  if (!mask_set)
+    return NULL;
+  mask = &mask_set->grid;
+  mask->xllcorner = cat->xllcorner;
+  mask->yllcorner = cat->yllcorner;
+  mask->cellsize = cat->cellsize;
+  mask->ucNODATA = 0;
+  memset(mask->ucData, 0, cat->nrow * cat->ncol);
+
+  cells = catchment_cells(cat, i, &count);
+  for (k = 0; k < count; k++)
+    mask->ucData[cells[k]] = 1;
+
+  return mask_set;
+}
+
+/**
+ * Load a stored index.  Only tin and size are stored; order is their
+ * inverse and is rebuilt in one pass.
+ */
+Catchment* catchment_load(const char *path)
+{
+  static Rtimer rt;
+  catchment_header hd;
+  Catchment *cat;
+  FILE *fp;
+  index_t n, i;
+
+  rt_start(rt);
+  assert(sizeof(catchment_header) == 40);
+
+  fp = fopen(path, "rb");
+  if (!fp) {
+    fprintf(stderr, "Could not open input file (%s).\n", path);
+    perror(NULL);
+    return NULL;
+  }
+  if (fread(&hd, sizeof(hd), 1, fp) != 1 ||
+      memcmp(hd.magic, CATCHMENT_MAGIC, 8) != 0) {
+    fprintf(stderr, "Not a catchment index file (%s).\n", path);
+    fclose(fp);
+    return NULL;
+  }
+
+  cat = catchment_new(hd.nrow, hd.ncol);
+  if (!cat) {
+    fclose(fp);
+    return NULL;
+  }
+  cat->xllcorner = hd.xllcorner;
+  cat->yllcorner = hd.yllcorner;
+  cat->cellsize = hd.cellsize;
+
+  n = cat->nrow * cat->ncol;
+  if (read_u64(cat->tin, n, fp) != 0 || read_u64(cat->size, n, fp) != 0) {
+    perror("Error reading catchment index");
+    catchment_free(cat);
+    fclose(fp);
+    return NULL;
+  }
+  fclose(fp);
+
+  for (i = 0; i < n; i++) {
+    if (cat->tin[i] != CATCHMENT_NONE)
+      cat->order[cat->tin[i]] = i;
+  }
+
+  rt_stop(rt);
+  static char buf[256];
+  rt_sprint(buf, rt);
+  printf("catchment_load('%s'):\t%s\n", path, buf);
+
+  return cat;
+}
+
+int catchment_store(Catchment *cat, const char *path)
+{
+  static Rtimer rt;
+  catchment_header hd;
+  FILE *fp;
+  index_t n;
+
+  rt_start(rt);
+  assert(cat);
+
+  fp = fopen(path, "wb");
+  if (!fp) {
+    fprintf(stderr, "Could not open output file (%s).\n", path);
+    perror(NULL);
+    return -1;
+  }
+
+  memset(&hd, 0, sizeof(hd));
+  memcpy(hd.magic, CATCHMENT_MAGIC, 8);
+  hd.nrow = cat->nrow;
+  hd.ncol = cat->ncol;
+  hd.xllcorner = cat->xllcorner;
+  hd.yllcorner = cat->yllcorner;
+  hd.cellsize = cat->cellsize;
+
+  n = cat->nrow * cat->ncol;
+  if (fwrite(&hd, sizeof(hd), 1, fp) != 1 ||
+      write_u64(cat->tin, n, fp) != 0 || write_u64(cat->size, n, fp) != 0) {
+    perror("Error writing catchment index");
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+
+  rt_stop(rt);
+  static char buf[256];
+  rt_sprint(buf, rt);
+  printf("catchment_store('%s'):\t%s\n", path, buf);
+
+  return 0;
+}
+
+void catchment_free(Catchment *cat)
+{
+  assert(cat);
+  free(cat->tin);
+  free(cat->size);
+  free(cat->order);
+  free(cat);
+}
@@ -0,0 +1,61 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _catchment_h_DEFINED
+#define _catchment_h_DEFINED
+
+#include "datagrid.h"
+
+// magic bytes at the start of a stored catchment index
+#define CATCHMENT_MAGIC "FLOWCAT1"
+// file name extension for stored catchment indexes
+#define CATCHMENT_EXT ".fci"
+// tin of NODATA cells, which belong to no catchment
+#define CATCHMENT_NONE ((index_t) -1)
+
+// upstream catchment index over the reverse-flow trees of a flow map.
+//   The trees are numbered in depth-first preorder, so the catchment of a
+//   cell is the run order[tin[i]] .. order[tin[i] + size[i] - 1].
+typedef struct catchment_t {
+  index_t nrow;
+  index_t ncol;
+  float xllcorner;
+  float yllcorner;
+  float cellsize;
+  index_t *tin;    // preorder number of each cell
+  index_t *size;   // number of cells in each cell's catchment, itself included
+  index_t *order;  // cell at each preorder number
+} Catchment;
+
+// build the index for a UCHAR flow direction grid
+Catchment* catchment_build(DataSet *flow_set);
+
+// number of cells upstream of cell i, itself included; 0 for NODATA
+index_t catchment_area(Catchment *cat, index_t i);
+
+// the cells upstream of cell i, as a run of the order array of length *count
+const index_t* catchment_cells(Catchment *cat, index_t i, index_t *count);
+
+// UCHAR grid with 1 on the catchment of cell i and NODATA 0 elsewhere
+DataSet* catchment_mask(Catchment *cat, index_t i);
+
+// load and store the index
+Catchment* catchment_load(const char *path);
+int catchment_store(Catchment *cat, const char *path);
+
+// free the memory allocated for an index
+void catchment_free(Catchment *cat);
+
+#endif
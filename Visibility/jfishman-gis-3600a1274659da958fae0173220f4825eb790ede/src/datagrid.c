@@ -26,93 +26,86 @@
 
 #include "rtimer.h"
 #include "datagrid.h"
+#include "gridio.h"
+#include "runthreads.h"
+#include "vector.h"
 
-// load functions for each type
-int gLoadf (FILE *fp, Grid *grid);
-int gLoadi (FILE *fp, Grid *grid);
-int gLoadui(FILE *fp, Grid *grid);
-int gLoads (FILE *fp, Grid *grid);
-int gLoadus(FILE *fp, Grid *grid);
-int gLoadc (FILE *fp, Grid *grid);
-int gLoaduc(FILE *fp, Grid *grid);
+static DataSet* dNew(index_t nrow, index_t ncol, enum GridDataType type);
+static int dSetPath(DataSet *dset, const char *path);
+static void dHeader(Grid *grid, GridIOHeader *hd);
+static void* dAlloc(DataSet *dset, size_t bytes);
+
+// the allocation policy, see dSetAlloc()
+static int alloc_policy = ALLOC_DEFAULT;
+static int alloc_nthread = 1;
 
 // load data from file into the data set
+//   ArcASCII files are memory mapped and parsed by every processor at once,
+//   see gio_read(); binary grids of the same type are used in place
 DataSet* dLoad(const char *path, enum GridDataType type)
 {
   static Rtimer rt;
   DataSet* dset;
   Grid *grid;
-  FILE *fp;
-  int result;
+  GridFile *gf;
+  void *data;
 
   rt_start(rt);
 
-  // allocate a new DataSet object
-  dset = (DataSet*) malloc(sizeof(DataSet));
-  if (dset == NULL) {
-    perror("Unable to allocate DataSet object");
-    return NULL;
-  }
-  dset->path = (char*) malloc(strlen(path) + 1);
-  if (dset->path == NULL) {
-    perror("Unable to allocate path string");
-    free(dset);
-    return NULL;
-  }
-  strcpy(dset->path, path);
-  
   // read grid meta info
-  grid = &dset->grid;
-  grid->type = type;
-  fp = fopen(path, "r");
-  if (!fp) {
-    fprintf(stderr, "Could not open input file (%s).\n", path);
-    perror(NULL);
-    free(dset->path);
-    free(dset);
+  gf = gio_open(path);
+  if (!gf)
+    return NULL;
+  if (!gf->hd.has_nodata) {
+    fprintf(stderr, "Could not read grid NODATA_value (%s).\n", path);
+    gio_close(gf);
     return NULL;
   }
 
-  result = fscanf(fp, "ncols\t" DGI_FMT "\nnrows\t" DGI_FMT "\n", &grid->ncol, &grid->nrow);
-  if (result != 2) {
-    perror("Could not read grid size.");
-    free(dset->path);
-    free(dset);
-    fclose(fp);
+  // allocate the DataSet, and its data array unless the values can be
+  // taken straight from the mapped file
+  data = gio_data(gf, (enum gridio_type) type);
+  if (data)
+    dset = dNew(gf->hd.nrow, gf->hd.ncol, type);
+  else
+    dset = dInit(gf->hd.nrow, gf->hd.ncol, type);
+  if (!dset) {
+    gio_close(gf);
     return NULL;
   }
-  result = fscanf(fp, "xllcorner\t%f\nyllcorner\t%f\ncellsize\t%f\n",
-                  &grid->xllcorner, &grid->yllcorner, &grid->cellsize);
-  if (result != 3) {
-    printf("%d\n", result);
-    perror("Could not read grid meta data");
-    free(dset->path);
-    free(dset);
-    fclose(fp);
+  if (dSetPath(dset, path) != 0) {
+    dFree(dset);
+    gio_close(gf);
     return NULL;
   }
 
-  result = -1;
+  grid = &dset->grid;
+  grid->xllcorner = gf->hd.xllcorner;
+  grid->yllcorner = gf->hd.yllcorner;
+  grid->cellsize = gf->hd.cellsize;
   switch (type) {
-    case FLOAT: result = gLoadf (fp, grid); break;
-    case INT:   result = gLoadi (fp, grid); break;
-    case UINT:  result = gLoadui(fp, grid); break;
-    case SHRT:  result = gLoads (fp, grid); break;
-    case USHRT: result = gLoadus(fp, grid); break;
-    case CHAR:  result = gLoadc (fp, grid); break;
-    case UCHAR: result = gLoaduc(fp, grid); break;
-    default: fprintf(stderr, "Invalid type given\n");
-  }
-  if (result != 0) {
-    free(dset->path);
-    free(dset);
-    fclose(fp);
-    return NULL;
+    case FLOAT: grid->fNODATA  = gf->hd.nodata; break;
+    case INT:   grid->iNODATA  = gf->hd.nodata; break;
+    case UINT:  grid->uiNODATA = gf->hd.nodata; break;
+    case SHRT:  grid->sNODATA  = gf->hd.nodata; break;
+    case USHRT: grid->usNODATA = gf->hd.nodata; break;
+    case CHAR:  grid->cNODATA  = gf->hd.nodata; break;
+    case UCHAR: grid->ucNODATA = gf->hd.nodata; break;
+  }
+  if (data) {
+    // every member of the data union is the same pointer; dFree() unmaps it
+    grid->fData = (float*) data;
+    dset->file = gf;
+  }else {
+    // read grid raw data
+    if (gio_read(gf, (enum gridio_type) type, grid->fData, 0) != 0) {
+      dFree(dset);
+      gio_close(gf);
+      return NULL;
+    }
+    gio_close(gf);
   }
 
-  // close input file
-  fclose(fp);
-
   rt_stop(rt);
   static char buf[256];
   rt_sprint(buf, rt);
@@ -121,491 +114,92 @@ DataSet* dLoad(const char *path, enum GridDataType type)
   return dset;
 }
 
-/**
- * Load a grid of floats from the given file pointer.
- */
-int gLoadf(FILE *fp, Grid *grid)
-{
-  index_t div, mod;
-  float *p, *end;
-#ifndef __APPLE__
-  int result;
-#endif
-
-  // read NODATA value
-  if (fscanf(fp, "NODATA_value\t%f", &grid->fNODATA) != 1) {
-    perror("Could not read grid NODATA_value");
-    return -1;
-  }
-
-  // allocate grid
-  grid->data_size = sizeof(float);
-#ifdef __APPLE__
-  grid->fData = (float*) malloc(grid->nrow * grid->ncol * grid->data_size);
-  if (!grid->fData) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            errno, strerror(errno));
-#else
-  result = sysconf(_SC_PAGESIZE);
-  result = posix_memalign((void**)&grid->fData, result,
-                     grid->ncol * grid->nrow * grid->data_size);
-  if (result != 0) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            result, strerror(result));
-#endif
-    return -1;
-  }
-
-  // read grid raw data
-  div = (grid->nrow * grid->ncol) / 16;
-  mod = (grid->nrow * grid->ncol) % 16;
-  p = grid->fData;
-  end = grid->fData + grid->nrow * grid->ncol - mod;
-
-  // loop-unroll by 4
-  if (div > 0) {
-    while (p < end) {
-      p += 15;
-      if (fscanf(fp, "%f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f ",
-                     p  , p--, p--, p--, p--, p--, p--, p--,
-                     p--, p--, p--, p--, p--, p--, p--, p--) != 16) {
-        perror("Error reading grid data");
-        free(grid->fData);
-          return -1;
-      }
-      p += 16;
-    }
-  }
-
-  // finish off the array
-  while (mod-- > 0) {
-    if (fscanf(fp, "%f ", p++) != 1) {
-      perror("Error reading grid data.");
-      free(grid->fData);
-      return -1;
-    }
-  }
-
-  return 0;
-}
-
-/**
- * Load a grid of integers from the given file pointer.
- */
-int gLoadi(FILE *fp, Grid *grid)
-{
-  index_t div, mod;
-  int *p, *end;
-#ifndef __APPLE__
-  int result;
-#endif
-
-  // read NODATA value
-  if (fscanf(fp, "NODATA_value\t%d", &grid->iNODATA) != 1) {
-    perror("Could not read grid NODATA_value");
-    return -1;
-  }
-
-  // allocate grid
-  grid->data_size = sizeof(int);
-#ifdef __APPLE__
-  grid->iData = (int*) malloc(grid->nrow * grid->ncol * grid->data_size);
-  if (!grid->iData) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            errno, strerror(errno));
-#else
-  result = sysconf(_SC_PAGESIZE);
-  result = posix_memalign((void**)&grid->iData, result,
-                     grid->ncol * grid->nrow * grid->data_size);
-  if (result != 0) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            result, strerror(result));
-#endif
-    return -1;
-  }
-
-  // read grid raw data
-  div = (grid->nrow * grid->ncol) / 16;
-  mod = (grid->nrow * grid->ncol) % 16;
-  p = grid->iData;
-  end = grid->iData + grid->nrow * grid->ncol - mod;
-
-  // loop-unroll by 4
-  if (div > 0) {
-    while (p < end) {
-      p += 15;
-      if (fscanf(fp, "%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d ",
-                     p  , p--, p--, p--, p--, p--, p--, p--,
-                     p--, p--, p--, p--, p--, p--, p--, p--) != 16) {
-        perror("Error reading grid data");
-        free(grid->iData);
-        return -1;
-      }
-      p += 16;
-    }
-  }
-
-  // finish off the array
-  while (mod-- > 0) {
-    if (fscanf(fp, "%d ", p++) != 1) {
-      perror("Error reading grid data.");
-      free(grid->iData);
-      return -1;
-    }
-  }
-
-  return 0;
-}
-
-/**
- * Load a grid of unsigned integers from the given file pointer.
- */
-int gLoadui(FILE *fp, Grid *grid)
-{
-  index_t div, mod;
-  unsigned int *p, *end;
-#ifndef __APPLE__
-  int result;
-#endif
-
-  // read NODATA value
-  if (fscanf(fp, "NODATA_value\t%u", &grid->uiNODATA) != 1) {
-    perror("Could not read grid NODATA_value");
-    return -1;
-  }
-
-  // allocate grid
-  grid->data_size = sizeof(unsigned int);
-#ifdef __APPLE__
-  grid->uiData = (unsigned int*) malloc(grid->nrow * grid->ncol *
-                                        grid->data_size);
-  if (!grid->uiData) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            errno, strerror(errno));
-#else
-  result = sysconf(_SC_PAGESIZE);
-  result = posix_memalign((void**)&grid->uiData, result,
-                     grid->ncol * grid->nrow * grid->data_size);
-  if (result != 0) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            result, strerror(result));
-#endif
-    return -1;
-  }
-
-  // read grid raw data
-  div = (grid->nrow * grid->ncol) / 16;
-  mod = (grid->nrow * grid->ncol) % 16;
-  p = grid->uiData;
-  end = grid->uiData + grid->nrow * grid->ncol - mod;
-
-  // loop-unroll by 4
-  if (div > 0) {
-    while (p < end) {
-      p += 15;
-      if (fscanf(fp, "%u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u ",
-                     p  , p--, p--, p--, p--, p--, p--, p--,
-                     p--, p--, p--, p--, p--, p--, p--, p--) != 16) {
-        perror("Error reading grid data");
-        free(grid->uiData);
-        return -1;
-      }
-      p += 16;
-    }
-  }
-
-  // finish off the array
-  while (mod-- > 0) {
-    if (fscanf(fp, "%u ", p++) != 1) {
-      perror("Error reading grid data.");
-      free(grid->uiData);
-      return -1;
-    }
-  }
-
-  return 0;
-}
-
-/**
- * Load a grid of shorts from the given file pointer.
- */
-int gLoads(FILE *fp, Grid *grid)
-{
-  index_t div, mod;
-  short *p, *end;
-#ifndef __APPLE__
-  int result;
-#endif
-
-  // read NODATA value
-  if (fscanf(fp, "NODATA_value\t%hd", &grid->sNODATA) != 1) {
-    perror("Could not read grid NODATA_value");
-    return -1;
-  }
-
-  // allocate grid
-  grid->data_size = sizeof(short);
-#ifdef __APPLE__
-  grid->sData = (short*) malloc(grid->nrow * grid->ncol * grid->data_size);
-  if (!grid->sData) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            errno, strerror(errno));
-#else
-  result = sysconf(_SC_PAGESIZE);
-  result = posix_memalign((void**)&grid->sData, result,
-                     grid->ncol * grid->nrow * grid->data_size);
-  if (result != 0) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            result, strerror(result));
-#endif
-    return -1;
-  }
-
-  // read grid raw data
-  div = (grid->nrow * grid->ncol) / 16;
-  mod = (grid->nrow * grid->ncol) % 16;
-  p = grid->sData;
-  end = grid->sData + grid->nrow * grid->ncol - mod;
-
-  // loop-unroll by 4
-  if (div > 0) {
-    while (p < end) {
-      p += 15;
-      if (fscanf(fp, "%hd %hd %hd %hd %hd %hd %hd %hd "
-                     "%hd %hd %hd %hd %hd %hd %hd %hd ",
-                     p  , p--, p--, p--, p--, p--, p--, p--,
-                     p--, p--, p--, p--, p--, p--, p--, p--) != 16) {
-        perror("Error reading grid data");
-        free(grid->sData);
-        return -1;
-      }
-      p += 16;
-    }
-  }
-
-  // finish off the array
-  while (mod-- > 0) {
-    if (fscanf(fp, "%hd ", p++) != 1) {
-      perror("Error reading grid data.");
-      free(grid->sData);
-      return -1;
-    }
-  }
-
-  return 0;
-}
-
-/**
- * Load a grid of unsigned shorts from the given file pointer.
- */
-int gLoadus(FILE *fp, Grid *grid)
+// load the nrow x ncol window of a grid whose top left cell is (row, col)
+//   from a tiled grid only the tiles under the window are decoded
+DataSet* dLoadWindow(const char *path, enum GridDataType type, index_t row,
+                     index_t col, index_t nrow, index_t ncol)
 {
-  index_t div, mod;
-  unsigned short *p, *end;
-#ifndef __APPLE__
-  int result;
-#endif
-
-  // read NODATA value
-  if (fscanf(fp, "NODATA_value\t%hu", &grid->usNODATA) != 1) {
-    perror("Could not read grid NODATA_value");
-    return -1;
-  }
-
-  // allocate grid
-  grid->data_size = sizeof(unsigned short);
-#ifdef __APPLE__
-  grid->usData = (unsigned short*) malloc(grid->nrow * grid->ncol *
-                                          grid->data_size);
-  if (!grid->usData) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            errno, strerror(errno));
-#else
-  result = sysconf(_SC_PAGESIZE);
-  result = posix_memalign((void**)&grid->usData, result,
-                     grid->ncol * grid->nrow * grid->data_size);
-  if (result != 0) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            result, strerror(result));
-#endif
-    return -1;
-  }
+  DataSet* dset;
+  Grid *grid;
+  GridFile *gf;
 
-  // read grid raw data
-  div = (grid->nrow * grid->ncol) / 16;
-  mod = (grid->nrow * grid->ncol) % 16;
-  p = grid->usData;
-  end = grid->usData + grid->nrow * grid->ncol - mod;
-
-  // loop-unroll by 4
-  if (div > 0) {
-    while (p < end) {
-      p += 15;
-      if (fscanf(fp, "%hu %hu %hu %hu %hu %hu %hu %hu "
-                     "%hu %hu %hu %hu %hu %hu %hu %hu ",
-                     p  , p--, p--, p--, p--, p--, p--, p--,
-                     p--, p--, p--, p--, p--, p--, p--, p--) != 16) {
-        perror("Error reading grid data");
-        free(grid->usData);
-        return -1;
-      }
-      p += 16;
-    }
+  gf = gio_open(path);
+  if (!gf)
+    return NULL;
+  dset = dInit(nrow, ncol, type);
+  if (!dset || dSetPath(dset, path) != 0 ||
+      gio_read_window(gf, (enum gridio_type) type, row, col, nrow, ncol,
+                      dset->grid.fData) != 0) {
+    if (dset)
+      dFree(dset);
+    gio_close(gf);
+    return NULL;
   }
 
-  // finish off the array
-  while (mod-- > 0) {
-    if (fscanf(fp, "%hu ", p++) != 1) {
-      perror("Error reading grid data.");
-      free(grid->usData);
-      return -1;
-    }
+  // the window's own lower left corner
+  grid = &dset->grid;
+  grid->xllcorner = gf->hd.xllcorner + col * gf->hd.cellsize;
+  grid->yllcorner = gf->hd.yllcorner +
+                    (gf->hd.nrow - row - nrow) * gf->hd.cellsize;
+  grid->cellsize = gf->hd.cellsize;
+  switch (type) {
+    case FLOAT: grid->fNODATA  = gf->hd.nodata; break;
+    case INT:   grid->iNODATA  = gf->hd.nodata; break;
+    case UINT:  grid->uiNODATA = gf->hd.nodata; break;
+    case SHRT:  grid->sNODATA  = gf->hd.nodata; break;
+    case USHRT: grid->usNODATA = gf->hd.nodata; break;
+    case CHAR:  grid->cNODATA  = gf->hd.nodata; break;
+    case UCHAR: grid->ucNODATA = gf->hd.nodata; break;
   }
+  gio_close(gf);
 
-  return 0;
+  return dset;
 }
 
-/**
- * Load a grid of chars from the given file pointer.
- */
-int gLoadc(FILE *fp, Grid *grid)
+// allocate a DataSet with an empty path and no data array
+static DataSet* dNew(index_t nrow, index_t ncol, enum GridDataType type)
 {
-  index_t div, mod;
-  char *p, *end;
-#ifndef __APPLE__
-  int result;
-#endif
-
-  // read NODATA value
-  if (fscanf(fp, "NODATA_value\t%hhd", &grid->cNODATA) != 1) {
-    perror("Could not read grid NODATA_value");
-    return -1;
-  }
-
-  // allocate grid
-  grid->data_size = sizeof(char);
-#ifdef __APPLE__
-  grid->cData = (char*) malloc(grid->nrow * grid->ncol *
-                                          grid->data_size);
-  if (!grid->cData) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            errno, strerror(errno));
-#else
-  result = sysconf(_SC_PAGESIZE);
-  result = posix_memalign((void**)&grid->cData, result,
-                     grid->ncol * grid->nrow * grid->data_size);
-  if (result != 0) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            result, strerror(result));
-#endif
-    return -1;
-  }
+  DataSet* dset;
 
-  // read grid raw data
-  div = (grid->nrow * grid->ncol) / 16;
-  mod = (grid->nrow * grid->ncol) % 16;
-  p = grid->cData;
-  end = grid->cData + grid->nrow * grid->ncol - mod;
-
-  // loop-unroll by 4
-  if (div > 0) {
-    while (p < end) {
-      p += 15;
-      if (fscanf(fp, "%hhd %hhd %hhd %hhd %hhd %hhd %hhd %hhd "
-                     "%hhd %hhd %hhd %hhd %hhd %hhd %hhd %hhd ",
-                     p  , p--, p--, p--, p--, p--, p--, p--,
-                     p--, p--, p--, p--, p--, p--, p--, p--) != 16) {
-        perror("Error reading grid data");
-        free(grid->cData);
-        return -1;
-      }
-      p += 16;
-    }
+  dset = (DataSet*) malloc(sizeof(DataSet));
+  if (dset == NULL) {
+    perror("Unable to allocate DataSet object");
+    return NULL;
   }
-
-  // finish off the array
-  while (mod-- > 0) {
-    if (fscanf(fp, "%hhd ", p++) != 1) {
-      perror("Error reading grid data.");
-      free(grid->cData);
-      return -1;
-    }
+  dset->path = (char*) malloc(1);
+  if (dset->path == NULL) {
+    perror("Unable to allocate path string");
+    free(dset);
+    return NULL;
   }
-
-  return 0;
+  dset->path[0] = '\0';
+  dset->file = NULL;
+  dset->mapped = 0;
+
+  dset->grid.nrow = nrow;
+  dset->grid.ncol = ncol;
+  dset->grid.type = type;
+  dset->grid.data_size = gio_size((enum gridio_type) type);
+  dset->grid.fData = NULL;
+  dset->grid.valid = NULL;
+  return dset;
 }
 
-/**
- * Load a grid of unsigned chars from the given file pointer.
- */
-int gLoaduc(FILE *fp, Grid *grid)
+// replace the path of a DataSet
+static int dSetPath(DataSet *dset, const char *path)
 {
-  index_t div, mod;
-  unsigned char *p, *end;
-#ifndef __APPLE__
-  int result;
-#endif
+  char *tmp;
 
-  // read NODATA value
-  if (fscanf(fp, "NODATA_value\t%hhu", &grid->ucNODATA) != 1) {
-    perror("Could not read grid NODATA_value");
+  tmp = (char*) realloc(dset->path, strlen(path) + 1);
+  if (!tmp) {
+    perror("Couldn't reallocate path string");
     return -1;
   }
-
-  // allocate grid
-  grid->data_size = sizeof(unsigned char);
-#ifdef __APPLE__
-  grid->ucData = (unsigned char*) malloc(grid->nrow * grid->ncol *
-                                          grid->data_size);
-  if (!grid->ucData) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            errno, strerror(errno));
-#else
-  result = sysconf(_SC_PAGESIZE);
-  result = posix_memalign((void**)&grid->ucData, result,
-                     grid->ncol * grid->nrow * grid->data_size);
-  if (result != 0) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            result, strerror(result));
-#endif
-    return -1;
-  }
-
-  // read grid raw data
-  div = (grid->nrow * grid->ncol) / 16;
-  mod = (grid->nrow * grid->ncol) % 16;
-  p = grid->ucData;
-  end = grid->ucData + grid->nrow * grid->ncol - mod;
-
-  // loop-unroll by 4
-  if (div > 0) {
-    while (p < end) {
-      p += 15;
-      if (fscanf(fp, "%hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu "
-                     "%hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu ",
-                     p  , p--, p--, p--, p--, p--, p--, p--,
-                     p--, p--, p--, p--, p--, p--, p--, p--) != 16) {
-        perror("Error reading grid data");
-        free(grid->ucData);
-        return -1;
-      }
-      p += 16;
-    }
-  }
-
-  // finish off the array
-  while (mod-- > 0) {
-    if (fscanf(fp, "%hhu ", p++) != 1) {
-      perror("Error reading grid data.");
-      free(grid->ucData);
-      return -1;
-    }
-  }
-
+  dset->path = tmp;
+  strcpy(dset->path, path);
   return 0;
 }
 
-
 DataSet* dInit(index_t nrow, index_t ncol, enum GridDataType type)
 {
   DataSet* dset;
@@ -613,28 +207,21 @@ DataSet* dInit(index_t nrow, index_t ncol, enum GridDataType type)
   int align, result;
 
   // allocate a new DataSet object
-  dset = (DataSet*) malloc(sizeof(DataSet));
-  if (dset == NULL) {
-    perror("Unable to allocate DataSet object");
-    return NULL;
-  }
-  dset->path = (char*) malloc(1);
-  if (dset->path == NULL) {
-    perror("Unable to allocate path string");
-    free(dset);
+  dset = dNew(nrow, ncol, type);
+  if (dset == NULL)
     return NULL;
-  }
-  dset->path[0] = '\0';
-
   grid = &dset->grid;
-  grid->nrow = nrow;
-  grid->ncol = ncol;
-  
+
   // allocate (empty) data array
   result = -1;
   align = sysconf(_SC_PAGESIZE);
   grid->type = type;
-  switch (type) {
+  if (alloc_policy != ALLOC_DEFAULT) {
+    // every member of the data union is the same pointer
+    grid->fData = (float*) dAlloc(dset, nrow * ncol * grid->data_size);
+    if (grid->fData)
+      result = 0;
+  }else switch (type) {
     case FLOAT:
       grid->data_size = sizeof(float);
 #ifdef __APPLE__
@@ -723,27 +310,117 @@ DataSet* dInit(index_t nrow, index_t ncol, enum GridDataType type)
   return dset;
 }
 
-// storage functions for each type
-int gStoref (FILE *fp, Grid *grid);
-int gStorei (FILE *fp, Grid *grid);
-int gStoreui(FILE *fp, Grid *grid);
-int gStores (FILE *fp, Grid *grid);
-int gStoreus(FILE *fp, Grid *grid);
-int gStorec (FILE *fp, Grid *grid);
-int gStoreuc(FILE *fp, Grid *grid);
+void dSetAlloc(int policy, int nthread)
+{
+  assert(policy >= 0 && policy <= (ALLOC_HUGE|ALLOC_INTERLEAVE|ALLOC_FIRSTTOUCH));
+  alloc_policy = policy;
+  alloc_nthread = nthread > 0 ? nthread : 1;
+}
+
+int dAllocParse(const char *name)
+{
+  const char *end;
+  size_t len;
+  int policy;
+
+  if (strcmp(name, "default") == 0)
+    return ALLOC_DEFAULT;
+  policy = 0;
+  while (*name) {
+    end = strchr(name, ',');
+    len = end ? (size_t) (end - name) : strlen(name);
+    if (len == 4 && strncmp(name, "huge", len) == 0)
+      policy |= ALLOC_HUGE;
+    else if (len == 10 && strncmp(name, "interleave", len) == 0)
+      policy |= ALLOC_INTERLEAVE;
+    else if (len == 10 && strncmp(name, "firsttouch", len) == 0)
+      policy |= ALLOC_FIRSTTOUCH;
+    else
+      return -1;
+    name += end ? len + 1 : len;
+  }
+  return policy ? policy : -1;
+}
+
+// a band of an array for a thread to touch
+typedef struct touch_band_t {
+  char *begin;
+  char *end;
+} TouchBand;
+
+static void* dTouch(void *closure)
+{
+  TouchBand *band;
+  char *p;
+  long page;
+
+  band = (TouchBand*) closure;
+  page = sysconf(_SC_PAGESIZE);
+  for (p = band->begin; p < band->end; p += page)
+    *p = 0;
+  return NULL;
+}
+
+// map an array as the allocation policy asks, recording it in dset
+//   the first touch splits it into alloc_nthread bands of whole rows, as the
+//   threaded commands split their work
+static void* dAlloc(DataSet *dset, size_t bytes)
+{
+  Vector *bands;
+  TouchBand band;
+  char *data;
+  size_t row, rows;
+  int i;
+
+  data = (char*) gio_alloc(bytes, alloc_policy &
+                           (ALLOC_HUGE | ALLOC_INTERLEAVE));
+  if (!data)
+    return NULL;
+  dset->mapped = bytes;
+
+  if ((alloc_policy & ALLOC_FIRSTTOUCH) && alloc_nthread > 1 && bytes > 0) {
+    row = dset->grid.ncol * dset->grid.data_size;
+    rows = (dset->grid.nrow + alloc_nthread - 1) / alloc_nthread;
+    bands = vinit2(sizeof(TouchBand), alloc_nthread);
+    for (i = 0; i < alloc_nthread; i++) {
+      band.begin = data + (i * rows < dset->grid.nrow ?
+                           i * rows : dset->grid.nrow) * row;
+      band.end = data + ((i + 1) * rows < dset->grid.nrow ?
+                         (i + 1) * rows : dset->grid.nrow) * row;
+      vappend(bands, &band);
+    }
+    run_threads(alloc_nthread, dTouch, bands);
+    vfree(bands);
+  }
+  return data;
+}
 
 /**
  * Store a DataSet containing a grid of any valid type in a file at the given
  * location.
  *
- * Stores data in Arc/Info ASCII Grid format.
+ * Stores data in Arc/Info ASCII Grid format with floats rounded to integers,
+ * as a checksummed binary grid when the path ends in GIO_BIN_SUFFIX, or as a
+ * tiled grid when it ends in GIO_TILE_SUFFIX.
  */
 int dStore(DataSet *dset, const char *path)
+{
+  if (gio_wants_binary(path))
+    return dStoreBinary(dset, path, GIO_BIN_CHECKSUM);
+  if (gio_wants_tiled(path))
+    return dStoreTiled(dset, path);
+  return dStoreAscii(dset, path, 0);
+}
+
+/**
+ * Store a DataSet in Arc/Info ASCII Grid format, with prec decimals for
+ * floats (see gio_write_rows()).
+ */
+int dStoreAscii(DataSet *dset, const char *path, int prec)
 {
   static Rtimer rt;
   FILE *fp;
   Grid *grid;
-  char *tmp;
   int result;
 
   rt_start(rt);
@@ -760,16 +437,10 @@ int dStore(DataSet *dset, const char *path)
   }
 
   // set path
-  if (strlen(dset->path) != strlen(path)) {
-    tmp = realloc(dset->path, strlen(path));
-    if (!tmp) {
-      perror("Couldn't reallocate path string");
-      fclose(fp);
-      return -1;
-    }
-    dset->path = tmp;
+  if (dSetPath(dset, path) != 0) {
+    fclose(fp);
+    return -1;
   }
-  strcpy(dset->path, path);
 
   // store meta data
   fprintf(fp, "ncols         " DGI_FMT "\n", grid->ncol);
@@ -778,18 +449,35 @@ int dStore(DataSet *dset, const char *path)
   fprintf(fp, "yllcorner     %.f\n", grid->yllcorner);
   fprintf(fp, "cellsize      %.f\n", grid->cellsize);
 
+  // store NODATA value
   result = -1;
   switch (grid->type) {
-    case FLOAT: result = gStoref (fp, grid); break;
-    case INT:   result = gStorei (fp, grid); break;
-    case UINT:  result = gStoreui(fp, grid); break;
-    case SHRT:  result = gStores (fp, grid); break;
-    case USHRT: result = gStoreus(fp, grid); break;
-    case CHAR:  result = gStorec (fp, grid); break;
-    case UCHAR: result = gStoreuc(fp, grid); break;
+    case FLOAT:
+      result = fprintf(fp, "NODATA_value  %.f\n", grid->fNODATA); break;
+    case INT:
+      result = fprintf(fp, "NODATA_value  %d\n", grid->iNODATA); break;
+    case UINT:
+      result = fprintf(fp, "NODATA_value  %u\n", grid->uiNODATA); break;
+    case SHRT:
+      result = fprintf(fp, "NODATA_value  %hd\n", grid->sNODATA); break;
+    case USHRT:
+      result = fprintf(fp, "NODATA_value  %hu\n", grid->usNODATA); break;
+    case CHAR:
+      result = fprintf(fp, "NODATA_value  %hhd\n", grid->cNODATA); break;
+    case UCHAR:
+      result = fprintf(fp, "NODATA_value  %hhu\n", grid->ucNODATA); break;
     default: fprintf(stderr,
                      "Invalid type set in DataSet argument to dStore()?\n");
   }
+  if (result <= 0) {
+    perror("Could not write grid NODATA_value");
+    fclose(fp);
+    return -1;
+  }
+
+  // store grid raw data; every member of the data union is the same pointer
+  result = gio_write_rows(fp, (enum gridio_type) grid->type, grid->fData,
+                          grid->nrow, grid->ncol, prec, 0);
   if (result != 0) {
     fclose(fp);
     return -1;
@@ -807,391 +495,103 @@ int dStore(DataSet *dset, const char *path)
 }
 
 
-int gStoref(FILE *fp, Grid *grid)
+// fill a gridio header from a grid
+static void dHeader(Grid *grid, GridIOHeader *hd)
 {
-  index_t div, mod, i, c;
-  float *p, *end;
-
-  // read NODATA value
-  if (fprintf(fp, "NODATA_value  %.f\n", grid->fNODATA) <= 0) {
-    perror("Could not write grid NODATA_value");
-    return -1;
-  }
-
-  // read grid raw data
-  div = grid->ncol / 16;
-  mod = grid->ncol % 16;
-  c = 0;
-  p = grid->fData;
-  end = grid->fData + grid->nrow * grid->ncol - mod;
-
-  while (p < end) {
-    // loop-unroll by 4
-    if (div > 0) {
-      c = 0;
-      i = grid->ncol - mod;
-      while (c < i) {
-        p += 15;
-        if (fprintf(fp, "%.f %.f %.f %.f %.f %.f %.f %.f "
-                        "%.f %.f %.f %.f %.f %.f %.f %.f ",
-                        *p  , *p--, *p--, *p--, *p--, *p--, *p--, *p--,
-                        *p--, *p--, *p--, *p--, *p--, *p--, *p--, *p--) <= 0) {
-          perror("Error writing grid data");
-          return -1;
-        }
-        c += 16;
-        p += 16;
-      }
-    }
-    // finish off the row
-    i = mod;
-    while (i-- > 0) {
-      if (fprintf(fp, "%.f ", *p++) <= 0) {
-        perror("Error writing grid data.");
-        return -1;
-      }
-    }
-    // print endline character
-    if (fprintf(fp, "\n") <= 0) {
-      perror("Error writing grid data.");
-      return -1;
-    }
-  }
-
-  return 0;
+  memset(hd, 0, sizeof(*hd));
+  hd->nrow = grid->nrow;
+  hd->ncol = grid->ncol;
+  hd->xllcorner = grid->xllcorner;
+  hd->yllcorner = grid->yllcorner;
+  hd->cellsize = grid->cellsize;
+  switch (grid->type) {
+    case FLOAT: hd->nodata = grid->fNODATA;  break;
+    case INT:   hd->nodata = grid->iNODATA;  break;
+    case UINT:  hd->nodata = grid->uiNODATA; break;
+    case SHRT:  hd->nodata = grid->sNODATA;  break;
+    case USHRT: hd->nodata = grid->usNODATA; break;
+    case CHAR:  hd->nodata = grid->cNODATA;  break;
+    case UCHAR: hd->nodata = grid->ucNODATA; break;
+  }
+  hd->has_nodata = 1;
 }
 
-int gStorei(FILE *fp, Grid *grid)
+/**
+ * Store a DataSet as a binary grid: the header, then the raw data array
+ * starting on a page boundary, then (with GIO_BIN_CHECKSUM) a crc32 per row.
+ * dLoad() maps such a file back without parsing or copying.
+ */
+int dStoreBinary(DataSet *dset, const char *path, int flags)
 {
-  index_t div, mod, i, c;
-  int *p, *end;
-
-  // read NODATA value
-  if (fprintf(fp, "NODATA_value  %d\n", grid->iNODATA) <= 0) {
-    perror("Could not write grid NODATA_value");
-    return -1;
-  }
+  static Rtimer rt;
+  GridIOHeader hd;
+  Grid *grid;
 
-  // read grid raw data
-  div = grid->ncol / 16;
-  mod = grid->ncol % 16;
-  c = 0;
-  p = grid->iData;
-  end = grid->iData + grid->nrow * grid->ncol - mod;
-
-  while (p < end) {
-    // loop-unroll by 4
-    if (div > 0) {
-      c = 0;
-      i = grid->ncol - mod;
-      while (c < i) {
-        p += 15;
-        if (fprintf(fp, "%d %d %d %d %d %d %d %d "
-                        "%d %d %d %d %d %d %d %d ",
-                        *p  , *p--, *p--, *p--, *p--, *p--, *p--, *p--,
-                        *p--, *p--, *p--, *p--, *p--, *p--, *p--, *p--) <= 0) {
-          perror("Error writing grid data");
-          return -1;
-        }
-        c += 16;
-        p += 16;
-      }
-    }
-    // finish off the row
-    i = mod;
-    while (i-- > 0) {
-      if (fprintf(fp, "%d ", *p++) <= 0) {
-        perror("Error writing grid data.");
-        return -1;
-      }
-    }
-    // print endline character
-    if (fprintf(fp, "\n") <= 0) {
-      perror("Error writing grid data.");
-      return -1;
-    }
-  }
+  rt_start(rt);
 
-  return 0;
-}
+  assert(dset);
+  assert(dset->path);
 
-int gStoreui(FILE *fp, Grid *grid)
-{
-  index_t div, mod, i, c;
-  unsigned int *p, *end;
+  grid = &dset->grid;
+  dHeader(grid, &hd);
 
-  // read NODATA value
-  if (fprintf(fp, "NODATA_value  %u\n", grid->uiNODATA) <= 0) {
-    perror("Could not write grid NODATA_value");
+  if (gio_write_binary(path, &hd, (enum gridio_type) grid->type, grid->fData,
+                       flags) != 0)
     return -1;
-  }
-
-  // read grid raw data
-  div = grid->ncol / 16;
-  mod = grid->ncol % 16;
-  c = 0;
-  p = grid->uiData;
-  end = grid->uiData + grid->nrow * grid->ncol - mod;
-
-  while (p < end) {
-    // loop-unroll by 4
-    if (div > 0) {
-      c = 0;
-      i = grid->ncol - mod;
-      while (c < i) {
-        p += 15;
-        if (fprintf(fp, "%u %u %u %u %u %u %u %u "
-                        "%u %u %u %u %u %u %u %u ",
-                        *p  , *p--, *p--, *p--, *p--, *p--, *p--, *p--,
-                        *p--, *p--, *p--, *p--, *p--, *p--, *p--, *p--) <= 0) {
-          perror("Error writing grid data");
-          return -1;
-        }
-        c += 16;
-        p += 16;
-      }
-    }
-    // finish off the row
-    i = mod;
-    while (i-- > 0) {
-      if (fprintf(fp, "%u ", *p++) <= 0) {
-        perror("Error writing grid data.");
-        return -1;
-      }
-    }
-    // print endline character
-    if (fprintf(fp, "\n") <= 0) {
-      perror("Error writing grid data.");
-      return -1;
-    }
-  }
-
-  return 0;
-}
-
-int gStores(FILE *fp, Grid *grid)
-{
-  index_t div, mod, i, c;
-  short *p, *end;
-
-  // read NODATA value
-  if (fprintf(fp, "NODATA_value  %hd\n", grid->sNODATA) <= 0) {
-    perror("Could not write grid NODATA_value");
+  if (dSetPath(dset, path) != 0)
     return -1;
-  }
 
-  // read grid raw data
-  div = grid->ncol / 16;
-  mod = grid->ncol % 16;
-  c = 0;
-  p = grid->sData;
-  end = grid->sData + grid->nrow * grid->ncol - mod;
-
-  while (p < end) {
-    // loop-unroll by 4
-    if (div > 0) {
-      c = 0;
-      i = grid->ncol - mod;
-      while (c < i) {
-        p += 15;
-        if (fprintf(fp, "%hd %hd %hd %hd %hd %hd %hd %hd "
-                        "%hd %hd %hd %hd %hd %hd %hd %hd ",
-                        *p  , *p--, *p--, *p--, *p--, *p--, *p--, *p--,
-                        *p--, *p--, *p--, *p--, *p--, *p--, *p--, *p--) <= 0) {
-          perror("Error writing grid data");
-          return -1;
-        }
-        c += 16;
-        p += 16;
-      }
-    }
-    // finish off the row
-    i = mod;
-    while (i-- > 0) {
-      if (fprintf(fp, "%hd ", *p++) <= 0) {
-        perror("Error writing grid data.");
-        return -1;
-      }
-    }
-    // print endline character
-    if (fprintf(fp, "\n") <= 0) {
-      perror("Error writing grid data.");
-      return -1;
-    }
-  }
+  rt_stop(rt);
+  static char buf[256];
+  rt_sprint(buf, rt);
+  printf("dStoreBinary(grid,'%s'):\t%s\n", path, buf);
 
   return 0;
 }
 
-int gStoreus(FILE *fp, Grid *grid)
-{
-  index_t div, mod, i, c;
-  unsigned short *p, *end;
-
-  // read NODATA value
-  if (fprintf(fp, "NODATA_value  %hu\n", grid->usNODATA) <= 0) {
-    perror("Could not write grid NODATA_value");
-    return -1;
-  }
 
-  // read grid raw data
-  div = grid->ncol / 16;
-  mod = grid->ncol % 16;
-  c = 0;
-  p = grid->usData;
-  end = grid->usData + grid->nrow * grid->ncol - mod;
-
-  while (p < end) {
-    // loop-unroll by 4
-    if (div > 0) {
-      c = 0;
-      i = grid->ncol - mod;
-      while (c < i) {
-        p += 15;
-        if (fprintf(fp, "%hu %hu %hu %hu %hu %hu %hu %hu "
-                        "%hu %hu %hu %hu %hu %hu %hu %hu ",
-                        *p  , *p--, *p--, *p--, *p--, *p--, *p--, *p--,
-                        *p--, *p--, *p--, *p--, *p--, *p--, *p--, *p--) <= 0) {
-          perror("Error writing grid data");
-          return -1;
-        }
-        c += 16;
-        p += 16;
-      }
-    }
-    // finish off the row
-    i = mod;
-    while (i-- > 0) {
-      if (fprintf(fp, "%hu ", *p++) <= 0) {
-        perror("Error writing grid data.");
-        return -1;
-      }
-    }
-    // print endline character
-    if (fprintf(fp, "\n") <= 0) {
-      perror("Error writing grid data.");
-      return -1;
-    }
-  }
-
-  return 0;
-}
-
-int gStorec(FILE *fp, Grid *grid)
+/**
+ * Store a DataSet as a tiled grid: GIO_TILE-square tiles, each compressed on
+ * its own, so a window of the grid can be read back without the rest.
+ */
+int dStoreTiled(DataSet *dset, const char *path)
 {
-  index_t div, mod, i, c;
-  char *p, *end;
-
-  // read NODATA value
-  if (fprintf(fp, "NODATA_value  %hhd\n", grid->cNODATA) <= 0) {
-    perror("Could not write grid NODATA_value");
-    return -1;
-  }
-
-  // read grid raw data
-  div = grid->ncol / 16;
-  mod = grid->ncol % 16;
-  c = 0;
-  p = grid->cData;
-  end = grid->cData + grid->nrow * grid->ncol - mod;
-
-  while (p < end) {
-    // loop-unroll by 4
-    if (div > 0) {
-      c = 0;
-      i = grid->ncol - mod;
-      while (c < i) {
-        p += 15;
-        if (fprintf(fp, "%hhd %hhd %hhd %hhd %hhd %hhd %hhd %hhd "
-                        "%hhd %hhd %hhd %hhd %hhd %hhd %hhd %hhd ",
-                        *p  , *p--, *p--, *p--, *p--, *p--, *p--, *p--,
-                        *p--, *p--, *p--, *p--, *p--, *p--, *p--, *p--) <= 0) {
-          perror("Error writing grid data");
-          return -1;
-        }
-        c += 16;
-        p += 16;
-      }
-    }
-    // finish off the row
-    i = mod;
-    while (i-- > 0) {
-      if (fprintf(fp, "%hhd ", *p++) <= 0) {
-        perror("Error writing grid data.");
-        return -1;
-      }
-    }
-    // print endline character
-    if (fprintf(fp, "\n") <= 0) {
-      perror("Error writing grid data.");
-      return -1;
-    }
-  }
+  static Rtimer rt;
+  GridIOHeader hd;
+  Grid *grid;
 
-  return 0;
-}
+  rt_start(rt);
 
-int gStoreuc(FILE *fp, Grid *grid)
-{
-  index_t div, mod, i, c;
-  unsigned char *p, *end;
+  assert(dset);
+  assert(dset->path);
 
-  // read NODATA value
-  if (fprintf(fp, "NODATA_value  %hhu\n", grid->ucNODATA) <= 0) {
-    perror("Could not write grid NODATA_value");
+  grid = &dset->grid;
+  dHeader(grid, &hd);
+  if (gio_write_tiled(path, &hd, (enum gridio_type) grid->type, grid->fData,
+                      0) != 0)
+    return -1;
+  if (dSetPath(dset, path) != 0)
     return -1;
-  }
 
-  // read grid raw data
-  div = grid->ncol / 16;
-  mod = grid->ncol % 16;
-  c = 0;
-  p = grid->ucData;
-  end = grid->ucData + grid->nrow * grid->ncol - mod;
-
-  while (p < end) {
-    // loop-unroll by 4
-    if (div > 0) {
-      c = 0;
-      i = grid->ncol - mod;
-      while (c < i) {
-        p += 15;
-        if (fprintf(fp, "%hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu "
-                        "%hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu ",
-                        *p  , *p--, *p--, *p--, *p--, *p--, *p--, *p--,
-                        *p--, *p--, *p--, *p--, *p--, *p--, *p--, *p--) <= 0) {
-          perror("Error writing grid data");
-          return -1;
-        }
-        c += 16;
-        p += 16;
-      }
-    }
-    // finish off the row
-    i = mod;
-    while (i-- > 0) {
-      if (fprintf(fp, "%hhu ", *p++) <= 0) {
-        perror("Error writing grid data.");
-        return -1;
-      }
-    }
-    // print endline character
-    if (fprintf(fp, "\n") <= 0) {
-      perror("Error writing grid data.");
-      return -1;
-    }
-  }
+  rt_stop(rt);
+  static char buf[256];
+  rt_sprint(buf, rt);
+  printf("dStoreTiled(grid,'%s'):\t%s\n", path, buf);
 
   return 0;
 }
 
-
 void dFree(DataSet *dset)
 {
   assert(dset);
   assert(dset->path);
 
-  switch (dset->grid.type) {
+  if (dset->file)
+    // the data lives in the mapped file
+    gio_close(dset->file);
+  else if (dset->mapped)
+    gio_free(dset->grid.fData, dset->mapped);
+  else switch (dset->grid.type) {
     case FLOAT: free(dset->grid.fData);  break;
     case INT:   free(dset->grid.iData);  break;
     case UINT:  free(dset->grid.uiData); break;
@@ -1201,22 +601,30 @@ void dFree(DataSet *dset)
     case UCHAR: free(dset->grid.ucData); break;
   }
 
+  gio_valid_free(dset->grid.valid);
   free(dset->path);
   free(dset);
 }
 
+GridValid* gValid(Grid *grid)
+{
+  if (!grid->valid)
+    // the NODATA union and the data union both start with the value itself,
+    //   whatever the type
+    grid->valid = gio_valid((enum gridio_type) grid->type, grid->fData,
+                            grid->nrow, grid->ncol, &grid->fNODATA);
+  return grid->valid;
+}
+
 
 // Calculate Grid statistics - min, max, average, standard deviation
 
 const int INITIAL_LEN = I_AVG;
 
-double *gStatf(Grid *grid, int level)
+// allocate and start an info array for gStatf() and dStatf()
+static double *gStatfInit(int level)
 {
-  double *info, dev;
-  float *p, *pend;
-
-  assert(grid->type == FLOAT);
-  assert(grid->nrow * grid->ncol >= 1);
+  double *info;
 
   info = (double*) malloc((INITIAL_LEN + level) * sizeof(double));
   assert(info);
@@ -1231,11 +639,19 @@ double *gStatf(Grid *grid, int level)
       info[I_MAX] = -FLT_MAX;
       info[I_MINI] = info[I_MAXI] = 0;
   }
+  return info;
+}
 
-  p = grid->fData;
-  pend = p + grid->nrow * grid->ncol;
-  for (; p < pend; p++) {
-    if (*p == grid->fNODATA)
+// fold the values in [begin, end) into info; begin is value number first of
+//   the grid
+static void gStatfUpdate(double *info, int level, const float *begin,
+                         const float *end, float nodata, double first)
+{
+  const float *p;
+  double dev;
+
+  for (p = begin; p < end; p++) {
+    if (*p == nodata)
       continue;
 
     // increment the count of actual data points
@@ -1252,13 +668,37 @@ double *gStatf(Grid *grid, int level)
 
     if (*p < info[I_MIN]) {
       info[I_MIN] = *p;
-      info[I_MINI] = p - grid->fData;
+      info[I_MINI] = first + (p - begin);
     }
     if (*p > info[I_MAX]) {
       info[I_MAX] = *p;
-      info[I_MAXI] = p - grid->fData;
+      info[I_MAXI] = first + (p - begin);
     }
   }
+}
+
+double *gStatf(Grid *grid, int level)
+{
+  GridValid *valid;
+  uint64_t r, c, end;
+  double *info;
+
+  assert(grid->type == FLOAT);
+  assert(grid->nrow * grid->ncol >= 1);
+
+  info = gStatfInit(level);
+  if (!(valid = gValid(grid)))
+    gStatfUpdate(info, level, grid->fData,
+                 grid->fData + grid->nrow * grid->ncol, grid->fNODATA, 0);
+  else
+    // only the runs of data, in the same order, so nothing changes but the
+    //   NODATA that is never looked at
+    for (r = valid->r0; r < valid->r1; r++)
+      for (c = gio_valid_run(valid, r, 0, &end); c < valid->ncol;
+           c = gio_valid_run(valid, r, end, &end))
+        gStatfUpdate(info, level, grid->fData + r * grid->ncol + c,
+                     grid->fData + r * grid->ncol + end, grid->fNODATA,
+                     (double) r * grid->ncol + c);
 
   if (level == STD && info[I_N] > 1)
     info[I_STD] /= info[I_N] - 1;
@@ -1266,6 +706,52 @@ double *gStatf(Grid *grid, int level)
   return info;
 }
 
+// as gStatf() for the grid in a file, read a block of rows at a time so it
+//   never has to fit in memory
+double *dStatf(const char *path, int level)
+{
+  static Rtimer rt;
+  GridStream *gs;
+  const void *rows;
+  double *info;
+  int64_t n;
+  uint64_t ncol;
+
+  rt_start(rt);
+
+  gs = gio_stream_open(path, GIO_FLOAT, 0);
+  if (!gs)
+    return NULL;
+  if (!gs->gf->hd.has_nodata) {
+    fprintf(stderr, "Could not read grid NODATA_value (%s).\n", path);
+    gio_stream_close(gs);
+    return NULL;
+  }
+  ncol = gs->gf->hd.ncol;
+  assert(gs->gf->hd.nrow * ncol >= 1);
+
+  info = gStatfInit(level);
+  while ((n = gio_stream_next(gs, &rows)) > 0)
+    gStatfUpdate(info, level, (const float*) rows,
+                 (const float*) rows + n * ncol, gs->gf->hd.nodata,
+                 (double) (gs->row - n) * ncol);
+  gio_stream_close(gs);
+  if (n < 0) {
+    free(info);
+    return NULL;
+  }
+
+  if (level == STD && info[I_N] > 1)
+    info[I_STD] /= info[I_N] - 1;
+
+  rt_stop(rt);
+  static char buf[256];
+  rt_sprint(buf, rt);
+  printf("dStatf('%s',%d):\t%s\n", path, level, buf);
+
+  return info;
+}
+
 double *gStati(Grid *grid, int level)
 {
   double *info, dev;
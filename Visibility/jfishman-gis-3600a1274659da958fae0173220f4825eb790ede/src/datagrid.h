@@ -18,6 +18,7 @@
 
 #include <sys/types.h>
 #include <stddef.h>
+#include "gridio.h"
 
 #ifndef index_t
 #  if __GLIBC_HAVE_LONG_LONG
@@ -66,6 +67,7 @@ typedef struct grid_t {
       char *cData;
       unsigned char *ucData;
   };
+  GridValid *valid;  // where the data is, once gValid() has worked it out
 } Grid;
 
 // struct representing a data set, loaded
@@ -73,20 +75,68 @@ typedef struct grid_t {
 typedef struct dataset_t {
   char* path;
   struct grid_t grid;
+  GridFile *file;   // binary grid the data is mapped from, or NULL
+  size_t mapped;    // bytes of the gio_alloc() mapping the data is in, or 0
 } DataSet;
 
+// how dInit() (and dLoad(), unless it maps a binary grid) allocates data
+//   arrays, or'ed together; the default is page aligned malloc memory
+//   ALLOC_HUGE        back the array with huge pages, see gio_alloc()
+//   ALLOC_INTERLEAVE  spread its pages round robin over the NUMA nodes
+//   ALLOC_FIRSTTOUCH  have the worker threads write its rows first, a band
+//                     each, so each band lands on the node of its thread
+enum GridAlloc {
+  ALLOC_DEFAULT    = 0,
+  ALLOC_HUGE       = GIO_ALLOC_HUGE,
+  ALLOC_INTERLEAVE = GIO_ALLOC_INTERLEAVE,
+  ALLOC_FIRSTTOUCH = 4
+};
+
+// set the allocation policy for later data arrays; nthread is how many
+//   threads ALLOC_FIRSTTOUCH touches them with
+void dSetAlloc(int policy, int nthread);
+
+// parse a policy named as "default" or a comma separated list of "huge",
+//   "interleave" and "firsttouch"; returns -1 for anything else
+int dAllocParse(const char *name);
+
 // load data from file into the data set
+//   either format is accepted; a binary grid already of the given type is
+//   mapped rather than read, so loading it costs no time up front
 DataSet* dLoad(const char *path, enum GridDataType type);
 
+// load only the nrow x ncol window of a grid whose top left cell is
+//   (row, col); cheap for tiled grids, which decode just the tiles under it
+DataSet* dLoadWindow(const char *path, enum GridDataType type, index_t row,
+                     index_t col, index_t nrow, index_t ncol);
+
 // initialize an empty data grid
 DataSet* dInit(index_t nrow, index_t ncol, enum GridDataType type);
 
 // store a data set to file
+//   in binary when the path ends in GIO_BIN_SUFFIX, tiled when it ends in
+//   GIO_TILE_SUFFIX, ArcASCII otherwise
 int dStore(DataSet *dset, const char* path);
 
+// store a data set to file as ArcASCII, floats with prec decimals or, with
+//   GIO_SHORTEST, as few as read back the same
+int dStoreAscii(DataSet *dset, const char *path, int prec);
+
+// store a data set to file as a binary grid; flags as for gio_write_binary()
+int dStoreBinary(DataSet *dset, const char *path, int flags);
+
+// store a data set to file as a tiled, compressed grid
+int dStoreTiled(DataSet *dset, const char *path);
+
 // free the memory allocated for a data set
 void dFree(DataSet *dset);
 
+// where the grid holds data rather than NODATA, worked out on the first call
+//   and kept until the data set is freed; NULL if it couldn't be.  Not safe
+//   to call from several threads at once for the same grid, so the threaded
+//   routines call it before they start
+GridValid* gValid(Grid *grid);
+
 
 // calculate certain important information about a data grid
 //   runs through the data array and calculates at the following levels
@@ -100,6 +150,9 @@ double *gStats (Grid *data, int level);
 double *gStatus(Grid *data, int level);
 double *gStatc (Grid *data, int level);
 double *gStatuc(Grid *data, int level);
+// as gStatf() for the grid in a file, streamed through a block of rows at
+//   a time instead of loaded
+double *dStatf(const char *path, int level);
 // processing level option
 enum {
   MINMAX = 0,
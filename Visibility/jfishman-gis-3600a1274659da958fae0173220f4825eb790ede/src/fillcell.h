@@ -0,0 +1,32 @@
+#ifndef _FILLCELL_H
+#define _FILLCELL_H
+
+
+#include "datagrid.h"
+
+/* a cell waiting to be flooded by flow_fill(): its (possibly raised)
+   elevation and its index in the grid */
+typedef struct fill_cell_t {
+  float elev;
+  index_t i;
+} FillCell;
+
+/* lower elevation first; ties go to the lower index, so fills are
+   repeatable */
+static inline int compare_FillCell(FillCell a, FillCell b) {
+  if (a.elev != b.elev)
+    return a.elev < b.elev ? -1 : 1;
+  if (a.i != b.i)
+    return a.i < b.i ? -1 : 1;
+  return 0;
+}
+
+/* the definition of a pqueue element, for the shared pqheap; the Makefile
+   names this header in PQ_ELEM_HEADER */
+typedef FillCell elemType;
+#define compare_element compare_FillCell
+#define getPriority(e) ((e).elev)
+#define printElem(e)   (printf("[%.3f, " DGI_FMT "] ", (e).elev, (e).i))
+
+
+#endif
@@ -0,0 +1,108 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "datagrid.h"
+#include "basin.h"
+#include "flow.h"
+
+int main(int argc, const char **argv)
+{
+  const char *USAGE =
+    "Usage: fishgis-basins [-n[ ]NTHREAD] [-a POLICY] FLOW.asc LABEL.asc "
+    "[BASINS.txt]\n"
+    "\n"
+    "  -a  allocate the grids as POLICY: default, or any of huge, interleave\n"
+    "      and firsttouch joined by commas\n"
+    "\n"
+    "  Label every cell with the basin it drains to.  Basins are numbered\n"
+    "  from 1; BASINS.txt lists each basin's outlet and cell count.  FLOW may\n"
+    "  also be a packed (" FLOWPACK_EXT ") flow direction file.";
+
+  DataSet *flow, *label;
+  FlowPack *pack;
+  Vector *basins;
+  int i, nthread, alloc, err;
+
+  i = 1;
+  argc--;
+  nthread = 1;
+  alloc = ALLOC_DEFAULT;
+  if (argc > 2 && strncmp(argv[i], "-n", 2) == 0) {
+    // supplied an nthread option
+    i++; argc--;
+    errno = 0;
+
+    // basins -nNTRHEAD FLOW.asc LABEL.asc
+    if (strlen(argv[i-1]) > 2)
+      nthread = strtol(argv[i-1] + 2, NULL, 10);
+    // basins -n NTHREAD FLOW.asc LABEL.asc
+    else if (argc > 2) {
+      i++; argc--;
+      nthread = strtol(argv[i-1], NULL, 10);
+    }else
+      errno = -1;
+
+    if (errno != 0 || nthread < 1) {
+      fprintf(stderr, "%s\n", USAGE);
+      return -1;
+    }
+  }
+  if (argc > 2 && strcmp(argv[i], "-a") == 0) {
+    // supplied an allocation policy for the grids
+    i++; argc--;
+    alloc = argc > 2 ? dAllocParse(argv[i]) : -1;
+    if (alloc < 0) {
+      fprintf(stderr, "%s\n", USAGE);
+      return -1;
+    }
+    i++; argc--;
+  }
+  dSetAlloc(alloc, nthread);
+  if (argc != 2 && argc != 3) {
+    // incorrect arg count
+    fprintf(stderr, "%s\n", USAGE);
+    return -1;
+  }
+
+  if (flowpack_is_packed(argv[i])) {
+    pack = flowpack_load(argv[i]);
+    flow = pack ? flowpack_unpack(pack) : NULL;
+    if (pack)
+      flowpack_free(pack);
+  }else
+    flow = dLoad(argv[i], UCHAR);
+  if (!flow)
+    return -1;
+
+  label = flow_basins(flow, nthread, argc == 3 ? &basins : NULL);
+  if (!label) {
+    dFree(flow);
+    return -1;
+  }
+
+  err = dStore(label, argv[i+1]) != 0;
+  if (argc == 3) {
+    err |= basins_store(basins, flow->grid.ncol, argv[i+2]) != 0;
+    vfree(basins);
+  }
+  dFree(label);
+  dFree(flow);
+
+  return err ? -1 : 0;
+}
@@ -0,0 +1,295 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batch.h"
+#include "datagrid.h"
+#include "flow.h"
+#include "flowpack.h"
+#include "vector.h"
+
+// the job and options every tile of the batch shares
+typedef struct batch_job_t {
+  int accu;          // flowaccu rather than flowdir
+  int filled, tree;  // as for fishgis-flowdir -f and fishgis-flowaccu -t
+  int nthread;
+  Vector *in, *out;  // the input and output path of each tile
+} BatchJob;
+
+// a tile between stages: a grid, or packed flow directions
+typedef struct batch_tile_t {
+  DataSet *set;
+  FlowPack *pack;
+} BatchTile;
+
+static BatchTile* tile_new(DataSet *set, FlowPack *pack)
+{
+  BatchTile *tile;
+
+  if (!set && !pack)
+    return NULL;
+  tile = (BatchTile*) malloc(sizeof(BatchTile));
+  if (!tile) {
+    perror("Could not allocate tile");
+    if (set)
+      dFree(set);
+    if (pack)
+      flowpack_free(pack);
+    return NULL;
+  }
+  tile->set = set;
+  tile->pack = pack;
+  return tile;
+}
+
+static void tile_free(BatchTile *tile)
+{
+  if (tile->set)
+    dFree(tile->set);
+  if (tile->pack)
+    flowpack_free(tile->pack);
+  free(tile);
+}
+
+static const char* tile_path(Vector *paths, size_t k)
+{
+  return *(const char**) vget(paths, k);
+}
+
+static void* load_stage(void *closure, size_t k, void *item)
+{
+  BatchJob *job;
+  const char *path;
+
+  job = (BatchJob*) closure;
+  path = tile_path(job->in, k);
+  if (job->accu && flowpack_is_packed(path))
+    return tile_new(NULL, flowpack_load(path));
+  return tile_new(dLoad(path, job->accu ? UCHAR : FLOAT), NULL);
+}
+
+static void* compute_stage(void *closure, size_t k, void *item)
+{
+  BatchJob *job;
+  BatchTile *tile;
+  DataSet *result, *fill;
+
+  job = (BatchJob*) closure;
+  tile = (BatchTile*) item;
+  result = NULL;
+
+  if (!job->accu) {
+    if (job->filled) {
+      fill = flow_fill(tile->set);
+      dFree(tile->set);
+      tile->set = fill;
+    }
+    if (tile->set)
+      result = flow_direction(tile->set, job->nthread);
+    if (result && flowpack_wants_packed(tile_path(job->out, k))) {
+      // four bits per cell, packed here rather than in the store stage
+      tile_free(tile);
+      tile = tile_new(NULL, flowpack_pack(&result->grid));
+      dFree(result);
+      return tile;
+    }
+  }else if (tile->pack) {
+    if (job->tree) {
+      fill = flowpack_unpack(tile->pack);
+      result = fill ? flow_accumulation_tree(fill, job->nthread) : NULL;
+      if (fill)
+        dFree(fill);
+    }else
+      result = flow_accumulation_packed(tile->pack, job->nthread);
+  }else if (job->tree)
+    result = flow_accumulation_tree(tile->set, job->nthread);
+  else
+    result = flow_accumulation_parallel(tile->set, job->nthread);
+
+  tile_free(tile);
+  return tile_new(result, NULL);
+}
+
+static void* store_stage(void *closure, size_t k, void *item)
+{
+  BatchJob *job;
+  BatchTile *tile;
+  const char *path;
+  int err;
+
+  job = (BatchJob*) closure;
+  tile = (BatchTile*) item;
+  path = tile_path(job->out, k);
+  if (tile->pack)
+    err = flowpack_store(tile->pack, path) != 0;
+  else
+    err = dStore(tile->set, path) != 0;
+  tile_free(tile);
+  if (err) {
+    fprintf(stderr, "Could not store tile " DGI_FMT " (%s).\n",
+            (index_t) k, path);
+    return NULL;
+  }
+  return closure;
+}
+
+// read the tiles of a list file, a line of "INPUT OUTPUT" each; blank lines
+//   and lines starting with # are skipped
+static int read_list(const char *list, Vector *in, Vector *out)
+{
+  FILE *fp;
+  char line[4096], a[2048], b[2048];
+  char *path;
+  int n;
+
+  fp = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+  if (!fp) {
+    fprintf(stderr, "Could not open tile list (%s).\n", list);
+    perror(NULL);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), fp)) {
+    n = sscanf(line, "%2047s %2047s", a, b);
+    if (n <= 0 || a[0] == '#')
+      continue;
+    if (n != 2) {
+      fprintf(stderr, "Tile list line has no output path: %s", line);
+      if (fp != stdin)
+        fclose(fp);
+      return -1;
+    }
+    path = strdup(a);
+    vappend(in, &path);
+    path = strdup(b);
+    vappend(out, &path);
+  }
+  if (fp != stdin)
+    fclose(fp);
+  return 0;
+}
+
+int main(int argc, const char **argv)
+{
+  const char *USAGE =
+    "Usage: fishgis-batch [-f] [-t] [-n[ ]NTHREAD] [-a POLICY] [-d DEPTH]\n"
+    "                     flowdir|flowaccu LIST\n"
+    "\n"
+    "  Runs fishgis-flowdir or fishgis-flowaccu over every tile in LIST, a\n"
+    "  line of \"INPUT OUTPUT\" per tile (- reads the list from stdin), loading\n"
+    "  the next tile and storing the last one while the current one computes.\n"
+    "  multiviewshed is not pipelined: it builds in its own tree, and loads,\n"
+    "  sweeps and stores each grid itself, so run it once per tile instead.\n"
+    "\n"
+    "  -f  flowdir: fill depressions first\n"
+    "  -t  flowaccu: use the reverse-flow tree accumulation\n"
+    "  -a  allocate the grids as POLICY: default, or any of huge, interleave\n"
+    "      and firsttouch joined by commas\n"
+    "  -d  let up to DEPTH tiles wait between stages (default 1)";
+
+  BatchStage stages[BATCH_NSTAGE] = { load_stage, compute_stage,
+                                      store_stage };
+  BatchStats stats;
+  BatchJob job;
+  size_t failed, k;
+  int i, alloc, depth;
+
+  i = 1;
+  argc--;
+  job.nthread = 1;
+  job.filled = job.tree = 0;
+  alloc = ALLOC_DEFAULT;
+  depth = 1;
+  if (argc > 2 && strcmp(argv[i], "-f") == 0) {
+    i++; argc--;
+    job.filled = 1;
+  }
+  if (argc > 2 && strcmp(argv[i], "-t") == 0) {
+    i++; argc--;
+    job.tree = 1;
+  }
+  if (argc > 2 && strncmp(argv[i], "-n", 2) == 0) {
+    // supplied an nthread option
+    i++; argc--;
+    errno = 0;
+
+    // batch -nNTHREAD JOB LIST
+    if (strlen(argv[i-1]) > 2)
+      job.nthread = strtol(argv[i-1] + 2, NULL, 10);
+    // batch -n NTHREAD JOB LIST
+    else if (argc > 2) {
+      i++; argc--;
+      job.nthread = strtol(argv[i-1], NULL, 10);
+    }else
+      errno = -1;
+
+    if (errno != 0 || job.nthread < 1) {
+      fprintf(stderr, "%s\n", USAGE);
+      return -1;
+    }
+  }
+  if (argc > 2 && strcmp(argv[i], "-a") == 0) {
+    // supplied an allocation policy for the grids
+    i++; argc--;
+    alloc = argc > 2 ? dAllocParse(argv[i]) : -1;
+    if (alloc < 0) {
+      fprintf(stderr, "%s\n", USAGE);
+      return -1;
+    }
+    i++; argc--;
+  }
+  if (argc > 2 && strcmp(argv[i], "-d") == 0) {
+    // supplied a queue depth
+    i++; argc--;
+    depth = argc > 2 ? strtol(argv[i], NULL, 10) : 0;
+    if (depth < 1) {
+      fprintf(stderr, "%s\n", USAGE);
+      return -1;
+    }
+    i++; argc--;
+  }
+  dSetAlloc(alloc, job.nthread);
+  if (argc != 2) {
+    // incorrect arg count
+    fprintf(stderr, "%s\n", USAGE);
+    return -1;
+  }
+  if (strcmp(argv[i], "flowdir") == 0)
+    job.accu = 0;
+  else if (strcmp(argv[i], "flowaccu") == 0)
+    job.accu = 1;
+  else {
+    fprintf(stderr, "%s\n", USAGE);
+    return -1;
+  }
+  i++;
+
+  job.in = vinit(sizeof(char*));
+  job.out = vinit(sizeof(char*));
+  if (read_list(argv[i], job.in, job.out) != 0)
+    return -1;
+
+  failed = run_batch(job.in->length, stages, &job, depth, &stats);
+  print_batch_stats(stdout, &stats);
+
+  for (k = 0; k < job.in->length; k++) {
+    free(*(char**) vget(job.in, k));
+    free(*(char**) vget(job.out, k));
+  }
+  vfree(job.in);
+  vfree(job.out);
+
+  return failed ? -1 : 0;
+}
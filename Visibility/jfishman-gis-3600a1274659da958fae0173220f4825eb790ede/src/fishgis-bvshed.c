@@ -21,14 +21,18 @@
 int main(int argc, const char **argv)
 {
   const char *USAGE =
-    "Usage: bvshed [-n[ ]NTHREAD] ELEV.asc VMAP.asc";
+    "Usage: bvshed [-n[ ]NTHREAD] [-a POLICY] ELEV.asc VMAP.asc\n"
+    "\n"
+    "  -a  allocate the grids as POLICY: default, or any of huge, interleave\n"
+    "      and firsttouch joined by commas";
 
   DataSet *terrain, *vmap;
-  int i, nthread;
+  int i, nthread, alloc;
 
   i = 1;
   argc--;
   nthread = 1;
+  alloc = ALLOC_DEFAULT;
   if (argc > 2 && strncmp(argv[i], "-n", 2) == 0) {
     // supplied an nthread option
     i++; argc--;
@@ -49,6 +53,17 @@ int main(int argc, const char **argv)
       return -1;
     }
   }
+  if (argc > 2 && strcmp(argv[i], "-a") == 0) {
+    // supplied an allocation policy for the grids
+    i++; argc--;
+    alloc = argc > 2 ? dAllocParse(argv[i]) : -1;
+    if (alloc < 0) {
+      fprintf(stderr, "%s\n", USAGE);
+      return -1;
+    }
+    i++; argc--;
+  }
+  dSetAlloc(alloc, nthread);
   if (argc != 2) {
     // incorrect arg count
     fprintf(stderr, "%s\n", USAGE);
@@ -0,0 +1,120 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "datagrid.h"
+#include "catchment.h"
+#include "flow.h"
+
+/**
+ * Parse a ROW COL pair into a cell index; returns -1 when out of range.
+ */
+static int parse_cell(Catchment *cat, const char *row, const char *col,
+                      index_t *i)
+{
+  index_t r, c;
+
+  errno = 0;
+  r = strtoull(row, NULL, 10);
+  c = strtoull(col, NULL, 10);
+  if (errno != 0 || r >= cat->nrow || c >= cat->ncol) {
+    fprintf(stderr, "Cell (%s, %s) is not in the grid.\n", row, col);
+    return -1;
+  }
+  *i = r * cat->ncol + c;
+  return 0;
+}
+
+int main(int argc, const char **argv)
+{
+  const char *USAGE =
+    "Usage: fishgis-catchment build FLOW.asc INDEX" CATCHMENT_EXT "\n"
+    "       fishgis-catchment area INDEX" CATCHMENT_EXT " ROW COL [ROW COL ...]\n"
+    "       fishgis-catchment mask INDEX" CATCHMENT_EXT " ROW COL MASK.asc\n"
+    "\n"
+    "  build - index the upstream catchments of a flow direction grid, which\n"
+    "          may be packed (" FLOWPACK_EXT ")\n"
+    "  area  - print the number of cells and the area upstream of each cell\n"
+    "  mask  - write a grid of 1 on the catchment of a cell, NODATA elsewhere";
+
+  Catchment *cat;
+  DataSet *flow, *mask;
+  FlowPack *pack;
+  index_t i;
+  int k, err;
+
+  if (argc == 4 && strcmp(argv[1], "build") == 0) {
+    if (flowpack_is_packed(argv[2])) {
+      pack = flowpack_load(argv[2]);
+      flow = pack ? flowpack_unpack(pack) : NULL;
+      if (pack)
+        flowpack_free(pack);
+    }else
+      flow = dLoad(argv[2], UCHAR);
+    if (!flow)
+      return -1;
+
+    cat = catchment_build(flow);
+    dFree(flow);
+    if (!cat)
+      return -1;
+    err = catchment_store(cat, argv[3]) != 0;
+    catchment_free(cat);
+    return err ? -1 : 0;
+  }
+
+  if (argc >= 5 && argc % 2 == 1 && strcmp(argv[1], "area") == 0) {
+    cat = catchment_load(argv[2]);
+    if (!cat)
+      return -1;
+
+    err = 0;
+    printf("row\tcol\tcells\tarea\n");
+    for (k = 3; k < argc; k += 2) {
+      if (parse_cell(cat, argv[k], argv[k+1], &i) != 0) {
+        err = 1;
+        continue;
+      }
+      printf("%s\t%s\t" DGI_FMT "\t%.f\n", argv[k], argv[k+1],
+             catchment_area(cat, i),
+             (double) catchment_area(cat, i) * cat->cellsize * cat->cellsize);
+    }
+    catchment_free(cat);
+    return err ? -1 : 0;
+  }
+
+  if (argc == 6 && strcmp(argv[1], "mask") == 0) {
+    cat = catchment_load(argv[2]);
+    if (!cat)
+      return -1;
+
+    err = -1;
+    if (parse_cell(cat, argv[3], argv[4], &i) == 0) {
+      mask = catchment_mask(cat, i);
+      if (mask) {
+        err = dStore(mask, argv[5]);
+        dFree(mask);
+      }
+    }
+    catchment_free(cat);
+    return err ? -1 : 0;
+  }
+
+  fprintf(stderr, "%s\n", USAGE);
+  return -1;
+}
@@ -0,0 +1,52 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "datagrid.h"
+#include "flow.h"
+
+int main(int argc, const char **argv)
+{
+  const char *USAGE =
+    "Usage: fishgis-fill ELEV.asc FILLED.asc\n"
+    "\n"
+    "  Fill the depressions in ELEV.asc so that every cell drains to the edge.\n"
+    "  Filled flats are only raised by the smallest float step, which is lost\n"
+    "  when the grid is written out; use fishgis-flowdir -f to fill and route\n"
+    "  flow in one pass.";
+
+  DataSet *elev, *fill;
+
+  if (argc != 3) {
+    fprintf(stderr, "%s\n", USAGE);
+    return -1;
+  }
+
+  elev = dLoad(argv[1], FLOAT);
+  if (elev) {
+    fill = flow_fill(elev);
+    dFree(elev);
+
+    if (fill) {
+      dStore(fill, argv[2]);
+      dFree(fill);
+    }else
+      return -1;
+  }else
+    return -1;
+
+  return 0;
+}
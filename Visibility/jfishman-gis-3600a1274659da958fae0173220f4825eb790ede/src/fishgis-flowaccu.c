@@ -23,13 +23,28 @@
 int main(int argc, const char **argv)
 {
   const char *USAGE =
-    "Usage: fishgis-flowaccu [-n NTHREAD] [ELEV.asc] FLOW.asc ACCU.asc";
+    "Usage: fishgis-flowaccu [-t] [-n NTHREAD] [-a POLICY] [ELEV.asc] FLOW.asc "
+    "ACCU.asc\n"
+    "\n"
+    "  -t  use the reverse-flow tree accumulation instead of the parallel one\n"
+    "  -a  allocate the grids as POLICY: default, or any of huge, interleave\n"
+    "      and firsttouch joined by commas\n"
+    "\n"
+    "  FLOW may also be a packed (" FLOWPACK_EXT ") flow direction file.";
 
   DataSet *flow, *accu;
-  int i, nthread;
+  FlowPack *pack;
+  int i, nthread, alloc, tree;
 
   i = 1; argc--;
   nthread = 1;
+  alloc = ALLOC_DEFAULT;
+  tree = 0;
+  if (argc > 2 && strcmp(argv[i], "-t") == 0) {
+    // use the older tree traversal
+    i++; argc--;
+    tree = 1;
+  }
   if (argc > 2 && strncmp(argv[i], "-n", 2) == 0) {
     // supplied an nthread option
     i++; argc--;
@@ -51,6 +66,17 @@ int main(int argc, const char **argv)
       return -1;
     }
   }
+  if (argc > 2 && strcmp(argv[i], "-a") == 0) {
+    // supplied an allocation policy for the grids
+    i++; argc--;
+    alloc = argc > 2 ? dAllocParse(argv[i]) : -1;
+    if (alloc < 0) {
+      fprintf(stderr, "%s\n", USAGE);
+      return -1;
+    }
+    i++; argc--;
+  }
+  dSetAlloc(alloc, nthread);
   if (argc > 3) {
     printf("too many args\n");
     // too many args
@@ -62,9 +88,34 @@ int main(int argc, const char **argv)
     argc--;
   }
 
+  if (flowpack_is_packed(argv[i])) {
+    // packed directions: the parallel accumulation reads them as they are
+    pack = flowpack_load(argv[i++]);
+    if (!pack)
+      return -1;
+    if (tree) {
+      flow = flowpack_unpack(pack);
+      accu = flow ? flow_accumulation_tree(flow, nthread) : NULL;
+      if (flow)
+        dFree(flow);
+    }else
+      accu = flow_accumulation_packed(pack, nthread);
+    flowpack_free(pack);
+
+    if (accu) {
+      dStore(accu, argv[i]);
+      dFree(accu);
+      return 0;
+    }
+    return -1;
+  }
+
   flow = dLoad(argv[i++], UCHAR);
   if (flow) {
-    accu = flow_accumulation_tree(flow, nthread);
+    if (tree)
+      accu = flow_accumulation_tree(flow, nthread);
+    else
+      accu = flow_accumulation_parallel(flow, nthread);
     dFree(flow);
 
     if (accu) {
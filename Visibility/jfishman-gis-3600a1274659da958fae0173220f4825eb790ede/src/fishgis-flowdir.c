@@ -23,14 +23,29 @@
 int main(int argc, const char **argv)
 {
   const char *USAGE =
-    "Usage: fishgis-flowdir [-n[ ]NTHREAD] ELEV.asc FLOW.asc";
+    "Usage: fishgis-flowdir [-f] [-n[ ]NTHREAD] [-a POLICY] ELEV.asc FLOW.asc\n"
+    "\n"
+    "  -f  fill depressions first, so that only edge cells are sinks\n"
+    "  -a  allocate the grids as POLICY: default, or any of huge, interleave\n"
+    "      and firsttouch joined by commas\n"
+    "\n"
+    "  A FLOW name ending in " FLOWPACK_EXT " is written in the packed format.";
 
-  DataSet *elev, *flow;
-  int i, nthread;
+  DataSet *elev, *flow, *fill;
+  FlowPack *pack;
+  int err;
+  int i, nthread, alloc, filled;
 
   i = 1;
   argc--;
   nthread = 1;
+  alloc = ALLOC_DEFAULT;
+  filled = 0;
+  if (argc > 2 && strcmp(argv[i], "-f") == 0) {
+    // fill in memory, since the fill gradients do not survive dStore()
+    i++; argc--;
+    filled = 1;
+  }
   if (argc > 2 && strncmp(argv[i], "-n", 2) == 0) {
     // supplied an nthread option
     i++; argc--;
@@ -51,6 +66,17 @@ int main(int argc, const char **argv)
       return -1;
     }
   }
+  if (argc > 2 && strcmp(argv[i], "-a") == 0) {
+    // supplied an allocation policy for the grids
+    i++; argc--;
+    alloc = argc > 2 ? dAllocParse(argv[i]) : -1;
+    if (alloc < 0) {
+      fprintf(stderr, "%s\n", USAGE);
+      return -1;
+    }
+    i++; argc--;
+  }
+  dSetAlloc(alloc, nthread);
   if (argc != 2) {
     // incorrect arg count
     fprintf(stderr, "%s\n", USAGE);
@@ -59,13 +85,29 @@ int main(int argc, const char **argv)
 
   
   elev = dLoad(argv[i++], FLOAT);
+  if (elev && filled) {
+    fill = flow_fill(elev);
+    dFree(elev);
+    elev = fill;
+  }
   if (elev) {
     flow = flow_direction(elev, nthread);
     dFree(elev);
 
     if (flow) {
-      dStore(flow, argv[i]);
-      dFree(flow);
+      if (flowpack_wants_packed(argv[i])) {
+        // four bits per cell instead of an ASCII grid
+        pack = flowpack_pack(&flow->grid);
+        err = !pack || flowpack_store(pack, argv[i]) != 0;
+        if (pack)
+          flowpack_free(pack);
+        dFree(flow);
+        if (err)
+          return -1;
+      }else {
+        dStore(flow, argv[i]);
+        dFree(flow);
+      }
     }else
       return -1;
   }else
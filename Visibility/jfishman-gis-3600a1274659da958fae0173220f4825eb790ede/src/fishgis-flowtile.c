@@ -0,0 +1,69 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flowtile.h"
+
+int main(int argc, const char **argv)
+{
+  const char *USAGE =
+    "Usage: fishgis-flowtile [-m MB] ELEV.asc FLOW.asc ACCU.asc\n"
+    "\n"
+    "  Calculate flow direction and accumulation without loading the whole\n"
+    "  grid, for grids larger than memory.  The grid is processed in tiles of\n"
+    "  whole rows sized to fit in MB megabytes (default 256).  FLOW.asc may be\n"
+    "  '-' to skip writing the directions.";
+
+  const char *flow_path;
+  long mb;
+  int i;
+
+  i = 1;
+  argc--;
+  mb = 256;
+  if (argc > 3 && strncmp(argv[i], "-m", 2) == 0) {
+    // supplied a memory budget
+    i++; argc--;
+    errno = 0;
+
+    // flowtile -mMB ELEV.asc FLOW.asc ACCU.asc
+    if (strlen(argv[i-1]) > 2)
+      mb = strtol(argv[i-1] + 2, NULL, 10);
+    // flowtile -m MB ELEV.asc FLOW.asc ACCU.asc
+    else {
+      i++; argc--;
+      mb = strtol(argv[i-1], NULL, 10);
+    }
+
+    if (errno != 0 || mb < 1) {
+      fprintf(stderr, "%s\n", USAGE);
+      return -1;
+    }
+  }
+  if (argc != 3) {
+    // incorrect arg count
+    fprintf(stderr, "%s\n", USAGE);
+    return -1;
+  }
+
+  flow_path = strcmp(argv[i+1], "-") == 0 ? NULL : argv[i+1];
+  if (flow_tiled(argv[i], flow_path, argv[i+2], (size_t) mb << 20) != 0)
+    return -1;
+
+  return 0;
+}
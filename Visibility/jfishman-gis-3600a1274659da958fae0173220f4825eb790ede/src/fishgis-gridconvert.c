@@ -0,0 +1,131 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "datagrid.h"
+#include "gridio.h"
+
+// names for -t, in enum GridDataType order
+static const char *TYPES[] = { "float", "int", "uint", "short", "ushort",
+                               "char", "uchar", NULL };
+
+int main(int argc, const char **argv)
+{
+  const char *USAGE =
+    "Usage: fishgis-gridconvert [-t TYPE] [-p PREC] [-n] [-v]\n"
+    "                           [-w ROW COL NROW NCOL] INPUT OUTPUT\n"
+    "\n"
+    "  -t TYPE  value type of the output: float, int, uint, short, ushort,\n"
+    "           char or uchar; defaults to the type of a binary or tiled\n"
+    "           INPUT, or float for an ASCII one\n"
+    "  -p PREC  decimals for float values in an ASCII OUTPUT; by default,\n"
+    "           as few as read back as the same value\n"
+    "  -n       write a binary OUTPUT without row checksums\n"
+    "  -v       check the row checksums of a binary INPUT first\n"
+    "  -w ROW COL NROW NCOL\n"
+    "           convert only the NROW x NCOL window whose top left cell is\n"
+    "           (ROW, COL); from a tiled INPUT only the tiles under it are read\n"
+    "\n"
+    "  Either file may be ASCII, binary or tiled; names ending in "
+    GIO_BIN_SUFFIX " are binary, and in " GIO_TILE_SUFFIX " tiled.";
+
+  DataSet *dset;
+  GridFile *gf;
+  int i, j, type, prec, flags, verify, window, result;
+  long win[4];
+
+  type = -1;
+  prec = GIO_SHORTEST;
+  flags = GIO_BIN_CHECKSUM;
+  verify = 0;
+  window = 0;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      i++;
+      for (type = 0; TYPES[type] && strcmp(TYPES[type], argv[i]) != 0; type++)
+        ;
+      if (!TYPES[type]) {
+        fprintf(stderr, "%s\n", USAGE);
+        return -1;
+      }
+    }else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      i++;
+      errno = 0;
+      prec = strtol(argv[i], NULL, 10);
+      if (errno != 0 || prec < 0) {
+        fprintf(stderr, "%s\n", USAGE);
+        return -1;
+      }
+    }else if (strcmp(argv[i], "-w") == 0 && i + 4 < argc) {
+      for (j = 0; j < 4; j++) {
+        errno = 0;
+        win[j] = strtol(argv[++i], NULL, 10);
+        if (errno != 0 || win[j] < 0 || (j >= 2 && win[j] == 0)) {
+          fprintf(stderr, "%s\n", USAGE);
+          return -1;
+        }
+      }
+      window = 1;
+    }else if (strcmp(argv[i], "-n") == 0)
+      flags = 0;
+    else if (strcmp(argv[i], "-v") == 0)
+      verify = 1;
+    else {
+      fprintf(stderr, "%s\n", USAGE);
+      return -1;
+    }
+  }
+  if (argc - i != 2) {
+    fprintf(stderr, "%s\n", USAGE);
+    return -1;
+  }
+
+  // peek at the input for its type, and its checksums
+  gf = gio_open(argv[i]);
+  if (!gf)
+    return -1;
+  if (type < 0)
+    type = gf->binary || gf->tiled ? (int) gf->type : FLOAT;
+  result = verify ? gio_verify(gf) : 0;
+  if (window && (win[0] + win[2] > (long) gf->hd.nrow ||
+                 win[1] + win[3] > (long) gf->hd.ncol)) {
+    fprintf(stderr, "window is not inside the %lux%lu grid\n",
+            (unsigned long) gf->hd.nrow, (unsigned long) gf->hd.ncol);
+    result = -1;
+  }
+  gio_close(gf);
+  if (result != 0)
+    return -1;
+
+  if (window)
+    dset = dLoadWindow(argv[i], (enum GridDataType) type, win[0], win[1],
+                       win[2], win[3]);
+  else
+    dset = dLoad(argv[i], (enum GridDataType) type);
+  if (!dset)
+    return -1;
+  if (gio_wants_binary(argv[i+1]))
+    result = dStoreBinary(dset, argv[i+1], flags);
+  else if (gio_wants_tiled(argv[i+1]))
+    result = dStoreTiled(dset, argv[i+1]);
+  else
+    result = dStoreAscii(dset, argv[i+1], prec);
+  dFree(dset);
+
+  return result;
+}
@@ -37,7 +37,9 @@ const char *USAGE =
   "    $> fishgis-command args\n"
   "  Otherwise, opens a readline-enabled shell.";
 
-const char* commands[] = { "flowdir", "flowaccu", "trials", NULL };
+const char* commands[] = { "fill", "flowdir", "flowaccu", "basins",
+                           "catchment", "gridconvert", "batch", "trials",
+                           NULL };
 
 
 // helper functions
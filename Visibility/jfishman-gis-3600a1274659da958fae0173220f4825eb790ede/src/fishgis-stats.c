@@ -12,7 +12,6 @@
 //    You should have received a copy of the GNU General Public License
 //    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
-#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -20,7 +19,6 @@
 
 int main(int argc, const char **argv)
 {
-  DataSet *data;
   double *stats;
 
   if (argc != 2) {
@@ -28,13 +26,11 @@ int main(int argc, const char **argv)
     return 1;
   }
 
-  data = dLoad(argv[1], FLOAT);
-  if (!data)
+  // one pass over the rows as they are read; the grid is never loaded
+  stats = dStatf(argv[1], STD);
+  if (!stats)
     return 1;
 
-  stats = gStatf(&data->grid, STD);
-  assert(stats);
-
   printf("Count:\t%i\n", (int)stats[I_N]);
   printf("Min:\t%f\n", stats[I_MIN]);
   printf("Max:\t%f\n", stats[I_MAX]);
@@ -42,7 +38,6 @@ int main(int argc, const char **argv)
   printf("Std:\t%f\n", stats[I_STD]);
 
   free(stats);
-  dFree(data);
 
   return 0;
 }
@@ -13,26 +13,42 @@
 //    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
+#include <assert.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "datagrid.h"
 #include "flow.h"
+#include "rtimer.h"
 
 int main(int argc, const char **argv)
 {
   const char *USAGE =
-    "Usage: fishgis-trials INPUT NTRIAL NTHREAD [MAX_THREAD]\n"
+    "Usage: fishgis-trials [-p] INPUT NTRIAL NTHREAD [MAX_THREAD]\n"
     "\n"
+    "  -p         - only time flow direction, comparing the interleaved and\n"
+    "               row block partitionings\n"
     "  NTRIAL     - the number of trials to run; NTRIAL >= 1\n"
     "  NTHREAD    - the number of threads to use; NTHREAD >= 1\n"
     "  MAX_THREAD - when given, run sub-trials with threads from NTHREAD to\n"
-    "               MAX_THREAD, inclusive; MAX_THREAD >= NTHREAD";
+    "               MAX_THREAD, inclusive; MAX_THREAD >= NTHREAD\n"
+    "\n"
+    "  After the trials, the average wall time of each thread count is printed\n"
+    "  along with its speedup over NTHREAD threads.";
 
-  DataSet *elev, *flow, *accu;
+  DataSet *elev, *flow, *accu, *block;
   int ntrial, nthread, max_thread;
-  int itrial, ithread;
+  int itrial, ithread, part;
+  double *flow_time, *accu_time, *block_time;
+  Rtimer rt;
 
+  part = 0;
+  if (argc > 1 && strcmp(argv[1], "-p") == 0) {
+    // partitioning benchmark
+    part = 1;
+    argv++; argc--;
+  }
   if (argc < 4 || argc > 5) {
     fprintf(stderr, USAGE, argv[0]);
     return -1;
@@ -58,16 +74,62 @@ int main(int argc, const char **argv)
     }
   }
 
+  // total wall time per thread count, for the speedup report
+  flow_time = (double*) calloc(max_thread - nthread + 1, sizeof(double));
+  accu_time = (double*) calloc(max_thread - nthread + 1, sizeof(double));
+  assert(flow_time && accu_time);
+
   printf("Loading elevation grid...\n");
   elev = dLoad(argv[1], FLOAT);
   flow = NULL;
 
+  if (part) {
+    // flow_time holds the interleaved times, block_time the row block times
+    block_time = (double*) calloc(max_thread - nthread + 1, sizeof(double));
+    assert(block_time);
+    for (itrial = 0; itrial < ntrial; itrial++) {
+      for (ithread = nthread; ithread < max_thread + 1; ithread++) {
+        rt_start(rt);
+        flow = flow_direction_part(elev, ithread, FLOW_INTERLEAVED);
+        rt_stop(rt);
+        flow_time[ithread - nthread] += rt_seconds(rt);
+
+        rt_start(rt);
+        block = flow_direction_part(elev, ithread, FLOW_ROWBLOCK);
+        rt_stop(rt);
+        block_time[ithread - nthread] += rt_seconds(rt);
+
+        if (memcmp(flow->grid.ucData, block->grid.ucData,
+                   flow->grid.nrow * flow->grid.ncol) != 0)
+          fprintf(stderr, "Partitionings disagree with %d threads!\n", ithread);
+        dFree(flow);
+        dFree(block);
+      }
+    }
+    dFree(elev);
+
+    printf("\nthreads\tinterleaved(s)\trowblock(s)\tratio\n");
+    for (ithread = nthread; ithread < max_thread + 1; ithread++) {
+      printf("%d\t%.4f\t\t%.4f\t\t%.2f\n", ithread,
+             flow_time[ithread - nthread] / ntrial,
+             block_time[ithread - nthread] / ntrial,
+             flow_time[ithread - nthread] / block_time[ithread - nthread]);
+    }
+    free(flow_time);
+    free(accu_time);
+    free(block_time);
+    return 0;
+  }
+
   for (itrial = 0; itrial < ntrial; itrial++) {
     for (ithread = nthread; ithread < max_thread + 1; ithread++) {
       if (flow)
         // free last flow result
         dFree(flow);
+      rt_start(rt);
       flow = flow_direction(elev, ithread);
+      rt_stop(rt);
+      flow_time[ithread - nthread] += rt_seconds(rt);
     }
   }
   // don't need the elevation anymore
@@ -75,7 +137,10 @@ int main(int argc, const char **argv)
 
   for (itrial = 0; itrial < ntrial; itrial++) {
     for (ithread = nthread; ithread < max_thread + 1; ithread++) {
-      accu = flow_accumulation_tree(flow, ithread);
+      rt_start(rt);
+      accu = flow_accumulation_parallel(flow, ithread);
+      rt_stop(rt);
+      accu_time[ithread - nthread] += rt_seconds(rt);
       // can simply free this immediately
       dFree(accu);
     }
@@ -83,6 +148,18 @@ int main(int argc, const char **argv)
   // done with the last flow, as well
   dFree(flow);
 
+  // report average times and speedup relative to the first thread count
+  printf("\nthreads\tflowdir(s)\tspeedup\tflowaccu(s)\tspeedup\n");
+  for (ithread = nthread; ithread < max_thread + 1; ithread++) {
+    printf("%d\t%.4f\t\t%.2f\t%.4f\t\t%.2f\n", ithread,
+           flow_time[ithread - nthread] / ntrial,
+           flow_time[0] / flow_time[ithread - nthread],
+           accu_time[ithread - nthread] / ntrial,
+           accu_time[0] / accu_time[ithread - nthread]);
+  }
+  free(flow_time);
+  free(accu_time);
+
   return 0;
 }
 
@@ -14,8 +14,11 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <math.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #ifdef __APPLE__
 #include <stdlib.h>
 #else
@@ -25,37 +28,168 @@
 #include "rtimer.h"
 #include "vector.h"
 #include "runthreads.h"
+#include "pqheap.h"
 #include "flow.h"
 
 
-// enumeration for flow map orientations
-//   see flow_direction() comments for explanation
-enum flowdir {
-  MM = 0,
-  LM = 1,
-  LR = 2,
-  LL = 3,
-  MR = 4,
-  ML = 5,
-  UR = 6,
-  UL = 7,
-  UM = 8,
-  NO_DIR = 9
-};
+// row and column offsets of the neighbor each flowdir points to
+const int flowdir_dr[] = { 0, 1, 1,  1, 0,  0, -1, -1, -1 };
+const int flowdir_dc[] = { 0, 0, 1, -1, 1, -1,  1, -1,  0 };
 
 // A global timer
 static Rtimer rt;
 
 
+/**
+ * Fill the depressions of an elevation grid so that every cell drains to the
+ * edge of the data, using the Priority-Flood+epsilon algorithm.
+ *
+ * The flood starts from the edge cells (the border of the grid, and any cell
+ * next to NODATA) on a priority queue, and repeatedly takes the lowest cell
+ * reached so far and floods its unvisited neighbors.  A neighbor that is not
+ * above the cell it was reached from is in a pit or on a flat; it is raised
+ * to the next representable float above that cell and put on a plain FIFO
+ * queue instead of the heap, since it is already the lowest thing around.
+ * The small rise gives every filled flat a gradient toward its outlet, so
+ * flow_direction() on the result finds no sinks except at the edges.
+ *
+ * Most cells of a real DEM are handled through the FIFO queue, so this is
+ * close to linear time; only the cells above their flood source pay for a
+ * heap operation.  Returns a new FLOAT DataSet.
+ */
+DataSet* flow_fill(DataSet *elev_set)
+{
+  Grid *elev, *fill;
+  DataSet *fill_set;
+  PQueue *open;
+  index_t *pit, pit_head, pit_tail;
+  unsigned char *closed;
+  index_t n, i, r, c, nr, nc, ni;
+  float eNODATA, raised;
+  FillCell cell, next;
+  int dir;
+
+  rt_start(rt);
+
+  // DataSet is not NULL
+  assert(elev_set);
+  // DataSet is float elevation data
+  elev = &elev_set->grid;
+  assert(elev->type == FLOAT);
+  eNODATA = elev->fNODATA;
+  n = elev->nrow * elev->ncol;
+
+  // Initialize output data grid as a copy of the input
+  fill_set = dInit(elev->nrow, elev->ncol, FLOAT);
+  if (!fill_set)
+    return NULL;
+  fill = &fill_set->grid;
+  fill->xllcorner = elev->xllcorner;
+  fill->yllcorner = elev->yllcorner;
+  fill->cellsize = elev->cellsize;
+  fill->fNODATA = eNODATA;
+  memcpy(fill->fData, elev->fData, n * sizeof(float));
+
+  // every cell goes through the pit queue at most once, so it never wraps
+  closed = (unsigned char*) calloc(n, sizeof(unsigned char));
+  pit = (index_t*) malloc(n * sizeof(index_t));
+  if (!closed || !pit) {
+    free(closed);
+    free(pit);
+    dFree(fill_set);
+    return NULL;
+  }
+  pit_head = pit_tail = 0;
+  open = PQ_initialize();
+
+  // seed the heap with the edge cells; NODATA is never visited
+  for (r = 0; r < fill->nrow; r++) {
+    for (c = 0; c < fill->ncol; c++) {
+      i = r*fill->ncol + c;
+      if (fill->fData[i] == eNODATA) {
+        closed[i] = 1;
+        continue;
+      }
+      for (dir = LM; dir < NO_DIR; dir++) {
+        nr = r + flowdir_dr[dir];
+        nc = c + flowdir_dc[dir];
+        // index_t is unsigned, so -1 wraps to be out of range
+        if (nr >= fill->nrow || nc >= fill->ncol ||
+            fill->fData[nr*fill->ncol + nc] == eNODATA)
+          break;
+      }
+      if (dir < NO_DIR) {
+        closed[i] = 1;
+        cell.elev = fill->fData[i];
+        cell.i = i;
+        PQ_insert(open, cell);
+      }
+    }
+  }
+
+  // flood inwards
+  while (pit_head < pit_tail || !PQ_isEmpty(open)) {
+    if (pit_head < pit_tail) {
+      cell.i = pit[pit_head++];
+      cell.elev = fill->fData[cell.i];
+    }else
+      PQ_extractMin(open, &cell);
+
+    r = cell.i / fill->ncol;
+    c = cell.i % fill->ncol;
+    raised = nextafterf(cell.elev, INFINITY);
+    for (dir = LM; dir < NO_DIR; dir++) {
+      nr = r + flowdir_dr[dir];
+      nc = c + flowdir_dc[dir];
+      if (nr >= fill->nrow || nc >= fill->ncol)
+        continue;
+      ni = nr*fill->ncol + nc;
+      if (closed[ni])
+        continue;
+      closed[ni] = 1;
+
+      if (fill->fData[ni] <= raised) {
+        // in a pit or on a flat: raise it just above us
+        fill->fData[ni] = raised;
+        pit[pit_tail++] = ni;
+      }else {
+        next.elev = fill->fData[ni];
+        next.i = ni;
+        PQ_insert(open, next);
+      }
+    }
+  }
+
+  // garbage collect
+  PQ_delete(open);
+  free(pit);
+  free(closed);
+
+  // print results
+  rt_stop(rt);
+  static char buf[256];
+  rt_sprint(buf, rt);
+  printf("flow_fill\t\t%s\n", buf);
+
+  return fill_set;
+}
+
+
 // Thread routine & closure definitions
-//   flow_direction subroutine
+//   flow_direction subroutines, one per partitioning
 void* flow_direction_sub(void *_closure);
+void* flow_direction_block_sub(void *_closure);
 //   flow_direction closure
 typedef struct gridflow_thread_data { 
   int id;
   int nthread;
   Grid *elev;
   Grid *flow;
+  // shared next row to hand out, and rows per block, for FLOW_ROWBLOCK
+  index_t *cursor;
+  index_t block_rows;
+  // where the elevations hold data, or NULL to look at every cell
+  GridValid *valid;
 } gridflow_band;
 
 
@@ -75,11 +209,31 @@ typedef struct gridflow_thread_data {
  * northern horizon.
  */
 DataSet* flow_direction(DataSet *elev_set, int nthread)
+{
+  return flow_direction_part(elev_set, nthread, FLOW_ROWBLOCK);
+}
+
+/**
+ * Calculate flow directions as flow_direction() does, choosing how the grid
+ * is divided between threads.
+ *
+ * FLOW_INTERLEAVED hands out cells round-robin, so every thread touches
+ * every cache line of both grids, and neighboring threads write to the same
+ * lines of the flow grid.  FLOW_ROWBLOCK hands out blocks of whole rows, sized
+ * so that a block of elevations and flows fits in half of the L2 cache, from a
+ * shared counter; each thread only reads the rows just above and below its
+ * block from anyone else's share.  Both produce the same directions.
+ */
+DataSet* flow_direction_part(DataSet *elev_set, int nthread,
+                             enum flowpart part)
 {
   Grid *elev, *flow;
   DataSet *flow_set;
+  GridValid *valid;
   Vector *gridflows;
   gridflow_band band;
+  index_t cursor;
+  long cache;
   int i;
 
   rt_start(rt);
@@ -100,6 +254,18 @@ DataSet* flow_direction(DataSet *elev_set, int nthread)
   flow->cellsize = elev->cellsize;
   flow->sNODATA = NO_DIR;
 
+  // size row blocks to half of L2, counting both grids
+  cache = -1;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  cache = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+  if (cache <= 0)
+    cache = 256 * 1024;
+  cursor = 0;
+
+  // NODATA cells only need their NO_DIR, so find them before the threads start
+  valid = part == FLOW_ROWBLOCK ? gValid(elev) : NULL;
+
   // initialize closures
   gridflows = vinit2(sizeof(gridflow_band), nthread);
   assert(gridflows);
@@ -110,12 +276,18 @@ DataSet* flow_direction(DataSet *elev_set, int nthread)
     band.nthread = nthread;
     band.elev = elev;
     band.flow = flow;
+    band.cursor = &cursor;
+    band.block_rows = MAX(cache / 2 / (elev->ncol * (sizeof(float) + 1)), 1);
+    band.valid = valid;
 
     vappend(gridflows, &band);
   }
 
   // calcculate flows in parallel
-  run_threads(nthread, flow_direction_sub, gridflows);
+  if (part == FLOW_INTERLEAVED)
+    run_threads(nthread, flow_direction_sub, gridflows);
+  else
+    run_threads(nthread, flow_direction_block_sub, gridflows);
 
   // garbage collect
   vfree(gridflows);
@@ -204,6 +376,14 @@ void* flow_direction_sub(void *_closure)
     assert(r == (fp - band.flow->ucData) / ncol);
     assert(c == (fp - band.flow->ucData) % ncol);
 
+    // NODATA has no direction
+    if (*(ep2 + 1) == eNODATA) {
+      fp += skip;
+      c += skip;
+      ep1 += skip; ep2 += skip; ep3 += skip;
+      continue;
+    }
+
     // first column of 3
     if (c > 0) {
       if (r > 0) {
@@ -256,7 +436,7 @@ void* flow_direction_sub(void *_closure)
         min = *ep2;
         *fp = MR;
       }
-      if (r < ncol - 1) {
+      if (r < nrow - 1) {
         if (*ep3 != eNODATA && *ep3 < min) {
           min = *ep3;
           *fp = LR;
@@ -274,6 +454,128 @@ void* flow_direction_sub(void *_closure)
 }
 
 
+/**
+ * Calculate the flow directions of columns [c0, c1) of one row, given the rows
+ * above and below it (NULL at the edges of the grid).
+ */
+static void flow_direction_span(const float *up, const float *mid,
+                                const float *dn, index_t ncol, index_t c0,
+                                index_t c1, float eNODATA, unsigned char *out)
+{
+  float min;
+  index_t c;
+
+#define check_dir(v, dir) { \
+  if ((v) != eNODATA && (v) < min) { \
+    min = (v); \
+    out[c] = dir; \
+  } \
+}
+
+  for (c = c0; c < c1; c++) {
+    out[c] = NO_DIR;
+    // NODATA has no direction
+    if (mid[c] == eNODATA)
+      continue;
+    min = SHRT_MAX;
+
+    // first column of 3
+    if (c > 0) {
+      if (up)
+        check_dir(up[c-1], UL);
+      check_dir(mid[c-1], ML);
+      if (dn)
+        check_dir(dn[c-1], LL);
+    }
+
+    // second column of 3; the center wins ties, making flats into sinks
+    if (up)
+      check_dir(up[c], UM);
+    if (mid[c] <= min) {
+      min = mid[c];
+      out[c] = MM;
+    }
+    if (dn)
+      check_dir(dn[c], LM);
+
+    // third column of 3
+    if (c < ncol - 1) {
+      if (up)
+        check_dir(up[c+1], UR);
+      check_dir(mid[c+1], MR);
+      if (dn)
+        check_dir(dn[c+1], LR);
+    }
+  }
+
+#undef check_dir
+}
+
+/**
+ * Calculate the flow directions of one row, given the rows above and below
+ * it (NULL at the edges of the grid).
+ *
+ * Uses the same neighbor order and tie rules as flow_direction_sub().
+ */
+void flow_direction_row(const float *up, const float *mid, const float *dn,
+                        index_t ncol, float eNODATA, unsigned char *out)
+{
+  flow_direction_span(up, mid, dn, ncol, 0, ncol, eNODATA, out);
+}
+
+/**
+ * Thread subroutine for the FLOW_ROWBLOCK partitioning of flow_direction.
+ *
+ * Claims blocks of whole rows from the shared cursor until the grid is done,
+ * and computes each row with flow_direction_row().  The rows just outside a
+ * block are read as a halo, but only our own rows of the flow grid are
+ * written, so threads never share a cache line except at block edges.  With
+ * the validity bitmap, rows are set to NO_DIR and only their runs of data are
+ * computed.
+ */
+void* flow_direction_block_sub(void *_closure)
+{
+  gridflow_band band;
+  index_t nrow, ncol, r, begin, end;
+  uint64_t c, cend;
+  const float *up, *dn;
+  float *elev;
+
+  assert(_closure);
+  band = *(gridflow_band*) _closure;
+  assert(band.elev);
+  assert(band.flow);
+  assert(band.cursor);
+  assert(band.block_rows > 0);
+  assert(band.elev->nrow == band.flow->nrow);
+  assert(band.elev->ncol == band.flow->ncol);
+
+  nrow = band.elev->nrow;
+  ncol = band.elev->ncol;
+  elev = band.elev->fData;
+
+  while ((begin = __sync_fetch_and_add(band.cursor, band.block_rows)) < nrow) {
+    end = MIN(begin + band.block_rows, nrow);
+    for (r = begin; r < end; r++) {
+      up = r > 0 ? elev + (r-1)*ncol : NULL;
+      dn = r < nrow - 1 ? elev + (r+1)*ncol : NULL;
+      if (!band.valid) {
+        flow_direction_row(up, elev + r*ncol, dn, ncol, band.elev->fNODATA,
+                           band.flow->ucData + r*ncol);
+        continue;
+      }
+      memset(band.flow->ucData + r*ncol, NO_DIR, ncol);
+      for (c = gio_valid_run(band.valid, r, 0, &cend); c < ncol;
+           c = gio_valid_run(band.valid, r, cend, &cend))
+        flow_direction_span(up, elev + r*ncol, dn, ncol, c, cend,
+                            band.elev->fNODATA, band.flow->ucData + r*ncol);
+    }
+  }
+
+  pthread_exit(NULL);
+}
+
+
 // Accumulation point structure
 //   structure for holding a vector of neighbors in the reverse flow tree
 //   constructed during the accumulation algorithm, as well as holding a
@@ -573,3 +875,264 @@ void* iter_accumulation(void *_closure)
 
   pthread_exit(NULL);
 }
+
+
+// Parallel accumulation band structure
+//   every thread gets the same closure data except for its id; the upstream
+//   neighbor counts are shared between threads, as is the cursor used to hand
+//   out chunks of the grid during the propagation phase.
+//   the flow directions are either one byte per cell or packed two cells per
+//   byte as in a FlowPack; band_dir() reads either.
+typedef struct flow_parallel_thread_data {
+  int id;
+  int nthread;
+  index_t nrow;
+  index_t ncol;
+  unsigned char *dirs;
+  int packed;
+  Grid *accu;
+  unsigned char *indeg;
+  index_t *cursor;
+} flowpar_band;
+
+// the flow direction of cell i in a band's direction array
+#define band_dir(band, i) \
+  ((band).packed ? (((band).dirs[(i) >> 1] >> (((i) & 1) << 2)) & 0x0f) \
+                 : (band).dirs[i])
+
+// flag set in an indeg entry that had no upstream neighbors to begin with,
+// so that cells whose count drops to zero later are not started twice
+#define FLOWPAR_SOURCE 0x10
+// number of cells handed to a thread at a time in the propagation phase
+#define FLOWPAR_CHUNK 4096
+
+// helper methods - forward references
+static DataSet* accumulate_parallel(index_t nrow, index_t ncol, float xll,
+                                    float yll, float cellsize,
+                                    unsigned char *dirs, int packed,
+                                    int nthread);
+void* count_upstream(void *_closure);
+void* propagate_accumulation(void *_closure);
+
+/**
+ * Calculate the flow accumulation of a flow map without building the
+ * reverse-flow trees.
+ *
+ * Each cell first counts how many of its neighbors flow into it.  Cells
+ * with no upstream neighbors are the starting points: a thread walks
+ * downstream from one, adding its accumulation to the next cell and
+ * decrementing that cell's count, and carries on from the next cell when it
+ * was the last one the count was waiting for.  Every cell is therefore
+ * finished by exactly one thread, after all of its upstream cells, and only
+ * the adds and decrements need to be atomic.
+ *
+ * Unlike flow_accumulation_tree(), the work is not tied to the basins: the
+ * grid is handed out in small chunks from a shared cursor, so one large basin
+ * is spread over every thread.  The result is an UINT grid with NODATA 0.
+ */
+DataSet* flow_accumulation_parallel(DataSet *flow_set, int nthread)
+{
+  Grid *flow;
+
+  // DataSet is not NULL
+  assert(flow_set);
+  // DataSet is unsigned char flow direction data
+  flow = &flow_set->grid;
+  assert(flow->type == UCHAR);
+
+  return accumulate_parallel(flow->nrow, flow->ncol, flow->xllcorner,
+                             flow->yllcorner, flow->cellsize,
+                             flow->ucData, FALSE, nthread);
+}
+
+/**
+ * Calculate the flow accumulation of a packed flow map, as
+ * flow_accumulation_parallel() does, without unpacking it.
+ */
+DataSet* flow_accumulation_packed(FlowPack *pack, int nthread)
+{
+  assert(pack);
+
+  return accumulate_parallel(pack->nrow, pack->ncol, pack->xllcorner,
+                             pack->yllcorner, pack->cellsize,
+                             pack->data, TRUE, nthread);
+}
+
+/**
+ * Shared body of flow_accumulation_parallel() and flow_accumulation_packed().
+ */
+static DataSet* accumulate_parallel(index_t nrow, index_t ncol, float xll,
+                                    float yll, float cellsize,
+                                    unsigned char *dirs, int packed,
+                                    int nthread)
+{
+  Vector *bands;
+  DataSet *accu_set;
+  Grid *accu;
+  flowpar_band band;
+  unsigned char *indeg;
+  index_t cursor;
+  int i;
+
+  rt_start(rt);
+
+  // Initialize output data grid
+  accu_set = dInit(nrow, ncol, UINT);
+  if (!accu_set)
+    return NULL;
+  accu = &accu_set->grid;
+  accu->xllcorner = xll;
+  accu->yllcorner = yll;
+  accu->cellsize = cellsize;
+  accu->uiNODATA = 0;
+
+  // upstream neighbor counts, filled in by count_upstream()
+  indeg = (unsigned char*) malloc(nrow * ncol);
+  if (!indeg) {
+    dFree(accu_set);
+    return NULL;
+  }
+  cursor = 0;
+
+  // allocate and initialize thread closures
+  bands = vinit2(sizeof(flowpar_band), nthread);
+  assert(bands);
+  i = -1;
+  while (++i < nthread) {
+    band.id = i;
+    band.nthread = nthread;
+    band.nrow = nrow;
+    band.ncol = ncol;
+    band.dirs = dirs;
+    band.packed = packed;
+    band.accu = accu;
+    band.indeg = indeg;
+    band.cursor = &cursor;
+
+    vappend(bands, &band);
+  }
+
+  // count upstream neighbors of each cell, by row blocks
+  run_threads(nthread, count_upstream, bands);
+
+  // pass flow downstream from the source cells
+  run_threads(nthread, propagate_accumulation, bands);
+
+  // garbage collect
+  vfree(bands);
+  free(indeg);
+
+  // print results
+  rt_stop(rt);
+  static char buf[1024];
+  rt_sprint(buf, rt);
+  printf("flow_accumulation_par\t%s\n", buf);
+
+  return accu_set;
+}
+
+/**
+ * Count the neighbors flowing into each cell of this thread's block of rows,
+ * and initialize its accumulation to 1 (0 for NODATA).  Counts are only
+ * written for our own cells, so no locking is needed.
+ */
+void* count_upstream(void *_closure)
+{
+  flowpar_band band;
+  index_t r, c, i, rbegin, rend, nr, nc;
+  unsigned char n, ndir;
+  int dir;
+
+  assert(_closure);
+  band = *(flowpar_band*) _closure;
+  assert(band.dirs);
+  assert(band.accu);
+  assert(band.indeg);
+
+  rbegin = band.nrow * band.id / band.nthread;
+  rend = band.nrow * (band.id + 1) / band.nthread;
+
+  for (r = rbegin; r < rend; r++) {
+    for (c = 0; c < band.ncol; c++) {
+      i = r*band.ncol + c;
+      if (band_dir(band, i) == NO_DIR) {
+        band.accu->uiData[i] = 0;
+        band.indeg[i] = 0;
+        continue;
+      }
+
+      // a neighbor in direction DIR flows into us when its own direction
+      // has the negated offsets
+      n = 0;
+      for (dir = LM; dir < NO_DIR; dir++) {
+        nr = r + flowdir_dr[dir];
+        nc = c + flowdir_dc[dir];
+        // index_t is unsigned, so -1 wraps to be out of range
+        if (nr >= band.nrow || nc >= band.ncol)
+          continue;
+        ndir = band_dir(band, nr*band.ncol + nc);
+        if (ndir < NO_DIR &&
+            flowdir_dr[ndir] == -flowdir_dr[dir] &&
+            flowdir_dc[ndir] == -flowdir_dc[dir])
+          n++;
+      }
+
+      band.accu->uiData[i] = 1;
+      band.indeg[i] = n ? n : FLOWPAR_SOURCE;
+    }
+  }
+
+  pthread_exit(NULL);
+}
+
+/**
+ * Claim chunks of the grid from the shared cursor and follow the flow path
+ * downstream from every source cell in them.  A path stops at a sink, or at
+ * a cell that is still waiting on other upstream neighbors; whichever thread
+ * delivers the last of those picks the path up again from there.
+ */
+void* propagate_accumulation(void *_closure)
+{
+  flowpar_band band;
+  index_t n, begin, end, i, r, c, down;
+  unsigned int *accu;
+  unsigned char *indeg, dir;
+
+  assert(_closure);
+  band = *(flowpar_band*) _closure;
+  assert(band.dirs);
+  assert(band.accu);
+  assert(band.indeg);
+  assert(band.cursor);
+  accu = band.accu->uiData;
+  indeg = band.indeg;
+  n = band.nrow * band.ncol;
+
+  while ((begin = __sync_fetch_and_add(band.cursor, FLOWPAR_CHUNK)) < n) {
+    end = MIN(begin + FLOWPAR_CHUNK, n);
+
+    for (i = begin; i < end; i++) {
+      if (indeg[i] != FLOWPAR_SOURCE)
+        continue;
+
+      // walk downstream while we are the last contributor of the next cell;
+      // the atomic builtins are full barriers, so by the time a count
+      // reaches zero every add into that cell is visible
+      down = i;
+      do {
+        dir = band_dir(band, down);
+        if (dir == MM || dir >= NO_DIR)
+          break;
+        r = down / band.ncol + flowdir_dr[dir];
+        c = down % band.ncol + flowdir_dc[dir];
+        if (r >= band.nrow || c >= band.ncol)
+          break;
+
+        __sync_fetch_and_add(accu + r*band.ncol + c, accu[down]);
+        down = r*band.ncol + c;
+      } while (__sync_sub_and_fetch(indeg + down, 1) == 0);
+    }
+  }
+
+  pthread_exit(NULL);
+}
@@ -17,9 +17,47 @@
 #define _flow_h_DEFINED
 
 #include "datagrid.h"
+#include "flowpack.h"
+
+// enumeration for flow map orientations
+//   see flow_direction() comments for explanation
+enum flowdir {
+  MM = 0,
+  LM = 1,
+  LR = 2,
+  LL = 3,
+  MR = 4,
+  ML = 5,
+  UR = 6,
+  UL = 7,
+  UM = 8,
+  NO_DIR = 9
+};
+
+// row and column offsets of the neighbor each flowdir points to
+extern const int flowdir_dr[];
+extern const int flowdir_dc[];
+
+DataSet* flow_fill(DataSet *elev_set);
+
+// how flow_direction_part() divides the grid between threads
+enum flowpart {
+  FLOW_INTERLEAVED,
+  FLOW_ROWBLOCK
+};
 
 DataSet* flow_direction(DataSet *elev_set, int nthread);
 
+DataSet* flow_direction_part(DataSet *elev_set, int nthread,
+                             enum flowpart part);
+
+void flow_direction_row(const float *up, const float *mid, const float *dn,
+                        index_t ncol, float eNODATA, unsigned char *out);
+
 DataSet* flow_accumulation_tree(DataSet *flow_set, int nthread);
 
+DataSet* flow_accumulation_parallel(DataSet *flow_set, int nthread);
+
+DataSet* flow_accumulation_packed(FlowPack *pack, int nthread);
+
 #endif
@@ -0,0 +1,289 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+#include "rtimer.h"
+#include "flow.h"
+#include "flowpack.h"
+
+// on-disk header, 48 bytes, followed by (nrow*ncol + 1) / 2 bytes of data
+typedef struct flowpack_header_t {
+  char magic[8];
+  uint8_t scheme;
+  uint8_t reserved[7];
+  uint64_t nrow;
+  uint64_t ncol;
+  float xllcorner;
+  float yllcorner;
+  float cellsize;
+  uint32_t reserved2;
+} flowpack_header;
+
+// enum flowdir code of each D8 code
+static const unsigned char d8_to_fishgis[16] = {
+  MM, UL, UM, UR, MR, LR, LM, LL, ML, NO_DIR,
+  NO_DIR, NO_DIR, NO_DIR, NO_DIR, NO_DIR, NO_DIR
+};
+
+/**
+ * Allocate a packed grid with the same size and position as grid.
+ */
+static FlowPack* flowpack_new(index_t nrow, index_t ncol)
+{
+  FlowPack *pack;
+
+  pack = (FlowPack*) malloc(sizeof(FlowPack));
+  if (!pack) {
+    perror("Unable to allocate FlowPack object");
+    return NULL;
+  }
+  pack->nrow = nrow;
+  pack->ncol = ncol;
+  pack->data = (unsigned char*) malloc((nrow * ncol + 1) / 2);
+  if (!pack->data) {
+    perror("Unable to allocate packed data");
+    free(pack);
+    return NULL;
+  }
+  return pack;
+}
+
+/**
+ * Pack a UCHAR flow direction grid into half the memory.  Codes above
+ * NO_DIR are stored as NO_DIR.
+ */
+FlowPack* flowpack_pack(Grid *flow)
+{
+  FlowPack *pack;
+  unsigned char *in, *out, lo, hi;
+  index_t n, i;
+
+  assert(flow);
+  assert(flow->type == UCHAR);
+
+  pack = flowpack_new(flow->nrow, flow->ncol);
+  if (!pack)
+    return NULL;
+  pack->xllcorner = flow->xllcorner;
+  pack->yllcorner = flow->yllcorner;
+  pack->cellsize = flow->cellsize;
+
+  n = flow->nrow * flow->ncol;
+  in = flow->ucData;
+  out = pack->data;
+  for (i = 0; i + 1 < n; i += 2) {
+    lo = MIN(in[i], NO_DIR);
+    hi = MIN(in[i+1], NO_DIR);
+    *out++ = lo | (hi << 4);
+  }
+  if (n & 1)
+    *out = MIN(in[n-1], NO_DIR);
+
+  return pack;
+}
+
+/**
+ * Unpack a packed grid into a new UCHAR DataSet, with NODATA NO_DIR.
+ */
+DataSet* flowpack_unpack(FlowPack *pack)
+{
+  static unsigned char pairs[256][2];
+  static int init = 0;
+  DataSet *flow_set;
+  Grid *flow;
+  unsigned char *out;
+  index_t n, i;
+  int b;
+
+  assert(pack);
+
+  // each byte unpacks to a fixed pair of cells, so look them up
+  if (!init) {
+    for (b = 0; b < 256; b++) {
+      pairs[b][0] = b & 0x0f;
+      pairs[b][1] = b >> 4;
+    }
+    init = 1;
+  }
+
+  flow_set = dInit(pack->nrow, pack->ncol, UCHAR);
+  if (!flow_set)
+    return NULL;
+  flow = &flow_set->grid;
+  flow->xllcorner = pack->xllcorner;
+  flow->yllcorner = pack->yllcorner;
+  flow->cellsize = pack->cellsize;
+  flow->ucNODATA = NO_DIR;
+
+  n = pack->nrow * pack->ncol;
+  out = flow->ucData;
+  for (i = 0; i < n / 2; i++, out += 2)
+    memcpy(out, pairs[pack->data[i]], 2);
+  if (n & 1)
+    *out = pack->data[n / 2] & 0x0f;
+
+  return flow_set;
+}
+
+/**
+ * Load a packed flow direction file.  Files written with D8 numbering are
+ * converted to enum flowdir numbering.
+ */
+FlowPack* flowpack_load(const char *path)
+{
+  static Rtimer rt;
+  flowpack_header hd;
+  FlowPack *pack;
+  FILE *fp;
+  index_t nbyte, i;
+  unsigned char lo, hi;
+
+  rt_start(rt);
+  assert(sizeof(flowpack_header) == 48);
+
+  fp = fopen(path, "rb");
+  if (!fp) {
+    fprintf(stderr, "Could not open input file (%s).\n", path);
+    perror(NULL);
+    return NULL;
+  }
+  if (fread(&hd, sizeof(hd), 1, fp) != 1 ||
+      memcmp(hd.magic, FLOWPACK_MAGIC, 8) != 0) {
+    fprintf(stderr, "Not a packed flow direction file (%s).\n", path);
+    fclose(fp);
+    return NULL;
+  }
+
+  pack = flowpack_new(hd.nrow, hd.ncol);
+  if (!pack) {
+    fclose(fp);
+    return NULL;
+  }
+  pack->xllcorner = hd.xllcorner;
+  pack->yllcorner = hd.yllcorner;
+  pack->cellsize = hd.cellsize;
+
+  nbyte = (pack->nrow * pack->ncol + 1) / 2;
+  if (fread(pack->data, 1, nbyte, fp) != nbyte) {
+    perror("Error reading packed grid data");
+    flowpack_free(pack);
+    fclose(fp);
+    return NULL;
+  }
+  fclose(fp);
+
+  if (hd.scheme == FLOWPACK_D8) {
+    for (i = 0; i < nbyte; i++) {
+      lo = d8_to_fishgis[pack->data[i] & 0x0f];
+      hi = d8_to_fishgis[pack->data[i] >> 4];
+      pack->data[i] = lo | (hi << 4);
+    }
+  }
+
+  rt_stop(rt);
+  static char buf[256];
+  rt_sprint(buf, rt);
+  printf("flowpack_load('%s'):\t%s\n", path, buf);
+
+  return pack;
+}
+
+/**
+ * Store a packed grid, in enum flowdir numbering.
+ */
+int flowpack_store(FlowPack *pack, const char *path)
+{
+  static Rtimer rt;
+  flowpack_header hd;
+  FILE *fp;
+  index_t nbyte;
+
+  rt_start(rt);
+  assert(pack);
+
+  fp = fopen(path, "wb");
+  if (!fp) {
+    fprintf(stderr, "Could not open output file (%s).\n", path);
+    perror(NULL);
+    return -1;
+  }
+
+  memset(&hd, 0, sizeof(hd));
+  memcpy(hd.magic, FLOWPACK_MAGIC, 8);
+  hd.scheme = FLOWPACK_FISHGIS;
+  hd.nrow = pack->nrow;
+  hd.ncol = pack->ncol;
+  hd.xllcorner = pack->xllcorner;
+  hd.yllcorner = pack->yllcorner;
+  hd.cellsize = pack->cellsize;
+
+  nbyte = (pack->nrow * pack->ncol + 1) / 2;
+  if (fwrite(&hd, sizeof(hd), 1, fp) != 1 ||
+      fwrite(pack->data, 1, nbyte, fp) != nbyte) {
+    perror("Error writing packed grid");
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+
+  rt_stop(rt);
+  static char buf[256];
+  rt_sprint(buf, rt);
+  printf("flowpack_store('%s'):\t%s\n", path, buf);
+
+  return 0;
+}
+
+/**
+ * Check whether the file at path starts with the packed format's magic.
+ */
+int flowpack_is_packed(const char *path)
+{
+  char magic[8];
+  FILE *fp;
+  int result;
+
+  fp = fopen(path, "rb");
+  if (!fp)
+    return 0;
+  result = fread(magic, 1, 8, fp) == 8 &&
+           memcmp(magic, FLOWPACK_MAGIC, 8) == 0;
+  fclose(fp);
+  return result;
+}
+
+/**
+ * Check whether path ends in FLOWPACK_EXT.
+ */
+int flowpack_wants_packed(const char *path)
+{
+  size_t len, ext;
+
+  len = strlen(path);
+  ext = strlen(FLOWPACK_EXT);
+  return len >= ext && strcmp(path + len - ext, FLOWPACK_EXT) == 0;
+}
+
+void flowpack_free(FlowPack *pack)
+{
+  assert(pack);
+  free(pack->data);
+  free(pack);
+}
@@ -0,0 +1,67 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _flowpack_h_DEFINED
+#define _flowpack_h_DEFINED
+
+#include <stdint.h>
+#include "datagrid.h"
+
+// magic bytes at the start of a packed flow direction file
+#define FLOWPACK_MAGIC "FLOWDIR4"
+// file name extension that selects the packed format on output
+#define FLOWPACK_EXT ".fdp"
+
+// direction numbering of a packed grid; codes are 0-8 in both, and 9 is NODATA
+enum flowpack_scheme {
+  FLOWPACK_FISHGIS = 0,  // enum flowdir, see flow.h
+  FLOWPACK_D8 = 1        // 1-8 clockwise from the upper left, 0 a sink
+};
+
+// flow direction grid packed two cells per byte, the even cell in the low
+// nibble.  Always uses FLOWPACK_FISHGIS numbering in memory.
+typedef struct flowpack_t {
+  index_t nrow;
+  index_t ncol;
+  float xllcorner;
+  float yllcorner;
+  float cellsize;
+  unsigned char *data;
+} FlowPack;
+
+// the direction of cell i of a packed grid
+#define flowpack_get(fp, i) \
+  (((fp)->data[(i) >> 1] >> (((i) & 1) << 2)) & 0x0f)
+
+// pack a UCHAR flow direction grid
+FlowPack* flowpack_pack(Grid *flow);
+
+// unpack into a new UCHAR flow direction DataSet
+DataSet* flowpack_unpack(FlowPack *pack);
+
+// load and store the packed file format
+FlowPack* flowpack_load(const char *path);
+int flowpack_store(FlowPack *pack, const char *path);
+
+// check a file for the packed format's magic bytes
+int flowpack_is_packed(const char *path);
+
+// check whether a path asks for the packed format by its extension
+int flowpack_wants_packed(const char *path);
+
+// free the memory allocated for a packed grid
+void flowpack_free(FlowPack *pack);
+
+#endif
@@ -0,0 +1,602 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rtimer.h"
+#include "misc.h"
+#include "datagrid.h"
+#include "flow.h"
+#include "flowtile.h"
+
+// no boundary cell downstream, or no successor in the boundary graph
+#define NO_SLOT UINT_MAX
+// the downstream neighbor of a cell lies in another tile
+#define OUT_OF_TILE (UINT_MAX - 1)
+
+// A global timer
+static Rtimer rt;
+
+// Tiling state
+//   the grid is cut into tiles of whole rows.  The first and last row of each
+//   tile are its boundary; every boundary cell gets a slot in the boundary
+//   graph, which is the only part of the problem kept for the whole grid.
+typedef struct flowtile_info_data {
+  FILE *dirs;
+  index_t nrow;
+  index_t ncol;
+  index_t tile_rows;
+  index_t ntile;
+  // first slot of each row, or -1 for rows inside a tile
+  index_t *rowslot;
+  unsigned int nslot;
+  // per slot: accumulation from within the tile, the next boundary slot
+  // downstream within the tile, the slot in the next tile flowed into, the
+  // flow entering from other tiles that passes through, and the part of that
+  // which enters directly from a neighboring tile
+  unsigned int *blocal;
+  unsigned int *bnext;
+  unsigned int *bcross;
+  unsigned int *bextra;
+  unsigned int *binflow;
+} flowtile_info;
+
+// Buffers for processing a single tile
+typedef struct flowtile_buffer_data {
+  unsigned char *dir;
+  unsigned char *indeg;
+  unsigned int *accu;
+  unsigned int *order;
+  unsigned int *next;
+} flowtile_buf;
+
+
+/**
+ * Read the Arc/Info ASCII Grid header from fp into the meta data of grid.
+ */
+static int read_header(FILE *fp, Grid *grid)
+{
+  if (fscanf(fp, "ncols\t" DGI_FMT "\nnrows\t" DGI_FMT "\n",
+             &grid->ncol, &grid->nrow) != 2) {
+    perror("Could not read grid size.");
+    return -1;
+  }
+  if (fscanf(fp, "xllcorner\t%f\nyllcorner\t%f\ncellsize\t%f\n",
+             &grid->xllcorner, &grid->yllcorner, &grid->cellsize) != 3) {
+    perror("Could not read grid meta data");
+    return -1;
+  }
+  if (fscanf(fp, "NODATA_value\t%f", &grid->fNODATA) != 1) {
+    perror("Could not read grid NODATA_value");
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Write the Arc/Info ASCII Grid header for grid to fp, in the same format as
+ * dStore(), up to but not including the NODATA_value line.
+ */
+static void write_header(FILE *fp, Grid *grid)
+{
+  fprintf(fp, "ncols         " DGI_FMT "\n", grid->ncol);
+  fprintf(fp, "nrows         " DGI_FMT "\n", grid->nrow);
+  fprintf(fp, "xllcorner     %.f\n", grid->xllcorner);
+  fprintf(fp, "yllcorner     %.f\n", grid->yllcorner);
+  fprintf(fp, "cellsize      %.f\n", grid->cellsize);
+}
+
+/**
+ * Read one row of ncol floats.
+ */
+static int read_row(FILE *fp, float *row, index_t ncol)
+{
+  index_t c;
+
+  for (c = 0; c < ncol; c++)
+    if (fscanf(fp, "%f", row + c) != 1) {
+      perror("Error reading grid data");
+      return -1;
+    }
+  return 0;
+}
+
+/**
+ * First pass: stream the elevation grid through a three row window, writing
+ * flow directions both to the temporary direction file and, if given, to the
+ * ASCII output.
+ */
+static int tiled_directions(FILE *in, Grid *meta, FILE *dirs, FILE *out)
+{
+  float *up, *mid, *dn, *tmp;
+  unsigned char *row;
+  index_t r, c;
+  int result;
+
+  up = (float*) malloc(meta->ncol * sizeof(float));
+  mid = (float*) malloc(meta->ncol * sizeof(float));
+  dn = (float*) malloc(meta->ncol * sizeof(float));
+  row = (unsigned char*) malloc(meta->ncol);
+  result = -1;
+  if (!up || !mid || !dn || !row) {
+    perror("Could not allocate row buffers");
+    goto done;
+  }
+
+  if (read_row(in, mid, meta->ncol) != 0)
+    goto done;
+  if (meta->nrow > 1 && read_row(in, dn, meta->ncol) != 0)
+    goto done;
+
+  for (r = 0; r < meta->nrow; r++) {
+    flow_direction_row(r > 0 ? up : NULL, mid,
+                       r < meta->nrow - 1 ? dn : NULL,
+                       meta->ncol, meta->fNODATA, row);
+
+    if (fwrite(row, 1, meta->ncol, dirs) != meta->ncol) {
+      perror("Error writing temporary direction file");
+      goto done;
+    }
+    if (out) {
+      for (c = 0; c < meta->ncol; c++)
+        fprintf(out, "%hhu ", row[c]);
+      fprintf(out, "\n");
+    }
+
+    // slide the window down
+    tmp = up; up = mid; mid = dn; dn = tmp;
+    if (r + 2 < meta->nrow && read_row(in, dn, meta->ncol) != 0)
+      goto done;
+  }
+  result = 0;
+
+done:
+  free(up);
+  free(mid);
+  free(dn);
+  free(row);
+  return result;
+}
+
+/**
+ * Load the directions of tile k from the temporary file.  Sets the first row
+ * and the number of rows of the tile.
+ */
+static int load_tile(flowtile_info *info, flowtile_buf *buf, index_t k,
+                     index_t *s, index_t *h)
+{
+  *s = k * info->tile_rows;
+  *h = MIN(info->tile_rows, info->nrow - *s);
+
+  if (fseeko(info->dirs, (off_t) *s * info->ncol, SEEK_SET) != 0 ||
+      fread(buf->dir, 1, (size_t) *h * info->ncol, info->dirs) !=
+      (size_t) *h * info->ncol) {
+    perror("Error reading temporary direction file");
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Find the cell downstream of local cell i of the tile starting at row s,
+ * with h rows.  Returns its local index, NO_SLOT if the flow stops here, or
+ * OUT_OF_TILE with the global row and column in *tr and *tc.
+ */
+static unsigned int tile_down(flowtile_info *info, flowtile_buf *buf,
+                              index_t s, index_t h, unsigned int i,
+                              index_t *tr, index_t *tc)
+{
+  unsigned char dir;
+  index_t r, c;
+
+  dir = buf->dir[i];
+  if (dir == MM || dir == NO_DIR)
+    return NO_SLOT;
+
+  // index_t is unsigned, so -1 wraps to be out of range
+  r = s + i / info->ncol + flowdir_dr[dir];
+  c = i % info->ncol + flowdir_dc[dir];
+  if (r >= info->nrow || c >= info->ncol)
+    return NO_SLOT;
+
+  if (r < s || r >= s + h) {
+    *tr = r;
+    *tc = c;
+    return OUT_OF_TILE;
+  }
+  return (r - s) * info->ncol + c;
+}
+
+/**
+ * Accumulate flow within a tile, in topological order.  Boundary cells start
+ * with the flow injected into their slot, if inject is given.  Leaves the
+ * topological order of the tile's cells in buf->order, and returns its length.
+ */
+static unsigned int tile_accumulate(flowtile_info *info, flowtile_buf *buf,
+                                    index_t s, index_t h,
+                                    const unsigned int *inject)
+{
+  unsigned int n, i, d, head, tail;
+  index_t r, tr, tc;
+
+  n = h * info->ncol;
+  memset(buf->indeg, 0, n);
+
+  for (i = 0; i < n; i++) {
+    buf->accu[i] = buf->dir[i] == NO_DIR ? 0 : 1;
+    d = tile_down(info, buf, s, h, i, &tr, &tc);
+    if (d != NO_SLOT && d != OUT_OF_TILE)
+      buf->indeg[d]++;
+  }
+  if (inject) {
+    for (r = s; r < s + h; r++) {
+      if (info->rowslot[r] == (index_t) -1)
+        continue;
+      for (i = 0; i < info->ncol; i++)
+        buf->accu[(r - s) * info->ncol + i] += inject[info->rowslot[r] + i];
+    }
+  }
+
+  // Kahn's algorithm, with the order array doubling as the queue
+  head = tail = 0;
+  for (i = 0; i < n; i++)
+    if (buf->indeg[i] == 0 && buf->dir[i] != NO_DIR)
+      buf->order[tail++] = i;
+  while (head < tail) {
+    i = buf->order[head++];
+    d = tile_down(info, buf, s, h, i, &tr, &tc);
+    if (d == NO_SLOT || d == OUT_OF_TILE)
+      continue;
+    buf->accu[d] += buf->accu[i];
+    if (--buf->indeg[d] == 0)
+      buf->order[tail++] = d;
+  }
+
+  return tail;
+}
+
+/**
+ * Second pass: accumulate each tile on its own and record, for every
+ * boundary cell, its local accumulation and where its flow goes next in the
+ * boundary graph.
+ */
+static int tiled_boundaries(flowtile_info *info, flowtile_buf *buf)
+{
+  index_t k, s, h, tr = 0, tc = 0, r;
+  unsigned int norder, i, d, slot;
+  long j;
+
+  for (k = 0; k < info->ntile; k++) {
+    if (load_tile(info, buf, k, &s, &h) != 0)
+      return -1;
+    norder = tile_accumulate(info, buf, s, h, NULL);
+
+    // next boundary cell downstream of each cell, filled in reverse
+    // topological order so the downstream cell is always done first
+    for (j = (long) norder - 1; j >= 0; j--) {
+      i = buf->order[j];
+      buf->next[i] = NO_SLOT;
+      d = tile_down(info, buf, s, h, i, &tr, &tc);
+      if (d == NO_SLOT || d == OUT_OF_TILE)
+        continue;
+      r = s + d / info->ncol;
+      if (info->rowslot[r] != (index_t) -1)
+        buf->next[i] = info->rowslot[r] + d % info->ncol;
+      else
+        buf->next[i] = buf->next[d];
+    }
+
+    // fill in this tile's boundary slots
+    for (r = s; r < s + h; r++) {
+      if (info->rowslot[r] == (index_t) -1)
+        continue;
+      for (i = (r - s) * info->ncol; i < (r - s + 1) * info->ncol; i++) {
+        slot = info->rowslot[r] + i % info->ncol;
+        info->blocal[slot] = buf->accu[i];
+        info->bnext[slot] = NO_SLOT;
+        info->bcross[slot] = NO_SLOT;
+
+        d = tile_down(info, buf, s, h, i, &tr, &tc);
+        if (d == OUT_OF_TILE) {
+          // the row flowed into is a boundary row of the neighboring tile
+          assert(info->rowslot[tr] != (index_t) -1);
+          info->bcross[slot] = info->rowslot[tr] + tc;
+        }else if (d != NO_SLOT)
+          info->bnext[slot] = buf->next[i];
+      }
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Resolve the flow entering each boundary cell from other tiles, by passing
+ * flow through the boundary graph in topological order.
+ */
+static int resolve_boundaries(flowtile_info *info)
+{
+  unsigned int *indeg, *queue;
+  unsigned int i, t, head, tail, total;
+
+  indeg = (unsigned int*) calloc(info->nslot, sizeof(unsigned int));
+  queue = (unsigned int*) malloc(info->nslot * sizeof(unsigned int));
+  if (!indeg || !queue) {
+    perror("Could not allocate boundary graph");
+    free(indeg);
+    free(queue);
+    return -1;
+  }
+
+  for (i = 0; i < info->nslot; i++) {
+    info->bextra[i] = 0;
+    info->binflow[i] = 0;
+    if (info->bnext[i] != NO_SLOT)
+      indeg[info->bnext[i]]++;
+    if (info->bcross[i] != NO_SLOT)
+      indeg[info->bcross[i]]++;
+  }
+
+  head = tail = 0;
+  for (i = 0; i < info->nslot; i++)
+    if (indeg[i] == 0)
+      queue[tail++] = i;
+  while (head < tail) {
+    i = queue[head++];
+    if (info->bnext[i] != NO_SLOT) {
+      // only the outside flow travels on; the tile's own flow is already
+      // counted in the local accumulation downstream
+      t = info->bnext[i];
+      info->bextra[t] += info->bextra[i];
+    }else if (info->bcross[i] != NO_SLOT) {
+      // everything leaves the tile here
+      t = info->bcross[i];
+      total = info->blocal[i] + info->bextra[i];
+      info->bextra[t] += total;
+      info->binflow[t] += total;
+    }else
+      continue;
+    if (--indeg[t] == 0)
+      queue[tail++] = t;
+  }
+  assert(tail == info->nslot);
+
+  free(indeg);
+  free(queue);
+  return 0;
+}
+
+/**
+ * Third pass: accumulate each tile again with the flow entering from other
+ * tiles injected at its boundary, and write the final accumulation out.
+ */
+static int tiled_output(flowtile_info *info, flowtile_buf *buf, FILE *out)
+{
+  index_t k, s, h, i;
+
+  for (k = 0; k < info->ntile; k++) {
+    if (load_tile(info, buf, k, &s, &h) != 0)
+      return -1;
+    tile_accumulate(info, buf, s, h, info->binflow);
+
+    for (i = 0; i < h * info->ncol; i++) {
+      fprintf(out, "%u ", buf->accu[i]);
+      if (i % info->ncol == info->ncol - 1)
+        fprintf(out, "\n");
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Approximate memory needed to process the grid in tiles of h rows.
+ */
+static size_t tile_memory(flowtile_info *info, index_t h)
+{
+  return (size_t) h * info->ncol * FLOWTILE_CELL_BYTES
+       + (size_t) 2 * ((info->nrow + h - 1) / h) * info->ncol
+                    * FLOWTILE_BOUNDARY_BYTES;
+}
+
+/**
+ * Calculate flow direction and flow accumulation for an elevation grid that
+ * is too large to fit in memory, keeping the working set near mem_bytes.
+ *
+ * The elevation grid is read once, through a three row window, to calculate
+ * flow directions; these are kept in a temporary file at one byte per cell.
+ * The grid is then cut into tiles of whole rows, sized to the memory budget.
+ * Flow is accumulated within each tile on its own, and for the boundary rows
+ * of each tile we record where their flow goes: into a boundary cell further
+ * down the same tile, or across into the next tile.  This boundary graph is
+ * small enough to keep in memory, and passing flow through it in topological
+ * order gives the flow entering every tile from outside.  A final pass
+ * accumulates each tile again with that flow injected at its boundary.
+ *
+ * Directions follow the same rules as flow_direction(); the accumulation is
+ * written as an UINT grid with NODATA 0, as with flow_accumulation_parallel().
+ * flow_path may be NULL to skip writing the directions.
+ */
+int flow_tiled(const char *elev_path, const char *flow_path,
+               const char *accu_path, size_t mem_bytes)
+{
+  flowtile_info info;
+  flowtile_buf buf;
+  Grid meta;
+  FILE *in, *flowout, *accuout;
+  index_t h, next, r, k;
+  int result;
+  static char tbuf[256];
+
+  memset(&info, 0, sizeof(info));
+  memset(&buf, 0, sizeof(buf));
+  flowout = accuout = NULL;
+  result = -1;
+
+  in = fopen(elev_path, "r");
+  if (!in) {
+    fprintf(stderr, "Could not open input file (%s).\n", elev_path);
+    perror(NULL);
+    return -1;
+  }
+  if (read_header(in, &meta) != 0) {
+    fclose(in);
+    return -1;
+  }
+  info.nrow = meta.nrow;
+  info.ncol = meta.ncol;
+
+  // the slots, the tile buffers and the accumulation are unsigned ints, with
+  // the two values at the top kept for NO_SLOT and OUT_OF_TILE
+  if ((unsigned long long) info.nrow * info.ncol >= OUT_OF_TILE) {
+    fprintf(stderr, "Grid is too big to tile (" DGI_FMT " x " DGI_FMT
+            " cells).\n", info.nrow, info.ncol);
+    fclose(in);
+    return -1;
+  }
+
+  // pick the tallest tiles that fit.  Shorter tiles mean more boundary rows,
+  // so past some point shrinking them only costs more memory
+  h = mem_bytes / (FLOWTILE_CELL_BYTES * info.ncol);
+  h = MAX(MIN(h, info.nrow), 1);
+  while (h > 1 && tile_memory(&info, h) > mem_bytes) {
+    next = h - h / 8 - 1;
+    next = MAX(next, 1);
+    if (tile_memory(&info, next) >= tile_memory(&info, h))
+      break;
+    h = next;
+  }
+  if (tile_memory(&info, h) > mem_bytes)
+    fprintf(stderr, "Memory budget is too small, using %zu bytes\n",
+            tile_memory(&info, h));
+  info.tile_rows = h;
+  info.ntile = (info.nrow + h - 1) / h;
+  printf("flow_tiled: " DGI_FMT " tiles of " DGI_FMT " rows\n",
+         info.ntile, info.tile_rows);
+
+  // assign boundary slots
+  info.rowslot = (index_t*) malloc(info.nrow * sizeof(index_t));
+  if (!info.rowslot) {
+    perror("Could not allocate row slots");
+    goto done;
+  }
+  info.nslot = 0;
+  for (r = 0; r < info.nrow; r++)
+    info.rowslot[r] = (index_t) -1;
+  for (k = 0; k < info.ntile; k++) {
+    r = k * h;
+    info.rowslot[r] = info.nslot;
+    info.nslot += info.ncol;
+    r = MIN(r + h, info.nrow) - 1;
+    if (info.rowslot[r] == (index_t) -1) {
+      info.rowslot[r] = info.nslot;
+      info.nslot += info.ncol;
+    }
+  }
+
+  // open outputs
+  if (flow_path) {
+    flowout = fopen(flow_path, "w");
+    if (!flowout) {
+      fprintf(stderr, "Could not open output file (%s).\n", flow_path);
+      perror(NULL);
+      goto done;
+    }
+    write_header(flowout, &meta);
+    fprintf(flowout, "NODATA_value  %hhu\n", (unsigned char) NO_DIR);
+  }
+  accuout = fopen(accu_path, "w");
+  if (!accuout) {
+    fprintf(stderr, "Could not open output file (%s).\n", accu_path);
+    perror(NULL);
+    goto done;
+  }
+  info.dirs = tmpfile();
+  if (!info.dirs) {
+    perror("Could not create temporary direction file");
+    goto done;
+  }
+
+  // pass 1: directions
+  rt_start(rt);
+  if (tiled_directions(in, &meta, info.dirs, flowout) != 0)
+    goto done;
+  rt_stop(rt);
+  rt_sprint(tbuf, rt);
+  printf("flow_tiled directions\t%s\n", tbuf);
+
+  // allocate tile buffers and the boundary graph
+  buf.dir = (unsigned char*) malloc(h * info.ncol);
+  buf.indeg = (unsigned char*) malloc(h * info.ncol);
+  buf.accu = (unsigned int*) malloc(h * info.ncol * sizeof(unsigned int));
+  buf.order = (unsigned int*) malloc(h * info.ncol * sizeof(unsigned int));
+  buf.next = (unsigned int*) malloc(h * info.ncol * sizeof(unsigned int));
+  info.blocal = (unsigned int*) malloc(info.nslot * sizeof(unsigned int));
+  info.bnext = (unsigned int*) malloc(info.nslot * sizeof(unsigned int));
+  info.bcross = (unsigned int*) malloc(info.nslot * sizeof(unsigned int));
+  info.bextra = (unsigned int*) malloc(info.nslot * sizeof(unsigned int));
+  info.binflow = (unsigned int*) malloc(info.nslot * sizeof(unsigned int));
+  if (!buf.dir || !buf.indeg || !buf.accu || !buf.order || !buf.next ||
+      !info.blocal || !info.bnext || !info.bcross || !info.bextra ||
+      !info.binflow) {
+    perror("Could not allocate tile buffers");
+    goto done;
+  }
+
+  // pass 2: the boundary graph
+  rt_start(rt);
+  if (tiled_boundaries(&info, &buf) != 0 || resolve_boundaries(&info) != 0)
+    goto done;
+  rt_stop(rt);
+  rt_sprint(tbuf, rt);
+  printf("flow_tiled boundaries\t%s\n", tbuf);
+
+  // pass 3: final accumulation
+  rt_start(rt);
+  write_header(accuout, &meta);
+  fprintf(accuout, "NODATA_value  %u\n", 0);
+  if (tiled_output(&info, &buf, accuout) != 0)
+    goto done;
+  rt_stop(rt);
+  rt_sprint(tbuf, rt);
+  printf("flow_tiled accumulation\t%s\n", tbuf);
+
+  result = 0;
+
+done:
+  fclose(in);
+  if (flowout)
+    fclose(flowout);
+  if (accuout)
+    fclose(accuout);
+  if (info.dirs)
+    fclose(info.dirs);
+  free(info.rowslot);
+  free(info.blocal);
+  free(info.bnext);
+  free(info.bcross);
+  free(info.bextra);
+  free(info.binflow);
+  free(buf.dir);
+  free(buf.indeg);
+  free(buf.accu);
+  free(buf.order);
+  free(buf.next);
+  return result;
+}
@@ -0,0 +1,29 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _flowtile_h_DEFINED
+#define _flowtile_h_DEFINED
+
+#include <stddef.h>
+
+// approximate working memory per grid cell of a tile, in bytes
+#define FLOWTILE_CELL_BYTES 14
+// approximate memory per cell of the boundary graph, in bytes
+#define FLOWTILE_BOUNDARY_BYTES 28
+
+int flow_tiled(const char *elev_path, const char *flow_path,
+               const char *accu_path, size_t mem_bytes);
+
+#endif
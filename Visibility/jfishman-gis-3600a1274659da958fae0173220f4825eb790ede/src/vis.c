@@ -18,6 +18,7 @@
 #include <math.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "rtimer.h"
 #include "runthreads.h"
@@ -138,7 +139,9 @@ DataSet *brute_viewshed(DataSet *terrain, GridPoint start)
 {
   static Rtimer rt;
   DataSet *viewshed;
+  GridValid *valid;
   GridPoint p;
+  uint64_t end;
   float fNODATA, h;
 
   rt_start(rt);
@@ -151,9 +154,21 @@ DataSet *brute_viewshed(DataSet *terrain, GridPoint start)
   viewshed = dInit(terrain->grid.nrow, terrain->grid.ncol, UCHAR);
   viewshed->grid.ucNODATA = 0;
 
-  for (p.r = 0; p.r < viewshed->grid.nrow; p.r++)
-    for (p.c = 0; p.c < viewshed->grid.ncol; p.c++)
-      dSet(viewshed, p.r, p.c, visible(terrain, start, p, fNODATA));
+  valid = gValid(&terrain->grid);
+  if (!valid) {
+    for (p.r = 0; p.r < viewshed->grid.nrow; p.r++)
+      for (p.c = 0; p.c < viewshed->grid.ncol; p.c++)
+        dSet(viewshed, p.r, p.c, visible(terrain, start, p, fNODATA));
+  } else {
+    // NODATA is never visible, so only the runs of data need a line of sight
+    memset(viewshed->grid.ucData, 0,
+           viewshed->grid.nrow * viewshed->grid.ncol);
+    for (p.r = valid->r0; p.r < valid->r1; p.r++)
+      for (p.c = gio_valid_run(valid, p.r, 0, &end); p.c < valid->ncol;
+           p.c = gio_valid_run(valid, p.r, end, &end))
+        for (; p.c < end; p.c++)
+          dSet(viewshed, p.r, p.c, visible(terrain, start, p, fNODATA));
+  }
 
   rt_stop(rt);
   static char buf[256];
@@ -167,7 +182,9 @@ DataSet *brute_viewshed(DataSet *terrain, GridPoint start)
 unsigned int brute_viewshed_cnt(DataSet *terrain, GridPoint start)
 {
   unsigned int count;
+  GridValid *valid;
   GridPoint p;
+  uint64_t end;
   float fNODATA, h;
 
   fNODATA = getNODATA(terrain);
@@ -176,10 +193,21 @@ unsigned int brute_viewshed_cnt(DataSet *terrain, GridPoint start)
     return 0;
 
   count = 0;
-  for (p.r = 0; p.r < terrain->grid.nrow; p.r++)
-    for (p.c = 0; p.c < terrain->grid.ncol; p.c++)
-      if (visible(terrain, start, p, fNODATA))
-        count ++;
+  valid = terrain->grid.valid;
+  if (!valid) {
+    for (p.r = 0; p.r < terrain->grid.nrow; p.r++)
+      for (p.c = 0; p.c < terrain->grid.ncol; p.c++)
+        if (visible(terrain, start, p, fNODATA))
+          count ++;
+  } else {
+    // run_viewshed_terrain() has worked out where the data is
+    for (p.r = valid->r0; p.r < valid->r1; p.r++)
+      for (p.c = gio_valid_run(valid, p.r, 0, &end); p.c < valid->ncol;
+           p.c = gio_valid_run(valid, p.r, end, &end))
+        for (; p.c < end; p.c++)
+          if (visible(terrain, start, p, fNODATA))
+            count ++;
+  }
 
   return count;
 }
@@ -210,6 +238,8 @@ DataSet *run_viewshed_terrain(DataSet *terrain, int nthread,
   assert(nthread > 0);
 
   fNODATA = getNODATA(terrain);
+  // before the threads, which only read it
+  gValid(&terrain->grid);
 
   vmap = dInit(terrain->grid.nrow, terrain->grid.ncol, UINT);
   assert(vmap);
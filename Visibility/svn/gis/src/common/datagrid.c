@@ -26,96 +26,72 @@
 
 #include "rtimer.h"
 #include "datagrid.h"
+#include "gridio.h"
 
-// load functions for each type
-int gLoadf (FILE *fp, Grid *grid);
-int gLoadi (FILE *fp, Grid *grid);
-int gLoadui(FILE *fp, Grid *grid);
-int gLoads (FILE *fp, Grid *grid);
-int gLoadus(FILE *fp, Grid *grid);
-int gLoadc (FILE *fp, Grid *grid);
-int gLoaduc(FILE *fp, Grid *grid);
+static DataSet* dNew(index_t nrow, index_t ncol, enum GridDataType type);
+static int dSetPath(DataSet *dset, const char *path);
+static void dHeader(Grid *grid, GridIOHeader *hd);
+static void *dRowMajor(Grid *grid);
 
 // load data from file into the data set
+//   ArcASCII files are memory mapped and parsed by every processor at once,
+//   see gio_read(); binary grids of the same type are used in place
 DataSet* dLoad(const char *path, enum GridDataType type)
 {
   static Rtimer rt;
   DataSet* dset;
   Grid *grid;
-  FILE *fp;
-  int result;
+  GridFile *gf;
+  void *data;
 
   rt_start(rt);
 
-  // allocate a new DataSet object
-  dset = (DataSet*) malloc(sizeof(DataSet));
-  if (dset == NULL) {
-    perror("Unable to allocate DataSet object");
-    return NULL;
-  }
-  dset->path = (char*) malloc(strlen(path) + 1);
-  if (dset->path == NULL) {
-    perror("Unable to allocate path string");
-    free(dset);
-    return NULL;
-  }
-  strcpy(dset->path, path);
-  
   // read grid meta info
-  grid = &dset->grid;
-  grid->type = type;
-  fp = fopen(path, "r");
-  if (!fp) {
-    fprintf(stderr, "Could not open input file (%s).\n", path);
-    perror(NULL);
-    free(dset->path);
-    free(dset);
+  gf = gio_open(path);
+  if (!gf)
+    return NULL;
+  if (!gf->hd.has_nodata) {
+    fprintf(stderr, "Could not read grid NODATA_value (%s).\n", path);
+    gio_close(gf);
     return NULL;
   }
 
-  result = fscanf(fp, "ncols\t%i\nnrows\t%i\n",
-                  &grid->hd.ncol, &grid->hd.nrow);
-  if (result != 2) {
-    perror("Could not read grid size.");
-    free(dset->path);
-    free(dset);
-    fclose(fp);
+  // allocate the DataSet, and its data array unless the values can be
+  // taken straight from the mapped file
+  data = gio_data(gf, (enum gridio_type) type);
+  if (data)
+    dset = dNew(gf->hd.nrow, gf->hd.ncol, type);
+  else
+    dset = dInit(gf->hd.nrow, gf->hd.ncol, type);
+  if (!dset) {
+    gio_close(gf);
     return NULL;
   }
-  result = fscanf(fp, "xllcorner\t%f\nyllcorner\t%f\ncellsize\t%f\n"
-                  "NODATA_value\t%f\n", &grid->hd.xllcorner,
-                  &grid->hd.yllcorner, &grid->hd.cellsize,
-                  &grid->hd.NODATA_value);
-  if (result != 4) {
-    printf("%d\n", result);
-    perror("Could not read grid meta data");
-    free(dset->path);
-    free(dset);
-    fclose(fp);
+  if (dSetPath(dset, path) != 0) {
+    dFree(dset);
+    gio_close(gf);
     return NULL;
   }
 
-  result = -1;
-  switch (type) {
-    case FLOAT: result = gLoadf (fp, grid); break;
-    case INT:   result = gLoadi (fp, grid); break;
-    case UINT:  result = gLoadui(fp, grid); break;
-    case SHRT:  result = gLoads (fp, grid); break;
-    case USHRT: result = gLoadus(fp, grid); break;
-    case CHAR:  result = gLoadc (fp, grid); break;
-    case UCHAR: result = gLoaduc(fp, grid); break;
-    default: fprintf(stderr, "Invalid type given\n");
-  }
-  if (result != 0) {
-    free(dset->path);
-    free(dset);
-    fclose(fp);
-    return NULL;
+  grid = &dset->grid;
+  grid->hd.xllcorner = gf->hd.xllcorner;
+  grid->hd.yllcorner = gf->hd.yllcorner;
+  grid->hd.cellsize = gf->hd.cellsize;
+  grid->hd.NODATA_value = gf->hd.nodata;
+  if (data) {
+    // every member of the data union is the same pointer; dFree() unmaps it
+    grid->fData = (float*) data;
+    dset->file = gf;
+  }else {
+    // read grid raw data
+    if (gio_read(gf, (enum gridio_type) type, grid->fData, 0) != 0) {
+      dFree(dset);
+      gio_close(gf);
+      return NULL;
+    }
+    gio_close(gf);
   }
 
-  // close input file
-  fclose(fp);
-
   rt_stop(rt);
   static char buf[256];
   rt_sprint(buf, rt);
@@ -124,449 +100,84 @@ DataSet* dLoad(const char *path, enum GridDataType type)
   return dset;
 }
 
-/**
- * Load a grid of floats from the given file pointer.
- */
-int gLoadf(FILE *fp, Grid *grid)
-{
-  index_t div, mod;
-  float *p, *end;
-#ifndef __APPLE__
-  int result;
-#endif
-
-  // allocate grid
-  grid->data_size = sizeof(float);
-#ifdef __APPLE__
-  grid->fData = (float*) malloc(grid->hd.nrow * grid->hd.ncol * grid->data_size);
-  if (!grid->fData) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            errno, strerror(errno));
-#else
-  result = sysconf(_SC_PAGESIZE);
-  result = posix_memalign((void**)&grid->fData, result,
-                     grid->hd.ncol * grid->hd.nrow * grid->data_size);
-  if (result != 0) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            result, strerror(result));
-#endif
-    return -1;
-  }
-
-  // read grid raw data
-  div = (grid->hd.nrow * grid->hd.ncol) / 16;
-  mod = (grid->hd.nrow * grid->hd.ncol) % 16;
-  p = grid->fData;
-  end = grid->fData + grid->hd.nrow * grid->hd.ncol - mod;
-
-  // loop-unroll by 4
-  if (div > 0) {
-    while (p < end) {
-      p += 15;
-      if (fscanf(fp, "%f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f ",
-                     p  , p--, p--, p--, p--, p--, p--, p--,
-                     p--, p--, p--, p--, p--, p--, p--, p--) != 16) {
-        perror("Error reading grid data");
-        free(grid->fData);
-          return -1;
-      }
-      p += 16;
-    }
-  }
-
-  // finish off the array
-  while (mod-- > 0) {
-    if (fscanf(fp, "%f ", p++) != 1) {
-      perror("Error reading grid data.");
-      free(grid->fData);
-      return -1;
-    }
-  }
-
-  return 0;
-}
-
-/**
- * Load a grid of integers from the given file pointer.
- */
-int gLoadi(FILE *fp, Grid *grid)
-{
-  index_t div, mod;
-  int *p, *end;
-#ifndef __APPLE__
-  int result;
-#endif
-
-  // allocate grid
-  grid->data_size = sizeof(int);
-#ifdef __APPLE__
-  grid->iData = (int*) malloc(grid->hd.nrow * grid->hd.ncol * grid->data_size);
-  if (!grid->iData) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            errno, strerror(errno));
-#else
-  result = sysconf(_SC_PAGESIZE);
-  result = posix_memalign((void**)&grid->iData, result,
-                     grid->hd.ncol * grid->hd.nrow * grid->data_size);
-  if (result != 0) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            result, strerror(result));
-#endif
-    return -1;
-  }
-
-  // read grid raw data
-  div = (grid->hd.nrow * grid->hd.ncol) / 16;
-  mod = (grid->hd.nrow * grid->hd.ncol) % 16;
-  p = grid->iData;
-  end = grid->iData + grid->hd.nrow * grid->hd.ncol - mod;
-
-  // loop-unroll by 4
-  if (div > 0) {
-    while (p < end) {
-      p += 15;
-      if (fscanf(fp, "%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d ",
-                     p  , p--, p--, p--, p--, p--, p--, p--,
-                     p--, p--, p--, p--, p--, p--, p--, p--) != 16) {
-        perror("Error reading grid data");
-        free(grid->iData);
-        return -1;
-      }
-      p += 16;
-    }
-  }
-
-  // finish off the array
-  while (mod-- > 0) {
-    if (fscanf(fp, "%d ", p++) != 1) {
-      perror("Error reading grid data.");
-      free(grid->iData);
-      return -1;
-    }
-  }
-
-  return 0;
-}
-
-/**
- * Load a grid of unsigned integers from the given file pointer.
- */
-int gLoadui(FILE *fp, Grid *grid)
-{
-  index_t div, mod;
-  unsigned int *p, *end;
-#ifndef __APPLE__
-  int result;
-#endif
-
-  // allocate grid
-  grid->data_size = sizeof(unsigned int);
-#ifdef __APPLE__
-  grid->uiData = (unsigned int*) malloc(grid->hd.nrow * grid->hd.ncol *
-                                        grid->data_size);
-  if (!grid->uiData) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            errno, strerror(errno));
-#else
-  result = sysconf(_SC_PAGESIZE);
-  result = posix_memalign((void**)&grid->uiData, result,
-                     grid->hd.ncol * grid->hd.nrow * grid->data_size);
-  if (result != 0) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            result, strerror(result));
-#endif
-    return -1;
-  }
-
-  // read grid raw data
-  div = (grid->hd.nrow * grid->hd.ncol) / 16;
-  mod = (grid->hd.nrow * grid->hd.ncol) % 16;
-  p = grid->uiData;
-  end = grid->uiData + grid->hd.nrow * grid->hd.ncol - mod;
-
-  // loop-unroll by 4
-  if (div > 0) {
-    while (p < end) {
-      p += 15;
-      if (fscanf(fp, "%u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u ",
-                     p  , p--, p--, p--, p--, p--, p--, p--,
-                     p--, p--, p--, p--, p--, p--, p--, p--) != 16) {
-        perror("Error reading grid data");
-        free(grid->uiData);
-        return -1;
-      }
-      p += 16;
-    }
-  }
-
-  // finish off the array
-  while (mod-- > 0) {
-    if (fscanf(fp, "%u ", p++) != 1) {
-      perror("Error reading grid data.");
-      free(grid->uiData);
-      return -1;
-    }
-  }
-
-  return 0;
-}
-
-/**
- * Load a grid of shorts from the given file pointer.
- */
-int gLoads(FILE *fp, Grid *grid)
-{
-  index_t div, mod;
-  short *p, *end;
-#ifndef __APPLE__
-  int result;
-#endif
-
-  // allocate grid
-  grid->data_size = sizeof(short);
-#ifdef __APPLE__
-  grid->sData = (short*) malloc(grid->hd.nrow * grid->hd.ncol * grid->data_size);
-  if (!grid->sData) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            errno, strerror(errno));
-#else
-  result = sysconf(_SC_PAGESIZE);
-  result = posix_memalign((void**)&grid->sData, result,
-                     grid->hd.ncol * grid->hd.nrow * grid->data_size);
-  if (result != 0) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            result, strerror(result));
-#endif
-    return -1;
-  }
-
-  // read grid raw data
-  div = (grid->hd.nrow * grid->hd.ncol) / 16;
-  mod = (grid->hd.nrow * grid->hd.ncol) % 16;
-  p = grid->sData;
-  end = grid->sData + grid->hd.nrow * grid->hd.ncol - mod;
-
-  // loop-unroll by 4
-  if (div > 0) {
-    while (p < end) {
-      p += 15;
-      if (fscanf(fp, "%hd %hd %hd %hd %hd %hd %hd %hd "
-                     "%hd %hd %hd %hd %hd %hd %hd %hd ",
-                     p  , p--, p--, p--, p--, p--, p--, p--,
-                     p--, p--, p--, p--, p--, p--, p--, p--) != 16) {
-        perror("Error reading grid data");
-        free(grid->sData);
-        return -1;
-      }
-      p += 16;
-    }
-  }
-
-  // finish off the array
-  while (mod-- > 0) {
-    if (fscanf(fp, "%hd ", p++) != 1) {
-      perror("Error reading grid data.");
-      free(grid->sData);
-      return -1;
-    }
-  }
-
-  return 0;
-}
-
-/**
- * Load a grid of unsigned shorts from the given file pointer.
- */
-int gLoadus(FILE *fp, Grid *grid)
+// load the nrow x ncol window of a grid whose top left cell is (row, col)
+//   from a tiled grid only the tiles under the window are decoded
+DataSet* dLoadWindow(const char *path, enum GridDataType type, index_t row,
+                     index_t col, index_t nrow, index_t ncol)
 {
-  index_t div, mod;
-  unsigned short *p, *end;
-#ifndef __APPLE__
-  int result;
-#endif
-
-  // allocate grid
-  grid->data_size = sizeof(unsigned short);
-#ifdef __APPLE__
-  grid->usData = (unsigned short*) malloc(grid->hd.nrow * grid->hd.ncol *
-                                          grid->data_size);
-  if (!grid->usData) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            errno, strerror(errno));
-#else
-  result = sysconf(_SC_PAGESIZE);
-  result = posix_memalign((void**)&grid->usData, result,
-                     grid->hd.ncol * grid->hd.nrow * grid->data_size);
-  if (result != 0) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            result, strerror(result));
-#endif
-    return -1;
-  }
+  DataSet* dset;
+  Grid *grid;
+  GridFile *gf;
 
-  // read grid raw data
-  div = (grid->hd.nrow * grid->hd.ncol) / 16;
-  mod = (grid->hd.nrow * grid->hd.ncol) % 16;
-  p = grid->usData;
-  end = grid->usData + grid->hd.nrow * grid->hd.ncol - mod;
-
-  // loop-unroll by 4
-  if (div > 0) {
-    while (p < end) {
-      p += 15;
-      if (fscanf(fp, "%hu %hu %hu %hu %hu %hu %hu %hu "
-                     "%hu %hu %hu %hu %hu %hu %hu %hu ",
-                     p  , p--, p--, p--, p--, p--, p--, p--,
-                     p--, p--, p--, p--, p--, p--, p--, p--) != 16) {
-        perror("Error reading grid data");
-        free(grid->usData);
-        return -1;
-      }
-      p += 16;
-    }
+  gf = gio_open(path);
+  if (!gf)
+    return NULL;
+  dset = dInit(nrow, ncol, type);
+  if (!dset || dSetPath(dset, path) != 0 ||
+      gio_read_window(gf, (enum gridio_type) type, row, col, nrow, ncol,
+                      dset->grid.fData) != 0) {
+    if (dset)
+      dFree(dset);
+    gio_close(gf);
+    return NULL;
   }
 
-  // finish off the array
-  while (mod-- > 0) {
-    if (fscanf(fp, "%hu ", p++) != 1) {
-      perror("Error reading grid data.");
-      free(grid->usData);
-      return -1;
-    }
-  }
+  // the window's own lower left corner
+  grid = &dset->grid;
+  grid->hd.xllcorner = gf->hd.xllcorner + col * gf->hd.cellsize;
+  grid->hd.yllcorner = gf->hd.yllcorner +
+                    (gf->hd.nrow - row - nrow) * gf->hd.cellsize;
+  grid->hd.cellsize = gf->hd.cellsize;
+  grid->hd.NODATA_value = gf->hd.nodata;
+  gio_close(gf);
 
-  return 0;
+  return dset;
 }
 
-/**
- * Load a grid of chars from the given file pointer.
- */
-int gLoadc(FILE *fp, Grid *grid)
+// allocate a DataSet with an empty path and no data array
+static DataSet* dNew(index_t nrow, index_t ncol, enum GridDataType type)
 {
-  index_t div, mod;
-  char *p, *end;
-#ifndef __APPLE__
-  int result;
-#endif
-
-  // allocate grid
-  grid->data_size = sizeof(char);
-#ifdef __APPLE__
-  grid->cData = (char*) malloc(grid->hd.nrow * grid->hd.ncol *
-                                          grid->data_size);
-  if (!grid->cData) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            errno, strerror(errno));
-#else
-  result = sysconf(_SC_PAGESIZE);
-  result = posix_memalign((void**)&grid->cData, result,
-                     grid->hd.ncol * grid->hd.nrow * grid->data_size);
-  if (result != 0) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            result, strerror(result));
-#endif
-    return -1;
-  }
+  DataSet* dset;
 
-  // read grid raw data
-  div = (grid->hd.nrow * grid->hd.ncol) / 16;
-  mod = (grid->hd.nrow * grid->hd.ncol) % 16;
-  p = grid->cData;
-  end = grid->cData + grid->hd.nrow * grid->hd.ncol - mod;
-
-  // loop-unroll by 4
-  if (div > 0) {
-    while (p < end) {
-      p += 15;
-      if (fscanf(fp, "%hhd %hhd %hhd %hhd %hhd %hhd %hhd %hhd "
-                     "%hhd %hhd %hhd %hhd %hhd %hhd %hhd %hhd ",
-                     p  , p--, p--, p--, p--, p--, p--, p--,
-                     p--, p--, p--, p--, p--, p--, p--, p--) != 16) {
-        perror("Error reading grid data");
-        free(grid->cData);
-        return -1;
-      }
-      p += 16;
-    }
+  dset = (DataSet*) malloc(sizeof(DataSet));
+  if (dset == NULL) {
+    perror("Unable to allocate DataSet object");
+    return NULL;
   }
-
-  // finish off the array
-  while (mod-- > 0) {
-    if (fscanf(fp, "%hhd ", p++) != 1) {
-      perror("Error reading grid data.");
-      free(grid->cData);
-      return -1;
-    }
+  dset->path = (char*) malloc(1);
+  if (dset->path == NULL) {
+    perror("Unable to allocate path string");
+    free(dset);
+    return NULL;
   }
-
-  return 0;
+  dset->path[0] = '\0';
+  dset->file = NULL;
+
+  dset->grid.hd.nrow = nrow;
+  dset->grid.hd.ncol = ncol;
+  dset->grid.type = type;
+  dset->grid.data_size = gio_size((enum gridio_type) type);
+  dset->grid.layout = ROWMAJOR;
+  dset->grid.nblockcol = (ncol + GRID_BLOCK - 1) >> GRID_BLOCK_BITS;
+  dset->grid.fData = NULL;
+  return dset;
 }
 
-/**
- * Load a grid of unsigned chars from the given file pointer.
- */
-int gLoaduc(FILE *fp, Grid *grid)
+// replace the path of a DataSet
+static int dSetPath(DataSet *dset, const char *path)
 {
-  index_t div, mod;
-  unsigned char *p, *end;
-#ifndef __APPLE__
-  int result;
-#endif
+  char *tmp;
 
-  // allocate grid
-  grid->data_size = sizeof(unsigned char);
-#ifdef __APPLE__
-  grid->ucData = (unsigned char*) malloc(grid->hd.nrow * grid->hd.ncol *
-                                          grid->data_size);
-  if (!grid->ucData) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            errno, strerror(errno));
-#else
-  result = sysconf(_SC_PAGESIZE);
-  result = posix_memalign((void**)&grid->ucData, result,
-                     grid->hd.ncol * grid->hd.nrow * grid->data_size);
-  if (result != 0) {
-    fprintf(stderr, "Could not allocate data array: [Errno %d] %s\n",
-            result, strerror(result));
-#endif
+  tmp = (char*) realloc(dset->path, strlen(path) + 1);
+  if (!tmp) {
+    perror("Couldn't reallocate path string");
     return -1;
   }
-
-  // read grid raw data
-  div = (grid->hd.nrow * grid->hd.ncol) / 16;
-  mod = (grid->hd.nrow * grid->hd.ncol) % 16;
-  p = grid->ucData;
-  end = grid->ucData + grid->hd.nrow * grid->hd.ncol - mod;
-
-  // loop-unroll by 4
-  if (div > 0) {
-    while (p < end) {
-      p += 15;
-      if (fscanf(fp, "%hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu "
-                     "%hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu ",
-                     p  , p--, p--, p--, p--, p--, p--, p--,
-                     p--, p--, p--, p--, p--, p--, p--, p--) != 16) {
-        perror("Error reading grid data");
-        free(grid->ucData);
-        return -1;
-      }
-      p += 16;
-    }
-  }
-
-  // finish off the array
-  while (mod-- > 0) {
-    if (fscanf(fp, "%hhu ", p++) != 1) {
-      perror("Error reading grid data.");
-      free(grid->ucData);
-      return -1;
-    }
-  }
-
+  dset->path = tmp;
+  strcpy(dset->path, path);
   return 0;
 }
 
-
 DataSet* dInit(index_t nrow, index_t ncol, enum GridDataType type)
 {
   DataSet* dset;
@@ -574,23 +185,11 @@ DataSet* dInit(index_t nrow, index_t ncol, enum GridDataType type)
   int align, result;
 
   // allocate a new DataSet object
-  dset = (DataSet*) malloc(sizeof(DataSet));
-  if (dset == NULL) {
-    perror("Unable to allocate DataSet object");
-    return NULL;
-  }
-  dset->path = (char*) malloc(1);
-  if (dset->path == NULL) {
-    perror("Unable to allocate path string");
-    free(dset);
+  dset = dNew(nrow, ncol, type);
+  if (dset == NULL)
     return NULL;
-  }
-  dset->path[0] = '\0';
-
   grid = &dset->grid;
-  grid->hd.nrow = nrow;
-  grid->hd.ncol = ncol;
-  
+
   // allocate (empty) data array
   result = -1;
   align = sysconf(_SC_PAGESIZE);
@@ -684,27 +283,20 @@ DataSet* dInit(index_t nrow, index_t ncol, enum GridDataType type)
   return dset;
 }
 
-// storage functions for each type
-int gStoref (FILE *fp, Grid *grid);
-int gStorei (FILE *fp, Grid *grid);
-int gStoreui(FILE *fp, Grid *grid);
-int gStores (FILE *fp, Grid *grid);
-int gStoreus(FILE *fp, Grid *grid);
-int gStorec (FILE *fp, Grid *grid);
-int gStoreuc(FILE *fp, Grid *grid);
-
 /**
  * Store a DataSet containing a grid of any valid type in a file at the given
  * location.
  *
- * Stores data in Arc/Info ASCII Grid format.
+ * Stores data in Arc/Info ASCII Grid format, as a checksummed binary grid
+ * when the path ends in GIO_BIN_SUFFIX, or as a tiled grid when it ends in
+ * GIO_TILE_SUFFIX.
  */
 int dStore(DataSet *dset, const char *path)
 {
   static Rtimer rt;
   FILE *fp;
   Grid *grid;
-  char *tmp;
+  void *data;
   int result;
 
   rt_start(rt);
@@ -712,6 +304,11 @@ int dStore(DataSet *dset, const char *path)
   assert(dset);
   assert(dset->path);
 
+  if (gio_wants_binary(path))
+    return dStoreBinary(dset, path, GIO_BIN_CHECKSUM);
+  if (gio_wants_tiled(path))
+    return dStoreTiled(dset, path);
+
   grid = &dset->grid;
   fp = fopen(path, "w");
   if (!fp) {
@@ -721,16 +318,10 @@ int dStore(DataSet *dset, const char *path)
   }
 
   // set path
-  if (strlen(dset->path) != strlen(path)) {
-    tmp = realloc(dset->path, strlen(path));
-    if (!tmp) {
-      perror("Couldn't reallocate path string");
-      fclose(fp);
-      return -1;
-    }
-    dset->path = tmp;
+  if (dSetPath(dset, path) != 0) {
+    fclose(fp);
+    return -1;
   }
-  strcpy(dset->path, path);
 
   // store meta data
   fprintf(fp, "ncols         %i\n", grid->hd.ncol);
@@ -739,18 +330,16 @@ int dStore(DataSet *dset, const char *path)
   fprintf(fp, "yllcorner     %f\n", grid->hd.yllcorner);
   fprintf(fp, "cellsize      %f\n", grid->hd.cellsize);
 
-  result = -1;
-  switch (grid->type) {
-    case FLOAT: result = gStoref (fp, grid); break;
-    case INT:   result = gStorei (fp, grid); break;
-    case UINT:  result = gStoreui(fp, grid); break;
-    case SHRT:  result = gStores (fp, grid); break;
-    case USHRT: result = gStoreus(fp, grid); break;
-    case CHAR:  result = gStorec (fp, grid); break;
-    case UCHAR: result = gStoreuc(fp, grid); break;
-    default: fprintf(stderr,
-                     "Invalid type set in DataSet argument to dStore()?\n");
+  // store grid raw data, formatted as "%f"
+  data = dRowMajor(grid);
+  if (!data) {
+    fclose(fp);
+    return -1;
   }
+  result = gio_write_rows(fp, (enum gridio_type) grid->type, data,
+                          grid->hd.nrow, grid->hd.ncol, 6, 0);
+  if (data != grid->fData)
+    free(data);
   if (result != 0) {
     fclose(fp);
     return -1;
@@ -768,349 +357,190 @@ int dStore(DataSet *dset, const char *path)
 }
 
 
-int gStoref(FILE *fp, Grid *grid)
+// fill a gridio header from a grid
+static void dHeader(Grid *grid, GridIOHeader *hd)
 {
-  index_t div, mod, i, c;
-  float *p, *end;
-
-  // read grid raw data
-  div = grid->hd.ncol / 16;
-  mod = grid->hd.ncol % 16;
-  c = 0;
-  p = grid->fData;
-  end = grid->fData + grid->hd.nrow * grid->hd.ncol - mod;
-
-  while (p < end) {
-    // loop-unroll by 4
-    if (div > 0) {
-      c = 0;
-      i = grid->hd.ncol - mod;
-      while (c < i) {
-        p += 15;
-        if (fprintf(fp, "%f %f %f %f %f %f %f %f "
-                        "%f %f %f %f %f %f %f %f ",
-                        *p  , *p--, *p--, *p--, *p--, *p--, *p--, *p--,
-                        *p--, *p--, *p--, *p--, *p--, *p--, *p--, *p--) <= 0) {
-          perror("Error writing grid data");
-          return -1;
-        }
-        c += 16;
-        p += 16;
-      }
-    }
-    // finish off the row
-    i = mod;
-    while (i-- > 0) {
-      if (fprintf(fp, "%f ", *p++) <= 0) {
-        perror("Error writing grid data.");
-        return -1;
-      }
-    }
-    // print endline character
-    if (fprintf(fp, "\n") <= 0) {
-      perror("Error writing grid data.");
-      return -1;
-    }
-  }
-
-  return 0;
+  memset(hd, 0, sizeof(*hd));
+  hd->nrow = grid->hd.nrow;
+  hd->ncol = grid->hd.ncol;
+  hd->xllcorner = grid->hd.xllcorner;
+  hd->yllcorner = grid->hd.yllcorner;
+  hd->cellsize = grid->hd.cellsize;
+  hd->nodata = grid->hd.NODATA_value;
+  hd->has_nodata = 1;
 }
 
-int gStorei(FILE *fp, Grid *grid)
+/**
+ * Store a DataSet as a binary grid: the header, then the raw data array
+ * starting on a page boundary, then (with GIO_BIN_CHECKSUM) a crc32 per row.
+ * dLoad() maps such a file back without parsing or copying.
+ */
+int dStoreBinary(DataSet *dset, const char *path, int flags)
 {
-  index_t div, mod, i, c;
-  int *p, *end;
+  static Rtimer rt;
+  GridIOHeader hd;
+  Grid *grid;
+  void *data;
+  int result;
 
-  // read grid raw data
-  div = grid->hd.ncol / 16;
-  mod = grid->hd.ncol % 16;
-  c = 0;
-  p = grid->iData;
-  end = grid->iData + grid->hd.nrow * grid->hd.ncol - mod;
-
-  while (p < end) {
-    // loop-unroll by 4
-    if (div > 0) {
-      c = 0;
-      i = grid->hd.ncol - mod;
-      while (c < i) {
-        p += 15;
-        if (fprintf(fp, "%d %d %d %d %d %d %d %d "
-                        "%d %d %d %d %d %d %d %d ",
-                        *p  , *p--, *p--, *p--, *p--, *p--, *p--, *p--,
-                        *p--, *p--, *p--, *p--, *p--, *p--, *p--, *p--) <= 0) {
-          perror("Error writing grid data");
-          return -1;
-        }
-        c += 16;
-        p += 16;
-      }
-    }
-    // finish off the row
-    i = mod;
-    while (i-- > 0) {
-      if (fprintf(fp, "%d ", *p++) <= 0) {
-        perror("Error writing grid data.");
-        return -1;
-      }
-    }
-    // print endline character
-    if (fprintf(fp, "\n") <= 0) {
-      perror("Error writing grid data.");
-      return -1;
-    }
-  }
+  rt_start(rt);
 
-  return 0;
-}
+  assert(dset);
+  assert(dset->path);
 
-int gStoreui(FILE *fp, Grid *grid)
-{
-  index_t div, mod, i, c;
-  unsigned int *p, *end;
+  grid = &dset->grid;
+  dHeader(grid, &hd);
+  data = dRowMajor(grid);
+  if (!data)
+    return -1;
 
-  // read grid raw data
-  div = grid->hd.ncol / 16;
-  mod = grid->hd.ncol % 16;
-  c = 0;
-  p = grid->uiData;
-  end = grid->uiData + grid->hd.nrow * grid->hd.ncol - mod;
-
-  while (p < end) {
-    // loop-unroll by 4
-    if (div > 0) {
-      c = 0;
-      i = grid->hd.ncol - mod;
-      while (c < i) {
-        p += 15;
-        if (fprintf(fp, "%u %u %u %u %u %u %u %u "
-                        "%u %u %u %u %u %u %u %u ",
-                        *p  , *p--, *p--, *p--, *p--, *p--, *p--, *p--,
-                        *p--, *p--, *p--, *p--, *p--, *p--, *p--, *p--) <= 0) {
-          perror("Error writing grid data");
-          return -1;
-        }
-        c += 16;
-        p += 16;
-      }
-    }
-    // finish off the row
-    i = mod;
-    while (i-- > 0) {
-      if (fprintf(fp, "%u ", *p++) <= 0) {
-        perror("Error writing grid data.");
-        return -1;
-      }
-    }
-    // print endline character
-    if (fprintf(fp, "\n") <= 0) {
-      perror("Error writing grid data.");
-      return -1;
-    }
-  }
+  result = gio_write_binary(path, &hd, (enum gridio_type) grid->type, data,
+                            flags);
+  if (data != grid->fData)
+    free(data);
+  if (result != 0)
+    return -1;
+  if (dSetPath(dset, path) != 0)
+    return -1;
+
+  rt_stop(rt);
+  static char buf[256];
+  rt_sprint(buf, rt);
+  printf("dStoreBinary(grid,'%s'):\t%s\n", path, buf);
 
   return 0;
 }
 
-int gStores(FILE *fp, Grid *grid)
+
+/**
+ * Store a DataSet as a tiled grid: GIO_TILE-square tiles, each compressed on
+ * its own, so a window of the grid can be read back without the rest.
+ */
+int dStoreTiled(DataSet *dset, const char *path)
 {
-  index_t div, mod, i, c;
-  short *p, *end;
+  static Rtimer rt;
+  GridIOHeader hd;
+  Grid *grid;
+  void *data;
+  int result;
 
-  // read grid raw data
-  div = grid->hd.ncol / 16;
-  mod = grid->hd.ncol % 16;
-  c = 0;
-  p = grid->sData;
-  end = grid->sData + grid->hd.nrow * grid->hd.ncol - mod;
-
-  while (p < end) {
-    // loop-unroll by 4
-    if (div > 0) {
-      c = 0;
-      i = grid->hd.ncol - mod;
-      while (c < i) {
-        p += 15;
-        if (fprintf(fp, "%hd %hd %hd %hd %hd %hd %hd %hd "
-                        "%hd %hd %hd %hd %hd %hd %hd %hd ",
-                        *p  , *p--, *p--, *p--, *p--, *p--, *p--, *p--,
-                        *p--, *p--, *p--, *p--, *p--, *p--, *p--, *p--) <= 0) {
-          perror("Error writing grid data");
-          return -1;
-        }
-        c += 16;
-        p += 16;
-      }
-    }
-    // finish off the row
-    i = mod;
-    while (i-- > 0) {
-      if (fprintf(fp, "%hd ", *p++) <= 0) {
-        perror("Error writing grid data.");
-        return -1;
-      }
-    }
-    // print endline character
-    if (fprintf(fp, "\n") <= 0) {
-      perror("Error writing grid data.");
-      return -1;
-    }
-  }
+  rt_start(rt);
+
+  assert(dset);
+  assert(dset->path);
+
+  grid = &dset->grid;
+  dHeader(grid, &hd);
+  data = dRowMajor(grid);
+  if (!data)
+    return -1;
+  result = gio_write_tiled(path, &hd, (enum gridio_type) grid->type, data, 0);
+  if (data != grid->fData)
+    free(data);
+  if (result != 0)
+    return -1;
+  if (dSetPath(dset, path) != 0)
+    return -1;
+
+  rt_stop(rt);
+  static char buf[256];
+  rt_sprint(buf, rt);
+  printf("dStoreTiled(grid,'%s'):\t%s\n", path, buf);
 
   return 0;
 }
 
-int gStoreus(FILE *fp, Grid *grid)
+// copy the runs of at most GRID_BLOCK values that every row of the grid
+//   splits into, from the array in layout from into the array in layout to
+static void dCopyRuns(Grid *grid, enum GridLayout from, const char *src,
+                      enum GridLayout to, char *dst)
 {
-  index_t div, mod, i, c;
-  unsigned short *p, *end;
-
-  // read grid raw data
-  div = grid->hd.ncol / 16;
-  mod = grid->hd.ncol % 16;
-  c = 0;
-  p = grid->usData;
-  end = grid->usData + grid->hd.nrow * grid->hd.ncol - mod;
-
-  while (p < end) {
-    // loop-unroll by 4
-    if (div > 0) {
-      c = 0;
-      i = grid->hd.ncol - mod;
-      while (c < i) {
-        p += 15;
-        if (fprintf(fp, "%hu %hu %hu %hu %hu %hu %hu %hu "
-                        "%hu %hu %hu %hu %hu %hu %hu %hu ",
-                        *p  , *p--, *p--, *p--, *p--, *p--, *p--, *p--,
-                        *p--, *p--, *p--, *p--, *p--, *p--, *p--, *p--) <= 0) {
-          perror("Error writing grid data");
-          return -1;
-        }
-        c += 16;
-        p += 16;
-      }
-    }
-    // finish off the row
-    i = mod;
-    while (i-- > 0) {
-      if (fprintf(fp, "%hu ", *p++) <= 0) {
-        perror("Error writing grid data.");
-        return -1;
-      }
-    }
-    // print endline character
-    if (fprintf(fp, "\n") <= 0) {
-      perror("Error writing grid data.");
-      return -1;
+  Grid f, t;
+  index_t r, c, n;
+
+  f = t = *grid;
+  f.layout = from;
+  t.layout = to;
+  for (r = 0; r < grid->hd.nrow; r++)
+    for (c = 0; c < grid->hd.ncol; c += GRID_BLOCK) {
+      n = grid->hd.ncol - c < GRID_BLOCK ? grid->hd.ncol - c : GRID_BLOCK;
+      memcpy(dst + dg_index(t, r, c) * grid->data_size,
+             src + dg_index(f, r, c) * grid->data_size,
+             n * grid->data_size);
     }
-  }
-
-  return 0;
 }
 
-int gStorec(FILE *fp, Grid *grid)
+// the data of a grid in ROWMAJOR order; a copy the caller frees unless it
+//   is grid->fData itself
+static void *dRowMajor(Grid *grid)
 {
-  index_t div, mod, i, c;
-  char *p, *end;
+  char *data;
 
-  // read grid raw data
-  div = grid->hd.ncol / 16;
-  mod = grid->hd.ncol % 16;
-  c = 0;
-  p = grid->cData;
-  end = grid->cData + grid->hd.nrow * grid->hd.ncol - mod;
-
-  while (p < end) {
-    // loop-unroll by 4
-    if (div > 0) {
-      c = 0;
-      i = grid->hd.ncol - mod;
-      while (c < i) {
-        p += 15;
-        if (fprintf(fp, "%hhd %hhd %hhd %hhd %hhd %hhd %hhd %hhd "
-                        "%hhd %hhd %hhd %hhd %hhd %hhd %hhd %hhd ",
-                        *p  , *p--, *p--, *p--, *p--, *p--, *p--, *p--,
-                        *p--, *p--, *p--, *p--, *p--, *p--, *p--, *p--) <= 0) {
-          perror("Error writing grid data");
-          return -1;
-        }
-        c += 16;
-        p += 16;
-      }
-    }
-    // finish off the row
-    i = mod;
-    while (i-- > 0) {
-      if (fprintf(fp, "%hhd ", *p++) <= 0) {
-        perror("Error writing grid data.");
-        return -1;
-      }
-    }
-    // print endline character
-    if (fprintf(fp, "\n") <= 0) {
-      perror("Error writing grid data.");
-      return -1;
-    }
+  if (grid->layout == ROWMAJOR)
+    return grid->fData;
+  data = (char*) malloc((size_t) grid->hd.nrow * grid->hd.ncol *
+                        grid->data_size);
+  if (!data) {
+    perror("Could not allocate data");
+    return NULL;
   }
-
-  return 0;
+  dCopyRuns(grid, grid->layout, (const char*) grid->fData, ROWMAJOR, data);
+  return data;
 }
 
-int gStoreuc(FILE *fp, Grid *grid)
+int dSetLayout(DataSet *dset, enum GridLayout layout)
 {
-  index_t div, mod, i, c;
-  unsigned char *p, *end;
+  static Rtimer rt;
+  Grid *grid;
+  char *data;
+  size_t n;
 
-  // read grid raw data
-  div = grid->hd.ncol / 16;
-  mod = grid->hd.ncol % 16;
-  c = 0;
-  p = grid->ucData;
-  end = grid->ucData + grid->hd.nrow * grid->hd.ncol - mod;
-
-  while (p < end) {
-    // loop-unroll by 4
-    if (div > 0) {
-      c = 0;
-      i = grid->hd.ncol - mod;
-      while (c < i) {
-        p += 15;
-        if (fprintf(fp, "%hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu "
-                        "%hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu ",
-                        *p  , *p--, *p--, *p--, *p--, *p--, *p--, *p--,
-                        *p--, *p--, *p--, *p--, *p--, *p--, *p--, *p--) <= 0) {
-          perror("Error writing grid data");
-          return -1;
-        }
-        c += 16;
-        p += 16;
-      }
-    }
-    // finish off the row
-    i = mod;
-    while (i-- > 0) {
-      if (fprintf(fp, "%hhu ", *p++) <= 0) {
-        perror("Error writing grid data.");
-        return -1;
-      }
-    }
-    // print endline character
-    if (fprintf(fp, "\n") <= 0) {
-      perror("Error writing grid data.");
-      return -1;
-    }
+  assert(dset);
+  grid = &dset->grid;
+  if (grid->layout == layout)
+    return 0;
+
+  rt_start(rt);
+
+  if (layout == BLOCKED)
+    n = (size_t) ((grid->hd.nrow + GRID_BLOCK - 1) >> GRID_BLOCK_BITS) *
+        grid->nblockcol << (2*GRID_BLOCK_BITS);
+  else
+    n = (size_t) grid->hd.nrow * grid->hd.ncol;
+  // the padding is never read, but zero it anyway
+  data = (char*) calloc(n, grid->data_size);
+  if (!data) {
+    perror("Could not allocate data");
+    return -1;
   }
+  dCopyRuns(grid, grid->layout, (const char*) grid->fData, layout, data);
+
+  // every member of the data union is the same pointer
+  if (dset->file) {
+    gio_close(dset->file);
+    dset->file = NULL;
+  }else
+    free(grid->fData);
+  grid->fData = (float*) data;
+  grid->layout = layout;
+
+  rt_stop(rt);
+  static char buf[256];
+  rt_sprint(buf, rt);
+  printf("dSetLayout(grid,%d):\t%s\n", layout, buf);
 
   return 0;
 }
 
-
 void dFree(DataSet *dset)
 {
   assert(dset);
   assert(dset->path);
 
-  switch (dset->grid.type) {
+  if (dset->file)
+    // the data lives in the mapped file
+    gio_close(dset->file);
+  else switch (dset->grid.type) {
     case FLOAT: free(dset->grid.fData);  break;
     case INT:   free(dset->grid.iData);  break;
     case UINT:  free(dset->grid.uiData); break;
@@ -1129,13 +559,10 @@ void dFree(DataSet *dset)
 
 const int INITIAL_LEN = I_AVG;
 
-double *gStatf(Grid *grid, int level)
+// allocate and start an info array for gStatf() and dStatf()
+static double *gStatfInit(int level)
 {
-  double *info, dev;
-  float *p, *pend;
-
-  assert(grid->type == FLOAT);
-  assert(grid->hd.nrow * grid->hd.ncol >= 1);
+  double *info;
 
   info = (double*) malloc((INITIAL_LEN + level) * sizeof(double));
   assert(info);
@@ -1150,11 +577,19 @@ double *gStatf(Grid *grid, int level)
       info[I_MAX] = -FLT_MAX;
       info[I_MINI] = info[I_MAXI] = 0;
   }
+  return info;
+}
 
-  p = grid->fData;
-  pend = p + grid->hd.nrow * grid->hd.ncol;
-  for (; p < pend; p++) {
-    if (*p == grid->hd.NODATA_value)
+// fold the values in [begin, end) into info; begin is value number first of
+//   the grid
+static void gStatfUpdate(double *info, int level, const float *begin,
+                         const float *end, float nodata, double first)
+{
+  const float *p;
+  double dev;
+
+  for (p = begin; p < end; p++) {
+    if (*p == nodata)
       continue;
 
     // increment the count of actual data points
@@ -1171,17 +606,77 @@ double *gStatf(Grid *grid, int level)
 
     if (*p < info[I_MIN]) {
       info[I_MIN] = *p;
-      info[I_MINI] = p - grid->fData;
+      info[I_MINI] = first + (p - begin);
     }
     if (*p > info[I_MAX]) {
       info[I_MAX] = *p;
-      info[I_MAXI] = p - grid->fData;
+      info[I_MAXI] = first + (p - begin);
     }
   }
+}
+
+double *gStatf(Grid *grid, int level)
+{
+  double *info;
+
+  assert(grid->type == FLOAT);
+  assert(grid->layout == ROWMAJOR);
+  assert(grid->hd.nrow * grid->hd.ncol >= 1);
+
+  info = gStatfInit(level);
+  gStatfUpdate(info, level, grid->fData,
+               grid->fData + grid->hd.nrow * grid->hd.ncol,
+               grid->hd.NODATA_value, 0);
+
+  if (level == STD && info[I_N] > 1)
+    info[I_STD] /= info[I_N] - 1;
+
+  return info;
+}
+
+// as gStatf() for the grid in a file, read a block of rows at a time so it
+//   never has to fit in memory
+double *dStatf(const char *path, int level)
+{
+  static Rtimer rt;
+  GridStream *gs;
+  const void *rows;
+  double *info;
+  int64_t n;
+  uint64_t ncol;
+
+  rt_start(rt);
+
+  gs = gio_stream_open(path, GIO_FLOAT, 0);
+  if (!gs)
+    return NULL;
+  if (!gs->gf->hd.has_nodata) {
+    fprintf(stderr, "Could not read grid NODATA_value (%s).\n", path);
+    gio_stream_close(gs);
+    return NULL;
+  }
+  ncol = gs->gf->hd.ncol;
+  assert(gs->gf->hd.nrow * ncol >= 1);
+
+  info = gStatfInit(level);
+  while ((n = gio_stream_next(gs, &rows)) > 0)
+    gStatfUpdate(info, level, (const float*) rows,
+                 (const float*) rows + n * ncol, gs->gf->hd.nodata,
+                 (double) (gs->row - n) * ncol);
+  gio_stream_close(gs);
+  if (n < 0) {
+    free(info);
+    return NULL;
+  }
 
   if (level == STD && info[I_N] > 1)
     info[I_STD] /= info[I_N] - 1;
 
+  rt_stop(rt);
+  static char buf[256];
+  rt_sprint(buf, rt);
+  printf("dStatf('%s',%d):\t%s\n", path, level, buf);
+
   return info;
 }
 
@@ -1191,6 +686,7 @@ double *gStati(Grid *grid, int level)
   int *p, *pend;
 
   assert(grid->type == INT);
+  assert(grid->layout == ROWMAJOR);
   assert(grid->hd.nrow * grid->hd.ncol >= 1);
 
   info = (double*) malloc((INITIAL_LEN + level) * sizeof(double));
@@ -1247,6 +743,7 @@ double *gStatui(Grid *grid, int level)
   unsigned int *p, *pend;
 
   assert(grid->type == UINT);
+  assert(grid->layout == ROWMAJOR);
   assert(grid->hd.nrow * grid->hd.ncol >= 1);
 
   info = (double*) malloc((INITIAL_LEN + level) * sizeof(double));
@@ -1303,6 +800,7 @@ double *gStats(Grid *grid, int level)
   short *p, *pend;
 
   assert(grid->type == SHRT);
+  assert(grid->layout == ROWMAJOR);
   assert(grid->hd.nrow * grid->hd.ncol >= 1);
 
   info = (double*) malloc((INITIAL_LEN + level) * sizeof(double));
@@ -1359,6 +857,7 @@ double *gStatus(Grid *grid, int level)
   unsigned short *p, *pend;
 
   assert(grid->type == USHRT);
+  assert(grid->layout == ROWMAJOR);
   assert(grid->hd.nrow * grid->hd.ncol >= 1);
 
   info = (double*) malloc((INITIAL_LEN + level) * sizeof(double));
@@ -1415,6 +914,7 @@ double *gStatc(Grid *grid, int level)
   char *p, *pend;
 
   assert(grid->type == CHAR);
+  assert(grid->layout == ROWMAJOR);
   assert(grid->hd.nrow * grid->hd.ncol >= 1);
 
   info = (double*) malloc((INITIAL_LEN + level) * sizeof(double));
@@ -1471,6 +971,7 @@ double *gStatuc(Grid *grid, int level)
   unsigned char *p, *pend;
 
   assert(grid->type == UCHAR);
+  assert(grid->layout == ROWMAJOR);
   assert(grid->hd.nrow * grid->hd.ncol >= 1);
 
   info = (double*) malloc((INITIAL_LEN + level) * sizeof(double));
@@ -18,6 +18,7 @@
 
 #include <sys/types.h>
 #include <stddef.h>
+#include "gridio.h"
 #include "gridpoint.h"
 
 enum GridDataType {
@@ -30,6 +31,21 @@ enum GridDataType {
     UCHAR,
 };
 
+// order of the values in a grid's data array
+//   ROWMAJOR  row after row, as in the files
+//   BLOCKED   GRID_BLOCK x GRID_BLOCK blocks, row after row of blocks, each
+//             block itself row after row; the blocks along the right and
+//             bottom edges are padded out to full size.  A radial sweep or
+//             a walk around the viewpoint then stays within a few blocks
+//             for a while, instead of touching a new row (and page) at
+//             every step
+enum GridLayout {
+  ROWMAJOR,
+  BLOCKED
+};
+#define GRID_BLOCK_BITS 6
+#define GRID_BLOCK (1 << GRID_BLOCK_BITS)
+
 typedef struct grid_header_t
 {
   dim_t nrow;
@@ -47,6 +63,8 @@ typedef struct grid_t
 
   enum GridDataType type;  
   size_t data_size;
+  enum GridLayout layout;
+  dim_t nblockcol;         // blocks across a row of the BLOCKED layout
   union { float *fData;
           int *iData;
           unsigned int *uiData;
@@ -62,17 +80,38 @@ typedef struct grid_t
 typedef struct dataset_t {
   char* path;
   struct grid_t grid;
+  GridFile *file;   // binary grid the data is mapped from, or NULL
 } DataSet;
 
 // load data from file into the data set
+//   either format is accepted; a binary grid already of the given type is
+//   mapped rather than read, so loading it costs no time up front
 DataSet* dLoad(const char *path, enum GridDataType type);
 
+// load only the nrow x ncol window of a grid whose top left cell is
+//   (row, col); cheap for tiled grids, which decode just the tiles under it
+DataSet* dLoadWindow(const char *path, enum GridDataType type, index_t row,
+                     index_t col, index_t nrow, index_t ncol);
+
 // initialize an empty data grid
 DataSet* dInit(index_t nrow, index_t ncol, enum GridDataType type);
 
 // store a data set to file
+//   in binary when the path ends in GIO_BIN_SUFFIX, tiled when it ends in
+//   GIO_TILE_SUFFIX, ArcASCII otherwise
 int dStore(DataSet *dset, const char* path);
 
+// store a data set to file as a binary grid; flags as for gio_write_binary()
+int dStoreBinary(DataSet *dset, const char *path, int flags);
+
+// store a data set to file as a tiled, compressed grid
+int dStoreTiled(DataSet *dset, const char *path);
+
+// rearrange the data of a data set into the given layout; a mapped binary
+//   grid is copied out of its file.  Grids are loaded and created ROWMAJOR,
+//   and are written ROWMAJOR whatever their layout
+int dSetLayout(DataSet *dset, enum GridLayout layout);
+
 // free the memory allocated for a data set
 void dFree(DataSet *dset);
 
@@ -82,6 +121,7 @@ void dFree(DataSet *dset);
 //     MINMAX = 0  -  only the minimum and maximum
 //     AVG    = 1  -  include the average
 //     STD    = 2  -  include the standard deviation
+//   the grid must be ROWMAJOR
 double *gStatf (Grid *data, int level);
 double *gStati (Grid *data, int level);
 double *gStatui(Grid *data, int level);
@@ -89,6 +129,9 @@ double *gStats (Grid *data, int level);
 double *gStatus(Grid *data, int level);
 double *gStatc (Grid *data, int level);
 double *gStatuc(Grid *data, int level);
+// as gStatf() for the grid in a file, streamed through a block of rows at
+//   a time instead of loaded
+double *dStatf(const char *path, int level);
 // processing level option
 enum {
   MINMAX = 0,
@@ -107,23 +150,30 @@ enum {
 };
 
 
+/* offset of the (r,c) entry in a data grid's array */
+#define dg_index(grid, r, c) ((grid).layout == ROWMAJOR ? \
+  (size_t)(r)*(grid).hd.ncol + (c) : \
+  ((((size_t)((r) >> GRID_BLOCK_BITS)*(grid).nblockcol + \
+     ((c) >> GRID_BLOCK_BITS)) << (2*GRID_BLOCK_BITS)) + \
+   (((r) & (GRID_BLOCK-1)) << GRID_BLOCK_BITS) + ((c) & (GRID_BLOCK-1))))
+
 /* get a (r,c) entry in a data grid */
 #define dg_get(grid, p, val, cast) { \
   switch ((grid).type) { \
     case FLOAT: \
-      val = (cast)*((grid).fData  + (p).r*(grid).hd.ncol + (p).c); break; \
+      val = (cast)*((grid).fData  + dg_index(grid, (p).r, (p).c)); break; \
     case INT: \
-      val = (cast)*((grid).iData  + (p).r*(grid).hd.ncol + (p).c); break; \
+      val = (cast)*((grid).iData  + dg_index(grid, (p).r, (p).c)); break; \
     case UINT: \
-      val = (cast)*((grid).uiData + (p).r*(grid).hd.ncol + (p).c); break; \
+      val = (cast)*((grid).uiData + dg_index(grid, (p).r, (p).c)); break; \
     case SHRT: \
-      val = (cast)*((grid).sData  + (p).r*(grid).hd.ncol + (p).c); break; \
+      val = (cast)*((grid).sData  + dg_index(grid, (p).r, (p).c)); break; \
     case USHRT: \
-      val = (cast)*((grid).usData + (p).r*(grid).hd.ncol + (p).c); break; \
+      val = (cast)*((grid).usData + dg_index(grid, (p).r, (p).c)); break; \
     case CHAR: \
-      val = (cast)*((grid).cData  + (p).r*(grid).hd.ncol + (p).c); break; \
+      val = (cast)*((grid).cData  + dg_index(grid, (p).r, (p).c)); break; \
     case UCHAR: \
-      val = (cast)*((grid).ucData + (p).r*(grid).hd.ncol + (p).c); break; \
+      val = (cast)*((grid).ucData + dg_index(grid, (p).r, (p).c)); break; \
     default: \
       val = (cast)*((int*)NULL); /* intentionally cause failure */ \
   } \
@@ -132,19 +182,19 @@ enum {
 #define dg_set(grid, p, val) { \
   switch ((grid).type) { \
     case FLOAT: \
-      *((grid).fData  + (p).r*(grid).hd.ncol + (p).c) = val; break; \
+      *((grid).fData  + dg_index(grid, (p).r, (p).c)) = val; break; \
     case INT: \
-      *((grid).iData  + (p).r*(grid).hd.ncol + (p).c) = val; break; \
+      *((grid).iData  + dg_index(grid, (p).r, (p).c)) = val; break; \
     case UINT: \
-      *((grid).uiData + (p).r*(grid).hd.ncol + (p).c) = val; break; \
+      *((grid).uiData + dg_index(grid, (p).r, (p).c)) = val; break; \
     case SHRT: \
-      *((grid).sData  + (p).r*(grid).hd.ncol + (p).c) = val; break; \
+      *((grid).sData  + dg_index(grid, (p).r, (p).c)) = val; break; \
     case USHRT: \
-      *((grid).usData + (p).r*(grid).hd.ncol + (p).c) = val; break; \
+      *((grid).usData + dg_index(grid, (p).r, (p).c)) = val; break; \
     case CHAR: \
-      *((grid).cData  + (p).r*(grid).hd.ncol + (p).c) = val; break; \
+      *((grid).cData  + dg_index(grid, (p).r, (p).c)) = val; break; \
     case UCHAR: \
-      *((grid).ucData + (p).r*(grid).hd.ncol + (p).c) = val; break; \
+      *((grid).ucData + dg_index(grid, (p).r, (p).c)) = val; break; \
     default: \
       *((int*)NULL) = val; /* intentionally cause failure */ \
   } \
@@ -155,19 +205,19 @@ enum {
 #define dGet(dset, r, c, val, cast) { \
   switch (dset->grid.type) { \
     case FLOAT: \
-      val = (cast)*(dset->grid.fData + r*dset->grid.hd.ncol + c); break; \
+      val = (cast)*(dset->grid.fData + dg_index(dset->grid, r, c)); break; \
     case INT: \
-      val = (cast)*(dset->grid.iData + r*dset->grid.hd.ncol + c); break; \
+      val = (cast)*(dset->grid.iData + dg_index(dset->grid, r, c)); break; \
     case UINT: \
-      val = (cast)*(dset->grid.uiData + r*dset->grid.hd.ncol + c); break; \
+      val = (cast)*(dset->grid.uiData + dg_index(dset->grid, r, c)); break; \
     case SHRT: \
-      val = (cast)*(dset->grid.sData + r*dset->grid.hd.ncol + c); break; \
+      val = (cast)*(dset->grid.sData + dg_index(dset->grid, r, c)); break; \
     case USHRT: \
-      val = (cast)*(dset->grid.usData + r*dset->grid.hd.ncol + c); break; \
+      val = (cast)*(dset->grid.usData + dg_index(dset->grid, r, c)); break; \
     case CHAR: \
-      val = (cast)*(dset->grid.cData + r*dset->grid.hd.ncol + c); break; \
+      val = (cast)*(dset->grid.cData + dg_index(dset->grid, r, c)); break; \
     case UCHAR: \
-      val = (cast)*(dset->grid.ucData + r*dset->grid.hd.ncol + c); break; \
+      val = (cast)*(dset->grid.ucData + dg_index(dset->grid, r, c)); break; \
     default: \
       val = (cast)*((int*)NULL); /* intentionally cause failure */ \
   } \
@@ -177,19 +227,19 @@ enum {
 #define dSet(dset, r, c, val) { \
   switch (dset->grid.type) { \
     case FLOAT: \
-      *(dset->grid.fData + r*dset->grid.hd.ncol + c) = val; break; \
+      *(dset->grid.fData + dg_index(dset->grid, r, c)) = val; break; \
     case INT: \
-      *(dset->grid.iData + r*dset->grid.hd.ncol + c) = val; break; \
+      *(dset->grid.iData + dg_index(dset->grid, r, c)) = val; break; \
     case UINT: \
-      *(dset->grid.uiData + r*dset->grid.hd.ncol + c) = val; break; \
+      *(dset->grid.uiData + dg_index(dset->grid, r, c)) = val; break; \
     case SHRT: \
-      *(dset->grid.sData + r*dset->grid.hd.ncol + c) = val; break; \
+      *(dset->grid.sData + dg_index(dset->grid, r, c)) = val; break; \
     case USHRT: \
-      *(dset->grid.usData + r*dset->grid.hd.ncol + c) = val; break; \
+      *(dset->grid.usData + dg_index(dset->grid, r, c)) = val; break; \
     case CHAR: \
-      *(dset->grid.cData + r*dset->grid.hd.ncol + c) = val; break; \
+      *(dset->grid.cData + dg_index(dset->grid, r, c)) = val; break; \
     case UCHAR: \
-      *(dset->grid.ucData + r*dset->grid.hd.ncol + c) = val; break; \
+      *(dset->grid.ucData + dg_index(dset->grid, r, c)) = val; break; \
     default: \
       *((int*)NULL) = val; /* intentionally cause failure */ \
   } \
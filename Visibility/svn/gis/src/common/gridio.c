@@ -0,0 +1,2159 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#  include <linux/mempolicy.h>
+#  include <sys/syscall.h>
+#endif
+
+#include "gridio.h"
+
+// most threads gio_read() will start
+#define GIO_MAX_THREADS 32
+// least data per thread worth starting a thread for
+#define GIO_MIN_CHUNK (1 << 20)
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+// longest token handed to strtod() when the fast scanner gives up
+#define GIO_MAX_TOKEN 64
+
+// exact powers of ten in a double
+static const double gio_pow10[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// one thread's share of the values
+typedef struct gio_chunk_t {
+  const char *begin;
+  const char *end;
+  uint64_t count;    // values in the chunk
+  uint64_t offset;   // index of the chunk's first value
+  uint64_t n;        // values wanted in total
+  enum gridio_type type;
+  void *data;
+} gio_chunk;
+
+#define gio_space(ch) \
+  ((ch) == ' ' || (ch) == '\n' || (ch) == '\t' || (ch) == '\r' || \
+   (ch) == '\v' || (ch) == '\f')
+
+/**
+ * Parse one header value from [p, end) with strtod().  Returns a pointer past
+ * the value, or NULL if there isn't one.
+ */
+static const char* gio_header_value(const char *p, const char *end,
+                                    double *val)
+{
+  char buf[GIO_MAX_TOKEN];
+  char *stop;
+  size_t k;
+
+  while (p < end && gio_space(*p) && *p != '\n')
+    p++;
+  for (k = 0; p + k < end && !gio_space(p[k]) && k < GIO_MAX_TOKEN - 1; k++)
+    buf[k] = p[k];
+  buf[k] = '\0';
+
+  *val = strtod(buf, &stop);
+  if (k == 0 || stop == buf)
+    return NULL;
+  return p + k;
+}
+
+/**
+ * Parse the key/value header lines at the start of a grid, stopping at the
+ * first line that starts with a number.
+ */
+static int gio_header(GridFile *gf)
+{
+  const char *p, *end, *key;
+  size_t klen;
+  double val;
+  int seen, xcenter, ycenter;
+
+  p = gf->map;
+  end = gf->map + gf->len;
+  memset(&gf->hd, 0, sizeof(gf->hd));
+  seen = xcenter = ycenter = 0;
+
+  for (;;) {
+    while (p < end && gio_space(*p))
+      p++;
+    if (p == end || (*p >= '0' && *p <= '9') || *p == '-' || *p == '+' ||
+        *p == '.')
+      break;
+
+    key = p;
+    while (p < end && !gio_space(*p))
+      p++;
+    klen = p - key;
+    p = gio_header_value(p, end, &val);
+    if (!p) {
+      fprintf(stderr, "Bad grid header line (%.*s).\n", (int) klen, key);
+      return -1;
+    }
+
+#define gio_key(name) \
+  (klen == sizeof(name) - 1 && strncasecmp(key, name, klen) == 0)
+    if (gio_key("ncols")) {
+      gf->hd.ncol = (uint64_t) val;
+      seen |= 1;
+    }else if (gio_key("nrows")) {
+      gf->hd.nrow = (uint64_t) val;
+      seen |= 2;
+    }else if (gio_key("xllcorner") || (xcenter = gio_key("xllcenter"))) {
+      gf->hd.xllcorner = val;
+    }else if (gio_key("yllcorner") || (ycenter = gio_key("yllcenter"))) {
+      gf->hd.yllcorner = val;
+    }else if (gio_key("cellsize")) {
+      gf->hd.cellsize = val;
+    }else if (gio_key("nodata_value")) {
+      gf->hd.nodata = val;
+      gf->hd.has_nodata = 1;
+    }
+#undef gio_key
+  }
+
+  if (seen != 3) {
+    fprintf(stderr, "Grid header is missing ncols or nrows.\n");
+    return -1;
+  }
+  // centers are half a cell in from the corner
+  if (xcenter)
+    gf->hd.xllcorner -= gf->hd.cellsize / 2;
+  if (ycenter)
+    gf->hd.yllcorner -= gf->hd.cellsize / 2;
+
+  gf->data = p - gf->map;
+  return 0;
+}
+
+/**
+ * Check the header of a binary grid and copy it into the GridFile.
+ */
+static int gio_bin_header(GridFile *gf)
+{
+  const GridBinHeader *bh;
+  uint64_t n;
+
+  bh = (const GridBinHeader*) gf->map;
+  if (bh->byteorder != GIO_BIN_BYTEORDER) {
+    fprintf(stderr, "Binary grid was written with another byte order.\n");
+    return -1;
+  }
+  if (bh->type > GIO_UCHAR) {
+    fprintf(stderr, "Binary grid has an unknown value type (%u).\n",
+            bh->type);
+    return -1;
+  }
+
+  gf->binary = 1;
+  gf->type = (enum gridio_type) bh->type;
+  gf->hd.nrow = bh->nrow;
+  gf->hd.ncol = bh->ncol;
+  gf->hd.xllcorner = bh->xllcorner;
+  gf->hd.yllcorner = bh->yllcorner;
+  gf->hd.cellsize = bh->cellsize;
+  gf->hd.nodata = bh->nodata;
+  gf->hd.has_nodata = bh->has_nodata != 0;
+  gf->data = bh->data;
+
+  n = bh->nrow * bh->ncol;
+  if (bh->data < sizeof(GridBinHeader) ||
+      bh->data + n * gio_size(gf->type) > gf->len) {
+    fprintf(stderr, "Binary grid is truncated.\n");
+    return -1;
+  }
+  if (bh->flags & GIO_BIN_CHECKSUM) {
+    if (bh->checksum % sizeof(uint32_t) != 0 ||
+        bh->checksum + bh->nrow * sizeof(uint32_t) > gf->len) {
+      fprintf(stderr, "Binary grid checksums are truncated.\n");
+      return -1;
+    }
+    gf->sums = (const uint32_t*) (gf->map + bh->checksum);
+  }
+  return 0;
+}
+
+/**
+ * Check the header of a tiled grid and copy it into the GridFile.
+ */
+static int gio_tile_header(GridFile *gf)
+{
+  const GridTileHeader *th;
+  uint64_t ntile;
+
+  th = (const GridTileHeader*) gf->map;
+  if (th->byteorder != GIO_BIN_BYTEORDER) {
+    fprintf(stderr, "Tiled grid was written with another byte order.\n");
+    return -1;
+  }
+  if (th->type > GIO_UCHAR || th->tile == 0) {
+    fprintf(stderr, "Tiled grid has a bad header.\n");
+    return -1;
+  }
+
+  gf->tiled = 1;
+  gf->type = (enum gridio_type) th->type;
+  gf->hd.nrow = th->nrow;
+  gf->hd.ncol = th->ncol;
+  gf->hd.xllcorner = th->xllcorner;
+  gf->hd.yllcorner = th->yllcorner;
+  gf->hd.cellsize = th->cellsize;
+  gf->hd.nodata = th->nodata;
+  gf->hd.has_nodata = th->has_nodata != 0;
+  gf->tile = th->tile;
+  gf->ntilerow = (th->nrow + th->tile - 1) / th->tile;
+  gf->ntilecol = (th->ncol + th->tile - 1) / th->tile;
+  gf->data = th->index;
+
+  ntile = gf->ntilerow * gf->ntilecol;
+  if (th->index % sizeof(uint64_t) != 0 ||
+      th->index + ntile * sizeof(GridTileEntry) > gf->len) {
+    fprintf(stderr, "Tiled grid index is truncated.\n");
+    return -1;
+  }
+  gf->index = (const GridTileEntry*) (gf->map + th->index);
+  return 0;
+}
+
+GridFile* gio_open(const char *path)
+{
+  GridFile *gf;
+  struct stat st;
+  void *map;
+
+  gf = (GridFile*) malloc(sizeof(GridFile));
+  if (!gf) {
+    perror("Unable to allocate GridFile object");
+    return NULL;
+  }
+
+  gf->fd = open(path, O_RDONLY);
+  if (gf->fd < 0 || fstat(gf->fd, &st) != 0 || st.st_size == 0) {
+    fprintf(stderr, "Could not open input file (%s).\n", path);
+    perror(NULL);
+    if (gf->fd >= 0)
+      close(gf->fd);
+    free(gf);
+    return NULL;
+  }
+  gf->len = st.st_size;
+
+  // writable, so binary grids can be used in place; writes stay private
+  map = mmap(NULL, gf->len, PROT_READ | PROT_WRITE, MAP_PRIVATE, gf->fd, 0);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Could not map input file (%s).\n", path);
+    perror(NULL);
+    close(gf->fd);
+    free(gf);
+    return NULL;
+  }
+  gf->map = (const char*) map;
+  gf->binary = 0;
+  gf->tiled = 0;
+  gf->sums = NULL;
+  gf->index = NULL;
+
+  if (gf->len >= sizeof(GridBinHeader) &&
+      memcmp(gf->map, GIO_BIN_MAGIC, sizeof(((GridBinHeader*)0)->magic)) == 0) {
+    if (gio_bin_header(gf) != 0) {
+      gio_close(gf);
+      return NULL;
+    }
+    return gf;
+  }
+  if (gf->len >= sizeof(GridTileHeader) &&
+      memcmp(gf->map, GIO_TILE_MAGIC, sizeof(((GridTileHeader*)0)->magic)) == 0) {
+    if (gio_tile_header(gf) != 0) {
+      gio_close(gf);
+      return NULL;
+    }
+    return gf;
+  }
+
+  // read front to back, once
+  madvise(map, gf->len, MADV_SEQUENTIAL);
+  if (gio_header(gf) != 0) {
+    gio_close(gf);
+    return NULL;
+  }
+  return gf;
+}
+
+void gio_close(GridFile *gf)
+{
+  assert(gf);
+  munmap((void*) gf->map, gf->len);
+  close(gf->fd);
+  free(gf);
+}
+
+/**
+ * Copy the token at p into buf, for strtod() and strtof().
+ */
+static void gio_token(const char *p, const char *end, char *buf)
+{
+  size_t k;
+
+  for (k = 0; p + k < end && !gio_space(p[k]) && k < GIO_MAX_TOKEN - 1; k++)
+    buf[k] = p[k];
+  buf[k] = '\0';
+}
+
+/**
+ * Scan the number starting at p into val, and return a pointer past it.
+ *
+ * Decimal mantissas of up to 19 digits are accumulated exactly as integers.
+ * When the mantissa fits in a double and the power of ten is at most 22,
+ * one multiply or divide by an exact power of ten rounds correctly.
+ * Anything else (long mantissas, big exponents, nan, inf) goes to strtod(),
+ * and *slow is set so FLOAT grids can use strtof() instead.
+ */
+static const char* gio_scan(const char *p, const char *end, double *val,
+                            int *slow)
+{
+  char buf[GIO_MAX_TOKEN];
+  const char *start;
+  uint64_t mant;
+  int neg, exp, esign, e, ndig, lost, digits;
+
+  start = p;
+  neg = 0;
+  if (p < end && (*p == '-' || *p == '+'))
+    neg = *p++ == '-';
+
+  mant = 0;
+  exp = 0;
+  ndig = 0;
+  lost = 0;
+  digits = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    if (ndig < 19) {
+      mant = mant * 10 + (*p - '0');
+      ndig += mant != 0;
+    }else {
+      exp++;
+      lost |= *p != '0';
+    }
+    p++;
+    digits = 1;
+  }
+  if (p < end && *p == '.') {
+    p++;
+    while (p < end && *p >= '0' && *p <= '9') {
+      if (ndig < 19) {
+        mant = mant * 10 + (*p - '0');
+        ndig += mant != 0;
+        exp--;
+      }else
+        lost |= *p != '0';
+      p++;
+      digits = 1;
+    }
+  }
+  if (digits && p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    esign = 1;
+    if (p < end && (*p == '-' || *p == '+'))
+      esign = *p++ == '-' ? -1 : 1;
+    e = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+      if (e < 100000)
+        e = e * 10 + (*p - '0');
+      p++;
+    }
+    exp += esign * e;
+  }
+
+  if (!digits || lost || (p < end && !gio_space(*p)) ||
+      mant > (1ULL << 53) || exp < -22 || exp > 22) {
+    gio_token(start, end, buf);
+    *val = strtod(buf, NULL);
+    *slow = 1;
+    while (p < end && !gio_space(*p))
+      p++;
+    return p;
+  }
+
+  *val = exp < 0 ? (double) mant / gio_pow10[-exp]
+                 : (double) mant * gio_pow10[exp];
+  if (neg)
+    *val = -*val;
+  *slow = 0;
+  return p;
+}
+
+/**
+ * Narrow a scanned double to a float exactly as strtof() would.  The double
+ * is correctly rounded, so narrowing it again only goes wrong when it lands
+ * exactly halfway between two floats; then the decimal decides.
+ */
+static float gio_narrow(const char *p, const char *end, double val, int slow)
+{
+  char buf[GIO_MAX_TOKEN];
+  float f, g;
+
+  f = (float) val;
+  if (!slow && (double) f != val) {
+    g = nextafterf(f, val > f ? INFINITY : -INFINITY);
+    if (val - (double) f != (double) g - val)
+      return f;
+  }else if (!slow)
+    return f;
+
+  gio_token(p, end, buf);
+  return strtof(buf, NULL);
+}
+
+/**
+ * Store val as value i of an array of the given type.  Integer types
+ * truncate, as a cast from the float fscanf() gave.
+ */
+static inline void gio_put(enum gridio_type type, void *data, uint64_t i,
+                           double val)
+{
+  switch (type) {
+    case GIO_FLOAT:
+      ((float*) data)[i] = (float) val; break;
+    case GIO_INT:
+      ((int*) data)[i] = (int) val; break;
+    case GIO_UINT:
+      ((unsigned int*) data)[i] =
+        val < 0 ? (unsigned int) (int) val : (unsigned int) val; break;
+    case GIO_SHRT:
+      ((short*) data)[i] = (short) val; break;
+    case GIO_USHRT:
+      ((unsigned short*) data)[i] = (unsigned short) (int) val; break;
+    case GIO_CHAR:
+      ((char*) data)[i] = (char) val; break;
+    case GIO_UCHAR:
+      ((unsigned char*) data)[i] = (unsigned char) (int) val; break;
+  }
+}
+
+/**
+ * Load value i of an array of the given type.
+ */
+static inline double gio_get(enum gridio_type type, const void *data,
+                             uint64_t i)
+{
+  switch (type) {
+    case GIO_FLOAT:  return ((const float*) data)[i];
+    case GIO_INT:    return ((const int*) data)[i];
+    case GIO_UINT:   return ((const unsigned int*) data)[i];
+    case GIO_SHRT:   return ((const short*) data)[i];
+    case GIO_USHRT:  return ((const unsigned short*) data)[i];
+    case GIO_CHAR:   return ((const char*) data)[i];
+    case GIO_UCHAR:  return ((const unsigned char*) data)[i];
+  }
+  return 0;
+}
+
+/**
+ * Copy n values of type from at src to dst, of type to, converting them as
+ * gio_put() does if the types differ.
+ */
+static void gio_convert(enum gridio_type from, const void *src,
+                        enum gridio_type to, void *dst, uint64_t n)
+{
+  uint64_t i;
+
+  if (from == to)
+    memcpy(dst, src, n * gio_size(to));
+  else
+    for (i = 0; i < n; i++)
+      gio_put(to, dst, i, gio_get(from, src, i));
+}
+
+static int gio_read_tiled(GridFile *gf, enum gridio_type type, void *data,
+                          int nthread);
+
+/**
+ * Count the values in a chunk.
+ */
+static void* gio_count(void *_closure)
+{
+  gio_chunk *chunk;
+  const char *p;
+  uint64_t count;
+  int in;
+
+  chunk = (gio_chunk*) _closure;
+  count = 0;
+  in = 0;
+  for (p = chunk->begin; p < chunk->end; p++) {
+    if (gio_space(*p))
+      in = 0;
+    else if (!in) {
+      in = 1;
+      count++;
+    }
+  }
+  chunk->count = count;
+
+  pthread_exit(NULL);
+}
+
+/**
+ * Parse the values of a chunk into their place in the data array.
+ */
+static void* gio_parse(void *_closure)
+{
+  gio_chunk *chunk;
+  const char *p, *start, *end;
+  uint64_t i, stop;
+  double val;
+  int slow;
+
+  chunk = (gio_chunk*) _closure;
+  p = chunk->begin;
+  end = chunk->end;
+  i = chunk->offset;
+  stop = chunk->offset + chunk->count;
+  if (stop > chunk->n)
+    stop = chunk->n;
+
+  while (i < stop) {
+    while (gio_space(*p))
+      p++;
+    start = p;
+    p = gio_scan(p, end, &val, &slow);
+
+    if (chunk->type == GIO_FLOAT)
+      ((float*) chunk->data)[i] = gio_narrow(start, end, val, slow);
+    else
+      gio_put(chunk->type, chunk->data, i, val);
+    i++;
+  }
+
+  pthread_exit(NULL);
+}
+
+/**
+ * Run func on each of nthread closures of the given size, one thread each,
+ * and wait for them.  Returns -1 if a thread could not be started or
+ * joined; the threads that did start are still waited for.
+ */
+static int gio_run(int nthread, void* (*func)(void*), void *args,
+                   size_t size)
+{
+  pthread_t threads[GIO_MAX_THREADS];
+  int t, started, result, status = 0;
+
+  for (started = 0; started < nthread; started++) {
+    result = pthread_create(threads + started, NULL, func,
+                            (char*) args + started * size);
+    if (result != 0) {
+      fprintf(stderr, "Unable to start grid thread (%s).\n", strerror(result));
+      status = -1;
+      break;
+    }
+  }
+  for (t = 0; t < started; t++) {
+    result = pthread_join(threads[t], NULL);
+    if (result != 0) {
+      fprintf(stderr, "Unable to join grid thread (%s).\n", strerror(result));
+      status = -1;
+    }
+  }
+  return status;
+}
+
+/**
+ * Parse the values of a grid into data.
+ *
+ * The values are cut into one chunk per thread at line breaks, so no value
+ * is split.  Each thread first counts the values in its chunk; the counts
+ * give every chunk the index of its first value, and then each thread parses
+ * its chunk straight into its own part of the array.
+ */
+int gio_read(GridFile *gf, enum gridio_type type, void *data, int nthread)
+{
+  gio_chunk chunks[GIO_MAX_THREADS];
+  const char *begin, *end, *cut, *line;
+  uint64_t n, total;
+  size_t len;
+  int t;
+
+  assert(gf);
+  assert(data);
+  n = gf->hd.nrow * gf->hd.ncol;
+  if (gf->binary) {
+    // nothing to parse; copy, converting if the types differ
+    gio_convert(gf->type, gf->map + gf->data, type, data, n);
+    return 0;
+  }
+  if (gf->tiled)
+    return gio_read_tiled(gf, type, data, nthread);
+  begin = gf->map + gf->data;
+  end = gf->map + gf->len;
+  len = end - begin;
+
+  if (nthread <= 0)
+    nthread = sysconf(_SC_NPROCESSORS_ONLN);
+  if ((size_t) nthread > len / GIO_MIN_CHUNK)
+    nthread = len / GIO_MIN_CHUNK;
+  if (nthread > GIO_MAX_THREADS)
+    nthread = GIO_MAX_THREADS;
+  if (nthread < 1)
+    nthread = 1;
+
+  // chunk boundaries, moved forward to the next line break (or, for a grid
+  // all on one line, the next space)
+  for (t = 0; t < nthread; t++) {
+    chunks[t].begin = t == 0 ? begin : chunks[t-1].end;
+    cut = t == nthread - 1 ? end : begin + len / nthread * (t + 1);
+    if (cut < chunks[t].begin)
+      cut = chunks[t].begin;
+    line = memchr(cut, '\n', MIN((size_t) (end - cut), GIO_MIN_CHUNK));
+    if (line)
+      cut = line;
+    else
+      while (cut < end && !gio_space(*cut))
+        cut++;
+    chunks[t].end = cut;
+    chunks[t].n = n;
+    chunks[t].type = type;
+    chunks[t].data = data;
+  }
+
+  if (gio_run(nthread, gio_count, chunks, sizeof(gio_chunk)) != 0)
+    return -1;
+
+  total = 0;
+  for (t = 0; t < nthread; t++) {
+    chunks[t].offset = total;
+    total += chunks[t].count;
+  }
+  if (total < n) {
+    fprintf(stderr, "Grid has %llu values, expected %llu.\n",
+            (unsigned long long) total, (unsigned long long) n);
+    return -1;
+  }
+
+  return gio_run(nthread, gio_parse, chunks, sizeof(gio_chunk));
+}
+
+
+void* gio_data(GridFile *gf, enum gridio_type type)
+{
+  assert(gf);
+  if (!gf->binary || gf->type != type)
+    return NULL;
+  return (void*) (gf->map + gf->data);
+}
+
+size_t gio_size(enum gridio_type type)
+{
+  switch (type) {
+    case GIO_FLOAT:  return sizeof(float);
+    case GIO_INT:    return sizeof(int);
+    case GIO_UINT:   return sizeof(unsigned int);
+    case GIO_SHRT:   return sizeof(short);
+    case GIO_USHRT:  return sizeof(unsigned short);
+    case GIO_CHAR:   return sizeof(char);
+    case GIO_UCHAR:  return sizeof(unsigned char);
+  }
+  return 0;
+}
+
+/**
+ * Whether path ends in suffix, ignoring case.
+ */
+static int gio_suffix(const char *path, const char *suffix)
+{
+  size_t len, slen;
+
+  len = strlen(path);
+  slen = strlen(suffix);
+  return len >= slen && strcasecmp(path + len - slen, suffix) == 0;
+}
+
+int gio_wants_binary(const char *path)
+{
+  return gio_suffix(path, GIO_BIN_SUFFIX);
+}
+
+int gio_wants_tiled(const char *path)
+{
+  return gio_suffix(path, GIO_TILE_SUFFIX);
+}
+
+// table for the reflected crc32 polynomial, filled on first use
+static uint32_t gio_crc_table[256];
+static pthread_once_t gio_crc_once = PTHREAD_ONCE_INIT;
+
+static void gio_crc_init(void)
+{
+  uint32_t c;
+  int i, k;
+
+  for (i = 0; i < 256; i++) {
+    c = i;
+    for (k = 0; k < 8; k++)
+      c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+    gio_crc_table[i] = c;
+  }
+}
+
+/**
+ * crc32 of len bytes, as zlib computes it.
+ */
+static uint32_t gio_crc32(const void *buf, size_t len)
+{
+  const unsigned char *p;
+  uint32_t c;
+
+  pthread_once(&gio_crc_once, gio_crc_init);
+  p = (const unsigned char*) buf;
+  c = 0xFFFFFFFFu;
+  while (len--)
+    c = gio_crc_table[(c ^ *p++) & 0xFF] ^ (c >> 8);
+  return c ^ 0xFFFFFFFFu;
+}
+
+int gio_verify(GridFile *gf)
+{
+  const char *row;
+  size_t rlen;
+  uint64_t r;
+
+  assert(gf);
+  if (!gf->binary || !gf->sums)
+    return 0;
+
+  rlen = gf->hd.ncol * gio_size(gf->type);
+  row = gf->map + gf->data;
+  for (r = 0; r < gf->hd.nrow; r++, row += rlen) {
+    if (gio_crc32(row, rlen) != gf->sums[r]) {
+      fprintf(stderr, "Binary grid row %llu fails its checksum.\n",
+              (unsigned long long) r);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int gio_write_binary(const char *path, const GridIOHeader *hd,
+                     enum gridio_type type, const void *data, int flags)
+{
+  GridBinHeader bh;
+  FILE *fp;
+  char *tmp, *pad;
+  uint32_t *sums;
+  size_t page, rlen, n;
+  uint64_t r;
+  int result;
+
+  assert(path && hd && data);
+
+  page = sysconf(_SC_PAGESIZE);
+  if (page < 4096)
+    page = 4096;
+  rlen = hd->ncol * gio_size(type);
+  n = hd->nrow * rlen;
+
+  memset(&bh, 0, sizeof(bh));
+  memcpy(bh.magic, GIO_BIN_MAGIC, sizeof(bh.magic));
+  bh.byteorder = GIO_BIN_BYTEORDER;
+  bh.type = type;
+  bh.nrow = hd->nrow;
+  bh.ncol = hd->ncol;
+  bh.xllcorner = hd->xllcorner;
+  bh.yllcorner = hd->yllcorner;
+  bh.cellsize = hd->cellsize;
+  bh.nodata = hd->nodata;
+  bh.has_nodata = hd->has_nodata;
+  bh.flags = flags & GIO_BIN_CHECKSUM;
+  bh.data = page;
+  // checksums go after the values, 8-byte aligned
+  bh.checksum = bh.flags ? (page + n + 7) / 8 * 8 : 0;
+
+  sums = NULL;
+  if (bh.flags) {
+    sums = (uint32_t*) malloc(hd->nrow * sizeof(uint32_t) + 1);
+    if (!sums) {
+      perror("Unable to allocate row checksums");
+      return -1;
+    }
+    for (r = 0; r < hd->nrow; r++)
+      sums[r] = gio_crc32((const char*) data + r * rlen, rlen);
+  }
+
+  // write beside path and rename, so a mapping of the old file stays good
+  tmp = (char*) malloc(strlen(path) + 5);
+  pad = (char*) calloc(page, 1);
+  if (!tmp || !pad) {
+    perror("Unable to allocate binary grid buffers");
+    free(sums);
+    free(tmp);
+    free(pad);
+    return -1;
+  }
+  sprintf(tmp, "%s.tmp", path);
+
+  result = -1;
+  fp = fopen(tmp, "wb");
+  if (!fp) {
+    fprintf(stderr, "Could not open output file (%s).\n", tmp);
+    perror(NULL);
+  }else {
+    memcpy(pad, &bh, sizeof(bh));
+    if (fwrite(pad, 1, page, fp) == page &&
+        fwrite(data, 1, n, fp) == n &&
+        (!sums ||
+         (fwrite(pad + sizeof(bh), 1, bh.checksum - page - n, fp) ==
+            bh.checksum - page - n &&
+          fwrite(sums, sizeof(uint32_t), hd->nrow, fp) == hd->nrow)))
+      result = 0;
+    if (fclose(fp) != 0)
+      result = -1;
+    if (result == 0 && rename(tmp, path) != 0)
+      result = -1;
+    if (result != 0) {
+      fprintf(stderr, "Could not write binary grid (%s).\n", path);
+      perror(NULL);
+      unlink(tmp);
+    }
+  }
+
+  free(sums);
+  free(tmp);
+  free(pad);
+  return result;
+}
+
+
+// output bytes each writer thread formats at a time
+#define GIO_WRITE_BLOCK (4 << 20)
+// most decimals gio_fixed() handles itself
+#define GIO_MAX_PREC 11
+
+static const uint64_t gio_upow10[] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+  100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL
+};
+
+static const char gio_digits[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536"
+  "37383940414243444546474849505152535455565758596061626364656667686970717273"
+  "7475767778798081828384858687888990919293949596979899";
+
+// one thread's share of the rows being written
+typedef struct gio_rows_t {
+  const void *data;
+  enum gridio_type type;
+  uint64_t ncol;
+  uint64_t begin;   // first row
+  uint64_t end;     // one past the last row
+  int prec;
+  char *buf;
+  size_t len;       // bytes formatted into buf
+} gio_rows;
+
+/**
+ * Write v in decimal at p, and return a pointer past it.
+ */
+static inline char* gio_utoa(char *p, uint64_t v)
+{
+  char buf[20], *q;
+  size_t n;
+
+  q = buf + sizeof(buf);
+  while (v >= 100) {
+    q -= 2;
+    memcpy(q, gio_digits + 2 * (v % 100), 2);
+    v /= 100;
+  }
+  if (v >= 10) {
+    q -= 2;
+    memcpy(q, gio_digits + 2 * v, 2);
+  }else
+    *--q = '0' + v;
+  n = buf + sizeof(buf) - q;
+  memcpy(p, q, n);
+  return p + n;
+}
+
+static inline char* gio_itoa(char *p, int64_t v)
+{
+  if (v < 0) {
+    *p++ = '-';
+    return gio_utoa(p, -(uint64_t) v);
+  }
+  return gio_utoa(p, v);
+}
+
+/**
+ * Round |v| * 10^prec to an integer, ties to even, exactly.  A float is
+ * m * 2^e with m < 2^24, so m * 10^prec fits in 64 bits and the rounding
+ * is a shift.  Returns -1 when the value is too big, not finite, or prec is
+ * over GIO_MAX_PREC.
+ */
+static inline int gio_round(float v, int prec, uint64_t *q)
+{
+  union { float f; uint32_t u; } bits;
+  uint64_t n, rem, half;
+  int ex, e, s;
+
+  bits.f = v;
+  ex = (bits.u >> 23) & 0xFF;
+  if (ex == 0xFF || prec < 0 || prec > GIO_MAX_PREC)
+    return -1;
+  n = bits.u & 0x7FFFFF;
+  if (ex == 0)
+    e = -149;
+  else {
+    n |= 1 << 23;
+    e = ex - 150;
+  }
+  n *= gio_upow10[prec];
+
+  if (e >= 0) {
+    if (e > 39 || n >> (63 - e) != 0)
+      return -1;
+    *q = n << e;
+    return 0;
+  }
+  s = -e;
+  if (s >= 64) {
+    // less than half of one unit
+    *q = 0;
+    return 0;
+  }
+  *q = n >> s;
+  rem = n & ((1ULL << s) - 1);
+  half = 1ULL << (s - 1);
+  if (rem > half || (rem == half && (*q & 1)))
+    (*q)++;
+  return 0;
+}
+
+/**
+ * Write the integer q / 10^prec with prec decimals, as printf("%.*f").
+ */
+static inline char* gio_decimal(char *p, int neg, uint64_t q, int prec)
+{
+  uint64_t frac;
+  int k;
+
+  if (neg)
+    *p++ = '-';
+  p = gio_utoa(p, q / gio_upow10[prec]);
+  if (prec > 0) {
+    *p++ = '.';
+    frac = q % gio_upow10[prec];
+    for (k = prec - 1; k >= 0; k--) {
+      p[k] = '0' + frac % 10;
+      frac /= 10;
+    }
+    p += prec;
+  }
+  return p;
+}
+
+/**
+ * Write v as printf("%.*f", prec, v) would; glibc also prints the sign of
+ * negative values that round to zero.
+ */
+static char* gio_fixed(char *p, float v, int prec)
+{
+  uint64_t q;
+
+  if (gio_round(v, prec, &q) != 0)
+    return p + sprintf(p, "%.*f", prec, v);
+  return gio_decimal(p, signbit(v), q, prec);
+}
+
+/**
+ * Write v with the fewest decimals that read back as the same float.  A
+ * candidate q / 10^prec is checked by dividing in double, which is exact to
+ * one rounding; candidates that land exactly between two floats are skipped,
+ * since a second rounding to float could go either way.
+ */
+static char* gio_shortest(char *p, float v)
+{
+  uint64_t q;
+  double d;
+  float a, f, g;
+  int prec;
+
+  a = fabsf(v);
+  for (prec = 0; prec <= 9; prec++) {
+    if (gio_round(v, prec, &q) != 0 || q > (1ULL << 53))
+      break;
+    d = (double) q / gio_pow10[prec];
+    f = (float) d;
+    if ((double) f != d) {
+      g = nextafterf(f, d > f ? INFINITY : -INFINITY);
+      if (d - (double) f == (double) g - d)
+        continue;
+    }
+    if (f == a)
+      return gio_decimal(p, signbit(v), q, prec);
+  }
+  return p + sprintf(p, "%.9g", v);
+}
+
+/**
+ * Largest number of bytes one value of the given type can take, with its
+ * separator.
+ */
+static size_t gio_width(enum gridio_type type, int prec)
+{
+  if (type != GIO_FLOAT)
+    return 12;
+  // sign, 39 integer digits, point, decimals, separator
+  return 42 + (prec > 0 ? prec : 9);
+}
+
+/**
+ * Format a run of rows into the closure's buffer.
+ */
+static void* gio_format(void *_closure)
+{
+  gio_rows *rows;
+  char *p;
+  uint64_t i, end;
+
+  rows = (gio_rows*) _closure;
+  p = rows->buf;
+  i = rows->begin * rows->ncol;
+  end = rows->end * rows->ncol;
+
+  for (; i < end; i++) {
+    switch (rows->type) {
+      case GIO_FLOAT:
+        if (rows->prec == GIO_SHORTEST)
+          p = gio_shortest(p, ((const float*) rows->data)[i]);
+        else
+          p = gio_fixed(p, ((const float*) rows->data)[i], rows->prec);
+        break;
+      case GIO_INT:
+        p = gio_itoa(p, ((const int*) rows->data)[i]); break;
+      case GIO_UINT:
+        p = gio_utoa(p, ((const unsigned int*) rows->data)[i]); break;
+      case GIO_SHRT:
+        p = gio_itoa(p, ((const short*) rows->data)[i]); break;
+      case GIO_USHRT:
+        p = gio_utoa(p, ((const unsigned short*) rows->data)[i]); break;
+      case GIO_CHAR:
+        p = gio_itoa(p, ((const signed char*) rows->data)[i]); break;
+      case GIO_UCHAR:
+        p = gio_utoa(p, ((const unsigned char*) rows->data)[i]); break;
+    }
+    *p++ = ' ';
+    if ((i + 1) % rows->ncol == 0)
+      *p++ = '\n';
+  }
+  rows->len = p - rows->buf;
+  return NULL;
+}
+
+static void* gio_format_thread(void *_closure)
+{
+  gio_format(_closure);
+  pthread_exit(NULL);
+}
+
+/**
+ * Write all of buf to fd.
+ */
+static int gio_write_all(int fd, const char *buf, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/**
+ * Write the values of a grid as ArcASCII rows.
+ *
+ * Each thread formats a block of rows into its own buffer, and the buffers
+ * are then written in order with one write() each, before the threads go on
+ * to the next blocks.
+ */
+int gio_write_rows(FILE *fp, enum gridio_type type, const void *data,
+                   uint64_t nrow, uint64_t ncol, int prec, int nthread)
+{
+  gio_rows rows[GIO_MAX_THREADS];
+  uint64_t block, r;
+  size_t cap;
+  int t, nt, fd, result;
+
+  assert(fp);
+  assert(data || nrow * ncol == 0);
+  if (nrow == 0 || ncol == 0)
+    return 0;
+
+  // rows per block, and the room a block can need
+  block = GIO_WRITE_BLOCK / (ncol * gio_width(type, prec));
+  if (block < 1)
+    block = 1;
+  cap = block * (ncol * gio_width(type, prec) + 1);
+
+  if (nthread <= 0)
+    nthread = sysconf(_SC_NPROCESSORS_ONLN);
+  if ((uint64_t) nthread > (nrow + block - 1) / block)
+    nthread = (nrow + block - 1) / block;
+  if (nthread > GIO_MAX_THREADS)
+    nthread = GIO_MAX_THREADS;
+  if (nthread < 1)
+    nthread = 1;
+
+  for (t = 0; t < nthread; t++) {
+    rows[t].data = data;
+    rows[t].type = type;
+    rows[t].ncol = ncol;
+    rows[t].prec = prec;
+    rows[t].buf = (char*) malloc(cap);
+    if (!rows[t].buf) {
+      perror("Unable to allocate grid output buffer");
+      while (t-- > 0)
+        free(rows[t].buf);
+      return -1;
+    }
+  }
+
+  // everything already in fp goes first
+  result = fflush(fp);
+  fd = fileno(fp);
+
+  for (r = 0; r < nrow && result == 0; r += block * nthread) {
+    for (nt = 0; nt < nthread && r + nt * block < nrow; nt++) {
+      rows[nt].begin = r + nt * block;
+      rows[nt].end = MIN(rows[nt].begin + block, nrow);
+    }
+    if (nt == 1)
+      gio_format(rows);
+    else if (gio_run(nt, gio_format_thread, rows, sizeof(gio_rows)) != 0)
+      result = -1;
+
+    for (t = 0; t < nt && result == 0; t++)
+      result = gio_write_all(fd, rows[t].buf, rows[t].len);
+  }
+  if (result != 0)
+    perror("Error writing grid data");
+
+  for (t = 0; t < nthread; t++)
+    free(rows[t].buf);
+  return result;
+}
+
+
+// tile codecs gio_code_tile() tries, besides storing the tile raw
+static const int gio_codecs[] = {
+  GIO_TILE_SHUFFLE, GIO_TILE_DELTA | GIO_TILE_SHUFFLE,
+  GIO_TILE_PLANES, GIO_TILE_DELTA | GIO_TILE_PLANES
+};
+#define GIO_NCODEC (sizeof(gio_codecs) / sizeof(gio_codecs[0]))
+
+// most bytes PackBits can turn len bytes into
+#define gio_packbits_bound(len) ((len) + (len) / 128 + 1)
+
+// bytes of the rearranged tile a codec runs PackBits over; bit planes are
+// padded to whole bytes
+#define gio_coded_len(codec, n, s) \
+  ((codec) & GIO_TILE_PLANES ? (size_t) (s) * 8 * (((n) + 7) / 8) : \
+                               (size_t) (n) * (s))
+
+/**
+ * Difference each value of a w x h tile of s-byte values with its left
+ * neighbour, or for the first column the value above, in place.  Working
+ * from the end back, every value is still original when it is subtracted.
+ */
+static void gio_delta(unsigned char *t, size_t w, size_t h, size_t s)
+{
+  size_t i, n;
+
+  n = w * h;
+  for (i = n; i-- > 1; ) {
+    size_t prev = i % w ? i - 1 : i - w;
+    switch (s) {
+      case 1: t[i] -= t[prev]; break;
+      case 2: ((uint16_t*) t)[i] -= ((uint16_t*) t)[prev]; break;
+      case 4: ((uint32_t*) t)[i] -= ((uint32_t*) t)[prev]; break;
+    }
+  }
+}
+
+/**
+ * Undo gio_delta(), front to back.
+ */
+static void gio_undelta(unsigned char *t, size_t w, size_t h, size_t s)
+{
+  size_t i, n;
+
+  n = w * h;
+  for (i = 1; i < n; i++) {
+    size_t prev = i % w ? i - 1 : i - w;
+    switch (s) {
+      case 1: t[i] += t[prev]; break;
+      case 2: ((uint16_t*) t)[i] += ((uint16_t*) t)[prev]; break;
+      case 4: ((uint32_t*) t)[i] += ((uint32_t*) t)[prev]; break;
+    }
+  }
+}
+
+/**
+ * Rearrange n s-byte values for a codec: gather byte k of every value
+ * together (GIO_TILE_SHUFFLE) or bit k (GIO_TILE_PLANES).
+ */
+static void gio_arrange(int codec, const unsigned char *in, unsigned char *out,
+                        size_t n, size_t s)
+{
+  size_t i, b, k, plane;
+
+  if (codec & GIO_TILE_SHUFFLE) {
+    for (b = 0; b < s; b++)
+      for (i = 0; i < n; i++)
+        out[b * n + i] = in[i * s + b];
+  }else if (codec & GIO_TILE_PLANES) {
+    plane = (n + 7) / 8;
+    memset(out, 0, s * 8 * plane);
+    for (i = 0; i < n; i++)
+      for (b = 0; b < s; b++)
+        for (k = 0; k < 8; k++)
+          out[(b * 8 + k) * plane + i / 8] |=
+            ((in[i * s + b] >> k) & 1) << (i % 8);
+  }else
+    memcpy(out, in, n * s);
+}
+
+/**
+ * Undo gio_arrange().
+ */
+static void gio_unarrange(int codec, const unsigned char *in,
+                          unsigned char *out, size_t n, size_t s)
+{
+  size_t i, b, k, plane;
+
+  if (codec & GIO_TILE_SHUFFLE) {
+    for (b = 0; b < s; b++)
+      for (i = 0; i < n; i++)
+        out[i * s + b] = in[b * n + i];
+  }else if (codec & GIO_TILE_PLANES) {
+    plane = (n + 7) / 8;
+    memset(out, 0, n * s);
+    for (b = 0; b < s; b++)
+      for (k = 0; k < 8; k++)
+        for (i = 0; i < n; i++)
+          out[i * s + b] |=
+            ((in[(b * 8 + k) * plane + i / 8] >> (i % 8)) & 1) << k;
+  }else
+    memcpy(out, in, n * s);
+}
+
+/**
+ * PackBits: a control byte c < 128 is followed by c + 1 literal bytes, and
+ * c > 128 by one byte repeated 257 - c times.  Returns the coded length.
+ */
+static size_t gio_packbits(const unsigned char *in, size_t len,
+                           unsigned char *out)
+{
+  size_t i, run, lit, o;
+
+  o = 0;
+  i = 0;
+  while (i < len) {
+    // a run of at least 2 equal bytes?
+    run = 1;
+    while (i + run < len && run < 128 && in[i + run] == in[i])
+      run++;
+    if (run > 1) {
+      out[o++] = (unsigned char) (257 - run);
+      out[o++] = in[i];
+      i += run;
+      continue;
+    }
+    // literals, up to the next run of 3 (a run of 2 costs as much as
+    // literals, and ending a literal block for it rarely pays)
+    lit = 1;
+    while (i + lit < len && lit < 128 &&
+           !(i + lit + 2 < len && in[i + lit] == in[i + lit + 1] &&
+             in[i + lit] == in[i + lit + 2]))
+      lit++;
+    out[o++] = (unsigned char) (lit - 1);
+    memcpy(out + o, in + i, lit);
+    o += lit;
+    i += lit;
+  }
+  return o;
+}
+
+/**
+ * Undo gio_packbits(), which must give exactly len bytes.
+ */
+static int gio_unpackbits(const unsigned char *in, size_t inlen,
+                          unsigned char *out, size_t len)
+{
+  size_t i, o, k;
+  unsigned char c;
+
+  i = o = 0;
+  while (i < inlen) {
+    c = in[i++];
+    if (c < 128) {
+      k = (size_t) c + 1;
+      if (i + k > inlen || o + k > len)
+        return -1;
+      memcpy(out + o, in + i, k);
+      i += k;
+    }else if (c > 128) {
+      k = 257 - (size_t) c;
+      if (i >= inlen || o + k > len)
+        return -1;
+      memset(out + o, in[i++], k);
+    }else
+      continue;
+    o += k;
+  }
+  return o == len ? 0 : -1;
+}
+
+/**
+ * Code the n = w * h values of s bytes in tile with each codec, keeping the
+ * smallest in out.  scratch and coded each need gio_packbits_bound() of the
+ * largest rearranged tile.  Returns the coded length and sets *codec.
+ */
+static size_t gio_code_tile(unsigned char *tile, size_t w, size_t h,
+                            size_t s, unsigned char *out,
+                            unsigned char *scratch, unsigned char *coded,
+                            uint32_t *codec)
+{
+  size_t n, best, len;
+  unsigned int c;
+  int pass;
+
+  n = w * h;
+  best = n * s;
+  *codec = GIO_TILE_RAW;
+  memcpy(out, tile, best);
+
+  // the codecs without delta first, since gio_delta() works in place
+  for (pass = 0; pass < 2; pass++) {
+    if (pass == 1)
+      gio_delta(tile, w, h, s);
+    for (c = 0; c < GIO_NCODEC; c++) {
+      if (((gio_codecs[c] & GIO_TILE_DELTA) != 0) != pass)
+        continue;
+      gio_arrange(gio_codecs[c], tile, scratch, n, s);
+      len = gio_packbits(scratch, gio_coded_len(gio_codecs[c], n, s), coded);
+      if (len < best) {
+        best = len;
+        *codec = gio_codecs[c];
+        memcpy(out, coded, len);
+      }
+    }
+  }
+  return best;
+}
+
+/**
+ * Size of tile (tr, tc): the tile edge, less on the right and bottom.
+ */
+static void gio_tile_size(GridFile *gf, uint64_t tr, uint64_t tc, size_t *w,
+                          size_t *h)
+{
+  *w = MIN((uint64_t) gf->tile, gf->hd.ncol - tc * gf->tile);
+  *h = MIN((uint64_t) gf->tile, gf->hd.nrow - tr * gf->tile);
+}
+
+int gio_read_tile(GridFile *gf, uint64_t tr, uint64_t tc, void *data)
+{
+  const GridTileEntry *e;
+  const unsigned char *in;
+  unsigned char *tmp;
+  size_t w, h, n, s, len;
+
+  assert(gf && data);
+  assert(gf->tiled);
+  if (tr >= gf->ntilerow || tc >= gf->ntilecol)
+    return -1;
+
+  gio_tile_size(gf, tr, tc, &w, &h);
+  n = w * h;
+  s = gio_size(gf->type);
+  e = gf->index + tr * gf->ntilecol + tc;
+  if (e->offset + e->length > gf->len) {
+    fprintf(stderr, "Tile (%llu, %llu) is truncated.\n",
+            (unsigned long long) tr, (unsigned long long) tc);
+    return -1;
+  }
+  in = (const unsigned char*) gf->map + e->offset;
+
+  if (e->codec == GIO_TILE_RAW) {
+    if (e->length != n * s)
+      return -1;
+    memcpy(data, in, n * s);
+    return 0;
+  }
+
+  len = gio_coded_len(e->codec, n, s);
+  tmp = (unsigned char*) malloc(len);
+  if (!tmp) {
+    perror("Unable to allocate tile buffer");
+    return -1;
+  }
+  if (gio_unpackbits(in, e->length, tmp, len) != 0) {
+    fprintf(stderr, "Tile (%llu, %llu) is corrupt.\n",
+            (unsigned long long) tr, (unsigned long long) tc);
+    free(tmp);
+    return -1;
+  }
+  gio_unarrange(e->codec, tmp, (unsigned char*) data, n, s);
+  if (e->codec & GIO_TILE_DELTA)
+    gio_undelta((unsigned char*) data, w, h, s);
+  free(tmp);
+  return 0;
+}
+
+// one thread's share of the tiles of a window
+typedef struct gio_tiles_t {
+  GridFile *gf;
+  enum gridio_type type;
+  uint64_t row, col, nrow, ncol;   // the window
+  void *data;
+  int thread, nthread;
+  int result;
+} gio_tiles;
+
+/**
+ * Decode the tiles meeting a window, and copy their part of it into data,
+ * an array of type with ncol values per row.  The tiles are split among the
+ * threads round robin.
+ */
+static void* gio_window_tiles(void *_closure)
+{
+  gio_tiles *w;
+  GridFile *gf;
+  unsigned char *tile;
+  uint64_t tr, tc, tr0, tr1, tc0, tc1, k, r, r0, r1, c0, c1;
+  size_t tw, th, s, sd;
+
+  w = (gio_tiles*) _closure;
+  gf = w->gf;
+  s = gio_size(gf->type);
+  sd = gio_size(w->type);
+  w->result = 0;
+  tile = (unsigned char*) malloc((size_t) gf->tile * gf->tile * s);
+  if (!tile) {
+    perror("Unable to allocate tile buffer");
+    w->result = -1;
+    return NULL;
+  }
+
+  tr0 = w->row / gf->tile;
+  tr1 = (w->row + w->nrow + gf->tile - 1) / gf->tile;
+  tc0 = w->col / gf->tile;
+  tc1 = (w->col + w->ncol + gf->tile - 1) / gf->tile;
+  for (k = w->thread; k < (tr1 - tr0) * (tc1 - tc0); k += w->nthread) {
+    tr = tr0 + k / (tc1 - tc0);
+    tc = tc0 + k % (tc1 - tc0);
+    if (gio_read_tile(gf, tr, tc, tile) != 0) {
+      w->result = -1;
+      break;
+    }
+    gio_tile_size(gf, tr, tc, &tw, &th);
+
+    // the part of the tile inside the window
+    r0 = MAX(w->row, tr * gf->tile);
+    r1 = MIN(w->row + w->nrow, tr * gf->tile + th);
+    c0 = MAX(w->col, tc * gf->tile);
+    c1 = MIN(w->col + w->ncol, tc * gf->tile + tw);
+    for (r = r0; r < r1; r++)
+      gio_convert(gf->type,
+                  tile + ((r - tr * gf->tile) * tw + (c0 - tc * gf->tile)) * s,
+                  w->type,
+                  (char*) w->data + ((r - w->row) * w->ncol + (c0 - w->col)) * sd,
+                  c1 - c0);
+  }
+
+  free(tile);
+  return NULL;
+}
+
+static void* gio_window_thread(void *_closure)
+{
+  gio_window_tiles(_closure);
+  pthread_exit(NULL);
+}
+
+/**
+ * Decode a window of a tiled grid with nthread threads.
+ */
+static int gio_tiled_window(GridFile *gf, enum gridio_type type, uint64_t row,
+                            uint64_t col, uint64_t nrow, uint64_t ncol,
+                            void *data, int nthread)
+{
+  gio_tiles tiles[GIO_MAX_THREADS];
+  uint64_t ntile;
+  int t, result;
+
+  ntile = ((row + nrow + gf->tile - 1) / gf->tile - row / gf->tile) *
+          ((col + ncol + gf->tile - 1) / gf->tile - col / gf->tile);
+  if (nthread <= 0)
+    nthread = sysconf(_SC_NPROCESSORS_ONLN);
+  if ((uint64_t) nthread > ntile)
+    nthread = ntile;
+  if (nthread > GIO_MAX_THREADS)
+    nthread = GIO_MAX_THREADS;
+  if (nthread < 1)
+    nthread = 1;
+
+  for (t = 0; t < nthread; t++) {
+    tiles[t].gf = gf;
+    tiles[t].type = type;
+    tiles[t].row = row;
+    tiles[t].col = col;
+    tiles[t].nrow = nrow;
+    tiles[t].ncol = ncol;
+    tiles[t].data = data;
+    tiles[t].thread = t;
+    tiles[t].nthread = nthread;
+  }
+  if (nthread == 1)
+    gio_window_tiles(tiles);
+  else if (gio_run(nthread, gio_window_thread, tiles, sizeof(gio_tiles)) != 0)
+    return -1;
+
+  result = 0;
+  for (t = 0; t < nthread; t++)
+    if (tiles[t].result != 0)
+      result = -1;
+  return result;
+}
+
+static int gio_read_tiled(GridFile *gf, enum gridio_type type, void *data,
+                          int nthread)
+{
+  if (gf->hd.nrow == 0 || gf->hd.ncol == 0)
+    return 0;
+  return gio_tiled_window(gf, type, 0, 0, gf->hd.nrow, gf->hd.ncol, data,
+                          nthread);
+}
+
+int gio_read_window(GridFile *gf, enum gridio_type type, uint64_t row,
+                    uint64_t col, uint64_t nrow, uint64_t ncol, void *data)
+{
+  void *all;
+  uint64_t r;
+  size_t s;
+  int result;
+
+  assert(gf && data);
+  if (row + nrow > gf->hd.nrow || col + ncol > gf->hd.ncol) {
+    fprintf(stderr, "Window is outside the grid.\n");
+    return -1;
+  }
+  if (nrow == 0 || ncol == 0)
+    return 0;
+  if (gf->tiled)
+    return gio_tiled_window(gf, type, row, col, nrow, ncol, data, 0);
+
+  // binary grids copy straight out of the mapping; ASCII ones are parsed
+  // whole first
+  s = gio_size(gf->binary ? gf->type : type);
+  all = NULL;
+  if (!gf->binary) {
+    all = malloc(gf->hd.nrow * gf->hd.ncol * s);
+    if (!all) {
+      perror("Unable to allocate grid");
+      return -1;
+    }
+    result = gio_read(gf, type, all, 0);
+    if (result != 0) {
+      free(all);
+      return result;
+    }
+  }
+  for (r = 0; r < nrow; r++)
+    gio_convert(gf->binary ? gf->type : type,
+                (const char*) (all ? all : gf->map + gf->data) +
+                  ((row + r) * gf->hd.ncol + col) * s,
+                type, (char*) data + r * ncol * gio_size(type), ncol);
+  free(all);
+  return 0;
+}
+
+GridStream* gio_stream_open(const char *path, enum gridio_type type,
+                            long bytes)
+{
+  GridStream *gs;
+  GridFile *gf;
+  uint64_t row;
+
+  gf = gio_open(path);
+  if (!gf)
+    return NULL;
+  gs = (GridStream*) malloc(sizeof(GridStream));
+  if (!gs) {
+    perror("Unable to allocate GridStream object");
+    gio_close(gf);
+    return NULL;
+  }
+  madvise((void*) gf->map, gf->len, MADV_SEQUENTIAL);
+
+  if (bytes <= 0)
+    bytes = GIO_STREAM_BLOCK;
+  row = gf->hd.ncol * gio_size(type);
+  gs->block = row ? bytes / row : gf->hd.nrow;
+  if (gf->tiled)
+    // decode whole tile rows, so no tile is decoded twice
+    gs->block = gs->block / gf->tile * gf->tile;
+  if (gs->block < 1)
+    gs->block = gf->tiled ? gf->tile : 1;
+  if (gs->block > gf->hd.nrow)
+    gs->block = gf->hd.nrow;
+
+  gs->gf = gf;
+  gs->type = type;
+  gs->row = 0;
+  gs->next = gf->map + gf->data;
+  gs->released = 0;
+  gs->buf = NULL;
+  if (!gio_data(gf, type) && gs->block * row > 0) {
+    gs->buf = malloc(gs->block * row);
+    if (!gs->buf) {
+      perror("Unable to allocate stream block");
+      gio_stream_close(gs);
+      return NULL;
+    }
+  }
+  return gs;
+}
+
+/**
+ * Hand the whole pages of the mapping before upto back to the system; they
+ * are only file pages, so reading them again would just fault them back in.
+ */
+static void gio_release(GridStream *gs, const char *upto)
+{
+  size_t page, end;
+
+  page = sysconf(_SC_PAGESIZE);
+  end = (upto - gs->gf->map) / page * page;
+  if (end > gs->released) {
+    madvise((void*) (gs->gf->map + gs->released), end - gs->released,
+            MADV_DONTNEED);
+    gs->released = end;
+  }
+}
+
+/**
+ * Parse the next n values of an ArcASCII grid into data.
+ */
+static int gio_stream_parse(GridStream *gs, void *data, uint64_t n)
+{
+  const char *p, *end, *start;
+  uint64_t i;
+  double val;
+  int slow;
+
+  p = gs->next;
+  end = gs->gf->map + gs->gf->len;
+  for (i = 0; i < n; i++) {
+    while (p < end && gio_space(*p))
+      p++;
+    if (p == end) {
+      fprintf(stderr, "Grid has %llu values, expected %llu.\n",
+              (unsigned long long) (gs->row * gs->gf->hd.ncol + i),
+              (unsigned long long) (gs->gf->hd.nrow * gs->gf->hd.ncol));
+      return -1;
+    }
+    start = p;
+    p = gio_scan(p, end, &val, &slow);
+
+    if (gs->type == GIO_FLOAT)
+      ((float*) data)[i] = gio_narrow(start, end, val, slow);
+    else
+      gio_put(gs->type, data, i, val);
+  }
+  gs->next = p;
+  return 0;
+}
+
+int64_t gio_stream_next(GridStream *gs, const void **rows)
+{
+  GridFile *gf;
+  const char *src;
+  uint64_t n;
+
+  assert(gs && rows);
+  gf = gs->gf;
+  *rows = NULL;
+  n = MIN(gs->block, gf->hd.nrow - gs->row);
+  if (n == 0)
+    return 0;
+
+  if (gf->binary) {
+    // the rows are in the mapping already
+    src = gf->map + gf->data + gs->row * gf->hd.ncol * gio_size(gf->type);
+    gio_release(gs, src);
+    if (gs->buf)
+      gio_convert(gf->type, src, gs->type, gs->buf, n * gf->hd.ncol);
+    *rows = gs->buf ? gs->buf : src;
+  }else if (gf->tiled) {
+    // the tiles are written in order, so every tile before this tile row
+    // is done with
+    gio_release(gs, gf->map +
+                gf->index[gs->row / gf->tile * gf->ntilecol].offset);
+    if (gio_tiled_window(gf, gs->type, gs->row, 0, n, gf->hd.ncol, gs->buf,
+                         0) != 0)
+      return -1;
+    *rows = gs->buf;
+  }else {
+    if (gio_stream_parse(gs, gs->buf, n * gf->hd.ncol) != 0)
+      return -1;
+    gio_release(gs, gs->next);
+    *rows = gs->buf;
+  }
+
+  gs->row += n;
+  return n;
+}
+
+void gio_stream_close(GridStream *gs)
+{
+  assert(gs);
+  gio_close(gs->gf);
+  free(gs->buf);
+  free(gs);
+}
+
+// one thread's share of the tiles of a tile row
+typedef struct gio_tilerow_t {
+  const unsigned char *data;
+  size_t s;
+  uint64_t nrow, ncol;
+  uint32_t tile;
+  uint64_t tr, ntilecol;
+  int thread, nthread;
+  unsigned char **out;     // coded tiles of the row
+  GridTileEntry *entries;  // their lengths and codecs
+  int result;
+} gio_tilerow;
+
+/**
+ * Code the tiles of one tile row.  Each thread codes every nthread-th tile
+ * into a buffer of its own, and gio_write_tiled() writes them in order.
+ */
+static void* gio_code_tilerow(void *_closure)
+{
+  gio_tilerow *tr;
+  unsigned char *tile, *scratch, *coded, *best;
+  uint64_t tc, r, r0, c0;
+  size_t w, h, cap, len;
+
+  tr = (gio_tilerow*) _closure;
+  tr->result = 0;
+  cap = gio_packbits_bound(gio_coded_len(GIO_TILE_PLANES,
+                                         (size_t) tr->tile * tr->tile, tr->s));
+  tile = (unsigned char*) malloc((size_t) tr->tile * tr->tile * tr->s);
+  scratch = (unsigned char*) malloc(cap);
+  coded = (unsigned char*) malloc(cap);
+  best = (unsigned char*) malloc(cap);
+  if (!tile || !scratch || !coded || !best) {
+    perror("Unable to allocate tile buffers");
+    tr->result = -1;
+  }
+
+  r0 = tr->tr * tr->tile;
+  h = MIN((uint64_t) tr->tile, tr->nrow - r0);
+  for (tc = tr->thread; tc < tr->ntilecol && tr->result == 0;
+       tc += tr->nthread) {
+    c0 = tc * tr->tile;
+    w = MIN((uint64_t) tr->tile, tr->ncol - c0);
+    for (r = 0; r < h; r++)
+      memcpy(tile + r * w * tr->s,
+             tr->data + ((r0 + r) * tr->ncol + c0) * tr->s, w * tr->s);
+
+    len = gio_code_tile(tile, w, h, tr->s, best, scratch, coded,
+                        &tr->entries[tc].codec);
+    tr->entries[tc].length = len;
+    tr->out[tc] = (unsigned char*) malloc(len + 1);
+    if (!tr->out[tc]) {
+      perror("Unable to allocate coded tile");
+      tr->result = -1;
+      break;
+    }
+    memcpy(tr->out[tc], best, len);
+  }
+
+  free(tile);
+  free(scratch);
+  free(coded);
+  free(best);
+  return NULL;
+}
+
+static void* gio_code_tilerow_thread(void *_closure)
+{
+  gio_code_tilerow(_closure);
+  pthread_exit(NULL);
+}
+
+int gio_write_tiled(const char *path, const GridIOHeader *hd,
+                    enum gridio_type type, const void *data, int nthread)
+{
+  gio_tilerow rows[GIO_MAX_THREADS];
+  GridTileHeader th;
+  GridTileEntry *index;
+  unsigned char **out;
+  uint64_t ntilerow, ntilecol, tr, tc, offset;
+  FILE *fp;
+  char *tmp;
+  static const char zeros[8] = { 0 };
+  int t, result;
+
+  assert(path && hd && (data || hd->nrow * hd->ncol == 0));
+
+  ntilerow = (hd->nrow + GIO_TILE - 1) / GIO_TILE;
+  ntilecol = (hd->ncol + GIO_TILE - 1) / GIO_TILE;
+
+  memset(&th, 0, sizeof(th));
+  memcpy(th.magic, GIO_TILE_MAGIC, sizeof(th.magic));
+  th.byteorder = GIO_BIN_BYTEORDER;
+  th.type = type;
+  th.nrow = hd->nrow;
+  th.ncol = hd->ncol;
+  th.xllcorner = hd->xllcorner;
+  th.yllcorner = hd->yllcorner;
+  th.cellsize = hd->cellsize;
+  th.nodata = hd->nodata;
+  th.has_nodata = hd->has_nodata;
+  th.tile = GIO_TILE;
+
+  if (nthread <= 0)
+    nthread = sysconf(_SC_NPROCESSORS_ONLN);
+  if ((uint64_t) nthread > ntilecol)
+    nthread = ntilecol;
+  if (nthread > GIO_MAX_THREADS)
+    nthread = GIO_MAX_THREADS;
+  if (nthread < 1)
+    nthread = 1;
+
+  index = (GridTileEntry*) calloc(ntilerow * ntilecol + 1,
+                                  sizeof(GridTileEntry));
+  out = (unsigned char**) calloc(ntilecol + 1, sizeof(unsigned char*));
+  tmp = (char*) malloc(strlen(path) + 5);
+  if (!index || !out || !tmp) {
+    perror("Unable to allocate tiled grid buffers");
+    free(index);
+    free(out);
+    free(tmp);
+    return -1;
+  }
+  sprintf(tmp, "%s.tmp", path);
+
+  fp = fopen(tmp, "wb");
+  if (!fp) {
+    fprintf(stderr, "Could not open output file (%s).\n", tmp);
+    perror(NULL);
+    free(index);
+    free(out);
+    free(tmp);
+    return -1;
+  }
+
+  // the header is written again at the end, once the index offset is known
+  result = fwrite(&th, sizeof(th), 1, fp) == 1 ? 0 : -1;
+  offset = sizeof(th);
+
+  for (tr = 0; tr < ntilerow && result == 0; tr++) {
+    for (t = 0; t < nthread; t++) {
+      rows[t].data = (const unsigned char*) data;
+      rows[t].s = gio_size(type);
+      rows[t].nrow = hd->nrow;
+      rows[t].ncol = hd->ncol;
+      rows[t].tile = GIO_TILE;
+      rows[t].tr = tr;
+      rows[t].ntilecol = ntilecol;
+      rows[t].thread = t;
+      rows[t].nthread = nthread;
+      rows[t].out = out;
+      rows[t].entries = index + tr * ntilecol;
+    }
+    if (nthread == 1)
+      gio_code_tilerow(rows);
+    else if (gio_run(nthread, gio_code_tilerow_thread, rows,
+                     sizeof(gio_tilerow)) != 0)
+      result = -1;
+    for (t = 0; t < nthread && result == 0; t++)
+      if (rows[t].result != 0)
+        result = -1;
+
+    for (tc = 0; tc < ntilecol; tc++) {
+      if (result == 0 && out[tc]) {
+        index[tr * ntilecol + tc].offset = offset;
+        if (fwrite(out[tc], 1, index[tr * ntilecol + tc].length, fp) !=
+            index[tr * ntilecol + tc].length)
+          result = -1;
+        offset += index[tr * ntilecol + tc].length;
+      }
+      free(out[tc]);
+      out[tc] = NULL;
+    }
+  }
+
+  // the index, 8-byte aligned, and the finished header
+  if (result == 0) {
+    th.index = (offset + 7) / 8 * 8;
+    if (fwrite(zeros, 1, th.index - offset, fp) != th.index - offset ||
+        fwrite(index, sizeof(GridTileEntry), ntilerow * ntilecol, fp) !=
+          ntilerow * ntilecol ||
+        fseek(fp, 0, SEEK_SET) != 0 ||
+        fwrite(&th, sizeof(th), 1, fp) != 1)
+      result = -1;
+  }
+  if (fclose(fp) != 0)
+    result = -1;
+  if (result == 0 && rename(tmp, path) != 0)
+    result = -1;
+  if (result != 0) {
+    fprintf(stderr, "Could not write tiled grid (%s).\n", path);
+    perror(NULL);
+    unlink(tmp);
+  }
+
+  free(index);
+  free(out);
+  free(tmp);
+  return result;
+}
+
+
+// set the bits of the cells of a row of type T that are not NODATA
+#define GIO_VALID_ROW(T) { \
+  const T *p = (const T*) data + r * ncol; \
+  const T nd = *(const T*) nodata; \
+  for (c = 0; c < ncol; c++) \
+    if (p[c] != nd) \
+      row[c >> 6] |= 1ULL << (c & 63); \
+}
+
+GridValid* gio_valid(enum gridio_type type, const void *data, uint64_t nrow,
+                     uint64_t ncol, const void *nodata)
+{
+  GridValid *v;
+  uint64_t *row;
+  uint64_t r, c, w;
+
+  v = (GridValid*) malloc(sizeof(GridValid));
+  if (!v) {
+    perror("Could not allocate validity bitmap");
+    return NULL;
+  }
+  v->nrow = nrow;
+  v->ncol = ncol;
+  v->nword = (ncol + 63) / 64;
+  w = nrow * v->nword;
+  v->bits = (uint64_t*) calloc(w ? w : 1, sizeof(uint64_t));
+  v->first = (uint64_t*) malloc((nrow ? nrow : 1) * sizeof(uint64_t));
+  v->last = (uint64_t*) malloc((nrow ? nrow : 1) * sizeof(uint64_t));
+  if (!v->bits || !v->first || !v->last) {
+    perror("Could not allocate validity bitmap");
+    gio_valid_free(v);
+    return NULL;
+  }
+
+  v->r0 = nrow;
+  v->r1 = 0;
+  v->c0 = ncol;
+  v->c1 = 0;
+  v->count = 0;
+  for (r = 0; r < nrow; r++) {
+    row = v->bits + r * v->nword;
+    switch (type) {
+      case GIO_FLOAT: GIO_VALID_ROW(float);          break;
+      case GIO_INT:   GIO_VALID_ROW(int);            break;
+      case GIO_UINT:  GIO_VALID_ROW(unsigned int);   break;
+      case GIO_SHRT:  GIO_VALID_ROW(short);          break;
+      case GIO_USHRT: GIO_VALID_ROW(unsigned short); break;
+      case GIO_CHAR:  GIO_VALID_ROW(char);           break;
+      case GIO_UCHAR: GIO_VALID_ROW(unsigned char);  break;
+    }
+
+    // the row's span, from its first and last non-empty words
+    v->first[r] = ncol;
+    v->last[r] = 0;
+    for (w = 0; w < v->nword; w++) {
+      if (!row[w])
+        continue;
+      if (v->first[r] == ncol)
+        v->first[r] = w * 64 + __builtin_ctzll(row[w]);
+      v->last[r] = w * 64 + 64 - __builtin_clzll(row[w]);
+      v->count += __builtin_popcountll(row[w]);
+    }
+    if (v->first[r] < v->last[r]) {
+      if (v->r0 == nrow)
+        v->r0 = r;
+      v->r1 = r + 1;
+      if (v->first[r] < v->c0)
+        v->c0 = v->first[r];
+      if (v->last[r] > v->c1)
+        v->c1 = v->last[r];
+    }
+  }
+  if (v->r0 == nrow) {
+    // no data at all
+    v->r0 = v->r1 = 0;
+    v->c0 = v->c1 = 0;
+  }
+  return v;
+}
+
+#undef GIO_VALID_ROW
+
+uint64_t gio_valid_run(const GridValid *v, uint64_t r, uint64_t c,
+                       uint64_t *end)
+{
+  const uint64_t *row;
+  uint64_t w, word;
+
+  *end = v->ncol;
+  if (c >= v->last[r])
+    return v->ncol;
+  if (c < v->first[r])
+    c = v->first[r];
+  row = v->bits + r * v->nword;
+
+  // the first data cell, passing over empty words
+  w = c / 64;
+  word = row[w] & (~0ULL << (c & 63));
+  while (!word)
+    word = row[++w];   // there is one before last[r]
+  c = w * 64 + __builtin_ctzll(word);
+
+  // the first NODATA cell after it, passing over full words; the bits past
+  // ncol are clear, so a run at the end of a row stops there
+  word = ~row[w] & (~0ULL << (c & 63));
+  while (!word) {
+    if (++w == v->nword)
+      return c;
+    word = ~row[w];
+  }
+  *end = w * 64 + __builtin_ctzll(word);
+  return c;
+}
+
+void gio_valid_free(GridValid *v)
+{
+  if (!v)
+    return;
+  free(v->bits);
+  free(v->first);
+  free(v->last);
+  free(v);
+}
+
+// spread the pages of data over the NUMA nodes this process may use
+static int gio_interleave(void *data, size_t bytes)
+{
+#ifdef __linux__
+  unsigned long nodes[16];   // up to 1024 nodes
+
+  memset(nodes, 0, sizeof(nodes));
+  if (syscall(SYS_get_mempolicy, NULL, nodes, 8 * sizeof(nodes), NULL,
+              MPOL_F_MEMS_ALLOWED) != 0 ||
+      syscall(SYS_mbind, data, bytes, MPOL_INTERLEAVE, nodes,
+              8 * sizeof(nodes), 0) != 0)
+    return -1;
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+void* gio_alloc(size_t bytes, int flags)
+{
+  char *map, *data;
+  size_t len;
+
+  len = (bytes + GIO_HUGE_PAGE - 1) & ~(GIO_HUGE_PAGE - 1);
+  if (len == 0)
+    len = GIO_HUGE_PAGE;
+  data = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (flags & GIO_ALLOC_HUGE)
+    data = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (data == MAP_FAILED) {
+    // map a huge page more than asked, and trim it down to an aligned
+    // stretch, so transparent huge pages can back all of it
+    map = mmap(NULL, len + GIO_HUGE_PAGE, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+      perror("Could not map data");
+      return NULL;
+    }
+    data = (char*) (((uintptr_t) map + GIO_HUGE_PAGE - 1) &
+                    ~(uintptr_t) (GIO_HUGE_PAGE - 1));
+    if (data > map)
+      munmap(map, data - map);
+    munmap(data + len, map + GIO_HUGE_PAGE - data);
+#ifdef MADV_HUGEPAGE
+    if (flags & GIO_ALLOC_HUGE)
+      madvise(data, len, MADV_HUGEPAGE);
+#endif
+  }
+
+  if ((flags & GIO_ALLOC_INTERLEAVE) && gio_interleave(data, len) != 0)
+    perror("Could not interleave data over the NUMA nodes");
+  return data;
+}
+
+void gio_free(void *data, size_t bytes)
+{
+  size_t len;
+
+  if (!data)
+    return;
+  len = (bytes + GIO_HUGE_PAGE - 1) & ~(GIO_HUGE_PAGE - 1);
+  if (len == 0)
+    len = GIO_HUGE_PAGE;
+  munmap(data, len);
+}
@@ -0,0 +1,274 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef _gridio_h_DEFINED
+#define _gridio_h_DEFINED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// element types gio_read() can fill; same order as enum GridDataType
+enum gridio_type {
+  GIO_FLOAT,
+  GIO_INT,
+  GIO_UINT,
+  GIO_SHRT,
+  GIO_USHRT,
+  GIO_CHAR,
+  GIO_UCHAR
+};
+
+// binary grids start with GIO_BIN_MAGIC and are named with GIO_BIN_SUFFIX
+#define GIO_BIN_MAGIC "GRIDBIN1"
+#define GIO_BIN_SUFFIX ".bgr"
+// written in the byteorder field, to catch files from other byte orders
+#define GIO_BIN_BYTEORDER 0x01020304u
+// binary grid flag: a crc32 of every row follows the values
+#define GIO_BIN_CHECKSUM 1
+
+// header at the start of a binary grid
+//   the values follow at offset data, a multiple of the page size, raw and
+//   in row-major order, so they can be mapped and used in place; with
+//   GIO_BIN_CHECKSUM, nrow 32-bit row checksums follow at offset checksum
+typedef struct gridio_bin_header_t {
+  char magic[8];
+  uint32_t byteorder;
+  uint32_t type;         // enum gridio_type of the values
+  uint64_t nrow;
+  uint64_t ncol;
+  double xllcorner;
+  double yllcorner;
+  double cellsize;
+  double nodata;
+  uint32_t has_nodata;
+  uint32_t flags;
+  uint64_t data;
+  uint64_t checksum;
+} GridBinHeader;
+
+// tiled grids start with GIO_TILE_MAGIC and are named with GIO_TILE_SUFFIX
+#define GIO_TILE_MAGIC "GRIDTIL1"
+#define GIO_TILE_SUFFIX ".tgr"
+// edge of the square tiles gio_write_tiled() cuts
+#define GIO_TILE 256
+
+// tile codecs; a tile is either stored raw, or rearranged and then run
+//   length coded (PackBits)
+//     GIO_TILE_DELTA    - each value less its left neighbour (the first column
+//                         less the value above), as unsigned integers of the
+//                         value's size
+//     GIO_TILE_SHUFFLE  - all the first bytes of the values, then all the
+//                         second bytes, and so on
+//     GIO_TILE_PLANES   - the values cut into bit planes, low bit first
+#define GIO_TILE_RAW     0
+#define GIO_TILE_DELTA   1
+#define GIO_TILE_SHUFFLE 2
+#define GIO_TILE_PLANES  4
+
+// header at the start of a tiled grid
+//   the grid is cut into tile x tile squares (smaller on the right and bottom
+//   edges), each coded on its own; the tiles follow the header, and at offset
+//   index an entry for each tile, in row-major tile order, tells where it is
+typedef struct gridio_tile_header_t {
+  char magic[8];
+  uint32_t byteorder;
+  uint32_t type;         // enum gridio_type of the values
+  uint64_t nrow;
+  uint64_t ncol;
+  double xllcorner;
+  double yllcorner;
+  double cellsize;
+  double nodata;
+  uint32_t has_nodata;
+  uint32_t tile;
+  uint64_t index;
+} GridTileHeader;
+
+// where a tile is in a tiled grid
+typedef struct gridio_tile_entry_t {
+  uint64_t offset;
+  uint32_t length;       // coded bytes
+  uint32_t codec;
+} GridTileEntry;
+
+// grid header, of any format
+typedef struct gridio_header_t {
+  uint64_t nrow;
+  uint64_t ncol;
+  double xllcorner;
+  double yllcorner;
+  double cellsize;
+  double nodata;
+  int has_nodata;   // whether the file had a NODATA_value line
+} GridIOHeader;
+
+// an ArcASCII, binary or tiled grid file, memory mapped
+typedef struct gridio_file_t {
+  int fd;
+  const char *map;
+  size_t len;
+  size_t data;      // offset of the first value
+  GridIOHeader hd;
+  int binary;       // whether this is a binary grid
+  int tiled;        // whether this is a tiled grid
+  enum gridio_type type;   // binary and tiled grids: type of the values
+  const uint32_t *sums;    // binary grids: row checksums, or NULL
+  uint32_t tile;           // tiled grids: tile edge
+  uint64_t ntilerow;       // tiled grids: tiles down and across
+  uint64_t ntilecol;
+  const GridTileEntry *index;  // tiled grids: the tile index
+} GridFile;
+
+// map a grid file of any format and parse its header
+GridFile* gio_open(const char *path);
+
+// default bytes in a block of gio_stream_next() rows
+#define GIO_STREAM_BLOCK (1 << 22)
+
+// a grid read front to back a block of rows at a time, for one-pass work on
+//   grids too big to hold; the pages behind the block are handed back to the
+//   system as it goes, so memory use stays at about a block
+typedef struct gridio_stream_t {
+  GridFile *gf;
+  enum gridio_type type;   // type of the rows handed out
+  uint64_t block;          // rows per block
+  uint64_t row;            // rows handed out so far
+  const char *next;        // ArcASCII grids: where the next value starts
+  size_t released;         // bytes at the front of the mapping handed back
+  void *buf;               // the block, unless it is used in place
+} GridStream;
+
+// open a grid of any format to stream rows of the given type from it, in
+//   blocks of about bytes (<= 0: GIO_STREAM_BLOCK); blocks of a tiled grid
+//   are whole tile rows
+GridStream* gio_stream_open(const char *path, enum gridio_type type,
+                            long bytes);
+
+// point rows at the next block of rows, good until the next call, and return
+//   how many rows it holds: 0 after the last row, and -1 on an error
+int64_t gio_stream_next(GridStream *gs, const void **rows);
+
+// close a stream and free its block
+void gio_stream_close(GridStream *gs);
+
+// decode tile (tr, tc) of a tiled grid into data, an array of the grid's
+//   type, as rows as wide as the tile; only that tile is read from the file
+int gio_read_tile(GridFile *gf, uint64_t tr, uint64_t tc, void *data);
+
+// read the nrow x ncol window of a grid whose top left cell is (row, col)
+//   into data, an array of the given type; a tiled grid decodes only the
+//   tiles the window touches, and the other formats read the whole grid
+int gio_read_window(GridFile *gf, enum gridio_type type, uint64_t row,
+                    uint64_t col, uint64_t nrow, uint64_t ncol, void *data);
+
+// the values of a binary grid of the given type, in place in the mapping, or
+//   NULL for ArcASCII grids and other types; writes to them stay private to
+//   the process, and the pointer is good until gio_close()
+void* gio_data(GridFile *gf, enum gridio_type type);
+
+// check the row checksums of a binary grid; returns 0 if they all match or
+//   the grid has none, and -1 (after reporting the first bad row) otherwise
+int gio_verify(GridFile *gf);
+
+// parse (or for binary grids copy, and for tiled grids decode) the nrow*ncol
+// values of a grid into data, an array of the given type, with nthread
+// threads; nthread <= 0 uses every online processor
+int gio_read(GridFile *gf, enum gridio_type type, void *data, int nthread);
+
+// unmap and free a grid file
+void gio_close(GridFile *gf);
+
+// size in bytes of one value of the given type
+size_t gio_size(enum gridio_type type);
+
+// whether path names a binary grid, by its suffix
+int gio_wants_binary(const char *path);
+
+// whether path names a tiled grid, by its suffix
+int gio_wants_tiled(const char *path);
+
+// precision for gio_write_rows() asking for the fewest decimals that read
+//   back as the same float
+#define GIO_SHORTEST -1
+
+// write the nrow*ncol values in data, of the given type, to fp as ArcASCII
+//   rows: every value followed by a space, every row by a newline.  Floats get
+//   prec decimals, byte for byte as printf("%.*f") prints them, or as few as
+//   round-trip with GIO_SHORTEST; integers print as "%d" or "%u" would.  Rows
+//   are formatted by nthread threads; nthread <= 0 uses every processor.
+int gio_write_rows(FILE *fp, enum gridio_type type, const void *data,
+                   uint64_t nrow, uint64_t ncol, int prec, int nthread);
+
+// write the nrow*ncol values in data, of the given type, as a binary grid;
+//   flags may include GIO_BIN_CHECKSUM.  The grid is written to a temporary
+//   file and renamed over path, so path may be mapped by a live GridFile.
+int gio_write_binary(const char *path, const GridIOHeader *hd,
+                     enum gridio_type type, const void *data, int flags);
+
+// write the nrow*ncol values in data, of the given type, as a tiled grid,
+//   coding each tile with whichever codec makes it smallest; tiles are coded
+//   by nthread threads (<= 0: every processor).  Written and renamed over
+//   path as gio_write_binary() does.
+int gio_write_tiled(const char *path, const GridIOHeader *hd,
+                    enum gridio_type type, const void *data, int nthread);
+
+// where a grid holds data rather than NODATA, worked out once so loops over
+//   the grid can pass over empty rows and empty stretches of 64 cells without
+//   looking at each cell
+typedef struct gridio_valid_t {
+  uint64_t nrow, ncol;
+  uint64_t nword;           // words of bits in a row
+  uint64_t *bits;           // (r, c) is bit c % 64 of word r * nword + c / 64
+  uint64_t *first;          // rows' first data column, ncol if they have none
+  uint64_t *last;           // rows' last data column plus one, 0 if none
+  uint64_t r0, r1, c0, c1;  // bounding box of the data, [r0,r1) x [c0,c1);
+                            //   r0 == r1 if there is none
+  uint64_t count;           // data cells
+} GridValid;
+
+// work out where the nrow*ncol values in data, of the given type, differ from
+//   *nodata, a value of the same type.  Returns NULL on failure
+GridValid* gio_valid(enum gridio_type type, const void *data, uint64_t nrow,
+                     uint64_t ncol, const void *nodata);
+
+// the next run of data cells in row r at or after column c: returns its first
+//   column and sets *end one past its last, or returns ncol if there is none
+uint64_t gio_valid_run(const GridValid *v, uint64_t r, uint64_t c,
+                       uint64_t *end);
+
+// free a GridValid
+void gio_valid_free(GridValid *v);
+
+// placement of the memory gio_alloc() hands out, or'ed together
+//   GIO_ALLOC_HUGE        huge pages: reserved ones (MAP_HUGETLB) if there
+//                         are enough, transparent ones otherwise
+//   GIO_ALLOC_INTERLEAVE  pages spread round robin over the NUMA nodes;
+//                         without it a page lands on the node of the thread
+//                         that first writes it
+#define GIO_ALLOC_HUGE       1
+#define GIO_ALLOC_INTERLEAVE 2
+
+// size of the huge pages gio_alloc() asks for, and what it rounds up to
+#define GIO_HUGE_PAGE (2UL << 20)
+
+// map bytes of zeroed memory, aligned to GIO_HUGE_PAGE and placed as flags
+//   asks; no page is touched.  Returns NULL on failure; free with gio_free()
+void* gio_alloc(size_t bytes, int flags);
+
+// unmap memory from gio_alloc(), of the same bytes
+void gio_free(void *data, size_t bytes);
+
+#endif
@@ -0,0 +1,130 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "perfcount.h"
+
+// names pc_sprint() prints, in counter order
+static const char *PC_NAMES[PC_NCOUNTER] = {
+  "cache-misses", "L1d-misses", "dTLB-misses"
+};
+
+#ifdef __linux__
+// type and config of each counter
+static const struct {
+  unsigned int type;
+  unsigned long long config;
+} PC_EVENTS[PC_NCOUNTER] = {
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+  { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+  { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+};
+#endif
+
+int pc_open(PerfCount *pc)
+{
+  int i, n;
+#ifdef __linux__
+  struct perf_event_attr attr;
+#endif
+
+  n = 0;
+  for (i = 0; i < PC_NCOUNTER; i++) {
+    pc->fd[i] = -1;
+    pc->total[i] = -1;
+#ifdef __linux__
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PC_EVENTS[i].type;
+    attr.config = PC_EVENTS[i].config;
+    attr.disabled = 1;
+    attr.inherit = 1;        // count the sweep threads too
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    pc->fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (pc->fd[i] >= 0) {
+      pc->total[i] = 0;
+      n++;
+    }
+#endif
+  }
+  return n;
+}
+
+void pc_start(PerfCount *pc)
+{
+#ifdef __linux__
+  int i;
+
+  for (i = 0; i < PC_NCOUNTER; i++)
+    if (pc->fd[i] >= 0) {
+      ioctl(pc->fd[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(pc->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+void pc_stop(PerfCount *pc)
+{
+#ifdef __linux__
+  long long count;
+  int i;
+
+  for (i = 0; i < PC_NCOUNTER; i++)
+    if (pc->fd[i] >= 0) {
+      ioctl(pc->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+      if (read(pc->fd[i], &count, sizeof(count)) == sizeof(count))
+        pc->total[i] += count;
+    }
+#endif
+}
+
+void pc_sprint(char *buf, PerfCount *pc)
+{
+  int i;
+
+  buf[0] = '\0';
+  for (i = 0; i < PC_NCOUNTER; i++) {
+    if (pc->total[i] < 0)
+      buf += sprintf(buf, "%s%s=n/a", i ? " " : "", PC_NAMES[i]);
+    else
+      buf += sprintf(buf, "%s%s=%lld", i ? " " : "", PC_NAMES[i],
+                     pc->total[i]);
+  }
+}
+
+void pc_close(PerfCount *pc)
+{
+  int i;
+
+  for (i = 0; i < PC_NCOUNTER; i++)
+    if (pc->fd[i] >= 0) {
+      close(pc->fd[i]);
+      pc->fd[i] = -1;
+    }
+}
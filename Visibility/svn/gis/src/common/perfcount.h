@@ -0,0 +1,53 @@
+
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+#ifndef _perfcount_h_DEFINED
+#define _perfcount_h_DEFINED
+
+// hardware event counts over stretches of a run, from perf_event_open(2),
+//   for comparing how the sweeps use the caches; counters the system will
+//   not give us (not Linux, no PMU, perf_event_paranoid too high) stay at -1
+
+// the events counted
+enum {
+  PC_CACHE_MISSES,   // last level cache misses
+  PC_L1D_MISSES,     // level 1 data cache read misses
+  PC_DTLB_MISSES,    // data TLB read misses
+  PC_NCOUNTER
+};
+
+typedef struct perfcount_t {
+  int fd[PC_NCOUNTER];
+  long long total[PC_NCOUNTER];   // summed over every pc_start()/pc_stop()
+} PerfCount;
+
+// open the counters, for this thread and the threads it starts later;
+//   returns how many could be opened
+int pc_open(PerfCount *pc);
+
+// count from here
+void pc_start(PerfCount *pc);
+
+// stop counting, and add the counts since pc_start() to the totals
+void pc_stop(PerfCount *pc);
+
+// print the totals into buf, one "name=count" per event
+void pc_sprint(char *buf, PerfCount *pc);
+
+// close the counters
+void pc_close(PerfCount *pc);
+
+#endif
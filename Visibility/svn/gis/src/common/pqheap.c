@@ -124,9 +124,10 @@ PQueue* PQ_initialize() {
 /* delete the pqueue and free its space */
 void PQ_delete(PQueue* pq) { 
 
-  printf("PQ-delete: deleting heap\n"); fflush(stdout);
+  PQ_DEBUG { printf("PQ-delete: deleting heap\n"); fflush(stdout); }
   assert(pq && pq->elements); 
   if (pq->elements) free(pq->elements);
+  free(pq);
 }
  
 
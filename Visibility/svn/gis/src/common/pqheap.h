@@ -2,14 +2,19 @@
 #define _PQHEAP_H
 
 
+/* the definition of a pqueue element; a program that queues something
+   else names a header defining these four in PQ_ELEM_HEADER */
+#ifdef PQ_ELEM_HEADER
+#include PQ_ELEM_HEADER
+#else
 #include "visevent.h"
 
-/* the definition of a pqueue element */
 typedef SweepEvent elemType;
 #define compare_element compare_SweepEvent
 #define getPriority(e) ((e).tangle)
 #define printElem(e)   (printf("[%.3f, %.3f, %d, (%d,%d)] ", (e).angle, \
                         (e).dist, (e).type, (e).p.r, (e).p.c))
+#endif
 
 
 
@@ -56,7 +56,9 @@
 
 
 
-TreeNode *NIL;
+/* each thread has its own sentinel, shared by all of its trees, so
+   trees can be used in several threads at once */
+static __thread TreeNode *NIL;
 
 #define EPSILON  0.000000000000000000001
 /* note: defining epsilon=0 fails */
@@ -110,6 +112,7 @@ void destroy_sub_tree(TreeNode * node)
 void delete_tree(RBTree * t)
 {
     destroy_sub_tree(t->root);
+    free(t);
     return;
 }
 
@@ -139,6 +142,8 @@ double find_max_gradient_within_key(RBTree * rbt, double key)
    //Private below this line */
 void init_nil_node()
 {
+    if (NIL)
+	return;
     NIL = (TreeNode *) malloc(sizeof(TreeNode));
     NIL->color = RB_BLACK;
     NIL->value.gradient = SMALLEST_GRADIENT;
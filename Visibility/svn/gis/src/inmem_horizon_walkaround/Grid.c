@@ -7,7 +7,7 @@
 
 //CONSTURCT AND DISTROY --------------------------------------------------------
 //Create and recturn a new grid, with the data array alloctade but not filled
-Grid* Grid_new(unsigned short num_c, unsigned short num_r, short no_data_value) {
+Grid* Grid_new(unsigned short num_c, unsigned short num_r, short no_data_value, GridLayout layout) {
   //create the new grid
   Grid* newGrid = (Grid*) malloc(sizeof(Grid));
   assert(newGrid);
@@ -16,21 +16,22 @@ Grid* Grid_new(unsigned short num_c, unsigned short num_r, short no_data_value)
   newGrid -> ncols = num_c;
   newGrid->nrows = num_r;
   newGrid->NODATA = no_data_value;
+  newGrid->layout = layout;
+  newGrid->nblockcols = (num_c + GRID_BLOCK - 1) >> GRID_BLOCK_BITS;
 
-  //allocate the array
-  newGrid->data = (Point**) malloc(sizeof(Point*) * num_c);
-  assert(newGrid->data);
-  int i;
-  for(i = 0; i < num_c; i++) {
-    newGrid->data[i] = (Point*) malloc(sizeof(Point)* num_r);
-    assert(newGrid->data[i]);
+  //allocate the array; the blocks on the right and bottom edges are padded out to full size
+  size_t n = (size_t) num_c * num_r;
+  if(layout == GRID_BLOCKED) {
+    n = (size_t) newGrid->nblockcols * ((num_r + GRID_BLOCK - 1) >> GRID_BLOCK_BITS) << (2 * GRID_BLOCK_BITS);
   }
+  newGrid->data = (Point*) malloc(sizeof(Point) * n);
+  assert(newGrid->data);
 
   return newGrid;
 }
 
 //create a grid from the file at the passed path
-Grid* Grid_createFromFile(char* grid_path) {
+Grid* Grid_createFromFile(char* grid_path, GridLayout layout) {
   assert(grid_path);
 
   //open the file
@@ -43,7 +44,7 @@ Grid* Grid_createFromFile(char* grid_path) {
 
   //make the grid
   Grid* newGrid = Grid_new((unsigned short)header[0], (unsigned short)header[1],
-			   (short) header[5]);
+			   (short) header[5], layout);
   
   //start reading in values
   unsigned short c, r;
@@ -66,13 +67,7 @@ Grid* Grid_createFromFile(char* grid_path) {
 void Grid_kill(Grid* grid) {
   assert(grid);
   
-  //free each row of the array
-  int i;
-  for(i = 0; i < Grid_getNCols(*grid); i++) {
-    free(grid->data[i]);
-  }
-
-  //free the arary now
+  //free the arary
   free(grid->data);
 
   //free the grid
@@ -90,7 +85,11 @@ Point* Grid_getPoint(Grid* grid, int i, int j) {
   assert(i >= 0);
   assert(j >= 0);
 
-  return &(grid->data[i][j]);
+  if(grid->layout == GRID_BLOCKED) {
+    return &(grid->data[(((size_t) (j >> GRID_BLOCK_BITS) * grid->nblockcols + (i >> GRID_BLOCK_BITS)) << (2 * GRID_BLOCK_BITS))
+			+ ((j & (GRID_BLOCK - 1)) << GRID_BLOCK_BITS) + (i & (GRID_BLOCK - 1))]);
+  }
+  return &(grid->data[(size_t) i * grid->nrows + j]);
 }
 
 //SETTERS ----------------------------------------------------------------------
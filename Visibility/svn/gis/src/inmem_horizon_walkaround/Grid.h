@@ -13,20 +13,30 @@
 
 #include "Points.h"
 
+// The order the points are kept in
+typedef enum {
+  GRID_COLUMNS, //column after column, (c,r) at c*nrows + r
+  GRID_BLOCKED  //GRID_BLOCK x GRID_BLOCK blocks, so a walk around the viewpoint stays in a few blocks for a while
+} GridLayout;
+#define GRID_BLOCK_BITS 6
+#define GRID_BLOCK (1 << GRID_BLOCK_BITS)
+
 // The sturcture that holds the grid, not only the input elevation grid, but since the points store visibility data, also stores the output visibility grid
 typedef struct grid_t {
   unsigned short ncols; //number of columns
   unsigned short nrows; //number of rows
   short NODATA; //the NODATA value
-  Point** data; //holds all the points in a 2D array
+  GridLayout layout; //the order of the points in data
+  unsigned short nblockcols; //number of blocks across, for GRID_BLOCKED
+  Point* data; //holds all the points in one array, see Grid_getPoint
 } Grid;
 
 //CONSTURCT AND DISTROY --------------------------------------------------------
 //Create and recturn a new grid, with the data array alloctade but not filled
-Grid* Grid_new(unsigned short num_c, unsigned short num_r, short no_data_value);
+Grid* Grid_new(unsigned short num_c, unsigned short num_r, short no_data_value, GridLayout layout);
 
-//create a grid from the file at the passed path
-Grid* Grid_createFromFile(char* grid_path);
+//create a grid from the file at the passed path, with its points kept in layout
+Grid* Grid_createFromFile(char* grid_path, GridLayout layout);
 
 //free the grid
 void Grid_kill(Grid* grid);
@@ -6,11 +6,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <string.h>
 
 #include "Grid.h"
 #include "Visibility.h"
 #include "Points.h"
 #include "rtimer.h"
+#include "perfcount.h"
 
 #define PRINT_PERCENTAGE if(1)
 
@@ -19,9 +21,9 @@ void writeOutputGrid(char* inputPath, char* outputPath, long** outputGrid, int n
 
 int main(int argc, char** argv) {
   //make sure input is valid
-  if(argc != 3) {
+  if(argc != 3 && (argc != 4 || strcmp(argv[3], "blocked") != 0)) {
     printf("Usage incorrect.\nOnly perfect spellers may\nrun algorithm\n\n-- originally by Jason Axley, modified by Will Richard\n");
-    printf("Usage: multVis <input file path> <output file path>\n");
+    printf("Usage: multVis <input file path> <output file path> [blocked]\n");
     exit(0);
   }
 
@@ -29,10 +31,10 @@ int main(int argc, char** argv) {
   rt_zero(total_time);
   rt_start(total_time);
 
-  //argv[1] is input path, argv[2] is output path
+  //argv[1] is input path, argv[2] is output path, and a 3rd argument of blocked keeps the grid in blocks
 
   //create the grid from the input file.
-  Grid* grid = Grid_createFromFile(argv[1]);
+  Grid* grid = Grid_createFromFile(argv[1], argc == 4 ? GRID_BLOCKED : GRID_COLUMNS);
 
   //make the short double array that will hold the output data
   long** outputGrid = (long**) malloc(sizeof(long*) * Grid_getNCols(*grid));
@@ -51,6 +53,8 @@ int main(int argc, char** argv) {
   
   Rtimer vis_time;//the time spent in the visibility algorithm
   rt_zero(vis_time);
+  PerfCount pc;//the cache misses in the visibility algorithm
+  pc_open(&pc);
 
   for(vc = 0; vc < Grid_getNCols(*grid); vc++) {
     for(vr = 0; vr < Grid_getNRows(*grid); vr++) {
@@ -77,9 +81,11 @@ int main(int argc, char** argv) {
 
       //do the visibility algorithm
       rt_start(vis_time);
+      pc_start(&pc);
       
       numVis = visibility(grid, *vp);
 
+      pc_stop(&pc);
       rt_stop_and_accumulate(vis_time);
 
       //write the number of visible points to the output grid
@@ -108,6 +114,9 @@ int main(int argc, char** argv) {
   char buf[1000];
   rt_sprint_total(buf, vis_time);
   printf("visibility time: %s\n", buf);
+  pc_sprint(buf, &pc);
+  printf("visibility cache: %s\n", buf);
+  pc_close(&pc);
   rt_sprint(buf, total_time);
   printf("total time: %s\n", buf);
 
@@ -7,27 +7,30 @@
 #include <stdio.h>
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 #include "Grid.h"
 #include "Visibility.h"
 #include "Points.h"
 #include "rtimer.h"
+#include "perfcount.h"
 
 int main(int argc, char** argv) {
   //make sure thi input is valid
-  if(argc != 5) {
+  if(argc != 5 && (argc != 6 || strcmp(argv[5], "blocked") != 0)) {
     printf("Usage incorrect.\nOnly perfect spellers may\nrun algorithm\n\n-- originally by Jason Axley, modified by Will Richard\n");
-    printf("Correct Usage: oneVis <input file path> <output file path> <viewpoint column> <viewpoint row>\n");
+    printf("Correct Usage: oneVis <input file path> <output file path> <viewpoint column> <viewpoint row> [blocked]\n");
     exit(0);
   }
 
   Rtimer total_time, vis_time;
   rt_start(total_time);
 
-  //argv[1] is input path, argv[2] is output path, argv[3] is viewpoint column, argv[4] is viewpoint row
+  //argv[1] is input path, argv[2] is output path, argv[3] is viewpoint column, argv[4] is viewpoint row,
+  //and a 5th argument of blocked keeps the grid in blocks
   
   //create the grid from the input file.  Note, this only fills in the elevation values.
-  Grid* grid = Grid_createFromFile(argv[1]);
+  Grid* grid = Grid_createFromFile(argv[1], argc == 6 ? GRID_BLOCKED : GRID_COLUMNS);
 
   //store the viewpoint row and column
   int vp_col = atoi(argv[3]);
@@ -50,12 +53,17 @@ int main(int argc, char** argv) {
     exit(0);
   }
 
+  //count the cache misses of the walk too
+  PerfCount pc;
+  pc_open(&pc);
+  pc_start(&pc);
   rt_start(vis_time);
 
   //start the visibilty algorithm.  We don't really care about the output horizon.
   unsigned int numVis = visibility(grid, *vp);
 
   rt_stop(vis_time);
+  pc_stop(&pc);
 
   //all visibility values should now be set, so output the file
   //just a reminder - argv[2] is the output path and argv[1] is input path
@@ -73,6 +81,9 @@ int main(int argc, char** argv) {
   char buf[1000];
   rt_sprint(buf, vis_time);
   printf("visibility time: %s\n", buf);
+  pc_sprint(buf, &pc);
+  printf("visibility cache: %s\n", buf);
+  pc_close(&pc);
   rt_sprint(buf, total_time);
   printf("total time: %s\n", buf);
 
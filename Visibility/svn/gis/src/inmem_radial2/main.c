@@ -16,6 +16,8 @@
 #include <errno.h>
 #include <getopt.h>
 #include <stdio.h>
+#include <string.h>
+#include "perfcount.h"
 #include "rtimer.h"
 #include "datagrid.h"
 #include "radial2.h"
@@ -32,6 +34,8 @@ int main(int argc, char * const argv[])
     "                          same as no option argument.\n"
     "  -r, --row        for single point viewshed, the row index.\n"
     "  -c, --col        for single point viewshed, the column index.\n"
+    "  -l, --layout     order to keep the terrain in memory, rowmajor (the\n"
+    "                      default) or blocked (64x64 blocks).\n"
     "\n"
     "   All option arguments must be >=0, except nthread must be >0\n";
 
@@ -39,21 +43,25 @@ int main(int argc, char * const argv[])
     {"points",  2, NULL, 'p'},
     {"row",     1, NULL, 'r'},
     {"col",     1, NULL, 'c'},
+    {"layout",  1, NULL, 'l'},
     /* sentinel */
     {0, 0, 0, 0}
   };
 
   DataSet *terrain, *vmap;
   int nthread, npoint, result;
+  enum GridLayout layout;
+  PerfCount pc;
   GridPoint p;
-  char c;
+  char c, buf[256];
 
   /* Rarse options */
   p.r = p.c = 0;
   npoint = 0;
   nthread = 1;
+  layout = ROWMAJOR;
   opterr = 1; /* ensure that bad options return error codes */
-  while ((c = getopt_long(argc, argv, "t:p::r:c:", options, NULL)) >= 0) {
+  while ((c = getopt_long(argc, argv, "t:p::r:c:l:", options, NULL)) >= 0) {
     switch (c) {
       case 'p':
         /* options supplied number of points */
@@ -70,6 +78,18 @@ int main(int argc, char * const argv[])
         /* options supplied point column index */
         p.c = strtol(optarg, NULL, 10);
         break;
+      case 'l':
+        /* options supplied terrain layout */
+        if (strcmp(optarg, "rowmajor") == 0)
+          layout = ROWMAJOR;
+        else if (strcmp(optarg, "blocked") == 0)
+          layout = BLOCKED;
+        else {
+          fprintf(stderr, "Unknown layout (%s)\n", optarg);
+          fprintf(stderr, "%s\n", USAGE);
+          return -1;
+        }
+        break;
       case '?':
         /* bad option */
         fprintf(stderr, "%s\n", USAGE);
@@ -98,18 +118,26 @@ int main(int argc, char * const argv[])
   terrain = dLoad(argv[optind++], FLOAT); 
   if (!terrain)
     return 1;
+  if (dSetLayout(terrain, layout) != 0)
+    return 1;
   if (npoint == 1 && (p.r > terrain->grid.hd.nrow ||
                       p.c > terrain->grid.hd.ncol)) {
     fprintf(stderr, "Specified point is not in grid (%i, %i)\n", p.r, p.c);
     return -1;
   }
 
-  /* Compute requested viewsheds */
+  /* Compute requested viewsheds, counting the cache misses */
+  pc_open(&pc);
+  pc_start(&pc);
   if (npoint == 1)
     vmap = radial2_viewshed(terrain, p);
   else
     vmap = radial2_viewshed_terrain(terrain);
   assert(vmap);
+  pc_stop(&pc);
+  pc_sprint(buf, &pc);
+  printf("viewshed cache:\t%s\n", buf);
+  pc_close(&pc);
 
   /* Store viewshed and exit */
   result = dStore(vmap, argv[optind]);
@@ -3,80 +3,62 @@
 #include <stdio.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 
 
 #include "event.h"
 #include "grid.h" 
+#include "event_quicksort.h"
 
 
-/* comparison function.  Compares two events based on their angle. */
-int compare_events_angle(const void* a, const void* b) {
-  assert(a && b);
-  Event* e1 = (Event*) a;
-  Event* e2 = (Event*) b;
-  if(e1->angle < e2->angle) {
-    return -1;
-  }
-  if(e1->angle > e2->angle) {
-     return 1;
+/* ------------------------------------------------------------ */
+/* allocates an empty list with room for size events of a nrows x
+   ncols grid; returns NULL if there is not enough memory */
+EventList* create_event_list(long size, int nrows, int ncols) {
+
+  EventList* list = (EventList*) malloc(sizeof(EventList)); 
+  if (!list) return NULL; 
+  list->n = 0; 
+  list->size = size; 
+  list->nrows = nrows; 
+  list->ncols = ncols; 
+  list->corner = NULL; 
+  list->cell = (uint32_t*) malloc((size ? size : 1) * sizeof(uint32_t)); 
+  list->key = (uint64_t*) malloc((size ? size : 1) * sizeof(uint64_t)); 
+  if (!list->cell || !list->key) {
+    destroy_event_list(list); 
+    return NULL; 
   }
-  
-  /* they are equal */  
-  /* then order by distance */
-  if (e1->dist < e2->dist) return -1; 
-  if (e1->dist > e2->dist) return 1; 
-
-  /* equal angle and equal distance from vp. Either they are events of
-     the viewpoint cell, or they represent the same point shared by 2
-     cells, one is EXIT evelt, one is ENTER.  */
-  
-  assert(
-	 (e1->dist ==0 && e2->dist==0) ||
-	 (e1->eventType == ENTERING_EVENT && e2->eventType==EXITING_EVENT) ||
-	 (e1->eventType == EXITING_EVENT && e2->eventType==ENTERING_EVENT)
-	 );
-
-  /*  in this case the order should be: EXIT, ENTER, QUERY. Basically
-     we want EXITS to be processed before ENTERS. Because EXIT deletes
-     an event with that distance from the tree, assuming that there is
-     no other node with the same distance (it could check, but it
-     would need to store i and j for teh cell). If the ENTER event
-     with the same distance is in the tree, then it may delete that
-     one.  This may cause subtle bugs and differences in
-     visibility. */
-  if (e1->eventType == EXITING_EVENT && e2->eventType == ENTERING_EVENT)
-    //then e1 comes first.
-    return -1; 
-
-  if (e2->eventType == EXITING_EVENT && e1->eventType == ENTERING_EVENT)
-    //then e1 comes second
-    return 1; 
-
-  //this should only happen when both events correspond to the
-  //viewpoint cell; this cell will be ignored, so order of its events
-  //does not matter.
-  return 0;
+  return list; 
 }
 
-/*comparison function.  Compares two events based on their distance for the viewpoint */
-int compare_events_dist(const void* a, const void* b) {
-  assert(a && b);
-  Event* e1 = (Event*) a;
-  Event* e2 = (Event*) b;
 
-  if(e1->dist < e2->dist) {
-    return -1;
-  }
-  if(e1->dist > e2->dist) {
-    return 1;
-  }
+void destroy_event_list(EventList* list) {
 
-  /* they are equal */
-  return 0;
+  assert(list); 
+  free(list->cell); 
+  free(list->key); 
+  free(list->corner); 
+  free(list); 
+}
 
+
+/* unpacks event i of the list into e, looking its elevation up in g */
+void get_event(EventList* list, long i, Grid* g, Event* e) {
+
+  assert(list && g && e && i >= 0 && i < list->n); 
+  uint32_t c = list->cell[i]; 
+  e->row = event_index(c) / list->ncols; 
+  e->col = event_index(c) % list->ncols; 
+  e->elev = get(g, e->row, e->col); 
+  e->angle = key_angle(list->key[i]); 
+  e->dist = key_dist(list->key[i]); 
+  e->eventType = event_type(c); 
 }
 
 
+
+
 /* ------------------------------------------------------------ 
    compute the gradient of the CENTER of this event wrt viewpoint. For
    efficiency it does not compute the gradient, but the square of the
@@ -377,97 +359,326 @@ double calculate_dist(double eventX, double eventY, double viewpointX, double vi
 
 
 
+/*adds the 3 events of point (row, col), one of each type, at
+  list->cell[nevents]; returns the new number of events */
+static inline long add_point_events(EventList* list, long nevents,
+				    int row, int col) {
+  uint32_t index = (uint32_t)row * list->ncols + col;
+
+  list->cell[nevents++] = event_cell(index, ENTERING_EVENT);
+  list->cell[nevents++] = event_cell(index, CENTER_EVENT);
+  list->cell[nevents++] = event_cell(index, EXITING_EVENT);
+  return nevents;
+}
+
+
 /* This function is called once, before knowing the actual
-  viewpoint. Fills the eventList with all the necessary events. Each
-  event is filled with row, column, elevation and type.  Angle will be
-  filled later for each viewpoint. The eventlist is allocated (outside
-  this function) to hold the maximum number of events possible.
-  Returns the number of events.*/
-long init_event_list (Event* eventList, Grid* g) {
+  viewpoint. Fills the list with all the necessary events. Each event
+  is filled with its cell and type.  The keys will be filled later for
+  each viewpoint. The list is allocated (outside this function) to
+  hold the maximum number of events possible.  Returns the number of
+  events.*/
+long init_event_list (EventList* list, Grid* g) {
   
-  assert(eventList && g);
+  assert(list && g && list->nrows == g->hd->nrows && list->ncols == g->hd->ncols);
   
   printf("Initializing events.\n"); 
   int nrows, ncols, row, col;
   nrows = g->hd->nrows;
   ncols = g->hd->ncols;
 
-  int nevents = 0;
-  Event e;
-  e.angle = e.dist = e.elev = -1; 
-
-  for(row = 0; row < nrows; row++) {
-    for(col = 0; col < ncols; col++) {
-    
-      /* if point is nodata, continue */
-      if (is_nodata_at(g, (dimensionType)row, (dimensionType)col)) continue; 
-      
-      e.row = row;
-      e.col = col;
-      e.elev = get(g, row, col); 
-
-      /*add 3 events to the event list, one of each type */
-      e.eventType = ENTERING_EVENT;
-      eventList[nevents] = e;
-      nevents++;
-
-      e.eventType = CENTER_EVENT;
-      eventList[nevents] = e;
-      nevents++;
-
-      e.eventType = EXITING_EVENT;
-      eventList[nevents] = e;
-      nevents++;
+  /* the cell indices get 30 bits, and twice the squared distances
+     32 */
+  if ((double)nrows * ncols > (double)(1 << 30) ||
+      2 * ((double)nrows * nrows + (double)ncols * ncols) > 4294967295.0) {
+    printf("grid too big for the event list\n"); 
+    exit(1); 
+  }
+
+  long nevents = 0;
+  GridValid *valid = g->valid;
+  uint64_t c, end;
+
+  if (valid) {
+    /*only the rows with data, and only their runs of data, so the
+      NODATA around and between them is never looked at */
+    for (row = valid->r0; row < (int)valid->r1; row++) {
+      for (c = gio_valid_run(valid, row, 0, &end); c < (uint64_t)ncols;
+	   c = gio_valid_run(valid, row, end, &end)) {
+	for (col = c; col < (int)end; col++)
+	  nevents = add_point_events(list, nevents, row, col);
+      }
+    }
+  } else {
+    for(row = 0; row < nrows; row++) {
+      for(col = 0; col < ncols; col++) {
+	/* if point is nodata, continue */
+	if (is_nodata_at(g, row, col)) continue; 
+	nevents = add_point_events(list, nevents, row, col);
+      }
     }
   }
   
   printf("Done initializing events.\n");
+  list->n = nevents;
   return nevents;  
 }
 
 
 
 
-/*sets each event in the event list with the correct angle from the
-  viewpoint.  It also fills data with the values for the row of the
-  viewpoint, to be used to fill the status structure later */
-void set_event_list_angles_and_dist (int nevents, Event* eventList, Viewpoint* vp){
-
-  assert(eventList && vp);
+/* the corner of the ENTER and EXIT event of a cell, as
+  calculate_event_position() picks it: corner_of[sr][sc][t] is 2*dy+dx
+  for the corner (row+dy-1/2, col+dx-1/2), where sr and sc are the sign
+  of row-vp.row and col-vp.col, plus 1, and t is 0 for EXIT and 1 for
+  ENTER */
+static const unsigned char corner_of[3][3][2] = {
+  {{2, 1}, {2, 3}, {0, 3}}, 
+  {{3, 1}, {0, 0}, {0, 2}}, 
+  {{3, 0}, {1, 0}, {1, 2}}
+}; 
+
+#define sign_index(d) (((d) > 0) - ((d) < 0) + 1)
+
+/* lists shorter than this are not worth starting threads for */
+#define KEY_MIN_PARALLEL (1 << 16)
+
+
+/* the state shared by the threads of set_event_list_angles_and_dist() */
+typedef struct key_job_ {
+  EventList* list; 
+  Viewpoint* vp; 
+  int nthreads; 
+  pthread_barrier_t barrier; 
+  pthread_mutex_t lock;  /* the threads wait for go, so that nthreads */
+  pthread_cond_t start;  /* is the number that did start */
+  int go; 
+} KeyJob; 
+
+/* one thread of set_event_list_angles_and_dist(); thread t keys the
+  corner rows [(nrows+1)*t/nthreads, (nrows+1)*(t+1)/nthreads), then
+  the same share of the events */
+typedef struct key_thread_ {
+  KeyJob* job; 
+  int t; 
+  pthread_t thread; 
+} KeyThread; 
+
+
+static void* set_keys_slice(void* arg) {
+
+  KeyThread* kt = (KeyThread*) arg; 
+  KeyJob* job = kt->job; 
+  EventList* list = job->list; 
+  Viewpoint* vp = job->vp; 
+  int ncols = list->ncols, crow, ccol, row, col, k, nthreads; 
+  long cwidth = ncols + 1, i, lo, hi; 
+  double x, y; 
+  uint64_t* corner; 
+  uint32_t c, index, vp_index = (uint32_t)vp->row * ncols + vp->col;
+
+  if (kt->t > 0) {
+    pthread_mutex_lock(&job->lock); 
+    while (!job->go) 
+      pthread_cond_wait(&job->start, &job->lock); 
+    pthread_mutex_unlock(&job->lock); 
+  }
+  nthreads = job->nthreads; 
+
+  /* the corners, a row at a time; corner (crow, ccol) is at
+     (crow-1/2, ccol-1/2) */
+  lo = (long)(list->nrows + 1) * kt->t / nthreads; 
+  hi = (long)(list->nrows + 1) * (kt->t + 1) / nthreads; 
+  for (crow = lo; crow < hi; crow++) {
+    corner = list->corner + crow * cwidth; 
+    y = crow - 0.5; 
+    for (ccol = 0; ccol <= ncols; ccol++) {
+      x = ccol - 0.5; 
+      corner[ccol] = event_key(calculate_angle(x, y, vp->col, vp->row),
+			       calculate_dist(x, y, vp->col, vp->row));
+    }
+  }
+  if (nthreads > 1)
+    pthread_barrier_wait(&job->barrier); 
+
+  /*the events copy the keys of their corners; only the centers are
+    keyed here */
+  lo = list->n * kt->t / nthreads; 
+  hi = list->n * (kt->t + 1) / nthreads; 
+  for (i = lo; i < hi; i++) {
+    c = list->cell[i];
+    index = event_index(c); 
+    /* skip the viewpoint */
+    if (index == vp_index) {
+      list->key[i] = 0; 
+      continue;
+    }
+    row = index / ncols; 
+    col = index % ncols; 
+    if (event_type(c) == CENTER_EVENT) {
+      list->key[i] = event_key(calculate_angle(col, row, vp->col, vp->row),
+			       calculate_dist(col, row, vp->col, vp->row));
+      continue; 
+    }
+    k = corner_of[sign_index(row - vp->row)][sign_index(col - vp->col)]
+      [event_type(c) == ENTERING_EVENT]; 
+    list->key[i] = list->corner[(row + (k >> 1)) * cwidth + col + (k & 1)]; 
+  }
+  return NULL; 
+}
 
-  /*temporary storage of the event's position */
-  double ax, ay;
 
-  /*go through each event */
-  int i;
-  for(i = 0; i < nevents; i++) {
+/*sets the key of each event in the list from its angle and distance
+  from the viewpoint, in nthreads threads */
+void set_event_list_angles_and_dist (EventList* list, Viewpoint* vp, 
+				     int nthreads) {
 
-    /* an event cannot be nodata */
-    //assert(!is_nodata(eventList[i].elev)); is_nodata needs the grid,
-    //which is not passed to this function. if you really want this
-    //assert here yuo need to change the function to taje the grid as
-    //parameter */
+  assert(list && vp && list->nrows > 0 && list->ncols > 0);
+  KeyThread* threads; 
+  KeyJob job; 
+  int t, started; 
 
-    /* skip the viewpoint */
-    if(eventList[i].row == vp->row && eventList[i].col == vp->col) {
-      eventList[i].dist = 0; 
-      eventList[i].angle = 0; 
-      continue;
+  if (!list->corner) {
+    list->corner = (uint64_t*) malloc((long)(list->nrows + 1) * 
+				      (list->ncols + 1) * sizeof(uint64_t)); 
+    if (!list->corner) {
+      printf("set_event_list_angles_and_dist: not enough memory\n"); 
+      exit(1); 
     }
-    
-    /*calculate the position, and then the angle*/
-    calculate_event_position(eventList[i], vp->row, vp->col, &ay, &ax);
-    eventList[i].angle = calculate_angle(ax, ay, vp->col, vp->row);
-    eventList[i].dist = calculate_dist(ax, ay, vp->col, vp->row);
+  }
+  if (nthreads < 1 || list->n < KEY_MIN_PARALLEL) 
+    nthreads = 1; 
+  if (nthreads > list->nrows + 1) 
+    nthreads = list->nrows + 1; 
+
+  threads = (KeyThread*) malloc(nthreads * sizeof(KeyThread)); 
+  if (!threads) {
+    printf("set_event_list_angles_and_dist: not enough memory\n"); 
+    exit(1); 
+  }
+  job.list = list; 
+  job.vp = vp; 
+  job.go = 0; 
+  pthread_mutex_init(&job.lock, NULL); 
+  pthread_cond_init(&job.start, NULL); 
+  for (t = 0; t < nthreads; t++) {
+    threads[t].job = &job; 
+    threads[t].t = t; 
+  }
+  /* the calling thread keys the first slice; if a thread cannot be
+     started, the ones that did split the list between them */
+  for (started = 1; started < nthreads; started++) {
+    if (pthread_create(&threads[started].thread, NULL, set_keys_slice, 
+		       &threads[started]) != 0) 
+      break; 
+  }
+  job.nthreads = started; 
+  if (started > 1 && pthread_barrier_init(&job.barrier, NULL, started) != 0) {
+    printf("set_event_list_angles_and_dist: could not start its threads\n"); 
+    exit(1); 
+  }
+  pthread_mutex_lock(&job.lock); 
+  job.go = 1; 
+  pthread_cond_broadcast(&job.start); 
+  pthread_mutex_unlock(&job.lock); 
+
+  set_keys_slice(&threads[0]); 
+  for (t = 1; t < started; t++) {
+    if (pthread_join(threads[t].thread, NULL) != 0) {
+      printf("set_event_list_angles_and_dist: could not join its threads\n"); 
+      exit(1); 
+    }
+  }
+  if (started > 1) 
+    pthread_barrier_destroy(&job.barrier); 
+  pthread_mutex_destroy(&job.lock); 
+  pthread_cond_destroy(&job.start); 
+  free(threads); 
+}
+
 
-    // print_event(eventList[i]); printf("ax=%f, ay=%f",ax, ay); printf("\n");
+/* The offsets run from -(nrows-1) to nrows-1 and -(ncols-1) to
+  ncols-1.  Their events are sorted as if seen from a viewpoint at
+  (0,0), or rather as the events of a (2*nrows-1)x(2*ncols-1) grid seen
+  from its middle: the angle and distance of an event only depend on
+  its offset, and the order is total except for the viewpoint cell's
+  own events, which the sweep skips.  So for any viewpoint, the events
+  of the offsets that land in the grid come out in the same order as
+  sorting them would give. */
+long init_event_offsets(EventOffset** offsets, int nrows, int ncols) {
+
+  assert(offsets && nrows > 0 && ncols > 0);
+  printf("Initializing event offsets.\n"); 
+
+  int orows = 2 * nrows - 1, ocols = 2 * ncols - 1; 
+  long noffsets = 3L * orows * ocols; 
+  if ((double)orows * ocols > (double)(1 << 30)) {
+    printf("grid too big for the event offsets\n"); 
+    exit(1); 
+  }
+  EventList* events = create_event_list(noffsets, orows, ocols); 
+  if (!events) {
+    printf("not enough memory for the event offsets\n"); 
+    exit(1); 
   }
 
-  return;
-  
+  long n = 0; 
+  int row, col; 
+  for (row = 0; row < orows; row++) 
+    for (col = 0; col < ocols; col++) 
+      n = add_point_events(events, n, row, col); 
+  assert(n == noffsets); 
+  events->n = n; 
+
+  Viewpoint middle; 
+  middle.row = nrows - 1; 
+  middle.col = ncols - 1; 
+  middle.elev = 0; 
+  set_event_list_angles_and_dist(events, &middle, 1); 
+  event_quicksort_radial(events); 
+
+  *offsets = (EventOffset*) malloc(noffsets * sizeof(EventOffset)); 
+  assert(*offsets); 
+  uint32_t c; 
+  for (n = 0; n < noffsets; n++) {
+    c = events->cell[n]; 
+    (*offsets)[n].drow = event_index(c) / ocols - middle.row; 
+    (*offsets)[n].dcol = event_index(c) % ocols - middle.col; 
+    (*offsets)[n].eventType = event_type(c); 
+  }
+  destroy_event_list(events); 
+
+  printf("Done initializing event offsets.\n");
+  return noffsets; 
+}
+
+
+
+long filter_event_offsets(EventList* list, const EventOffset* offsets, 
+			  long noffsets, Grid* g, Viewpoint* vp) {
+
+  assert(list && offsets && g && vp && list->ncols == g->hd->ncols); 
+  unsigned int nrows = g->hd->nrows; 
+  unsigned int ncols = g->hd->ncols; 
+  unsigned int row, col; 
+  long i, nevents = 0; 
+
+  for (i = 0; i < noffsets; i++) {
+    /* unsigned, so points off either side of the grid fail one test */
+    row = vp->row + offsets[i].drow; 
+    col = vp->col + offsets[i].dcol; 
+    if (row >= nrows || col >= ncols || is_nodata_at(g, row, col)) 
+      continue; 
+    assert(nevents < list->size); 
+    list->cell[nevents++] = event_cell(row * ncols + col, 
+				       offsets[i].eventType); 
+  }
+  list->n = nevents; 
+  return nevents; 
 }
 
 
+
 void print_event( Event e) {
   printf("e=[row=%d, col =%d, elev=%lf, angle=%f, dist=%f, ", 
 	 e.row, e.col, e.elev, e.angle, e.dist); 
@@ -1,6 +1,9 @@
 #ifndef __EVENTLIST_H
 #define __EVENTLIST_H
 
+#include <stdint.h>
+#include <math.h>
+
 #include "grid.h"
 
 #define EXITING_EVENT -1
@@ -15,6 +18,7 @@ typedef struct viewpoint_ {
 } Viewpoint; 
 
 
+/* one event, unpacked from an EventList by get_event() */
 typedef struct event_ {
   int row, col;         /* location of the center of the cell */
   float elev;           /* elevation of the event*/
@@ -25,12 +29,72 @@ typedef struct event_ {
 
 } Event;
 
-/* Compares two events based on their angle wrt viewpoint. */
-int compare_events_angle(const void* a, const void* b);
-
 
-/* Compares two events based on their distance for the viewpoint */
-int compare_events_dist(const void* a, const void* b);
+/* The events of the sweeps, as a structure of arrays: 12 bytes an
+   event, where an Event takes 40.  The sweeps only stream over cell[];
+   the sorts move key[] and cell[] together.
+
+   cell[i] is the index row*ncols+col of the cell of event i, shifted
+   up 2 bits over the rank of its type (EXIT=0, CENTER=1, ENTER=2); the
+   elevation is looked up in the grid.
+
+   key[i] is set for each viewpoint by set_event_list_angles_and_dist():
+   the angle from the viewpoint in the high 32 bits, in units of
+   2pi/2^32, and twice the squared distance in the low 32 bits.  Cell
+   centers and corners sit on a half-cell lattice, so twice the squared
+   distance is a whole number and exact.  Radial order is by key, then
+   by type rank, so the EXIT event of a corner comes before the ENTER
+   event of the cell that shares it; distance order is by the low 32
+   bits of the key.
+
+   corner is scratch space for set_event_list_angles_and_dist(): the
+   keys of the (nrows+1)x(ncols+1) cell corners, allocated on first
+   use.  The ENTER and EXIT events of a cell sit on two of its corners,
+   and each corner is shared by 4 cells, so the corners are keyed once
+   and the events copy their keys. */
+typedef struct event_list_ {
+  long n;               /* number of events */
+  long size;            /* the arrays have room for this many */
+  int nrows, ncols;     /* size of the grid the cells index */
+  uint32_t* cell; 
+  uint64_t* key; 
+  uint64_t* corner; 
+} EventList;
+
+#define event_cell(index, type) (((uint32_t)(index) << 2) | (uint32_t)((type) + 1))
+#define event_index(c) ((c) >> 2)
+#define event_rank(c) ((c) & 3)
+#define event_type(c) ((int)event_rank(c) - 1)
+
+/* angle units per radian in the keys */
+#define EVENT_ANGLE_SCALE (4294967296.0 / (2 * M_PI))
+
+/* the key of an event at this angle and (squared) distance */
+static inline uint64_t event_key(double angle, double dist) {
+  double a = angle * EVENT_ANGLE_SCALE; 
+  /* angles just under 2pi round up to 2^32 */
+  uint64_t q = (a < 4294967295.0) ? (uint64_t) a : 0xFFFFFFFF; 
+  return (q << 32) | (uint64_t)(2 * dist); 
+}
+#define key_angle(key) ((double)((key) >> 32) / EVENT_ANGLE_SCALE)
+#define key_dist(key) ((double)((key) & 0xFFFFFFFF) / 2)
+
+/* an event of the cell (drow, dcol) away from the viewpoint; the angle
+   and distance of an event depend only on this offset */
+typedef struct event_offset_ {
+  int drow, dcol; 
+  char eventType; 
+} EventOffset; 
+
+
+/* allocates an empty list with room for size events of a nrows x
+   ncols grid; returns NULL if there is not enough memory */
+EventList* create_event_list(long size, int nrows, int ncols); 
+
+void destroy_event_list(EventList* list); 
+
+/* unpacks event i of the list into e, looking its elevation up in g */
+void get_event(EventList* list, long i, Grid* g, Event* e); 
 
 
 /* compute the gradient of the CENTER of this event wrt viewpoint. For
@@ -71,16 +135,29 @@ double calculate_dist(double eventX, double eventY, double viewpointX,
 		     double viewpointY);
 
 
-/* returns an eventList that has all the events in it, and all events
-   are filled with row, column, elevation and type.  Angle will be
-   filled later for each viewpoint. */
-long  init_event_list (Event* eventList, Grid* g);
+/* fills the list with the events of all points of g that are not
+   nodata, without keys; these are set later for each viewpoint.
+   Returns the number of events. */
+long  init_event_list (EventList* list, Grid* g);
+
+
+
+/*sets the key of each event in the list from its angle and distance
+  from the viewpoint, in nthreads threads */
+void set_event_list_angles_and_dist (EventList* list, Viewpoint* vp, 
+				     int nthreads);
 
+/* allocates and returns in *offsets the events of every offset a
+   viewpoint of a nrows x ncols grid can have, sorted as the events of
+   a radial sweep are.  Returns the number of offsets. */
+long init_event_offsets(EventOffset** offsets, int nrows, int ncols);
 
 
-/*sets each event in the event list with the correct angle from the viewpoint */
-void set_event_list_angles_and_dist (int nevents, Event* eventList, 
-				     Viewpoint* vp);
+/* fills the list with the events of the points of g that are not
+   nodata, in the order of the offsets from vp; the events are ready
+   for a radial sweep, without keys.  Returns the number of events. */
+long filter_event_offsets(EventList* list, const EventOffset* offsets, 
+			  long noffsets, Grid* g, Viewpoint* vp);
 
 void print_event( Event e);
 #endif
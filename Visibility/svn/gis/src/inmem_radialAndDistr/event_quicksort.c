@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 
 #include "event.h"
@@ -9,6 +10,13 @@
 static int MIN_LEN = 20; 
 
 
+/* swap events i and j of the key and cell arrays */
+#define swap_events(key, cell, i, j) do {		\
+    uint64_t tk = (key)[i]; (key)[i] = (key)[j]; (key)[j] = tk;	\
+    uint32_t tc = (cell)[i]; (cell)[i] = (cell)[j]; (cell)[j] = tc;	\
+  } while (0)
+
+
 
 /* ************************************************************ */
 /*      SORT BY RADIAL ANGLE
@@ -16,129 +24,95 @@ static int MIN_LEN = 20;
 /* ************************************************************ */
 
 
-/* comparison function.  Compares two events based on their angle. */
-int event_compare_radial(Event e1, Event e2) {
+/* Compares two events on their angle, then on their distance from the
+   viewpoint; both are in the key.  Equal angle and equal distance
+   means they are events of the viewpoint cell, or they represent the
+   same point shared by 2 cells, one is EXIT event, one is ENTER.  In
+   this case the order should be: EXIT, ENTER.  Basically we want EXITS
+   to be processed before ENTERS. Because EXIT deletes an event with
+   that distance from the tree, assuming that there is no other node
+   with the same distance (it could check, but it would need to store i
+   and j for teh cell). If the ENTER event with the same distance is in
+   the tree, then it may delete that one.  This may cause subtle bugs
+   and differences in visibility.  The events of the viewpoint cell
+   are ignored, so their order does not matter. */
+#define event_compare_radial(k1, c1, k2, c2) (		\
+  ((k1) != (k2)) ? compare_values((k1), (k2)) :		\
+  compare_values(event_rank(c1), event_rank(c2)))
 
 
-  if(e1.angle < e2.angle) {
-    return -1;
-  }
-  if(e1.angle > e2.angle) {
-     return 1;
-  }
-  
-  /* they are equal */  
-  /* then order by distance */
-  if (e1.dist < e2.dist) return -1; 
-  if (e1.dist > e2.dist) return 1; 
-
-  /* equal angle and equal distance from vp. Either they are events of
-     the viewpoint cell, or they represent the same point shared by 2
-     cells, one is EXIT evelt, one is ENTER.  */
-  
-  assert(
-	 (e1.dist ==0 && e2.dist==0) ||
-	 (e1.eventType == ENTERING_EVENT && e2.eventType==EXITING_EVENT) ||
-	 (e1.eventType == EXITING_EVENT && e2.eventType==ENTERING_EVENT)
-	 );
-
-  /*  in this case the order should be: EXIT, ENTER, QUERY. Basically
-     we want EXITS to be processed before ENTERS. Because EXIT deletes
-     an event with that distance from the tree, assuming that there is
-     no other node with the same distance (it could check, but it
-     would need to store i and j for teh cell). If the ENTER event
-     with the same distance is in the tree, then it may delete that
-     one.  This may cause subtle bugs and differences in
-     visibility. */
-  if (e1.eventType == EXITING_EVENT && e2.eventType == ENTERING_EVENT)
-    //then e1 comes first.
-    return -1; 
-
-  if (e2.eventType == EXITING_EVENT && e1.eventType == ENTERING_EVENT)
-    //then e1 comes second
-    return 1; 
-
-  //this should only happen when both events correspond to the
-  //viewpoint cell; this cell will be ignored, so order of its events
-  //does not matter.
-  return 0;
-}
-#define event_compare_radial(e1, e2) (\
-((e1).angle < (e2).angle) ? (-1) : ( \
-  ((e1).angle > (e2).angle) ? (1) : ( \
-  ((e1).dist < (e2).dist) ? (-1) : ( \
-  ((e1).dist > (e2).dist) ? (1) : ( \
-  (((e1).eventType ^ (e2).eventType) == -2) ? ((e1).eventType) : (0) )))))
 
 
+static size_t partition_radial(uint64_t* key, uint32_t* cell, size_t n) {
 
-
-size_t partition_radial(Event *data, size_t n) {
-
-  Event *ptpart, tpart;
-  Event *p, *q;
-  Event t0;
-  size_t pivot;
+  uint64_t kpart; 
+  uint32_t cpart; 
+  size_t p, q, r;
     
-    // Try to get a good partition value and avoid being bitten by
-    // already sorted input.  //ptpart = data + (random() % n);
-  ptpart = data + (random() % n);
+  // Try to get a good partition value and avoid being bitten by
+  // already sorted input.
+  r = random() % n; 
   
   //swap with data[0]
-  tpart = *ptpart;
-  *ptpart = data[0];
-  data[0] = tpart;
+  swap_events(key, cell, 0, r); 
+  kpart = key[0]; 
+  cpart = cell[0]; 
     
   // Walk through the array and partition it.
-  for (p = data - 1, q = data + n; ; ) {
+  for (p = (size_t)-1, q = n; ; ) {
     
     do {
       q--;
-    } while (event_compare_radial(*q, tpart) > 0);
+    } while (event_compare_radial(key[q], cell[q], kpart, cpart) > 0);
 
     do {
       p++;
-    } while (event_compare_radial(*p, tpart) < 0);
+    } while (event_compare_radial(key[p], cell[p], kpart, cpart) < 0);
     
     if (p < q) {
-      t0 = *p;
-      *p = *q;
-      *q = t0;
+      swap_events(key, cell, p, q); 
     } else {
-      pivot = q - data;            
-      break;
+      return q; 
     }
   }
-  return pivot;
 }
 
-void insertionsort_radial(Event *data, size_t n) {
-  Event *p, *q, test;
+static void insertionsort_radial(uint64_t* key, uint32_t* cell, size_t n) {
+
+  uint64_t tk; 
+  uint32_t tc; 
+  size_t p, q; 
   
-  for (p = data + 1; p < data + n; p++) {
-    for (q = p - 1, test = *p; event_compare_radial(*q, test) > 0; q--) {
-      *(q+1) = *q;
-      if (q==data) {
-	q--; // to make assignment below correct
-	break;
-      }
+  for (p = 1; p < n; p++) {
+    tk = key[p]; 
+    tc = cell[p]; 
+    for (q = p; q > 0 && event_compare_radial(key[q-1], cell[q-1], tk, tc) > 0; q--) {
+      key[q] = key[q-1]; 
+      cell[q] = cell[q-1]; 
     }
-    *(q+1) = test;
+    key[q] = tk; 
+    cell[q] = tc; 
   }
 }
 
-/* sort the event list in radial order */
-void event_quicksort_radial(Event* eventlist, size_t n) {
+static void quicksort_radial(uint64_t* key, uint32_t* cell, size_t n) {
 
  size_t pivot;
  if (n < MIN_LEN) {
-   insertionsort_radial(eventlist, n);
+   insertionsort_radial(key, cell, n);
    return;
  }
  //else
- pivot = partition_radial(eventlist, n);
- event_quicksort_radial(eventlist, pivot + 1);
- event_quicksort_radial(eventlist + pivot + 1, n - pivot - 1);
+ pivot = partition_radial(key, cell, n);
+ quicksort_radial(key, cell, pivot + 1);
+ quicksort_radial(key + pivot + 1, cell + pivot + 1, n - pivot - 1);
+}
+
+/* sort the event list in radial order */
+void event_quicksort_radial(EventList* list) {
+
+  assert(list); 
+  quicksort_radial(list->key, list->cell, list->n); 
 }
 
 
@@ -152,90 +126,137 @@ void event_quicksort_radial(Event* eventlist, size_t n) {
 /* ************************************************************ */
 
 
-/*comparison function.  Compares two events based on their distance
-  for the viewpoint */
-int event_compare_distance(Event e1, Event e2) {
-  //assert(e1 && e2);
+/* Compares two events on their distance from the viewpoint, the low
+   32 bits of the key */
+#define event_compare_distance(k1, k2) \
+  compare_values((uint32_t)(k1), (uint32_t)(k2))
 
-  if(e1.dist < e2.dist) {
-    return -1;
-  }
-  if(e1.dist > e2.dist) {
-    return 1;
-  }
-
-  /* they are equal */
-  return 0;
-
-}
-#define event_compare_distance(e1, e2) compare_values((e1).dist, (e2).dist)
+static size_t partition_distance(uint64_t* key, uint32_t* cell, size_t n) {
 
-size_t partition_distance(Event *data, size_t n) {
-
-  Event *ptpart, tpart;
-  Event *p, *q;
-  Event t0;
-  size_t pivot;
+  uint32_t dpart; 
+  size_t p, q, r;
     
-    // Try to get a good partition value and avoid being bitten by
-    // already sorted input.  //ptpart = data + (random() % n);
-  ptpart = data + (random() % n);
+  // Try to get a good partition value and avoid being bitten by
+  // already sorted input.
+  r = random() % n; 
   
   //swap with data[0]
-  tpart = *ptpart;
-  *ptpart = data[0];
-  data[0] = tpart;
+  swap_events(key, cell, 0, r); 
+  dpart = (uint32_t)key[0]; 
     
   // Walk through the array and partition it.
-  for (p = data - 1, q = data + n; ; ) {
+  for (p = (size_t)-1, q = n; ; ) {
     
     do {
       q--;
-    } while (event_compare_distance(*q, tpart) > 0);
+    } while (event_compare_distance(key[q], dpart) > 0);
 
     do {
       p++;
-    } while (event_compare_distance(*p, tpart) < 0);
+    } while (event_compare_distance(key[p], dpart) < 0);
     
     if (p < q) {
-      t0 = *p;
-      *p = *q;
-      *q = t0;
+      swap_events(key, cell, p, q); 
     } else {
-      pivot = q - data;            
-      break;
+      return q; 
     }
   }
-  return pivot;
 }
 
-void insertionsort_distance(Event *data, size_t n) {
-  Event *p, *q, test;
+static void insertionsort_distance(uint64_t* key, uint32_t* cell, size_t n) {
+
+  uint64_t tk; 
+  uint32_t tc; 
+  size_t p, q; 
   
-  for (p = data + 1; p < data + n; p++) {
-    for (q = p - 1, test = *p; event_compare_distance(*q, test) > 0; q--) {
-      *(q+1) = *q;
-      if (q==data) {
-	q--; // to make assignment below correct
-	break;
-      }
+  for (p = 1; p < n; p++) {
+    tk = key[p]; 
+    tc = cell[p]; 
+    for (q = p; q > 0 && event_compare_distance(key[q-1], tk) > 0; q--) {
+      key[q] = key[q-1]; 
+      cell[q] = cell[q-1]; 
     }
-    *(q+1) = test;
+    key[q] = tk; 
+    cell[q] = tc; 
   }
 }
 
-/* sort the event list in distance order */
-void event_quicksort_distance(Event* eventlist, size_t n) {
+static void quicksort_distance(uint64_t* key, uint32_t* cell, size_t n) {
 
  size_t pivot;
  if (n < MIN_LEN) {
-   insertionsort_distance(eventlist, n);
+   insertionsort_distance(key, cell, n);
    return;
  }
  //else
- pivot = partition_distance(eventlist, n);
- event_quicksort_distance(eventlist, pivot + 1);
- event_quicksort_distance(eventlist + pivot + 1, n - pivot - 1);
+ pivot = partition_distance(key, cell, n);
+ quicksort_distance(key, cell, pivot + 1);
+ quicksort_distance(key + pivot + 1, cell + pivot + 1, n - pivot - 1);
 }
 
+/* sort the event list in distance order */
+void event_quicksort_distance(EventList* list) {
+
+  assert(list); 
+  quicksort_distance(list->key, list->cell, list->n); 
+}
 
+
+
+
+/* ************************************************************ */
+/*      SYSTEM QSORT
+ */
+/* ************************************************************ */
+
+
+/* qsort moves whole elements, so the key and cell of an event are
+   packed together for it */
+typedef struct packed_event_ {
+  uint64_t key; 
+  uint32_t cell; 
+} PackedEvent; 
+
+
+static int compare_events_angle(const void* a, const void* b) {
+
+  const PackedEvent* e1 = (const PackedEvent*) a; 
+  const PackedEvent* e2 = (const PackedEvent*) b; 
+  return event_compare_radial(e1->key, e1->cell, e2->key, e2->cell); 
+}
+
+static int compare_events_dist(const void* a, const void* b) {
+
+  const PackedEvent* e1 = (const PackedEvent*) a; 
+  const PackedEvent* e2 = (const PackedEvent*) b; 
+  return event_compare_distance(e1->key, e2->key); 
+}
+
+
+static void packed_qsort(EventList* list, 
+			 int (*compare)(const void*, const void*)) {
+
+  assert(list); 
+  long i; 
+  PackedEvent* packed = (PackedEvent*) malloc((list->n ? list->n : 1) * 
+					      sizeof(PackedEvent)); 
+  assert(packed); 
+  for (i = 0; i < list->n; i++) {
+    packed[i].key = list->key[i]; 
+    packed[i].cell = list->cell[i]; 
+  }
+  qsort(packed, list->n, sizeof(PackedEvent), compare); 
+  for (i = 0; i < list->n; i++) {
+    list->key[i] = packed[i].key; 
+    list->cell[i] = packed[i].cell; 
+  }
+  free(packed); 
+}
+
+void event_qsort_radial(EventList* list) {
+  packed_qsort(list, compare_events_angle); 
+}
+
+void event_qsort_distance(EventList* list) {
+  packed_qsort(list, compare_events_dist); 
+}
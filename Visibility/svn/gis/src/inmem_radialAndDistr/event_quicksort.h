@@ -3,11 +3,16 @@
 
 
 /* sort the event list in radial order */
-void event_quicksort_radial(Event* eventlist, size_t nevents); 
+void event_quicksort_radial(EventList* list); 
 
 
 /* sort the event list in distance order */
-void event_quicksort_distance(Event* eventlist, size_t nevents); 
+void event_quicksort_distance(EventList* list); 
+
+
+/* the same, with the system qsort */
+void event_qsort_radial(EventList* list); 
+void event_qsort_distance(EventList* list); 
 
 
 #define compare_values(a, b) ((a < b) ? (-1) : (a > b))
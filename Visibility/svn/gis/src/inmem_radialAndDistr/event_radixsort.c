@@ -0,0 +1,296 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdio.h>
+
+#include "event.h"
+#include "event_radixsort.h"
+
+
+/* An LSD radix sort of the event list.  The keys of the events are
+   unsigned integers already (see event.h), so the sort moves the
+   (key, cell) pairs back and forth between the list and a buffer of
+   the same shape, one digit per pass.  For the radial order the first
+   pass sorts on the type rank in the cell, and the passes after it on
+   the key: each pass is stable, so the type only breaks ties in angle
+   and distance, and the EXIT event of a corner comes before the ENTER
+   event of the cell that shares it, as event_compare_radial() does.
+   The distance order only sorts on the low 32 bits of the key. */
+
+
+/* bits of the key sorted on per pass: 6 passes for a 64-bit key, and
+   the counts of all digits of a slice take 56KB */
+#define RADIX_BITS 11
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_MASK (RADIX_BUCKETS - 1)
+#define RADIX_KEY_PASSES ((64 + RADIX_BITS - 1) / RADIX_BITS)
+#define RADIX_DIST_PASSES ((32 + RADIX_BITS - 1) / RADIX_BITS)
+#define RADIX_PASSES (RADIX_KEY_PASSES + 1)
+
+/* lists shorter than this are not worth starting threads for */
+#define RADIX_MIN_PARALLEL (1 << 16)
+
+
+/* the state shared by the threads of one sort */
+typedef struct _radixSort {
+  size_t n;
+  int nthreads;
+  int radial;           /* radial order; else distance order */
+  int npasses;
+  uint64_t* key[2];     /* the list, and the buffer each pass copies */
+  uint32_t* cell[2];    /* it to or from */
+  uint32_t (*count)[RADIX_PASSES][RADIX_BUCKETS]; /* count[t][p][b]: events
+				     of thread t's slice with digit p = b */
+  pthread_barrier_t barrier;
+  pthread_mutex_t lock;  /* the threads wait for go, so that nthreads */
+  pthread_cond_t start;  /* is the number that did start */
+  int go;
+} RadixSort;
+
+/* the buffers of the sorts of one thread, kept from one sort to the
+   next: the sweeps sort lists of the same length over and over, and
+   fresh buffers that large come straight from the kernel, a page fault
+   per page */
+typedef struct _radixWork {
+  size_t size;          /* events the buffers hold */
+  uint64_t* key;
+  uint32_t* cell;
+} RadixWork;
+
+static __thread RadixWork work;
+
+/* one thread of a sort; thread t counts and moves the slice
+   [n*t/nthreads, n*(t+1)/nthreads) of every pass */
+typedef struct _radixThread {
+  RadixSort* s;
+  int t;
+  pthread_t thread;
+} RadixThread;
+
+
+
+/* ************************************************************ */
+/* digit p of an event */
+static inline unsigned radix_digit(const RadixSort* s, int p, uint64_t key,
+				   uint32_t cell) {
+
+  if (!s->radial)
+    return ((uint32_t)key >> (p * RADIX_BITS)) & RADIX_MASK;
+  if (p == 0)
+    return event_rank(cell);
+  return (key >> ((p - 1) * RADIX_BITS)) & RADIX_MASK;
+}
+
+
+/* wait until all threads of the sort get here */
+static inline void radix_sync(RadixSort* s) {
+
+  if (s->nthreads > 1)
+    pthread_barrier_wait(&s->barrier);
+}
+
+
+/* ************************************************************ */
+static void* radix_sort_slice(void* arg) {
+
+  RadixThread* rt = (RadixThread*) arg;
+  RadixSort* s = rt->s;
+  int t = rt->t;
+  size_t lo, hi;
+  uint32_t (*count)[RADIX_BUCKETS] = s->count[t];
+  size_t start[RADIX_BUCKETS];
+  int trivial[RADIX_PASSES];
+  size_t i, j, sum, total;
+  uint64_t *key, *key2;
+  uint32_t *cell, *cell2;
+  int cur = 0, p, b, u, moved = 0;
+
+  if (t > 0) {
+    pthread_mutex_lock(&s->lock);
+    while (!s->go)
+      pthread_cond_wait(&s->start, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+  }
+  lo = s->n * t / s->nthreads;
+  hi = s->n * (t + 1) / s->nthreads;
+
+  /* count every digit of the slice in one go */
+  key = s->key[0];
+  cell = s->cell[0];
+  memset(count, 0, s->npasses * sizeof(*count));
+  for (i = lo; i < hi; i++)
+    for (p = 0; p < s->npasses; p++)
+      count[p][radix_digit(s, p, key[i], cell[i])]++;
+  radix_sync(s);
+
+  /* a digit that is the same for every event (the high bits of the
+     angle of a narrow list, the type of a list of centers) moves
+     nothing */
+  for (p = 0; p < s->npasses; p++) {
+    trivial[p] = 0;
+    for (b = 0; b < RADIX_BUCKETS && !trivial[p]; b++) {
+      for (u = 0, total = 0; u < s->nthreads; u++)
+	total += s->count[u][p][b];
+      trivial[p] = (total == s->n);
+    }
+  }
+  /* the counts of the other slices are read; they may change now */
+  radix_sync(s);
+
+  for (p = 0; p < s->npasses; p++) {
+    if (trivial[p])
+      continue;
+    key = s->key[cur];
+    cell = s->cell[cur];
+    key2 = s->key[cur ^ 1];
+    cell2 = s->cell[cur ^ 1];
+
+    /* the slices hold other events once a pass has moved them */
+    if (moved && s->nthreads > 1) {
+      memset(count[p], 0, sizeof(count[p]));
+      for (i = lo; i < hi; i++)
+	count[p][radix_digit(s, p, key[i], cell[i])]++;
+      radix_sync(s);
+    }
+
+    /* this slice's events of bucket b go after all events of the
+       smaller buckets and after the events of bucket b of the slices
+       before it */
+    for (b = 0, sum = 0; b < RADIX_BUCKETS; b++) {
+      for (u = 0, total = 0; u < s->nthreads; u++) {
+	if (u == t)
+	  start[b] = sum + total;
+	total += s->count[u][p][b];
+      }
+      sum += total;
+    }
+
+    for (i = lo; i < hi; i++) {
+      j = start[radix_digit(s, p, key[i], cell[i])]++;
+      key2[j] = key[i];
+      cell2[j] = cell[i];
+    }
+    cur ^= 1;
+    moved = 1;
+    /* everyone is done with the counts, and with this pass's
+       buffers */
+    radix_sync(s);
+  }
+
+  /* an odd number of passes leaves the events in the buffer */
+  if (cur) {
+    memcpy(s->key[0] + lo, s->key[1] + lo, (hi - lo) * sizeof(uint64_t));
+    memcpy(s->cell[0] + lo, s->cell[1] + lo, (hi - lo) * sizeof(uint32_t));
+  }
+  return NULL;
+}
+
+
+/* ************************************************************ */
+/* sort the events in radial or distance order */
+static void radix_sort(EventList* list, int radial, int nthreads) {
+
+  RadixSort s;
+  RadixThread* threads;
+  size_t n;
+  int t, started, result;
+
+  assert(list);
+  n = list->n;
+  if (n < 2) return;
+  assert(n <= UINT32_MAX);
+  if (nthreads < 1 || n < RADIX_MIN_PARALLEL)
+    nthreads = 1;
+
+  s.n = n;
+  s.nthreads = nthreads;
+  s.radial = radial;
+  s.npasses = radial ? RADIX_PASSES : RADIX_DIST_PASSES;
+  if (work.size < n) {
+    event_radixsort_free();
+    work.key = (uint64_t*) malloc(n * sizeof(uint64_t));
+    work.cell = (uint32_t*) malloc(n * sizeof(uint32_t));
+    if (!work.key || !work.cell) {
+      fprintf(stderr, "event_radixsort: not enough memory\n");
+      exit(1);
+    }
+    work.size = n;
+  }
+  s.key[0] = list->key;
+  s.cell[0] = list->cell;
+  s.key[1] = work.key;
+  s.cell[1] = work.cell;
+  s.count = malloc(nthreads * sizeof(*s.count));
+  threads = (RadixThread*) malloc(nthreads * sizeof(RadixThread));
+  if (!s.count || !threads) {
+    fprintf(stderr, "event_radixsort: not enough memory\n");
+    exit(1);
+  }
+  s.go = 0;
+  pthread_mutex_init(&s.lock, NULL);
+  pthread_cond_init(&s.start, NULL);
+
+  /* the calling thread sorts the first slice; if a thread cannot be
+     started, the ones that did split the list between them */
+  for (t = 0; t < nthreads; t++) {
+    threads[t].s = &s;
+    threads[t].t = t;
+  }
+  for (started = 1; started < nthreads; started++) {
+    result = pthread_create(&threads[started].thread, NULL, radix_sort_slice,
+			    &threads[started]);
+    if (result != 0)
+      break;
+  }
+  s.nthreads = started;
+  if (started > 1 && pthread_barrier_init(&s.barrier, NULL, started) != 0) {
+    fprintf(stderr, "event_radixsort: could not start its threads\n");
+    exit(1);
+  }
+  pthread_mutex_lock(&s.lock);
+  s.go = 1;
+  pthread_cond_broadcast(&s.start);
+  pthread_mutex_unlock(&s.lock);
+
+  radix_sort_slice(&threads[0]);
+  for (t = 1; t < started; t++) {
+    if (pthread_join(threads[t].thread, NULL) != 0) {
+      fprintf(stderr, "event_radixsort: could not join its threads\n");
+      exit(1);
+    }
+  }
+
+  if (started > 1)
+    pthread_barrier_destroy(&s.barrier);
+  pthread_mutex_destroy(&s.lock);
+  pthread_cond_destroy(&s.start);
+  free(s.count);
+  free(threads);
+}
+
+
+
+/* ************************************************************ */
+/* sort the event list in radial order */
+void event_radixsort_radial(EventList* list, int nthreads) {
+
+  radix_sort(list, 1, nthreads);
+}
+
+
+/* sort the event list in distance order */
+void event_radixsort_distance(EventList* list, int nthreads) {
+
+  radix_sort(list, 0, nthreads);
+}
+
+
+/* free the buffers the sorts of this thread kept */
+void event_radixsort_free() {
+
+  free(work.key);
+  free(work.cell);
+  memset(&work, 0, sizeof(work));
+}
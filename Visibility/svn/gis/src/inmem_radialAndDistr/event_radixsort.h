@@ -0,0 +1,20 @@
+#ifndef __radixsort_h_
+#define __radixsort_h_
+
+
+/* sort the event list in radial order, the same order as
+   event_quicksort_radial(), in nthreads threads */
+void event_radixsort_radial(EventList* list, int nthreads);
+
+
+/* sort the event list in distance order, in nthreads threads; events
+   at the same distance keep their order */
+void event_radixsort_distance(EventList* list, int nthreads);
+
+
+/* the sorts of a thread keep their buffers for the next sort; free
+   them */
+void event_radixsort_free();
+
+
+#endif
@@ -2,9 +2,17 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "grid.h"
+#include "gridio.h"
+
+/*values write_rows() runs through fun() at a time */
+#define SAVE_BATCH (1 << 22)
+
+/*how alloc_grid_data() allocates, see set_grid_alloc() */
+static int grid_alloc = 0;
 
 
 /* ------------------------------------------------------------ */
@@ -37,7 +45,8 @@ void read_header_from_arcascii_file(GridHeader* hd, FILE* fp)
   result = fscanf(fp, "%*s%d\n", &nrows);
   assert(result == 1);
   /*check that you dont lose precision */
-  if (nrows <= maxDimension && ncols <= maxDimension) {
+  if (nrows >= 0 && ncols >= 0 &&
+      (unsigned)nrows <= maxDimension && (unsigned)ncols <= maxDimension) {
     hd->nrows = (dimensionType) nrows;
     hd->ncols = (dimensionType) ncols;
   }
@@ -101,8 +110,8 @@ void print_grid_header(GridHeader * hd)
 void fprint_grid_header(FILE * fp, GridHeader * hd)
 {
     assert(fp && hd);
-    fprintf(fp, "ncols\t%d\n", hd->ncols);
-    fprintf(fp, "nrows\t%d\n", hd->nrows);
+    fprintf(fp, "ncols\t%u\n", hd->ncols);
+    fprintf(fp, "nrows\t%u\n", hd->nrows);
     fprintf(fp, "xllcorner\t%f\n", hd->xllcorner);
     fprintf(fp, "yllcorner\t%f\n", hd->yllcorner);
     fprintf(fp, "cellsize\t%f\n", hd->cellsize);
@@ -134,41 +143,6 @@ int is_nodata(Grid * grid, float value)
 }
 
 
-/* ------------------------------------------------------------ */
-/* return 1 iff grid(i,j) is Nodata; 0 otherwise */
-int is_nodata_at(Grid* grid, dimensionType i, dimensionType j) {
-
-  assert(grid && i< grid->hd->nrows && j<grid->hd->ncols);
-  return is_header_nodata(grid->hd, grid->grid_data[i][j]);
-}
-
-
-/* ------------------------------------------------------------ */
-/* return the value at (i,j) */
-float get(Grid* grid, dimensionType i, dimensionType j) {
-
-  assert(grid && i< grid->hd->nrows && j<grid->hd->ncols);
-  return grid->grid_data[i][j];
-}
-
-
-/* ------------------------------------------------------------ */
-/* set data[i][j] in the grid to this value */
-void set(Grid* grid, dimensionType i, dimensionType j, float value) {
-  assert(grid && i< grid->hd->nrows && j<grid->hd->ncols);
-  grid->grid_data[i][j] = value;
-}
-
-
-/* ------------------------------------------------------------ */
-/* set data[i][j] in the grid to NODATA */
-void set_nodata(Grid* grid, dimensionType i, dimensionType j) {
-  assert(grid && i< grid->hd->nrows &&  j<grid->hd->ncols);
-  grid->grid_data[i][j] = grid->hd->nodata_value;
-}
-
-
-
 /* ------------------------------------------------------------ */
 /* create an empty grid with an empty header and return it. The header
    is all 0 and data is set to NULL.  */
@@ -179,7 +153,14 @@ Grid *create_empty_grid()
 
   /*initialize structure */
   ptr_grid->hd = create_empty_header();
-  ptr_grid->grid_data = NULL;
+  ptr_grid->storage = GRID_FLOAT;
+  ptr_grid->layout = GRID_ROWMAJOR;
+  ptr_grid->nblockcols = 0;
+  ptr_grid->fdata = NULL;
+  ptr_grid->sdata = NULL;
+  ptr_grid->snodata = 0;
+  ptr_grid->mapped = 0;
+  ptr_grid->valid = NULL;
 
 #ifdef _DEBUG_ON
   printf("**DEBUG: createEmptyGrid \n");
@@ -193,22 +174,53 @@ Grid *create_empty_grid()
 
 
 /* ------------------------------------------------------------ */
-/* allocate memroy for grid_data; grid must have a header that gives
-   the dimensions */
+void set_grid_alloc(int flags)
+{
+  grid_alloc = flags;
+}
+
+
+
+/* ------------------------------------------------------------ */
+/* allocate memroy for the grid data, in the grid's storage; grid must
+   have a header that gives the dimensions */
 void alloc_grid_data(Grid * pgrid)
 {
-    dimensionType i;
+    size_t size, n;
+    void *block = NULL;
 
     assert(pgrid);
     assert(pgrid->hd);
-    pgrid->grid_data = (float **)malloc(pgrid->hd->nrows * sizeof(float *));
-    assert(pgrid->grid_data);
-
-    for (i = 0; i < pgrid->hd->nrows; i++) {
-      pgrid->grid_data[i] =
-	(float *)malloc(pgrid->hd->ncols * sizeof(float));
-      assert(pgrid->grid_data[i]);
+    size = pgrid->storage == GRID_INT16 ? sizeof(short) : sizeof(float);
+    pgrid->nblockcols = (pgrid->hd->ncols + GRID_BLOCK - 1) >> GRID_BLOCK_BITS;
+    if (pgrid->layout == GRID_BLOCKED)
+      n = (size_t)((pgrid->hd->nrows + GRID_BLOCK - 1) >> GRID_BLOCK_BITS) *
+	pgrid->nblockcols << (2 * GRID_BLOCK_BITS);
+    else
+      n = (size_t)pgrid->hd->nrows * pgrid->hd->ncols;
+
+    /*one aligned block for all the rows, so the loader can fill it in
+      one go and a row never starts partway into a cache line it shares
+      with anything else */
+    if (grid_alloc) {
+      /*a mapping is aligned to a huge page, so to GRID_ALIGN too */
+      block = gio_alloc(n * size, grid_alloc);
+      pgrid->mapped = n * size;
+    } else {
+      if (posix_memalign(&block, GRID_ALIGN, n * size) != 0)
+	block = NULL;
+      pgrid->mapped = 0;
     }
+    if (!block) {
+      fprintf(stderr, "could not allocate %lu bytes of grid data\n",
+	      (unsigned long)(n * size));
+      exit(1);
+    }
+    if (pgrid->storage == GRID_INT16) {
+      pgrid->sdata = (short *)block;
+      pgrid->snodata = (short)pgrid->hd->nodata_value;
+    } else
+      pgrid->fdata = (float *)block;
 
 #ifdef _DEBUG_ON
     printf("**DEBUG: allocGridData\n");
@@ -221,51 +233,169 @@ void alloc_grid_data(Grid * pgrid)
 /*reads header and data from file */
 Grid *read_grid_from_arcascii_file(char *filename)
 {
-    FILE *fp;
+    return read_grid_from_arcascii_file_as(filename, GRID_FLOAT,
+					   GRID_ROWMAJOR);
+}
+
+/* ------------------------------------------------------------ */
+/*returns 1 if value is a whole number that fits in a short */
+static int fits_int16(float value)
+{
+    return value >= SHRT_MIN && value <= SHRT_MAX && value == (short)value;
+}
+
+/* ------------------------------------------------------------ */
+/*move the values of a GRID_ROWMAJOR grid into GRID_BLOCKED order; each
+  row of a block is a run of up to GRID_BLOCK values in both */
+static void block_grid_data(Grid *grid)
+{
+    Grid rows;
+    dimensionType i, j, k;
+    size_t size;
+    char *src, *dst;
+
+    assert(grid->layout == GRID_ROWMAJOR);
+    rows = *grid;
+    grid->layout = GRID_BLOCKED;
+    grid->fdata = NULL;
+    grid->sdata = NULL;
+    alloc_grid_data(grid);
+
+    size = grid->storage == GRID_INT16 ? sizeof(short) : sizeof(float);
+    src = grid->storage == GRID_INT16 ? (char *)rows.sdata : (char *)rows.fdata;
+    dst = grid->storage == GRID_INT16 ? (char *)grid->sdata : (char *)grid->fdata;
+    for (i = 0; i < grid->hd->nrows; i++) {
+      for (j = 0; j < grid->hd->ncols; j += k) {
+	k = grid->hd->ncols - j < GRID_BLOCK ? grid->hd->ncols - j : GRID_BLOCK;
+	memcpy(dst + grid_index(grid, i, j) * size,
+	       src + grid_index(&rows, i, j) * size, k * size);
+      }
+    }
+    if (rows.mapped) {
+      gio_free(rows.fdata, rows.mapped);
+      gio_free(rows.sdata, rows.mapped);
+    } else {
+      free(rows.fdata);
+      free(rows.sdata);
+    }
+}
+
+/* ------------------------------------------------------------ */
+/*reads header and data from file, into the given storage and layout */
+Grid *read_grid_from_arcascii_file_as(char *filename, GridStorage storage,
+				      GridLayout layout)
+{
+    GridFile *gf;
+    GridStream *gs;
     Grid *grid;
-    dimensionType i, j;
+    const void *rows;
+    const float *block;
+    size_t i, n, k;
+    int64_t m;
     int first_flag, result;
     float value;
 
     assert(filename);
-    fp = fopen(filename, "r");
-    assert(fp);
+    gf = gio_open(filename);
+    if (!gf) {
+	printf("could not open file %s\n", filename);
+	exit(1);
+    }
 
     grid = create_empty_grid();
-
-    read_header_from_arcascii_file(grid->hd, fp);
+    /*check that you dont lose precision */
+    if (gf->hd.nrow > maxDimension || gf->hd.ncol > maxDimension) {
+	fprintf(stderr, "grid dimension too big for current precision\n");
+	printf("change type and re-compile\n");
+	exit(1);
+    }
+    grid->hd->nrows = (dimensionType) gf->hd.nrow;
+    grid->hd->ncols = (dimensionType) gf->hd.ncol;
+    grid->hd->xllcorner = gf->hd.xllcorner;
+    grid->hd->yllcorner = gf->hd.yllcorner;
+    grid->hd->cellsize = gf->hd.cellsize;
+    grid->hd->nodata_value = gf->hd.nodata;
+    grid->storage = storage;
+    if (storage == GRID_INT16 && !fits_int16(grid->hd->nodata_value)) {
+	fprintf(stderr, "NODATA value %f is not a 16-bit integer\n",
+		grid->hd->nodata_value);
+	exit(1);
+    }
     alloc_grid_data(grid);
+    n = (size_t)grid->hd->nrows * grid->hd->ncols;
+
+    if (storage == GRID_FLOAT) {
+      /*READ DATA, in parallel into the one block */
+      result = gio_read(gf, GIO_FLOAT, grid->fdata, 0);
+      gio_close(gf);
+      if (result != 0) {
+	printf("could not read file %s\n", filename);
+	exit(1);
+      }
+    } else {
+      /*READ DATA a block of rows at a time, checking every value is a
+	whole number that fits before narrowing it */
+      gio_close(gf);
+      gs = gio_stream_open(filename, GIO_FLOAT, 0);
+      if (!gs) {
+	printf("could not read file %s\n", filename);
+	exit(1);
+      }
+      k = 0;
+      while ((m = gio_stream_next(gs, &rows)) > 0) {
+	if (k + (size_t)m * grid->hd->ncols > n)
+	  break;
+	block = (const float *)rows;
+	for (i = 0; i < (size_t)m * grid->hd->ncols; i++, k++) {
+	  if (!fits_int16(block[i])) {
+	    fprintf(stderr, "value %f at (%lu,%lu) is not a 16-bit integer\n",
+		    block[i], (unsigned long)(k / grid->hd->ncols),
+		    (unsigned long)(k % grid->hd->ncols));
+	    exit(1);
+	  }
+	  grid->sdata[k] = (short)block[i];
+	}
+      }
+      gio_stream_close(gs);
+      if (m != 0 || k != n) {
+	printf("could not read file %s\n", filename);
+	exit(1);
+      }
+    }
 
-    /*READ DATA */
     first_flag = 1;
-    value = 0;
-
-    for (i = 0; i < grid->hd->nrows; i++) {
-	for (j = 0; j < grid->hd->ncols; j++) {
-	    result = fscanf(fp, "%f", &value);
-		assert(result == 1);
-	    grid->grid_data[i][j] = value;
-
-	    if (first_flag) {
-		if (is_nodata(grid, value))
-		    continue;
-		grid->minvalue = grid->maxvalue = value;
-		first_flag = 0;
-	    }
-	    else {
-		if (is_nodata(grid, value))
-		    continue;
-		if (value > grid->maxvalue)
-		    grid->maxvalue = value;
-		if (value < grid->minvalue)
-		    grid->minvalue = value;
-	    }
+    for (i = 0; i < n; i++) {
+	value = storage == GRID_INT16 ? grid->sdata[i] : grid->fdata[i];
+	if (is_nodata(grid, value))
+	    continue;
+	if (first_flag) {
+	    grid->minvalue = grid->maxvalue = value;
+	    first_flag = 0;
+	}
+	else {
+	    if (value > grid->maxvalue)
+		grid->maxvalue = value;
+	    if (value < grid->minvalue)
+		grid->minvalue = value;
 	}
-	result = fscanf(fp, "\n");
-	assert(result == 0);
     }
 
-    fclose(fp);
+    /*find the data while the values are still row after row; the
+      NODATA test is exact rather than within is_nodata()'s tolerance,
+      which is below the spacing of floats anywhere near a usual NODATA
+      value */
+    if (storage == GRID_INT16)
+	grid->valid = gio_valid(GIO_SHRT, grid->sdata, grid->hd->nrows,
+				grid->hd->ncols, &grid->snodata);
+    else
+	grid->valid = gio_valid(GIO_FLOAT, grid->fdata, grid->hd->nrows,
+				grid->hd->ncols, &grid->hd->nodata_value);
+    if (!grid->valid)
+	printf("could not allocate the data runs, scanning every cell\n");
+
+    /*the values are read row after row, and rearranged after */
+    if (layout == GRID_BLOCKED)
+	block_grid_data(grid);
 
 #ifdef DEBUG_ON
     printf("**DEBUG: readGridFromArcasciiFile():\n");
@@ -284,17 +414,16 @@ Grid *read_grid_from_arcascii_file(char *filename)
 void destroy_grid(Grid * grid)
 {
     assert(grid);
-    /*free grid data if its allocated */
-    if (grid->grid_data) {
-      dimensionType i;
-
-      for (i = 0; i < grid->hd->nrows; i++) {
-	if (!grid->grid_data[i])
-	  free((float *)grid->grid_data[i]);
-      }
-
-      free((float **)grid->grid_data);
+    /*free grid data if its allocated; the rows share one block, see
+      alloc_grid_data() */
+    if (grid->mapped) {
+      gio_free(grid->fdata, grid->mapped);
+      gio_free(grid->sdata, grid->mapped);
+    } else {
+      free(grid->fdata);
+      free(grid->sdata);
     }
+    gio_valid_free(grid->valid);
 
     assert(grid->hd);
     free(grid->hd);
@@ -312,6 +441,37 @@ void destroy_grid(Grid * grid)
 
 
 
+/* ------------------------------------------------------------ */
+/*write the values of the grid to fp: run fun() (if any) on a batch of
+  rows at a time, then write the batch out as "%.1f " */
+static void write_rows(Grid * grid, FILE *fp, float (*fun)(float))
+{
+  dimensionType i, j, k;
+  unsigned long batch;
+  float *buf, value;
+
+  batch = SAVE_BATCH / grid->hd->ncols;
+  if (batch < 1) batch = 1;
+  if (batch > grid->hd->nrows) batch = grid->hd->nrows;
+  buf = (float*) malloc(batch * grid->hd->ncols * sizeof(float));
+  assert(buf);
+  for (i = 0; i < grid->hd->nrows; i += k) {
+    for (k = 0; k < batch && i + k < grid->hd->nrows; k++) {
+      for (j = 0; j < grid->hd->ncols; j++) {
+	value = get(grid, i + k, j);
+	buf[k * grid->hd->ncols + j] = fun ? fun(value) : value;
+      }
+    }
+    if (gio_write_rows(fp, GIO_FLOAT, buf, k, grid->hd->ncols, 1, 0) != 0) {
+      printf("could not write the grid\n");
+      exit(1);
+    }
+  }
+  free(buf);
+}
+
+
+
 /* ------------------------------------------------------------ */
 /*save the grid into an arcascii file.  Loops through all elements x
   in row-column order and writes fun(x) to file */
@@ -320,7 +480,6 @@ save_grid_to_arcascii_file(Grid * grid, char *filename) {
 
   FILE *outfile, *fp;
   int ret;
-  dimensionType i, j;
 
   assert(filename && grid);
   printf("saving grid to %s\n", filename);
@@ -344,15 +503,18 @@ save_grid_to_arcascii_file(Grid * grid, char *filename) {
   /*print header */
   fprint_grid_header(fp, grid->hd);
 
-  /*print data */
-  for (i = 0; i < grid->hd->nrows; i++) {
-    for (j = 0; j < grid->hd->ncols; j++) {
-
-      /*  call fun() on this element and write it to file  */
-      fprintf(fp, "%.1f ",  grid->grid_data[i][j]);
+  /*print data; row-major float rows are one block, see alloc_grid_data(),
+    so they are formatted in parallel, exactly as "%.1f " */
+  if (grid->storage == GRID_FLOAT && grid->layout == GRID_ROWMAJOR) {
+    ret = gio_write_rows(fp, GIO_FLOAT, grid->fdata, grid->hd->nrows,
+			 grid->hd->ncols, 1, 0);
+    if (ret != 0) {
+      printf("could not write the grid\n");
+      exit(1);
     }
-    fprintf(fp, "\n");
-  }
+  } else
+    write_rows(grid, fp, NULL);
+  fclose(fp);
 
 #ifdef _DEBUG_ON
   printf("**DEBUG: saveGridToArcasciiFile: saved to %s\n", filename);
@@ -372,7 +534,6 @@ save_grid_to_arcascii_file_fun(Grid * grid, char *filename,
 			   float(*fun)(float)) {
   FILE *outfile, *fp;
   int ret;
-  dimensionType i, j;
 
   assert(filename && grid);
   printf("saving grid to %s\n", filename);
@@ -397,15 +558,8 @@ save_grid_to_arcascii_file_fun(Grid * grid, char *filename,
   fprint_grid_header(fp, grid->hd);
 
   /*print data */
-  for (i = 0; i < grid->hd->nrows; i++) {
-    for (j = 0; j < grid->hd->ncols; j++) {
-
-      /*  call fun() on this element and write it to file  */
-      fprintf(fp, "%.1f ",  fun(grid->grid_data[i][j]) );
-
-    }
-    fprintf(fp, "\n");
-  }
+  write_rows(grid, fp, fun);
+  fclose(fp);
 
 #ifdef _DEBUG_ON
   printf("**DEBUG: saveGridToArcasciiFile: saved to %s\n", filename);
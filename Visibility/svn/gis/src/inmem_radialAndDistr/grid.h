@@ -8,14 +8,42 @@
 #define __GRID_H
 
 #include <stdio.h>
+#include <stddef.h>
+#include <assert.h>
 #include <limits.h>
+#include <math.h>
 
+#include "gridio.h"
 
 
-/* this should accomodate grid sizes up to 2^16-1=65,535
-   If this is not enough, change type and recompile */
-typedef unsigned short int dimensionType;
-static const dimensionType maxDimension = USHRT_MAX - 1;
+
+/* this accomodates grid sizes up to 2^32-2; the grid has to fit in
+   memory long before that */
+typedef unsigned int dimensionType;
+static const dimensionType maxDimension = UINT_MAX - 1;
+
+
+/* the grid data is one block aligned to this many bytes (a cache line) */
+#define GRID_ALIGN 64
+
+/* how the values of a grid are stored */
+typedef enum {
+  GRID_FLOAT = 0,   /* as floats */
+  GRID_INT16 = 1    /* as 16-bit integers, for integer-valued DEMs; half
+		       the memory */
+} GridStorage;
+
+/* the order of the values in the data block */
+typedef enum {
+  GRID_ROWMAJOR = 0,  /* row after row */
+  GRID_BLOCKED = 1    /* GRID_BLOCK x GRID_BLOCK blocks, row after row of
+			 blocks and each block row after row, padded out at
+			 the right and bottom edges; a sweep around the
+			 viewpoint stays in the same few blocks (and pages)
+			 for a while instead of changing rows every step */
+} GridLayout;
+#define GRID_BLOCK_BITS 6
+#define GRID_BLOCK (1 << GRID_BLOCK_BITS)
 
 
 typedef struct grid_header {
@@ -32,8 +60,29 @@ typedef struct grid_header {
 typedef struct grid_ {
     GridHeader *hd;
 
-    /*two dimensional array holding all the values in the grid */
-    float **grid_data;
+    /*how the values are stored: in fdata, or in sdata for GRID_INT16 */
+    GridStorage storage;
+
+    /*the order of the values, and the blocks across a GRID_BLOCKED row */
+    GridLayout layout;
+    dimensionType nblockcols;
+
+    /*all the values in the grid, in one aligned block; (i,j) is at
+      grid_index(grid, i, j) */
+    float *fdata;
+    short *sdata;
+
+    /*the nodata value as stored in sdata */
+    short snodata;
+
+    /*bytes of the gio_alloc() mapping the data is in, or 0 if it was
+      allocated with posix_memalign() */
+    size_t mapped;
+
+    /*where the grid holds data rather than NODATA, worked out when it
+      is read, in row-major order whatever the layout; NULL for a grid
+      that was not read from a file */
+    GridValid *valid;
 
     float minvalue;		/*the minimum value in the grid */
     float maxvalue;		/*the maximum value in the grid */
@@ -41,7 +90,6 @@ typedef struct grid_ {
 
 
 
-
 /* read the header of the grid stored in this file;*/
 void read_header_from_arcascii_filename(GridHeader *hd, char* fname);
 
@@ -64,28 +112,75 @@ void fprint_grid_header(FILE * fp, GridHeader * hd);
 int is_header_nodata(GridHeader * hd, float value);
 
 int is_nodata(Grid * grid, float value);
-/* return 1 iff grid(i,j) is Nodata; 0 otherwise */
-int is_nodata_at(Grid* grid, dimensionType i, dimensionType j);
 
-/* return the value at (i,j) */
-float get(Grid* grid, dimensionType i, dimensionType j);
 
-/* set data[i][j] in teh grid to this value */
-void set(Grid* g, dimensionType i, dimensionType j, float value);
+/* the accessors are inline, so the sweeps read the grid with no call
+   and no row pointer in between */
 
-/* set data[i][j] in teh grid to NODATA */
-void set_nodata(Grid* g, dimensionType i, dimensionType j);
+/* return the index of (i,j) in the data block */
+static inline size_t grid_index(Grid* grid, dimensionType i, dimensionType j) {
+  assert(grid && i< grid->hd->nrows && j<grid->hd->ncols);
+  if (grid->layout == GRID_BLOCKED)
+    return ((((size_t)(i >> GRID_BLOCK_BITS) * grid->nblockcols +
+	      (j >> GRID_BLOCK_BITS)) << (2 * GRID_BLOCK_BITS)) +
+	    ((i & (GRID_BLOCK - 1)) << GRID_BLOCK_BITS) + (j & (GRID_BLOCK - 1)));
+  return (size_t)i * grid->hd->ncols + j;
+}
+
+/* return 1 iff grid(i,j) is Nodata; 0 otherwise */
+static inline int is_nodata_at(Grid* grid, dimensionType i, dimensionType j) {
+  if (grid->storage == GRID_INT16)
+    return grid->sdata[grid_index(grid, i, j)] == grid->snodata;
+  return fabs(grid->fdata[grid_index(grid, i, j)] - grid->hd->nodata_value)
+    < 0.000001;
+}
+
+/* return the value at (i,j) */
+static inline float get(Grid* grid, dimensionType i, dimensionType j) {
+  if (grid->storage == GRID_INT16)
+    return grid->sdata[grid_index(grid, i, j)];
+  return grid->fdata[grid_index(grid, i, j)];
+}
+
+/* set data[i][j] in the grid to this value */
+static inline void set(Grid* grid, dimensionType i, dimensionType j,
+		       float value) {
+  if (grid->storage == GRID_INT16)
+    grid->sdata[grid_index(grid, i, j)] = (short)value;
+  else
+    grid->fdata[grid_index(grid, i, j)] = value;
+}
+
+/* set data[i][j] in the grid to NODATA */
+static inline void set_nodata(Grid* grid, dimensionType i, dimensionType j) {
+  if (grid->storage == GRID_INT16)
+    grid->sdata[grid_index(grid, i, j)] = grid->snodata;
+  else
+    grid->fdata[grid_index(grid, i, j)] = grid->hd->nodata_value;
+}
 
 
 /* create and return an empty grid */
 Grid *create_empty_grid(void);
 
-/*allocate memory for grid data, grid must have a header */
+/*map the data of grids allocated from now on with gio_alloc(), placed as
+  flags (GIO_ALLOC_HUGE, GIO_ALLOC_INTERLEAVE) asks; 0 goes back to
+  posix_memalign() */
+void set_grid_alloc(int flags);
+
+/*allocate memory for grid data, grid must have a header, a storage and a
+  layout */
 void alloc_grid_data(Grid * grid);
 
-/*scan an arcascii file and fill the information in the given structure */
+/*scan an arcascii file (or a binary or tiled grid, see gridio.h) and fill the
+  information in the given structure */
 Grid *read_grid_from_arcascii_file(char *filename);
 
+/*as read_grid_from_arcascii_file(), storing the values as given; with
+  GRID_INT16 every value must be a whole number that fits in a short */
+Grid *read_grid_from_arcascii_file_as(char *filename, GridStorage storage,
+				      GridLayout layout);
+
 /*destroy the structure and reclaim all memory allocated */
 void destroy_grid(Grid * grid);
 
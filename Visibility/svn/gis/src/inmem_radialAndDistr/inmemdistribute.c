@@ -7,6 +7,7 @@
 #include "inmemdistribute.h"
 #include "radial.h"
 #include "event.h"
+#include "event_quicksort.h"
 #include "status_structure.h"
 
 #define PRINT_DISTRIBUTE if(0)
@@ -23,11 +24,11 @@
    the number of visible cells.  Assumes the eventList has already
    been sorted by distance. returns the number of cells visible from
    the viewpoint, and sets the number of dropped cells */
-int distribute_and_sweep(Event* eventList, int nevents, 
+int distribute_and_sweep(EventList* eventList, 
 			 int NUM_SECTORS,  int  BASECASE_THRESHOLD,  
-			 Viewpoint* vp, int* dropped) {
+			 Viewpoint* vp, Grid* grid, int* dropped) {
   
-  assert(eventList && vp && dropped);
+  assert(eventList && vp && grid && dropped);
 
   /* 1 means each sector is allocated large enough to hold its
 	 theoretical worst-case size; 2 means it is half the theoretical
@@ -37,14 +38,15 @@ int distribute_and_sweep(Event* eventList, int nevents,
   //  printf("MAX_SECTOR=%d \n", MAX_SECTOR_FACTOR);
   
   ALLOC_DEBUG {
-    double size =  (double)(nevents * sizeof(Event)/MAX_SECTOR_FACTOR); 
+    double size =  (double)(eventList->n * (sizeof(uint64_t) + sizeof(uint32_t))
+			    / MAX_SECTOR_FACTOR); 
     printf("allocated %dx2 sectors size %d, total %.1f MB\n", 
 	   NUM_SECTORS, (int) size,  2*NUM_SECTORS*size/(1024.0 * 1024.0)); 
     fflush(stdout); 
   }
-  return  distribute_sector(eventList, nevents, 
+  return  distribute_sector(eventList, 
 			    MAX_SECTOR_FACTOR, NUM_SECTORS,BASECASE_THRESHOLD, 
-			    NULL, 0, vp, 0, 2 * M_PI, FALSE, dropped);
+			    NULL, vp, grid, 0, 2 * M_PI, FALSE, dropped);
 }
 
 
@@ -54,19 +56,22 @@ int distribute_and_sweep(Event* eventList, int nevents,
 /* recursively distribute each sector, solving it in memory if it is
    small enough, otherwise split the sector and distribute the events
    into it */
-int distribute_sector(Event* eventList, int nevents, 
+int distribute_sector(EventList* eventList, 
 		      int MAX_SECTOR_FACTOR,
 		      int NUM_SECTORS, int  BASECASE_THRESHOLD,  
-		      Event* enterBndEvents,  int enterBnd_length, 
-		      Viewpoint* vp, double start_angle,  double end_angle, 
+		      EventList* enterBndEvents, 
+		      Viewpoint* vp, Grid* grid, 
+		      double start_angle,  double end_angle, 
 		      int deleteEventList, int* dropped_events) {
   
   
-  assert(eventList &&  vp && dropped_events);
+  assert(eventList &&  vp && grid && dropped_events);
+  long nevents = eventList->n; 
+  long enterBnd_length = enterBndEvents ? enterBndEvents->n : 0; 
   
   PRINT_DISTRIBUTE {
     printf("***DISTRIBUTE sector [%.4f, %.4f]***   ", start_angle, end_angle); 
-    printf("nevents=%d,bnd-events=%d BASECASE_THRESHOLD=%d, NUM_SECTORS=%d\n", 
+    printf("nevents=%ld,bnd-events=%ld BASECASE_THRESHOLD=%d, NUM_SECTORS=%d\n", 
 	   nevents, enterBnd_length,BASECASE_THRESHOLD,NUM_SECTORS); 
     fflush(stdout); 
   }
@@ -74,7 +79,7 @@ int distribute_sector(Event* eventList, int nevents,
   /* this is the largest sector size that we'll provide for; in theory
      teh max is nevents; hopefully in practice it will be closer to
      nevents/NUM_SECTORS */
-  int MAX_SECTOR =  (nevents+enterBnd_length)/MAX_SECTOR_FACTOR; 
+  long MAX_SECTOR =  (nevents+enterBnd_length)/MAX_SECTOR_FACTOR; 
   
   int nvis;
   
@@ -83,9 +88,9 @@ int distribute_sector(Event* eventList, int nevents,
   //*******************************************************
   if(nevents < BASECASE_THRESHOLD) {
     /* dropped does not change */
-    nvis =  distribute_basecase(eventList, nevents, enterBndEvents, 
-				enterBnd_length, start_angle, end_angle, 
-				vp, deleteEventList);
+    nvis =  distribute_basecase(eventList, enterBndEvents, 
+				start_angle, end_angle, 
+				vp, grid, deleteEventList);
     return nvis;
   }
 
@@ -96,29 +101,22 @@ int distribute_sector(Event* eventList, int nevents,
   //*******************************************************/
 
   /* sector[i] will hold all the events in the i-th sector */
-  Event** sector;
-  sector = (Event**) malloc (NUM_SECTORS * sizeof(Event*));
+  EventList** sector;
+  sector = (EventList**) malloc (NUM_SECTORS * sizeof(EventList*));
   assert(sector);
   int i;
   for(i = 0; i < NUM_SECTORS; i++){
     /*  allocate enough space for each sector */
-    //sector[i] = (Event*)malloc((nevents+enter Bnd_length)*sizeof(Event));
+    //sector[i] = create_event_list(nevents+enterBnd_length, grid->hd->nrows, grid->hd->ncols);
     /* LT: it turns out that malloc fails for a large number of
        sectors; naturally, for 200+ sectors and 500k events total, it
        is a waste to allocate each sector of max size */ 
     
-    sector[i] = (Event*)malloc(MAX_SECTOR * sizeof(Event));
-    assert(sector[i]);
-  }
-  
-  /* keep an array of ints that holds the number of events in a given
-     sector.  sector_length[i] is the number of events in sector i */
-  int* sector_length;
-  sector_length = (int*) malloc(NUM_SECTORS * sizeof(int));
-  assert(sector_length); 
-  /*initialzie to 0*/
-  for(i = 0; i < NUM_SECTORS; i++) {
-    sector_length[i] = 0;
+    sector[i] = create_event_list(MAX_SECTOR, grid->hd->nrows, grid->hd->ncols);
+    if (!sector[i]) {
+      printf("distribute_sector: could not allocate sector %d\n", i);
+      exit(1); 
+    }
   }
 
   /*the array of gradient values, one for each sector; the gradient is
@@ -135,22 +133,15 @@ int distribute_sector(Event* eventList, int nevents,
   /*make an array of events, one for each boundary, to hold events for
     cells on the boundary of sectors. sectorBnd[i] will keep all the
     cells crossing into sector i and below. */
-  Event** sectorBnd = (Event**) malloc (NUM_SECTORS * sizeof(Event*));
+  EventList** sectorBnd = (EventList**) malloc (NUM_SECTORS * sizeof(EventList*));
   assert(sectorBnd); 
   /* again, make sure we have enough space to hold nevent events */
   for(i=0; i< NUM_SECTORS; i++) {
-    //sectorBnd[i] = (Event*) malloc ((nevents + enterBnd_length) * sizeof(Event));
-	sectorBnd[i] = (Event*) malloc (MAX_SECTOR * sizeof(Event));
-    assert(sectorBnd[i]);
-  }
-
-  /* keep track of sectorBnd length as well */
-  int* sectorBnd_length;
-  sectorBnd_length = (int*) malloc(NUM_SECTORS * sizeof(int));
-  assert(sectorBnd_length); 
-  /*initialize to 0 */
-  for(i = 0; i < NUM_SECTORS; i++) {
-    sectorBnd_length[i] = 0;
+    sectorBnd[i] = create_event_list(MAX_SECTOR, grid->hd->nrows, grid->hd->ncols);
+    if (!sectorBnd[i]) {
+      printf("distribute_sector: could not allocate sector boundary %d\n", i);
+      exit(1); 
+    }
   }
   
   /* keep stats for each sector */
@@ -177,12 +168,15 @@ int distribute_sector(Event* eventList, int nevents,
   CONCENTRIC SWEEP
   *****************************************************************/
   Event e;
+  uint64_t key; 
   double exit_angle, enter_angle;
   int exit_sec, enter_sec, sec;
   int boundaryEvents = 0;
+  long k; 
 
-  for(i = 0; i < nevents; i++){
-    e = eventList[i];
+  for(k = 0; k < nevents; k++){
+    get_event(eventList, k, grid, &e);
+    key = eventList->key[k]; 
 
     /* skip the viewpoint */
     if(e.row == vp->row && e.col == vp->col) {
@@ -202,7 +196,7 @@ int distribute_sector(Event* eventList, int nevents,
    /*  total[sec]++; */
 
     /* insert event into the sector, if it is not occulded */
-    insert_event_in_sector(e, sec, sector[sec], sector_length, MAX_SECTOR, high[sec], vp, dropped_events);
+    insert_event_in_sector(e, key, sector[sec], high[sec], vp, dropped_events);
 
     /* handle the corresponding events of this event */
     switch(e.eventType) {
@@ -247,7 +241,7 @@ int distribute_sector(Event* eventList, int nevents,
 	  the corresonding ENTER event must be inserted in secterBnd[sec] */
 	e.eventType = ENTERING_EVENT;
 	BND_DEBUG {printf("BND event "); print_event(e); printf("in bndSector %d\n", sec); fflush(stdout);}
-	insert_event_in_sector(e, sec, sectorBnd[sec], sectorBnd_length, MAX_SECTOR,  high[sec], vp, dropped_events);
+	insert_event_in_sector(e, key, sectorBnd[sec], high[sec], vp, dropped_events);
       }
       else {
 	/* long event */
@@ -257,7 +251,7 @@ int distribute_sector(Event* eventList, int nevents,
 	/* the corresponding ENTER event must insert itself in sectorBnd[sec] */
 	e.eventType = ENTERING_EVENT;
 	BND_DEBUG {printf("BND event "); print_event(e); printf("in bndSector %d\n", sec); fflush(stdout);}
-	insert_event_in_sector(e, sec, sectorBnd[sec], sectorBnd_length, MAX_SECTOR, high[sec], vp, dropped_events);
+	insert_event_in_sector(e, key, sectorBnd[sec], high[sec], vp, dropped_events);
       }
       break;
 
@@ -267,23 +261,23 @@ int distribute_sector(Event* eventList, int nevents,
 
     /* distribute the border events */
   if(enterBndEvents)
-    distribute_bnd_events(enterBndEvents, enterBnd_length,  NUM_SECTORS, MAX_SECTOR, sectorBnd, 
-			  sectorBnd_length, vp, start_angle, end_angle, high, 
+    distribute_bnd_events(enterBndEvents, NUM_SECTORS, sectorBnd, 
+			  vp, grid, start_angle, end_angle, high, 
 			  dropped_events);
 
   /* save some memory before recursion */
   /*if the flag is set, delete the eventList */
-  if(deleteEventList) free(eventList);
+  if(deleteEventList) destroy_event_list(eventList);
   /* delete boundary events  */
-  if(enterBndEvents) free(enterBndEvents);
+  if(enterBndEvents) destroy_event_list(enterBndEvents);
 
 
   /*recursively solve each sector */
   nvis = 0; 
   for(i=0; i < NUM_SECTORS; i++) {
-    nvis += distribute_sector(sector[i], sector_length[i], 
+    nvis += distribute_sector(sector[i], 
 			      MAX_SECTOR_FACTOR, NUM_SECTORS, BASECASE_THRESHOLD, 
-			      sectorBnd[i], sectorBnd_length[i], vp, 
+			      sectorBnd[i], vp, grid, 
 			      start_angle+i*((end_angle-start_angle)/NUM_SECTORS), 
 			      start_angle+(i+1)*((end_angle-start_angle)/NUM_SECTORS), 
 			      TRUE, dropped_events);
@@ -294,11 +288,9 @@ int distribute_sector(Event* eventList, int nevents,
   /* the sectors are passed as event lists recursively into the
      function, and they are deleted above */ 
   free(sector);
-  free(sector_length);
     /* the sector boundaries are passed as event lists recursively into
      the function, and they are deleted above */ 
   free(sectorBnd);
-  free(sectorBnd_length);
   free(high); 
 
   PRINT_DISTRIBUTE {
@@ -319,13 +311,12 @@ int distribute_sector(Event* eventList, int nevents,
    of the sub-sectors of this sector. Note: the boundary streams of
    the sub-sectors may not be empty; as a result, events get appended
    at the end, and they will not be sorted by distance from the vp. */
-void distribute_bnd_events(Event* bndEvents, int bndEvents_length, 
-			   int NUM_SECTORS, int MAX_SECTOR, 
-			   Event** sectorBnd, int* sectorBnd_length, 
-			   Viewpoint * vp, double start_angle, 
+void distribute_bnd_events(EventList* bndEvents, int NUM_SECTORS, 
+			   EventList** sectorBnd, 
+			   Viewpoint * vp, Grid* grid, double start_angle, 
 			   double end_angle, double *high, int* dropped_events) {
 
-  assert(bndEvents && sectorBnd && vp && high);
+  assert(bndEvents && sectorBnd && vp && grid && high);
   //PRINT_DISTRIBUTE {
     //printf("Distribute boundary of sector [ %.4f, %.4f]  nevents=%d\n ",
     //start_angle, end_angle, bndEvents_length);
@@ -335,11 +326,11 @@ void distribute_bnd_events(Event* bndEvents, int bndEvents_length,
   Event e;
   double exit_angle;
   int exit_sec;
-  int i;
-  for(i = 0; i < bndEvents_length; i++) {
+  long i;
+  for(i = 0; i < bndEvents->n; i++) {
     
     /* get the i-th event */
-    e = bndEvents[i];
+    get_event(bndEvents, i, grid, &e);
     
     /*     printf("in dist_bnd_events, event %d at %d,%d has type =
 	   %d\n", i, e.row, e.col, e.eventType); fflush(stdout); */
@@ -356,9 +347,8 @@ void distribute_bnd_events(Event* bndEvents, int bndEvents_length,
     assert(exit_sec >= 0 && exit_sec < NUM_SECTORS);
 
     /*insert this event in the boundary stream of this sector */
-    insert_event_in_sector(e, exit_sec, sectorBnd[exit_sec],
-			   sectorBnd_length, MAX_SECTOR, high[exit_sec], 
-			   vp, dropped_events);
+    insert_event_in_sector(e, bndEvents->key[i], sectorBnd[exit_sec],
+			   high[exit_sec], vp, dropped_events);
     
   }
   return;
@@ -420,26 +410,27 @@ int is_almost_on_boundary(double angle, int sec, double start_angle,
 
 
 
-/* insert event e into the sector if it is not occuded by high_s */
-void insert_event_in_sector(Event e, int s, Event* sector, int* sector_length, 
-			    int MAX_SECTOR, 
+/* append event e, with the given key, to the sector if it is not
+   occuded by high_s */
+void insert_event_in_sector(Event e, uint64_t key, EventList* sector, 
 			    double high_s, Viewpoint* vp, int* dropped) {
   
-  assert(sector && sector_length && vp && dropped);
+  assert(sector && vp && dropped);
   
   /* sector is not dropped - add it to the sector and increment the
      count and the sector length */
   if(!(is_center_gradient_occluded(e, high_s, vp))) {
 	/* insert in sector */
-	if (sector_length[s] >= MAX_SECTOR) {
+	if (sector->n >= sector->size) {
 	  /* no more space in this sector */
 	  printf("insert_event_in_sector:  sector is full\n");
 	  exit(1); 
 	}
-    sector[sector_length[s]] = e;
-    sector_length[s]++;
-    BND_DEBUG{printf("inserted at sector %d  sector_length=%d\n", 
-		     s, sector_length[s]);}
+    sector->key[sector->n] = key; 
+    sector->cell[sector->n] = event_cell(e.row * sector->ncols + e.col, 
+					 e.eventType); 
+    sector->n++;
+    BND_DEBUG{printf("inserted in sector, sector_length=%ld\n", sector->n);}
   }
   /* the sector has been dropped - increment the count */
   else {
@@ -566,14 +557,16 @@ void print_stats(Viewpoint* vp, int insertCount, int dropCount,
 
 
 /* base case of distribution.  */
-int distribute_basecase(Event* eventList, int nevents, 
-			Event* enterBndEvents,  int enterBnd_length, 
+int distribute_basecase(EventList* eventList, 
+			EventList* enterBndEvents, 
 			double start_angle,  double end_angle,
-			Viewpoint* vp, int deleteEventList) {
+			Viewpoint* vp, Grid* grid, int deleteEventList) {
   
-  assert(eventList && enterBndEvents && vp);
+  assert(eventList && vp && grid);
+  long nevents = eventList->n; 
+  long enterBnd_length = enterBndEvents ? enterBndEvents->n : 0; 
   PRINT_DISTRIBUTE {
-    printf("solve basecase, nevents=%d, nbnd events=%d.. ", 
+    printf("solve basecase, nevents=%ld, nbnd events=%ld.. ", 
 	   nevents, enterBnd_length); 
     fflush(stdout);
   }
@@ -581,8 +574,8 @@ int distribute_basecase(Event* eventList, int nevents,
 
   /* if there is no event in this sector, then nothing to do */
   if (nevents ==0) {
-    if(deleteEventList) free(eventList);
-    if  (enterBndEvents)  free(enterBndEvents);
+    if(deleteEventList) destroy_event_list(eventList);
+    if  (enterBndEvents)  destroy_event_list(enterBndEvents);
     PRINT_DISTRIBUTE {
       printf("basecase done. Total visible cells=0\n"); 
       fflush(stdout); 
@@ -592,22 +585,22 @@ int distribute_basecase(Event* eventList, int nevents,
 
   
   /* sort the eventList by angle */
-  qsort(&eventList[0], nevents, sizeof(Event), compare_events_angle);
+  event_quicksort_radial(eventList);
 
   /*create the status structure */
   StatusList* status_struct = create_status_struct();
 
   /* initialize the status structuure with all ENTER events whose EXIT
      events are inside this sector */
-  Event e;
   StatusNode sn;
-  int i;
+  long i;
+  uint32_t c; 
   double max; 
   for(i = 0; i < enterBnd_length; i++) {
-    e = enterBndEvents[i];
-    sn.col = e.col;
-    sn.row = e.row;
-    sn.elev = e.elev;
+    c = enterBndEvents->cell[i];
+    sn.col = event_index(c) % grid->hd->ncols;
+    sn.row = event_index(c) / grid->hd->ncols;
+    sn.elev = get(grid, sn.row, sn.col);
     calculate_dist_n_gradient(&sn, vp);
     insert_into_status_struct(sn, status_struct);
   }
@@ -616,13 +609,13 @@ int distribute_basecase(Event* eventList, int nevents,
   /*sweep the event list */
   int nvis = 0; 
   for(i = 0; i < nevents; i++) {
-    e = eventList[i];
-    sn.col = e.col;
-    sn.row = e.row;
-    sn.elev = e.elev;
+    c = eventList->cell[i];
+    sn.col = event_index(c) % grid->hd->ncols;
+    sn.row = event_index(c) / grid->hd->ncols;
+    sn.elev = get(grid, sn.row, sn.col);
     calculate_dist_n_gradient(&sn, vp);
 
-    switch(e.eventType) {
+    switch(event_type(c)) {
     case ENTERING_EVENT:
       insert_into_status_struct(sn, status_struct);
       break;
@@ -645,8 +638,8 @@ int distribute_basecase(Event* eventList, int nevents,
 
   /* cleanup */
   delete_status_structure(status_struct);
-  if(deleteEventList)  free(eventList);
-  if(enterBndEvents) free(enterBndEvents);
+  if(deleteEventList)  destroy_event_list(eventList);
+  if(enterBndEvents) destroy_event_list(enterBndEvents);
 
   PRINT_DISTRIBUTE {
     printf("basecase done. Total visible cells=%d\n", nvis); 
@@ -2,6 +2,7 @@
 #define __INMEMDISTRIBUTE_H
 
 #include "event.h"
+#include "grid.h"
 #define EPSILON .00000001          /* used for comparing doubles */
 
 
@@ -11,27 +12,28 @@
    recursively. Returns the number of visible cells. Returns the
    number of visible cells.  Assumes the eventList has already been
    sorted by distance. */
-int distribute_and_sweep(Event* eventList, int nevents,
+int distribute_and_sweep(EventList* eventList, 
 			 int NUM_SECTORS, int  BASECASE_THRESHOLD,  
-			 Viewpoint* vp, int* dropped);
+			 Viewpoint* vp, Grid* grid, int* dropped);
 
 
 /* recursively distribute each sector, solving it in memory if it is
    small enough, otherwise split the sector and distribute the events
    into it */
-int distribute_sector(Event* eventList, int nevents, 
+int distribute_sector(EventList* eventList, 
 		      int MAX_SECTOR_FACTOR,
 		      int NUM_SECTORS, int  BASECASE_THRESHOLD,  
-		      Event* enterBndEvents, int enterBnd_length, 
-		      Viewpoint* vp, double start_angle, double end_angle, 
+		      EventList* enterBndEvents, 
+		      Viewpoint* vp, Grid* grid, 
+		      double start_angle, double end_angle, 
 		      int deleteEventList, int* dropped);
 
 
 /* base case of distribution.  */
-int distribute_basecase(Event* eventList, int nevents, 
-			Event* enterBndEvents,  int enterBnd_length, 
+int distribute_basecase(EventList* eventList, 
+			EventList* enterBndEvents, 
 			double start_angle,  double end_angle,
-			Viewpoint* vp, int deleteEventList);
+			Viewpoint* vp, Grid* grid, int deleteEventList);
 
 
 /* bndEvents is an array of events that cross into the sector's
@@ -39,10 +41,10 @@ int distribute_basecase(Event* eventList, int nevents,
    of the sub-sectors of this sector. Note: the boundary streams of
    the sub-sectors may not be empty; as a result, events get appended
    at the end, and they will not be sorted by distance from the vp. */
-void distribute_bnd_events(Event* bndEvents, int bndEvents_length, 
-			   int NUM_SECTORS, int MAX_SECTOR_SIZE,
-			   Event** sectorBnd, int* secotrBnd_length, 
-			   Viewpoint * vp, double start_angle,double end_angle,
+void distribute_bnd_events(EventList* bndEvents, int NUM_SECTORS, 
+			   EventList** sectorBnd, 
+			   Viewpoint * vp, Grid* grid, 
+			   double start_angle,double end_angle,
 			   double *high, int* dropped_events);
 
 
@@ -62,9 +64,10 @@ int is_almost_on_boundary(double angle, int sec, double start_angle,
    epsion from boundary angle */
 int is_almost_on_boundry_helper(double angle, double boundary_angle);
 
-/* insert event e into the sector if it is not occuded by high_s */
-void insert_event_in_sector(Event e, int s, Event* sector, int* sector_length, 
-			    int MAX_SECTOR, double high_s, Viewpoint* vp, int* dropped);
+/* append event e, with the given key, to the sector if it is not
+   occuded by high_s */
+void insert_event_in_sector(Event e, uint64_t key, EventList* sector, 
+			    double high_s, Viewpoint* vp, int* dropped);
 
 
 /* returns 1 if the center of event is occluded by the gradient, which
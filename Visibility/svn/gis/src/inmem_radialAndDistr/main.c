@@ -3,20 +3,26 @@
 #include <assert.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "grid.h"
+#include "gridio.h"
 #include "event.h"
 #include "status_structure.h"
 #include "radial.h"
 #include "inmemdistribute.h"
 #include "rtimer.h"
+#include "perfcount.h"
 #include "multiviewshedOptions.h"
 #include "event_quicksort.h"
+#include "event_radixsort.h"
 
 
 //#define SYSTEM_SORT
-//if this flag is defined the sweep uses system qsort; otherwise it
-//uses a (hopefully faster) quicksort defined in event_quicksort.h
+//if this flag is defined the sweep uses system qsort unless -q says
+//otherwise; if not, it uses a (hopefully faster) quicksort defined in
+//event_quicksort.h
 
 
 /* ********************************************************************** */
@@ -72,12 +78,31 @@ void set_viewpoint(Viewpoint* vp, int row, int col, float elev);
 /* compute the viewshed using a distribution sweep */
 void compute_multiviewshed_distribution(MultiviewOptions opt, int DO_EVERY, 
 					Grid* ingrid,Grid* outgrid,
-					int nevents, Event* eventlist);
+					EventList* eventlist);
 
 /* compute the viewshed using a radial sweep */
 void compute_multiviewshed_radial(MultiviewOptions opt, int DO_EVERY,  
 				  Grid* ingrid, Grid* outgrid,
-				  int nevents, Event* eventlist);
+				  EventList* eventlist, 
+				  EventOffset* offsets, long noffsets);
+
+/* compute the viewshed count of every DO_EVERY-th point, in
+   opt.nthreads threads */
+void sweep_all_viewpoints(MultiviewOptions opt, int DO_EVERY, 
+			  Grid* ingrid, Grid* outgrid,
+			  EventList* eventlist, 
+			  EventOffset* offsets, long noffsets, 
+			  int* nviewsheds, int* total_dropped);
+
+
+/* sort the eventlist in radial order with the sort opt.sort names; a
+   radix sort runs in nthreads threads */
+void sort_events_radial(MultiviewOptions opt, EventList* eventlist, 
+			int nthreads);
+
+/* sort the eventlist in distance order, likewise */
+void sort_events_distance(MultiviewOptions opt, EventList* eventlist, 
+			  int nthreads);
 
 
 void print_init_timings(Rtimer initTime);
@@ -86,9 +111,9 @@ void print_init_timings(Rtimer initTime);
 
 
 void print_usage() {
-  printf("usage:\nmultiviewshed -i <inputname> -o <outputname> -v <nbviewpoints> -s <sweepmode> -b <basecase> -f <fanout> -r <row> -c <col> -w\n");
+  printf("usage:\nmultiviewshed -i <inputname> -o <outputname> -v <nbviewpoints> -s <sweepmode> -b <basecase> -f <fanout> -r <row> -c <col> -e <storage> -l <layout> -a <alloc> -t <threads> -p -q <sort> -w\n");
   printf("OPTIONS:\n");
-  printf("\t-i input map name.\n"); 
+  printf("\t-i input map name, arcascii, binary (.bgr) or tiled (.tgr).\n"); 
   printf("\t-o output map name.\n"); 
   printf("\t-v number of viewpoints to compute viewsheds for [default: all].\n"); 
   printf("\t-r row of viewpoint [relevant only if NVIEWSHEDS=1]\n"); 
@@ -96,6 +121,12 @@ void print_usage() {
   printf("\t-s sweep mode.[radial or distribute]. \n"); 
   printf("\t-b basecase [relevant only if mode=distribute].\n"); 
   printf("\t-f fanout [relevant only if mode=distribute].\n"); 
+  printf("\t-e elevation storage [float or int16; int16 halves the grid for\n\t   integer-valued DEMs. default: float].\n"); 
+  printf("\t-l elevation layout [rowmajor or blocked; blocked keeps 64x64\n\t   blocks together for the sweeps. default: rowmajor].\n"); 
+  printf("\t-a grid allocation [default, huge, interleave or huge,interleave;\n\t   huge pages and/or pages spread over the NUMA nodes. default: default].\n"); 
+  printf("\t-t threads sweeping viewpoints at once, each with its own event\n\t   list; with one viewpoint, threads of the radix sort [default: 1].\n"); 
+  printf("\t-p presort: sort the events of every offset from a viewpoint by\n\t   angle once, and filter that list for each viewpoint instead of\n\t   sorting [relevant only if mode=radial].\n"); 
+  printf("\t-q event sort [quick, system or radix; radix sorts 64-bit keys\n\t   of the events instead of the events. default: quick].\n"); 
   printf("\t-w verbose.\n"); 
 }
 
@@ -112,10 +143,20 @@ void  parse_args(int argc,char* argv[], MultiviewOptions *options) {
   options->NUM_SECTORS = 0; 
   options->verbose=0;
   options->vc = options->vr = -1; 
+  options->int16 = 0; 
+  options->blocked = 0; 
+  options->alloc = 0; 
+  options->nthreads = 1; 
+  options->presorted = 0; 
+#ifdef SYSTEM_SORT
+  options->sort = SORT_SYSTEM; 
+#else 
+  options->sort = SORT_QUICK; 
+#endif
 
   int gotinput=0, gotoutput=0, gotmode=0;
   char c; 
-  while ((c = getopt(argc, argv, "i:o:v:s:b:f:r:c:w")) != -1) {
+  while ((c = getopt(argc, argv, "i:o:v:s:b:f:r:c:e:l:a:t:pq:w")) != -1) {
     switch (c) {
     case 'i':
       /* inputfile name */
@@ -161,12 +202,70 @@ void  parse_args(int argc,char* argv[], MultiviewOptions *options) {
       /* fanout/NUM_SECTORS */
       options->NUM_SECTORS = atoi(optarg); 
       break; 
+    case 'e': 
+      /* how to store the elevations */
+      if(strcmp(optarg,"float")==0)
+	options->int16 = 0; 
+      else if (strcmp(optarg,"int16")==0)
+	options->int16 = 1; 
+      else {
+	printf("unknown option %s: use  -e: [float|int16]\n", optarg); 
+	exit(1);
+      }
+      break; 
+    case 'l': 
+      /* how to lay out the elevations */
+      if(strcmp(optarg,"rowmajor")==0)
+	options->blocked = 0; 
+      else if (strcmp(optarg,"blocked")==0)
+	options->blocked = 1; 
+      else {
+	printf("unknown option %s: use  -l: [rowmajor|blocked]\n", optarg); 
+	exit(1);
+      }
+      break; 
+    case 'a': 
+      /* how to allocate the grids */
+      if(strcmp(optarg,"default")==0)
+	options->alloc = 0; 
+      else if (strcmp(optarg,"huge")==0)
+	options->alloc = GIO_ALLOC_HUGE; 
+      else if (strcmp(optarg,"interleave")==0)
+	options->alloc = GIO_ALLOC_INTERLEAVE; 
+      else if (strcmp(optarg,"huge,interleave")==0)
+	options->alloc = GIO_ALLOC_HUGE | GIO_ALLOC_INTERLEAVE; 
+      else {
+	printf("unknown option %s: use  -a: [default|huge|interleave|huge,interleave]\n", optarg); 
+	exit(1);
+      }
+      break; 
+    case 't': 
+      /* number of threads */
+      options->nthreads = atoi(optarg); 
+      break; 
+    case 'p': 
+      options->presorted = 1; 
+      break; 
+    case 'q': 
+      /* how to sort the events */
+      if(strcmp(optarg,"quick")==0)
+	options->sort = SORT_QUICK; 
+      else if (strcmp(optarg,"system")==0)
+	options->sort = SORT_SYSTEM; 
+      else if (strcmp(optarg,"radix")==0)
+	options->sort = SORT_RADIX; 
+      else {
+	printf("unknown option %s: use  -q: [quick|system|radix]\n", optarg); 
+	exit(1);
+      }
+      break; 
     case 'w': 
       options->verbose = 1; 
       break;
     case '?':
         if (optopt == 'i' || optopt == 'o' || optopt == 'n' ||
-	    optopt == 's' || optopt == 'b' || optopt == 'f')
+	    optopt == 's' || optopt == 'b' || optopt == 'f' || optopt == 'e' ||
+	    optopt == 'l' || optopt == 'a' || optopt == 't' || optopt == 'q')
 	  fprintf(stderr, "Option -%c requires an argument.\n", optopt);
 	else if (isprint(optopt)) 
 	  fprintf(stderr, "Unknown option '-%c'.\n", optopt);
@@ -206,6 +305,10 @@ void  parse_args(int argc,char* argv[], MultiviewOptions *options) {
     printf("NUM_SECTORS cannot be <0\n");
     exit(1); 
   }
+  if (options->nthreads < 1) {
+    printf("threads cannot be <1\n");
+    exit(1); 
+  }
   
   if (options->SWEEP_MODE ==SWEEP_DISTRIBUTE) 
     assert(options->BASECASE_THRESHOLD > 0 &&   options->NUM_SECTORS > 0);
@@ -226,11 +329,24 @@ void record_args(MultiviewOptions opt) {
   else 
     printf("MODE: radial sweep, base=%d, fanout=%d\n", 
 	   opt.BASECASE_THRESHOLD,opt.NUM_SECTORS);
-#ifdef SYSTEM_SORT
-  printf("using system qsort\n");
-#else 
-  printf("using own sort\n");
-#endif
+  if (opt.int16) 
+    printf("elevations stored as int16\n");
+  if (opt.blocked) 
+    printf("elevations stored in blocks\n");
+  if (opt.alloc & GIO_ALLOC_HUGE) 
+    printf("grids on huge pages\n");
+  if (opt.alloc & GIO_ALLOC_INTERLEAVE) 
+    printf("grids interleaved over the NUMA nodes\n");
+  if (opt.nthreads > 1) 
+    printf("%d threads\n", opt.nthreads);
+  if (opt.presorted) 
+    printf("presorted event offsets\n");
+  if (opt.sort == SORT_SYSTEM) 
+    printf("using system qsort\n");
+  else if (opt.sort == SORT_RADIX) 
+    printf("using radix sort\n");
+  else 
+    printf("using own sort\n");
  printf("------------------------");
 }
 
@@ -265,8 +381,11 @@ int main(int argc, char* argv[]) {
 
 
   //read input raster 
+  set_grid_alloc(options.alloc); 
   printf("reading input grid %s ", options.input_name); 
-  Grid *ingrid = read_grid_from_arcascii_file(options.input_name);
+  Grid *ingrid = read_grid_from_arcascii_file_as(options.input_name, 
+					options.int16 ? GRID_INT16 : GRID_FLOAT,
+					options.blocked ? GRID_BLOCKED : GRID_ROWMAJOR);
   assert(ingrid); 
   printf("..done\n");
 
@@ -292,10 +411,16 @@ int main(int argc, char* argv[]) {
   /* INITIALIZE EVENT LIST */
   /* **************************************** */
 
-  /*allocate the eventlist to hold the maximum number of events possible*/
-  Event* eventList;
-  eventList = (Event*) malloc(ncols * nrows * 3 * sizeof(Event));
-  assert(eventList);
+  /*allocate the eventlist to hold the maximum number of events
+    possible: 3 for each point with data*/
+  EventList* eventList;
+  size_t npoints = ingrid->valid ? ingrid->valid->count :
+    (size_t)ncols * nrows;
+  eventList = create_event_list(npoints * 3, nrows, ncols);
+  if (!eventList) {
+    fprintf(stderr, "could not allocate the event list\n");
+    exit(1);
+  }
   
   /*initialize the eventList with the info common to all viewpoints */
   long  nevents;
@@ -305,6 +430,19 @@ int main(int argc, char* argv[]) {
   printf("nb events = %ld\n", nevents);
   rt_stop(initTime); 
   print_init_timings(initTime); 
+
+  /*the angle-sorted offsets, which replace the per-viewpoint sort of
+    the radial sweep over many viewpoints */
+  EventOffset* offsets = NULL; 
+  long noffsets = 0; 
+  if (options.presorted && options.SWEEP_MODE == SWEEP_RADIAL && 
+      options.NVIEWSHEDS > 1) {
+    rt_start(initTime);
+    noffsets = init_event_offsets(&offsets, nrows, ncols); 
+    printf("nb offsets = %ld\n", noffsets);
+    rt_stop(initTime); 
+    print_init_timings(initTime); 
+  }
   
  
 
@@ -317,20 +455,31 @@ int main(int argc, char* argv[]) {
   /* start going through the data and considering each point, in turn,
      as a viewshed */
  
+  /* count the cache misses of the sweeps, to compare the layouts */
+  PerfCount pc; 
+  char counts[256]; 
+  pc_open(&pc); 
+  pc_start(&pc); 
   if (options.SWEEP_MODE == SWEEP_DISTRIBUTE)  {
     assert(options.BASECASE_THRESHOLD >0 && options.NUM_SECTORS >0);
     compute_multiviewshed_distribution(options, DO_EVERY,
-				       ingrid, outgrid,  nevents, eventList); 
+				       ingrid, outgrid, eventList); 
   }
   else { 
     compute_multiviewshed_radial(options, DO_EVERY, ingrid, outgrid, 
-				 nevents, eventList);
+				 eventList, offsets, noffsets);
   }
+  pc_stop(&pc); 
+  pc_sprint(counts, &pc); 
+  printf("%20s: %s\n", "sweep cache", counts);
+  pc_close(&pc); 
 
 
   /* ****************************** */
   /*all sweeping and computing done - clean up */
-  free(eventList);
+  destroy_event_list(eventList);
+  free(offsets);
+  event_radixsort_free(); 
 
   //write output grid to file 
   save_grid_to_arcascii_file(outgrid, options.output_name); 
@@ -361,7 +510,7 @@ int main(int argc, char* argv[]) {
 /* ************************************************************ */
 void compute_multiviewshed_distribution(MultiviewOptions opt, int DO_EVERY, 
 					Grid* ingrid, Grid* outgrid, 
-					int nevents, Event* eventlist) {
+					EventList* eventlist) {
 
   
   assert(ingrid && outgrid && eventlist); 
@@ -375,12 +524,6 @@ void compute_multiviewshed_distribution(MultiviewOptions opt, int DO_EVERY,
   int dropped, total_dropped=0;   /*   dropped cells during distribution */
   int nviewsheds = 0;
   Rtimer sweepTotalTime;
-  int nrows, ncols, row, col;
-
-   /* get raster rows and cols */
-  nrows = ingrid->hd->nrows;
-  ncols = ingrid->hd->ncols;
-
 
 
   /* ************************************************************ */
@@ -398,18 +541,14 @@ void compute_multiviewshed_distribution(MultiviewOptions opt, int DO_EVERY,
       set_viewpoint(&vp, opt.vr, opt.vc, crt_elev); 
       
       /*set the angles for all the events in the eventlist*/
-      set_event_list_angles_and_dist(nevents, eventlist, &vp);
+      set_event_list_angles_and_dist(eventlist, &vp, opt.nthreads);
       
       /*sort the eventlist*/
-#ifdef SYSTEM_SORT
-      qsort(eventlist, nevents, sizeof(Event), compare_events_angle);
-#else 
-      event_quicksort_radial(eventlist, nevents);
-#endif
+      sort_events_radial(opt, eventlist, opt.nthreads);
       /*compute the visibility of the viewpoint */
       dropped = 0; 
-      nvis = distribute_and_sweep(eventlist, nevents, opt.NUM_SECTORS, 
-				  opt.BASECASE_THRESHOLD, &vp, &dropped);
+      nvis = distribute_and_sweep(eventlist, opt.NUM_SECTORS, 
+				  opt.BASECASE_THRESHOLD, &vp, ingrid, &dropped);
       
       /* update total number of drpped cells */
       total_dropped += dropped; 
@@ -432,75 +571,9 @@ void compute_multiviewshed_distribution(MultiviewOptions opt, int DO_EVERY,
  
  /* ************************************************************ */
   //else  compute VC for many/all viewpoints
-
-  for(row = 0; row < nrows; row++) {
-    for(col = 0; col < ncols; col++) {
-      
-      if(((row*ncols)+col) % DO_EVERY != 0){
-	/* do not compute the viewshed of this point: set this point
-	   in the output as NODATA */
-	set_nodata(outgrid, row, col);
-	continue;
-      }
-      
-      /* check if this point is nodata.  If it is, write it as
-	 such in output raster and continue*/
-      if (is_nodata_at(ingrid, row, col)) {
-	set_nodata(outgrid, row, col);
-	if (opt.NVIEWSHEDS < 10) 
-	  //don't print unless very few viewsheds
-	  printf("point at (%5d,%5d): NODATA; ignoring\n",row, col); 
-	fflush(stdout);  
-	continue; 
-      }
-      
-      /* compute the viewshed of this point */
-      nviewsheds++; 
-      
-      /* print progress to user, one dot per viewpoint */
-      //printf("."); fflush(stdout); 
-     
-
-      /*set the viewpoint to be this point */
-      float crt_elev = get(ingrid, row, col); 
-      set_viewpoint(&vp, row, col, crt_elev); 
-      
-      /*set the angles for all the events in the eventlist*/
-      set_event_list_angles_and_dist(nevents, eventlist, &vp);
-      
-      /*sort the eventList by distance */
-      //printf("\nsorting concentrically.."); fflush(stdout);
-#ifdef SYSTEM_SORT
-      qsort(eventlist, nevents, sizeof(Event), compare_events_dist);
-#else 
-      event_quicksort_distance(eventlist, nevents);
-#endif
-      /*distribute and sweep */
-      dropped = 0; 
-      nvis = distribute_and_sweep(eventlist, nevents, opt.NUM_SECTORS, 
-				  opt.BASECASE_THRESHOLD, &vp, &dropped);
-      
-      /* update total number of drpped cells */
-      total_dropped += dropped; 
-      
-      /* write nvis to output raster */
-      set(outgrid, row, col, nvis);
-      
-#ifdef INTERPOLATE_RESULT 
-      //insert this poitn in the array of computed viewsheds 
-      Nvis x = {row,col,nvis}; 
-      viewsheds[nvp] = x; 
-      nvp++;
-#endif
-
-      // print this point 
-      if (opt.verbose) {
-	printf("point at (%5d,%5d): ",row, col); fflush(stdout);  
-	printf("nvis=%10d, dropped=%10d\n", nvis, dropped); fflush(stdout);
-      }
-
-    } /* for col */
-  } /* for row */
+  rt_start(sweepTotalTime);
+  sweep_all_viewpoints(opt, DO_EVERY, ingrid, outgrid, eventlist, 
+		       NULL, 0, &nviewsheds, &total_dropped); 
   rt_stop(sweepTotalTime);
   printf("\ndone.");
   
@@ -513,7 +586,7 @@ void compute_multiviewshed_distribution(MultiviewOptions opt, int DO_EVERY,
     float avg_dropped;
     avg_dropped = (float)total_dropped / (float)nviewsheds;
     printf("average nb. cells dropped = %f (%.2f %%)\n", 
-	   avg_dropped, avg_dropped/(float)nevents * 100);
+	   avg_dropped, avg_dropped/(float)eventlist->n * 100);
     
     char timeused[100];
     rt_sprint_safe_average(timeused, sweepTotalTime, nviewsheds); 
@@ -555,20 +628,16 @@ void set_viewpoint(Viewpoint* vp, int row, int col, float elev) {
    viewpoint. */
 void compute_multiviewshed_radial(MultiviewOptions opt, int DO_EVERY, 
 				  Grid* ingrid, Grid* outgrid, 
-				  int nevents, Event* eventlist) {
+				  EventList* eventlist, 
+				  EventOffset* offsets, long noffsets) {
   assert(ingrid && outgrid && eventlist); 
   printf("\n----------------------------------------\n");
   printf("Starting radial sweep, total %d viewpoints.\n", opt.NVIEWSHEDS); 
   
   int nvis, nviewsheds=0;
   Rtimer sweepTotalTime;
-  int nrows, ncols, row, col;
   Viewpoint vp; 
 
-  /* get raster rows and cols */
-  nrows = ingrid->hd->nrows;
-  ncols = ingrid->hd->ncols;
-  
    
   /* ************************************************************ */
   //compute just one viewshed 
@@ -582,17 +651,12 @@ void compute_multiviewshed_radial(MultiviewOptions opt, int DO_EVERY,
       printf("point at (%5d,%5d): NODATA\n",opt.vr, opt.vc); 
     else {
       /*set the angles for all the events in the eventlist*/
-      set_event_list_angles_and_dist(nevents, eventlist, &vp);
+      set_event_list_angles_and_dist(eventlist, &vp, opt.nthreads);
       
       /*sort the eventlist*/
-#ifdef SYSTEM_SORT
-      qsort(eventlist, nevents, sizeof(Event), compare_events_angle);
-#else 
-      event_quicksort_radial(eventlist, nevents);
-#endif
+      sort_events_radial(opt, eventlist, opt.nthreads);
       /*compute the visibility of the viewpoint */
-      nvis = sweep_radial(eventlist,nevents, ingrid->grid_data[opt.vr],
-		     vp,ingrid);
+      nvis = sweep_radial(eventlist, vp,ingrid);
       rt_stop(sweepTotalTime); 
 
       printf("v=(%5d,%5d): nvis=%10d\n", opt.vr, opt.vc, nvis); fflush(stdout); 
@@ -609,21 +673,118 @@ void compute_multiviewshed_radial(MultiviewOptions opt, int DO_EVERY,
   /* ************************************************************ */
   //else  compute VC for many/all viewpoints
   rt_start(sweepTotalTime);
-  for(row = 0; row < nrows; row++) {
-    for (col = 0; col < ncols; col++) {
-      
-      
-      if (((row*ncols)+col) % DO_EVERY !=0){
-	/* do not compute the viewshed of this point: set this point
-	   in the output as NODATA */
-	set_nodata(outgrid, row, col);
-	continue;
-      }
-      
-      /*check if this point is nodata.  If it is, write it as such in
-	output raster and continue*/
-      if (is_nodata_at(ingrid, row, col)) {
-	set_nodata(outgrid, row, col);
+  sweep_all_viewpoints(opt, DO_EVERY, ingrid, outgrid, eventlist, 
+		       offsets, noffsets, &nviewsheds, NULL); 
+  rt_stop(sweepTotalTime);
+  
+  printf("\ndone.\n");
+  printf("----------------------------------------\n");
+  printf("RADIAL sweep:\n"); 
+  printf("total nviewsheds=%d\n", nviewsheds);
+  if (nviewsheds==0) {
+    printf("%20s: 0\n", "total");
+  } else {
+    char timeused[100];
+    rt_sprint_safe_average(timeused, sweepTotalTime, nviewsheds); 
+    printf("AVERAGE viewshed time per viewpoint: \n");
+    printf("%20s: %s\n", "total", timeused);
+    
+    printf("TOTAL time: \n");
+    rt_sprint_safe_average(timeused, sweepTotalTime, 1); 
+    printf("%20s: %s\n", "total", timeused);
+  }
+  return;
+}
+
+
+
+
+
+
+
+/* ************************************************************ */
+/* sort the eventlist in radial order with the sort opt.sort names */
+void sort_events_radial(MultiviewOptions opt, EventList* eventlist, 
+			int nthreads) {
+
+  switch (opt.sort) {
+  case SORT_SYSTEM: 
+    event_qsort_radial(eventlist);
+    break; 
+  case SORT_RADIX: 
+    event_radixsort_radial(eventlist, nthreads);
+    break; 
+  default: 
+    event_quicksort_radial(eventlist);
+  }
+}
+
+
+/* sort the eventlist in distance order with the sort opt.sort names */
+void sort_events_distance(MultiviewOptions opt, EventList* eventlist, 
+			  int nthreads) {
+
+  switch (opt.sort) {
+  case SORT_SYSTEM: 
+    event_qsort_distance(eventlist);
+    break; 
+  case SORT_RADIX: 
+    event_radixsort_distance(eventlist, nthreads);
+    break; 
+  default: 
+    event_quicksort_distance(eventlist);
+  }
+}
+
+
+
+
+/* ************************************************************ */
+/* viewpoints a thread claims at a time; small, since one viewpoint
+   can cost far more than another (those near NODATA or the edges see
+   few cells) */
+#define VIEWPOINT_CHUNK 8
+
+/* one thread of sweep_all_viewpoints() */
+typedef struct _sweepThread {
+  MultiviewOptions* opt; 
+  int DO_EVERY; 
+  Grid *ingrid, *outgrid; 
+  EventList* eventlist; /* this thread's own event list */
+  EventOffset* offsets; /* the angle-sorted event offsets, or NULL */
+  long noffsets; 
+  long* next;           /* the next viewpoint to hand out, shared */
+  long nviewpoints;     /* viewpoints 0..nviewpoints-1 are points
+			   0, DO_EVERY, 2*DO_EVERY.. of the grid */
+  int nviewsheds;       /* viewsheds this thread computed */
+  int dropped;          /* and the cells it dropped, if distributing */
+  pthread_t thread; 
+} SweepThread; 
+
+
+/* compute the viewshed counts of the viewpoints claimed from the
+   shared counter until there are none left */
+void* sweep_viewpoints(void* arg) {
+
+  SweepThread* t = (SweepThread*) arg; 
+  MultiviewOptions opt = *t->opt; 
+  int ncols = t->ingrid->hd->ncols; 
+  long v, end, i; 
+  int row, col, nvis, dropped; 
+  Viewpoint vp; 
+
+  while ((v = __sync_fetch_and_add(t->next, VIEWPOINT_CHUNK)) 
+	 < t->nviewpoints) {
+    end = v + VIEWPOINT_CHUNK; 
+    if (end > t->nviewpoints) end = t->nviewpoints; 
+    for (; v < end; v++) {
+      i = v * t->DO_EVERY; 
+      row = i / ncols; 
+      col = i % ncols; 
+
+      /*check if this point is nodata.  If it is, it stays NODATA
+	in the output raster*/
+      if (is_nodata_at(t->ingrid, row, col)) {
 	if (opt.NVIEWSHEDS < 10) 
 	  //don't print unless very few viewsheds
 	  printf("point at (%5d,%5d): NODATA; ignoring\n",row, col); 
@@ -632,65 +793,170 @@ void compute_multiviewshed_radial(MultiviewOptions opt, int DO_EVERY,
       }
       
       /* compute the viewshed of this point */
-      nviewsheds++; 
-      
-      /* print progress to the user: one dot per viewshed computed*/
-      //printf("."); fflush(stdout); 
-      //printf("point at (%5d,%5d): ",row, col); fflush(stdout);  
+      t->nviewsheds++; 
       
       /*set the viewpoint to be this point */
-      float crt_elev = get(ingrid, row, col); 
+      float crt_elev = get(t->ingrid, row, col); 
       set_viewpoint(&vp, row, col, crt_elev); 
       
-      /*set the angles for all the events in the eventlist*/
-      set_event_list_angles_and_dist(nevents, eventlist, &vp);
+      if (opt.SWEEP_MODE == SWEEP_DISTRIBUTE) {
+	/*set the angles for all the events in the eventlist*/
+	set_event_list_angles_and_dist(t->eventlist, &vp, 1);
+
+
+	/*sort the eventList by distance; the other threads are busy
+	  with their own viewpoints, so in this one */
+	sort_events_distance(opt, t->eventlist, 1);
+	/*distribute and sweep */
+	dropped = 0; 
+	nvis = distribute_and_sweep(t->eventlist, 
+				    opt.NUM_SECTORS, opt.BASECASE_THRESHOLD, 
+				    &vp, t->ingrid, &dropped);
+	t->dropped += dropped; 
+      } else if (t->offsets) {
+	/*the events of this viewpoint, already in angular order */
+	filter_event_offsets(t->eventlist, t->offsets, t->noffsets, 
+			     t->ingrid, &vp); 
+	nvis = sweep_radial(t->eventlist, vp, t->ingrid);
+	dropped = 0; 
+      } else {
+	/*set the angles for all the events in the eventlist*/
+	set_event_list_angles_and_dist(t->eventlist, &vp, 1);
+
+	/*sort the eventlist*/
+	sort_events_radial(opt, t->eventlist, 1);
       
-	
-      /*sort the eventlist*/
-      /* note: this should be done with an optimized quicksort */
-      qsort(eventlist, nevents, sizeof(Event), compare_events_angle);
+	/*compute the visibility of the viewpoint */
+	nvis = sweep_radial(t->eventlist, vp, t->ingrid);
+	dropped = 0; 
+      }
       
-      /*compute the visibility of the viewpoint */
-      nvis = sweep_radial(eventlist,nevents, ingrid->grid_data[row],vp,ingrid);
-	
-      /* write nvis to the output raster */
-      set(outgrid, row, col, nvis);
+      /* write nvis to the output raster; no other thread writes
+	 this point */
+      set(t->outgrid, row, col, nvis);
       
 #ifdef INTERPOLATE_RESULT 
       //insert this poitn in the array of computed viewsheds 
       Nvis x = {row,col,nvis}; 
-      viewsheds[nvp] = x; 
-      nvp++;
+      viewsheds[__sync_fetch_and_add(&nvp, 1)] = x; 
 #endif
 
       //print this point 
-      if (opt.verbose) printf("v=(%5d,%5d): nvis=%10d\n", row, col, nvis);
-
-      } /* for col */
-  } /* for row */
-  rt_stop(sweepTotalTime);
-  
-  printf("\ndone.\n");
-  printf("----------------------------------------\n");
-  printf("RADIAL sweep:\n"); 
-  printf("total nviewsheds=%d\n", nviewsheds);
-  if (nviewsheds==0) {
-    printf("%20s: 0\n", "total");
-  } else {
-    char timeused[100];
-    rt_sprint_safe_average(timeused, sweepTotalTime, nviewsheds); 
-    printf("AVERAGE viewshed time per viewpoint: \n");
-    printf("%20s: %s\n", "total", timeused);
-    
-    printf("TOTAL time: \n");
-    rt_sprint_safe_average(timeused, sweepTotalTime, 1); 
-    printf("%20s: %s\n", "total", timeused);
+      if (opt.verbose) {
+	if (opt.SWEEP_MODE == SWEEP_DISTRIBUTE) 
+	  printf("point at (%5d,%5d): nvis=%10d, dropped=%10d\n", 
+		 row, col, nvis, dropped); 
+	else 
+	  printf("v=(%5d,%5d): nvis=%10d\n", row, col, nvis);
+	fflush(stdout); 
+      }
+    }
   }
-  return;
+  /* the buffers of this thread's radix sorts, if any */
+  event_radixsort_free(); 
+  return NULL; 
 }
 
 
-
+/* ************************************************************ */
+/* compute the viewshed count of every DO_EVERY-th point of ingrid
+   into outgrid, and NODATA everywhere else.  The viewpoints are handed
+   out VIEWPOINT_CHUNK at a time to opt.nthreads threads, each sorting
+   its own copy of the eventlist; with one thread the eventlist itself
+   is used.  Given the angle-sorted offsets, a radial sweep fills its
+   eventlist from them instead.  A thread that cannot be started, or
+   given its own eventlist, leaves its viewpoints to the others.  Sets
+   the number of viewsheds computed and, if total_dropped is not NULL,
+   the cells the distribution sweep dropped. */
+void sweep_all_viewpoints(MultiviewOptions opt, int DO_EVERY, 
+			  Grid* ingrid, Grid* outgrid, 
+			  EventList* eventlist, 
+			  EventOffset* offsets, long noffsets, 
+			  int* nviewsheds, int* total_dropped) {
+
+  assert(ingrid && outgrid && eventlist && nviewsheds); 
+  int nrows = ingrid->hd->nrows; 
+  int ncols = ingrid->hd->ncols; 
+  int row, col, i, result, nthreads; 
+  long next = 0; 
+
+  /* the points that are not viewpoints, or are NODATA, stay NODATA */
+  for (row = 0; row < nrows; row++) 
+    for (col = 0; col < ncols; col++) 
+      set_nodata(outgrid, row, col); 
+
+  SweepThread* threads = (SweepThread*) malloc(opt.nthreads * 
+					       sizeof(SweepThread)); 
+  if (!threads) {
+    fprintf(stderr, "could not allocate %d sweep threads\n", opt.nthreads); 
+    exit(1); 
+  }
+  for (i = 0; i < opt.nthreads; i++) {
+    threads[i].opt = &opt; 
+    threads[i].DO_EVERY = DO_EVERY; 
+    threads[i].ingrid = ingrid; 
+    threads[i].outgrid = outgrid; 
+    threads[i].offsets = offsets; 
+    threads[i].noffsets = noffsets; 
+    threads[i].next = &next; 
+    threads[i].nviewpoints = ((long)nrows * ncols + DO_EVERY - 1) / DO_EVERY; 
+    threads[i].nviewsheds = 0; 
+    threads[i].dropped = 0; 
+    if (i == 0) {
+      threads[i].eventlist = eventlist; 
+    } else if (offsets) {
+      /* filter_event_offsets() fills it in for each viewpoint */
+      threads[i].eventlist = create_event_list(eventlist->size, nrows, ncols); 
+    } else {
+      /* the sweeps only reorder the events, so any order will do;
+	 the keys are set for each viewpoint */
+      threads[i].eventlist = create_event_list(eventlist->n, nrows, ncols); 
+      if (threads[i].eventlist) {
+	memcpy(threads[i].eventlist->cell, eventlist->cell, 
+	       eventlist->n * sizeof(uint32_t)); 
+	threads[i].eventlist->n = eventlist->n; 
+      }
+    }
+    if (!threads[i].eventlist) {
+      fprintf(stderr, "could not allocate the event list of sweep thread %d;"
+	      " running on %d\n", i, i); 
+      break; 
+    }
+  }
+  nthreads = i; 
+
+  /* the calling thread is the first of them; the viewpoints are
+     claimed from a shared counter, so the threads that start do the
+     work of any that do not */
+  for (i = 1; i < nthreads; i++) {
+    result = pthread_create(&threads[i].thread, NULL, sweep_viewpoints, 
+			    &threads[i]); 
+    if (result != 0) {
+      fprintf(stderr, "could not start sweep thread %d (%s); running on"
+	      " %d\n", i, strerror(result), i); 
+      break; 
+    }
+  }
+  int started = i; 
+  sweep_viewpoints(&threads[0]); 
+
+  *nviewsheds = threads[0].nviewsheds; 
+  if (total_dropped) *total_dropped = threads[0].dropped; 
+  for (i = 1; i < nthreads; i++) {
+    if (i < started) {
+      result = pthread_join(threads[i].thread, NULL); 
+      if (result != 0) {
+	fprintf(stderr, "could not join sweep thread %d (%s)\n", i, 
+		strerror(result)); 
+	exit(1); 
+      }
+      *nviewsheds += threads[i].nviewsheds; 
+      if (total_dropped) *total_dropped += threads[i].dropped; 
+    }
+    destroy_event_list(threads[i].eventlist); 
+  }
+  free(threads); 
+}
 
 
 
@@ -9,6 +9,13 @@ typedef enum {
 } SweepMode;
 
 
+typedef enum {
+  SORT_QUICK = 0, 
+  SORT_SYSTEM = 1, 
+  SORT_RADIX = 2
+} SortMode;
+
+
 
 
 typedef struct _multiviewOptions {
@@ -50,6 +57,19 @@ typedef struct _multiviewOptions {
   
   int memSize; /* main memory size */
 
+  int int16; /* store the input elevations as 16-bit integers */
+
+  int blocked; /* keep the input elevations in 64x64 blocks */
+
+  int alloc; /* how to place the grids in memory: GIO_ALLOC_* flags */
+
+  int nthreads; /* threads sweeping viewpoints at once */
+
+  int presorted; /* radial sweeps filter one angle-sorted list of event
+		    offsets instead of sorting for every viewpoint */
+
+  SortMode sort; /* how to sort the events for each viewpoint */
+
 } MultiviewOptions; 
 
 #endif
@@ -12,24 +12,25 @@
 #define VISIBLE_DEBUG  if(0)
 
 /*compute the visibility of the viewpoint based on the events in the
-  eventList and data.  Return the number of visible cells.*/
-int sweep_radial(Event* eventList, long nevents, float* data, Viewpoint vp, 
-		 Grid* grid) {
+  list and the viewpoint's row of the grid.  Return the number of
+  visible cells.*/
+int sweep_radial(EventList* list, Viewpoint vp, Grid* grid) {
   
-  assert(eventList && data);
+  assert(list && grid && list->ncols == grid->hd->ncols);
 
   StatusList *status_struct = create_status_struct();
   assert(status_struct); 
 
-  /* initialize the status struct with the non-null values in data */
+  /* initialize the status struct with the non-null values in the
+     viewpoint's row, right of the viewpoint */
   StatusNode sn;
   long i;
   for (i = vp.col +1; i < grid->hd->ncols; i++) {
-    if(!is_nodata(grid, data[i])) {
+    if(!is_nodata_at(grid, vp.row, i)) {
       /*now fill the status node */
       sn.col = i;
       sn.row = vp.row;
-      sn.elev = data[i];
+      sn.elev = get(grid, vp.row, i);
       /*calculate distance to vp and Gradient, store them in sn */
       calculate_dist_n_gradient(&sn, &vp);
       /* insert sn into the status structure */
@@ -41,29 +42,33 @@ int sweep_radial(Event* eventList, long nevents, float* data, Viewpoint vp,
   /* sweep the eventlist */
   int nvis = 0; /*the number of visible cells.  Will be returned later */
   double max; 
-  Event* e;
-  for (i = 0; i < nevents; i++) {
+  uint32_t c, index, vp_index = (uint32_t)vp.row * list->ncols + vp.col;
+  for (i = 0; i < list->n; i++) {
 
-    /* get out one event at a time and process it according to its type */
-    e = &(eventList[i]);
+    /* get out one event at a time and process it according to its
+       type; the sweep only needs its cell */
+    c = list->cell[i];
+    index = event_index(c);
     
     /* skip the viewpoint */
-    if(e->col == vp.col && e->row == vp.row) {
+    if(index == vp_index) {
       continue;
     }
 
-    sn.col = e->col;
-    sn.row = e->row;
-    sn.elev = e->elev;
+    sn.col = index % list->ncols;
+    sn.row = index / list->ncols;
+    sn.elev = get(grid, sn.row, sn.col);
     //sn.dist_to_vp = e->dist; 
     /*calculate the (vertical) gradient wrt vp*/
     // calculate_gradient(&sn, &vp);
     calculate_dist_n_gradient(&sn, &vp);
     RADIAL_DEBUG {
-    printf("event %ld:",i);  print_event (*e); 
+    Event e; 
+    get_event(list, i, grid, &e); 
+    printf("event %ld:",i);  print_event (e); 
     printf("sn.dist=%lf, sn.gradient=%lf\n", sn.dist_to_vp, sn.gradient); 
     }
-    switch(e->eventType) {
+    switch(event_type(c)) {
 
     case ENTERING_EVENT:
       /*insert the node into the status structure */
@@ -99,6 +104,7 @@ int sweep_radial(Event* eventList, long nevents, float* data, Viewpoint vp,
       break;
     }
   }
+  delete_status_structure(status_struct);
   return nvis;
 }
 
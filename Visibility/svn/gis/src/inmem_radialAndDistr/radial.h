@@ -8,8 +8,8 @@
 
 
 /*compute the visibility of the viewpoint based on the events in the
-  eventList and data.  Return the number of visible cells.*/
-int sweep_radial(Event* eventList, long nevents, float* data, Viewpoint vp, 
-		 Grid* grid); 
+  list and the viewpoint's row of the grid.  Return the number of
+  visible cells.*/
+int sweep_radial(EventList* list, Viewpoint vp, Grid* grid); 
   
 #endif
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "grid.h"
+#include "event.h"
+#include "rtimer.h"
+#include "event_quicksort.h"
+#include "event_radixsort.h"
+
+
+/* sortbench: times the event sorts of multiviewshed against each
+   other.  For a few viewpoints of each grid it sorts the same event
+   list in radial and in distance order with the system qsort, the
+   quicksort and the radix sort, checks that they agree, and prints the
+   average time per viewpoint of each. */
+
+
+#define NSORTS 3
+static const char* sort_names[NSORTS] = {"system", "quick", "radix"};
+
+
+void print_usage() {
+  printf("usage:\nsortbench [-v <nbviewpoints>] [-t <threads>] <grid> [<grid>..]\n");
+  printf("OPTIONS:\n");
+  printf("\t-v number of viewpoints to sort the events of, per grid [default: 10].\n");
+  printf("\t-t threads of the radix sort [default: 1].\n");
+}
+
+
+/* sort the events in radial (or distance) order with sort k */
+void sort_radial(int k, EventList* list, int nthreads) {
+  switch (k) {
+  case 0: event_qsort_radial(list); break;
+  case 1: event_quicksort_radial(list); break;
+  default: event_radixsort_radial(list, nthreads);
+  }
+}
+
+void sort_distance(int k, EventList* list, int nthreads) {
+  switch (k) {
+  case 0: event_qsort_distance(list); break;
+  case 1: event_quicksort_distance(list); break;
+  default: event_radixsort_distance(list, nthreads);
+  }
+}
+
+
+/* return 1 if a and b are the same radial order: the events of the
+   viewpoint cell all have key 0 and can come in any order */
+int same_radial_order(EventList* a, EventList* b) {
+  long i;
+  for (i = 0; i < a->n; i++) {
+    if (a->key[i] != b->key[i])
+      return 0;
+    if (a->key[i] != 0 && a->cell[i] != b->cell[i])
+      return 0;
+  }
+  return 1;
+}
+
+/* events at the same distance can come in any order */
+int same_distance_order(EventList* a, EventList* b) {
+  long i;
+  for (i = 0; i < a->n; i++)
+    if ((uint32_t)a->key[i] != (uint32_t)b->key[i])
+      return 0;
+  return 1;
+}
+
+
+/* copy the events of src into dst */
+void copy_events(EventList* dst, EventList* src) {
+  memcpy(dst->key, src->key, src->n * sizeof(uint64_t));
+  memcpy(dst->cell, src->cell, src->n * sizeof(uint32_t));
+  dst->n = src->n;
+}
+
+
+/* ************************************************************ */
+/* time the sorts on the events of nvp viewpoints of the grid */
+void bench_grid(char* name, int nvp, int nthreads) {
+
+  Grid* grid = read_grid_from_arcascii_file_as(name, GRID_FLOAT, GRID_ROWMAJOR);
+  assert(grid);
+  int nrows = grid->hd->nrows, ncols = grid->hd->ncols;
+  size_t npoints = grid->valid ? grid->valid->count : (size_t)nrows * ncols;
+
+  EventList* eventlist = create_event_list(npoints * 3, nrows, ncols);
+  EventList* sorted[NSORTS];
+  int k;
+  for (k = 0; k < NSORTS; k++)
+    sorted[k] = create_event_list(npoints * 3, nrows, ncols);
+  for (k = 0; k < NSORTS; k++)
+    if (!eventlist || !sorted[k]) {
+      printf("%s: not enough memory for the event lists\n", name);
+      exit(1);
+    }
+  long nevents = init_event_list(eventlist, grid);
+
+  Rtimer radial[NSORTS], distance[NSORTS];
+  for (k = 0; k < NSORTS; k++) {
+    rt_zero(radial[k]);
+    rt_zero(distance[k]);
+  }
+
+  /* viewpoints spread evenly over the grid, skipping NODATA */
+  long DO_EVERY = (long)nrows * ncols / nvp, i;
+  int row, col, done = 0, ok = 1;
+  Viewpoint vp;
+  if (DO_EVERY < 1) DO_EVERY = 1;
+  for (i = DO_EVERY / 2; i < (long)nrows * ncols && done < nvp; i += DO_EVERY) {
+    row = i / ncols;
+    col = i % ncols;
+    if (is_nodata_at(grid, row, col))
+      continue;
+    vp.row = row;
+    vp.col = col;
+    vp.elev = get(grid, row, col);
+    set_event_list_angles_and_dist(eventlist, &vp, nthreads);
+    done++;
+
+    /* every sort starts from the same list */
+    for (k = 0; k < NSORTS; k++) {
+      copy_events(sorted[k], eventlist);
+      rt_start(radial[k]);
+      sort_radial(k, sorted[k], nthreads);
+      rt_stop_and_accumulate(radial[k]);
+      if (k > 0 && !same_radial_order(sorted[0], sorted[k])) {
+	printf("v=(%5d,%5d): %s radial order differs\n", row, col, sort_names[k]);
+	ok = 0;
+      }
+    }
+    for (k = 0; k < NSORTS; k++) {
+      copy_events(sorted[k], eventlist);
+      rt_start(distance[k]);
+      sort_distance(k, sorted[k], nthreads);
+      rt_stop_and_accumulate(distance[k]);
+      if (k > 0 && !same_distance_order(sorted[0], sorted[k])) {
+	printf("v=(%5d,%5d): %s distance order differs\n", row, col, sort_names[k]);
+	ok = 0;
+      }
+    }
+  }
+
+  printf("%s: rows = %d, cols = %d, nb events = %ld, %d viewpoints%s\n",
+	 name, nrows, ncols, nevents, done, ok ? "" : " (ORDERS DIFFER)");
+  char timeused[100];
+  for (k = 0; done > 0 && k < NSORTS; k++) {
+    printf("%10s radial: %10.3f ms/viewpoint %s\n", sort_names[k],
+	   radial[k].tw_usec / 1000 / done, rt_sprint_total(timeused, radial[k]));
+    printf("%10s dist:   %10.3f ms/viewpoint %s\n", sort_names[k],
+	   distance[k].tw_usec / 1000 / done, rt_sprint_total(timeused, distance[k]));
+  }
+  fflush(stdout);
+
+  for (k = 0; k < NSORTS; k++)
+    destroy_event_list(sorted[k]);
+  destroy_event_list(eventlist);
+  event_radixsort_free();
+  destroy_grid(grid);
+}
+
+
+
+/************************************************************/
+int main(int argc, char* argv[]) {
+
+  int nvp = 10, nthreads = 1;
+  int c;
+  while ((c = getopt(argc, argv, "v:t:")) != -1) {
+    switch (c) {
+    case 'v':
+      nvp = atoi(optarg);
+      break;
+    case 't':
+      nthreads = atoi(optarg);
+      break;
+    default:
+      print_usage();
+      exit(1);
+    }
+  }
+  if (optind >= argc || nvp < 1 || nthreads < 1) {
+    print_usage();
+    exit(1);
+  }
+
+  for (; optind < argc; optind++)
+    bench_grid(argv[optind], nvp, nthreads);
+  return 0;
+}
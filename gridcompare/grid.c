@@ -5,6 +5,10 @@
 
 
 #include "grid.h"
+#include "gridio.h"
+
+/*values save_grid_to_arcascii_file() runs through fun() at a time */
+#define SAVE_BATCH (1 << 22)
 
 
 /* ------------------------------------------------------------ */
@@ -152,20 +156,22 @@ Grid *create_empty_grid()
    the dimensions */
 void alloc_grid_data(Grid * pgrid)
 {
+    dimensionType i;
+    float *block;
+
     assert(pgrid);
     assert(pgrid->hd);
-
     pgrid->grid_data = (float **)malloc(pgrid->hd->nrows * sizeof(float *));
     assert(pgrid->grid_data);
 
-    dimensionType i;
-
+    /*one block for all the rows, so the loader can fill it in one go */
+    block = (float *)malloc((size_t)pgrid->hd->nrows * pgrid->hd->ncols *
+			    sizeof(float));
+    assert(block);
     for (i = 0; i < pgrid->hd->nrows; i++) {
-	  pgrid->grid_data[i] =
-	    (float *)malloc(pgrid->hd->ncols * sizeof(float));
-	  assert(pgrid->grid_data[i]);
+      pgrid->grid_data[i] = block + (size_t)i * pgrid->hd->ncols;
     }
-	
+
 #ifdef _DEBUG_ON
     printf("**DEBUG: allocGridData\n");
     fflush(stdout);
@@ -174,51 +180,72 @@ void alloc_grid_data(Grid * pgrid)
     return;
 }
 
+/* ------------------------------------------------------------ */
+/*make a header from the header of a grid file */
+static GridHeader *header_from_grid_file(GridFile *gf)
+{
+    GridHeader *hd = (GridHeader *) malloc(sizeof(GridHeader));
+    assert(hd);
+
+    /*check that you dont lose precision */
+    if (gf->hd.nrow > maxDimension || gf->hd.ncol > maxDimension) {
+	fprintf(stderr, "grid dimension too big for current precision\n");
+	printf("change type and re-compile\n");
+	exit(1);
+    }
+    hd->nrows = (dimensionType) gf->hd.nrow;
+    hd->ncols = (dimensionType) gf->hd.ncol;
+    hd->xllcorner = gf->hd.xllcorner;
+    hd->yllcorner = gf->hd.yllcorner;
+    hd->cellsize = gf->hd.cellsize;
+    hd->nodata_value = gf->hd.nodata;
+    return hd;
+}
+
 /* ------------------------------------------------------------ */
 /*reads header and data from file */
 Grid *read_grid_from_arcascii_file(char *filename)
 {
+    GridFile *gf;
+    Grid *grid;
+    size_t i, n;
+    int first_flag, result;
+    float value;
 
     assert(filename);
-    FILE *fp = fopen(filename, "r");
-
-    assert(fp);
-
-    Grid *grid = create_empty_grid();
+    gf = gio_open(filename);
+    if (!gf) {
+	printf("could not open file %s\n", filename);
+	exit(1);
+    }
 
-    grid->hd = fread_header_from_arcascii_file(fp);
+    grid = create_empty_grid();
+    grid->hd = header_from_grid_file(gf);
     alloc_grid_data(grid);
 
-    /*READ DATA */
-    dimensionType i, j;
-    int first_flag = 1;
-    float value = 0;
-
-    for (i = 0; i < grid->hd->nrows; i++) {
-	for (j = 0; j < grid->hd->ncols; j++) {
-	    fscanf(fp, "%f", &value);
-	    grid->grid_data[i][j] = value;
-
-	    if (first_flag) {
-		if (is_nodata_grid(grid, value))
-		    continue;
-		grid->minvalue = grid->maxvalue = value;
-		first_flag = 0;
-	    }
-	    else {
-		  if (is_nodata_grid(grid, value))
-		    continue;
-		  if (value > grid->maxvalue)
-		    grid->maxvalue = value;
-		  if (value < grid->minvalue)
-		    grid->minvalue = value;
-	    }
+    /*READ DATA, in parallel into the one block */
+    result = gio_read(gf, GIO_FLOAT, grid->grid_data[0], 0);
+    assert(result == 0);
+    gio_close(gf);
+
+    first_flag = 1;
+    n = (size_t)grid->hd->nrows * grid->hd->ncols;
+    for (i = 0; i < n; i++) {
+	value = grid->grid_data[0][i];
+	if (is_nodata_grid(grid, value))
+	    continue;
+	if (first_flag) {
+	    grid->minvalue = grid->maxvalue = value;
+	    first_flag = 0;
+	}
+	else {
+	    if (value > grid->maxvalue)
+		grid->maxvalue = value;
+	    if (value < grid->minvalue)
+		grid->minvalue = value;
 	}
-	fscanf(fp, "\n");
     }
-	
-    fclose(fp);
-	
+
 #ifdef DEBUG_ON
     printf("**DEBUG: readGridFromArcasciiFile():\n");
     fflush(stdout);
@@ -231,6 +258,56 @@ Grid *read_grid_from_arcascii_file(char *filename)
 
 
 
+/* ------------------------------------------------------------ */
+/*opens a grid to read a block of rows at a time */
+GridRows *open_grid_rows(char *filename)
+{
+    GridRows *gr;
+
+    assert(filename);
+    gr = (GridRows *) malloc(sizeof(GridRows));
+    assert(gr);
+    gr->gs = gio_stream_open(filename, GIO_FLOAT, 0);
+    if (!gr->gs) {
+	printf("could not open file %s\n", filename);
+	exit(1);
+    }
+    gr->hd = header_from_grid_file(gr->gs->gf);
+    gr->row = 0;
+    return gr;
+}
+
+
+/* ------------------------------------------------------------ */
+/*reads the next block of rows */
+dimensionType read_grid_rows(GridRows *gr, float **rows)
+{
+    const void *block;
+    int64_t n;
+
+    assert(gr && rows);
+    gr->row = (dimensionType) gr->gs->row;
+    n = gio_stream_next(gr->gs, &block);
+    if (n < 0) {
+	printf("could not read row %d\n", gr->row);
+	exit(1);
+    }
+    *rows = (float *) block;
+    return (dimensionType) n;
+}
+
+
+/* ------------------------------------------------------------ */
+/*closes the grid */
+void close_grid_rows(GridRows *gr)
+{
+    assert(gr);
+    gio_stream_close(gr->gs);
+    free(gr->hd);
+    free(gr);
+}
+
+
 /* ------------------------------------------------------------ */
 /*destroy the structure and reclaim all memory allocated */
 void destroy_grid(Grid * grid)
@@ -239,13 +316,9 @@ void destroy_grid(Grid * grid)
 
     /*free grid data if its allocated */
     if (grid->grid_data) {
-	dimensionType i;
-
-	for (i = 0; i < grid->hd->nrows; i++) {
-	    if (!grid->grid_data[i])
-		free((float *)grid->grid_data[i]);
-	}
-
+	/*the rows share one block, see alloc_grid_data() */
+	if (grid->hd->nrows > 0)
+	    free(grid->grid_data[0]);
 	free((float **)grid->grid_data);
     }
 
@@ -294,18 +367,26 @@ save_grid_to_arcascii_file(Grid * grid, char *filename,
   /*print header */
   fprint_grid_header(fp, grid->hd);
   
-  /*print data */
-  dimensionType i, j;
+  /*print data: call fun() on a batch of rows at a time, then write the
+	batch out as "%.1f " */
+  dimensionType i, j, k;
+  unsigned long batch = SAVE_BATCH / grid->hd->ncols;
+  if (batch < 1) batch = 1;
+  if (batch > grid->hd->nrows) batch = grid->hd->nrows;
+  float *buf = (float*) malloc(batch * grid->hd->ncols * sizeof(float));
+  assert(buf);
   
-  for (i = 0; i < grid->hd->nrows; i++) {
-	for (j = 0; j < grid->hd->ncols; j++) {
-	  
-	  /*  call fun() on this element and write it to file  */
-	  fprintf(fp, "%.1f ",  fun(grid->grid_data[i][j]) ); 
-	  
+  for (i = 0; i < grid->hd->nrows; i += k) {
+	for (k = 0; k < batch && i + k < grid->hd->nrows; k++) {
+	  for (j = 0; j < grid->hd->ncols; j++) {
+		buf[k * grid->hd->ncols + j] = fun(grid->grid_data[i + k][j]);
+	  }
 	}
-	fprintf(fp, "\n");
+	int ret = gio_write_rows(fp, GIO_FLOAT, buf, k, grid->hd->ncols, 1, 0);
+	assert(ret == 0);
   }
+  free(buf);
+  fclose(fp);
   
 #ifdef _DEBUG_ON
   printf("**DEBUG: saveGridToArcasciiFile: saved to %s\n", filename);
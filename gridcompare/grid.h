@@ -34,6 +34,13 @@ typedef struct grid_ {
 } Grid;
 
 
+/* a grid read a block of rows at a time, so only the block is in memory */
+typedef struct grid_rows_ {
+    GridHeader *hd;
+    struct gridio_stream_t *gs;
+    dimensionType row;    /*first row of the current block */
+} GridRows;
+
 
 
 /* create and return the header of the grid stored in this file;*/
@@ -59,9 +66,22 @@ Grid *create_empty_grid();
 /*allocate memory for grid data, grid must have a header */
 void alloc_grid_data(Grid * grid);
 
-/*scan an arcascii file and fill the information in the given structure */
+/*scan an arcascii file (or a binary or tiled grid, see gridio.h) and fill the
+  information in the given structure */
 Grid *read_grid_from_arcascii_file(char *filename);
 
+/*open a grid (any format read_grid_from_arcascii_file() takes) to read a
+  block of rows at a time */
+GridRows *open_grid_rows(char *filename);
+
+/*point rows at the next block of rows, row-major, and return how many
+  rows it holds; 0 once all the rows are read.  The block is good until
+  the next call */
+dimensionType read_grid_rows(GridRows *gr, float **rows);
+
+/*close the grid and reclaim all memory allocated */
+void close_grid_rows(GridRows *gr);
+
 /*destroy the structure and reclaim all memory allocated */
 void destroy_grid(Grid * grid);
 
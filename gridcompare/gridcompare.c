@@ -11,13 +11,20 @@
 //write out the differences; can be set by the user
 int writeoutput = 0; 
 
+/* running totals of the differences, see compute_differences() */
+typedef struct diff_totals_ {
+  long n, nonzero; 
+  double max, sum, sumsq, sumper, maxper; 
+} DiffTotals; 
+
 /* forward declarations */
 void parse_args(int argc, char *argv[], char** gname1, char** gname2);
 void print_usage(); 
 int compatible_header(GridHeader *hd1,  GridHeader *hd2); 
-double* compute_differences(Grid *g1, Grid *g2);
-double* compute_percentage_differences(Grid *g1, Grid *g2);
-void compute_distance(double* delta, double* pdelta, int n); 
+void compute_differences(float *r1, float *r2, GridHeader *hd1, GridHeader *hd2,
+			 int row, int nrows, DiffTotals *tot);
+double percentage_difference(float v1, float v2, int i, int j); 
+void compute_distance(DiffTotals *tot); 
 
 
 
@@ -28,9 +35,11 @@ int main(int argc, char *argv[]) {
   char *gname1, *gname2; 
   parse_args(argc, argv, &gname1, &gname2); 
   
-  Grid *g1, *g2;  
-  g1 = read_grid_from_arcascii_file(gname1); 
-  g2 = read_grid_from_arcascii_file(gname2); 
+  /* the grids are read a block of rows at a time, side by side, so
+     only a block of each is ever in memory */
+  GridRows *g1, *g2;  
+  g1 = open_grid_rows(gname1); 
+  g2 = open_grid_rows(gname2); 
   assert(g1 && g2); 
 
   printf("grid1: (rows=%d, cols=%d)\n", g1->hd->nrows, g1->hd->ncols);fflush(stdout);
@@ -43,106 +52,97 @@ int main(int argc, char *argv[]) {
     printf("headers compatible.\n"); 
   }
 
-  double* delta = compute_differences(g1, g2); 
-  double* pdelta = compute_percentage_differences(g1, g2); 
-  compute_distance(delta, pdelta, g1->hd->nrows * g1->hd->ncols); 
+  DiffTotals tot; 
+  memset(&tot, 0, sizeof(tot)); 
+  float *r1, *r2; 
+  dimensionType n1, n2, k1 = 0, k2 = 0, row = 0, k; 
+  n1 = n2 = 0; 
+  /* the blocks of the two grids need not line up (a tiled grid reads
+     whole tile rows), so step through the shorter of the two */
+  while (row < g1->hd->nrows) {
+    if (k1 == n1) { n1 = read_grid_rows(g1, &r1); k1 = 0; }
+    if (k2 == n2) { n2 = read_grid_rows(g2, &r2); k2 = 0; }
+    assert(n1 > 0 && n2 > 0); 
+    k = n1 - k1 < n2 - k2 ? n1 - k1 : n2 - k2; 
+    compute_differences(r1 + (size_t)k1 * g1->hd->ncols,
+			r2 + (size_t)k2 * g2->hd->ncols,
+			g1->hd, g2->hd, row, k, &tot); 
+    k1 += k; 
+    k2 += k; 
+    row += k; 
+  }
+  compute_distance(&tot); 
 
-  destroy_grid(g1);
-  destroy_grid(g2);
+  close_grid_rows(g1);
+  close_grid_rows(g2);
   return 0;
 }
 
 
 /* ------------------------------------------------------------ */
-//delta represents a difference vector of size n.  pdelta represents
-//percentage differences. compute the norm of these vectors.
-void compute_distance(double* delta, double* pdelta, int n) {
-
-  assert(delta); 
-  int i, nonzero=0; 
-  double max = 0, sum=0, sumsq=0, sumper=0, maxper=0; 
-  for (i=0; i<n; i++) {
-    
-    if(delta[i] != 0) nonzero++; 
-    if (fabs(delta[i]) > max) max = fabs(delta[i]); 
-    if (pdelta[i] >maxper) maxper = pdelta[i];
-    sum += fabs(delta[i]); 
-    sumsq += delta[i]*delta[i];
-    sumper += pdelta[i]; 
-  }
+//print the norms of the difference vector and of the percentage
+//differences, from their running totals
+void compute_distance(DiffTotals *tot) {
+
+  assert(tot); 
+  long n = tot->n, nonzero = tot->nonzero; 
   
-  printf("total points: %d\n", n); 
-  printf("\tmatching: %d, nonmatching: %d\n", n-nonzero, nonzero);
-  printf("\tmax       difference: %.2f\n", max); 
-  printf("\tavg       difference: %.2f\n", ((float)sum)/n); 
-  printf("\tsum       difference: %.2f\n", sum);
-  printf("\teuclidian difference: %.2f\n", sqrt(sumsq));
-  printf("\taverage percentatge difference: %.2f\n", sumper/n);
-  printf("\tmax percentatge difference: %.2f\n", maxper);
+  printf("total points: %ld\n", n); 
+  printf("\tmatching: %ld, nonmatching: %ld\n", n-nonzero, nonzero);
+  printf("\tmax       difference: %.2f\n", tot->max); 
+  printf("\tavg       difference: %.2f\n", ((float)tot->sum)/n); 
+  printf("\tsum       difference: %.2f\n", tot->sum);
+  printf("\teuclidian difference: %.2f\n", sqrt(tot->sumsq));
+  printf("\taverage percentatge difference: %.2f\n", tot->sumper/n);
+  printf("\tmax percentatge difference: %.2f\n", tot->maxper);
 }
 
 /* ------------------------------------------------------------ */
-double* compute_differences(Grid *g1, Grid *g2) {
-
-  assert(g1 && g2); 
-  int i, j, nrows, ncols;
-  double* delta;    //the difference array 
+//add the differences of nrows rows of the two grids, starting at
+//row, to the running totals
+void compute_differences(float *r1, float *r2, GridHeader *hd1, GridHeader *hd2,
+			 int row, int nrows, DiffTotals *tot) {
+
+  assert(r1 && r2 && tot); 
+  int i, j, ncols;
+  double delta, pdelta; 
   
-  nrows =  g1->hd->nrows;
-  ncols =  g1->hd->ncols;
-  delta = (double*) malloc(nrows*ncols*sizeof(double));
-  assert(delta); 
+  ncols =  hd1->ncols;
   for (i=0; i<nrows; i++) {
-    for (j=0; j<ncols; j++) {
-      if (is_nodata(g1->hd, g1->grid_data[i][j]) || is_nodata(g2->hd, g2->grid_data[i][j]))
+    for (j=0; j<ncols; j++, r1++, r2++) {
+      tot->n++; 
+      if (is_nodata(hd1, *r1) || is_nodata(hd2, *r2))
 	{
 	  //this is a nodata point; skip 
-	  delta[i*ncols+j] = 0; 
 	  continue;
 	} 
-      delta[i*ncols+j] =  g1->grid_data[i][j] - g2->grid_data[i][j]; 
-      if (writeoutput &&   (delta[i*ncols+j] != 0)) 
+      delta =  *r1 - *r2; 
+      if (writeoutput &&   (delta != 0)) 
 	printf("(%3d,%3d): %5.1f [1] %5.1f [2]\tdelta: %5.1f\n",  
-	       i, j, g1->grid_data[i][j], g2->grid_data[i][j], delta[i*ncols+j]);
-     }
+	       row+i, j, *r1, *r2, delta);
+      pdelta = percentage_difference(*r1, *r2, row+i, j); 
+
+      if(delta != 0) tot->nonzero++; 
+      if (fabs(delta) > tot->max) tot->max = fabs(delta); 
+      if (pdelta > tot->maxper) tot->maxper = pdelta;
+      tot->sum += fabs(delta); 
+      tot->sumsq += delta*delta;
+      tot->sumper += pdelta; 
+    }
   }
-  return delta; 
 }
 
 
 /* ------------------------------------------------------------ */
-double* compute_percentage_differences(Grid *g1, Grid *g2) {
-
-  assert(g1 && g2); 
-  int i, j, nrows, ncols;
-  double* delta;    //the difference array 
-  
-  nrows =  g1->hd->nrows;
-  ncols =  g1->hd->ncols;
-  delta = (double*) malloc(nrows*ncols*sizeof(double));
-  assert(delta); 
-  for (i=0; i<nrows; i++) {
-    for (j=0; j<ncols; j++) {
-
-      if (is_nodata(g1->hd, g1->grid_data[i][j]) || is_nodata(g2->hd, g2->grid_data[i][j]))
-	{
-	  //this is a nodata point; skip 
-	  delta[i*ncols+j] = 0; 
-	}
-      else {
-	if (g1->grid_data[i][j] == 0 && g2->grid_data[i][j]==0)
-	  delta[i*ncols+j] = 0; 
-	else if (g1->grid_data[i][j] == 0) {
-	  printf("warning: point (%d,%d): 0 [1] %.2f [2]\n",i,j,g2->grid_data[i][j]); 
-	  delta[i*ncols+j]  = 100; //100% errorq
-	} else {
-	  delta[i*ncols+j] =  fabs(g1->grid_data[i][j] - g2->grid_data[i][j])/fabs(g1->grid_data[i][j]);
-	}
-      }
-    } //for j
-  } //for i
+double percentage_difference(float v1, float v2, int i, int j) {
 
-  return delta; 
+  if (v1 == 0 && v2==0)
+    return 0; 
+  if (v1 == 0) {
+    printf("warning: point (%d,%d): 0 [1] %.2f [2]\n",i,j,v2); 
+    return 100; //100% errorq
+  }
+  return fabs(v1 - v2)/fabs(v1);
 }
 
 
@@ -175,6 +175,7 @@ void print_usage() {
   printf("\tgrid1 is the reference grid\n"); 
   printf("\tgrid2 is the grid to compare\n"); 
   printf("\t-o prints to stdout the differences\n"); 
+  printf("\tgrids can be arcascii, binary (.bgr) or tiled (.tgr)\n"); 
 }
 
 